@@ -1,14 +1,36 @@
 #version 450
+#extension GL_GOOGLE_include_directive : require
+#ifdef BINDLESS
+#extension GL_EXT_nonuniform_qualifier : require
+#endif
 
 layout (location = 0) in vec3 fragColor;
+layout (location = 1) in vec3 fragPosWorld;
+layout (location = 2) in vec3 fragNormalWorld;
+layout (location = 3) in vec2 fragUv;
 
 layout (location = 0) out vec4 outColor;
 
-layout(push_constant) uniform Push {
-	mat4 modelMatrix;
-	mat4 normalMatrix;
-} push;
+#include "GlobalUbo.glsl"
+#include "ClusteredLights.glsl"
+#ifdef BINDLESS
+#include "Bindless.glsl"
+#endif
+
+layout(constant_id = 0) const float AMBIENT = 0.02;
+layout(constant_id = 1) const bool POINT_LIGHTS = true;
 
 void main(){
-	outColor = vec4(fragColor, 1.0);
-}
\ No newline at end of file
+	vec3 normalWorld = normalize(fragNormalWorld);
+
+	vec3 lighting = vec3(AMBIENT + max(dot(normalWorld, ubo.directionToLight), 0));
+	if (POINT_LIGHTS) {
+		lighting += clusteredPointLighting(fragPosWorld, normalWorld);
+	}
+
+	vec3 albedo = fragColor;
+#ifdef BINDLESS
+	albedo *= texture(textures[push.textureIndex], fragUv).rgb;
+#endif
+	outColor = vec4(lighting * albedo, 1.0);
+}
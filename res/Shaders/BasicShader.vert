@@ -1,4 +1,8 @@
 #version 450
+#extension GL_GOOGLE_include_directive : require
+#ifdef BINDLESS
+#extension GL_EXT_nonuniform_qualifier : require
+#endif
 
 layout(location = 0) in vec3 position;
 layout(location = 1) in vec3 color;
@@ -6,25 +10,38 @@ layout(location = 2) in vec3 normal;
 layout(location = 3) in vec2 uv;
 
 layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec3 fragPosWorld;
+layout(location = 2) out vec3 fragNormalWorld;
+layout(location = 3) out vec2 fragUv;
 
-layout(set = 0, binding = 0) uniform GlobalUbo{
-	mat4 projectionViewMatrix;
-	vec3 directionToLight;
-} ubo;
+#include "GlobalUbo.glsl"
 
+#ifdef BINDLESS
+#include "Bindless.glsl"
+#else
 layout(push_constant) uniform Push {
 	mat4 modelMatrix;
 	mat4 normalMatrix;
 } push;
+#endif
 
-const float AMBIENT = 0.02;
+// Keeps depth identical to DepthPrepass.vert
+invariant gl_Position;
 
 void main(){
-	gl_Position = ubo.projectionViewMatrix * push.modelMatrix * vec4(position, 1.0f);
-
-	vec3 normalWorldSpace = normalize(mat3(push.normalMatrix) * normal);
-
-	float lightIntensity = AMBIENT + max(dot(normalWorldSpace, ubo.directionToLight), 0);
-	
-	fragColor = lightIntensity * color;
-}
\ No newline at end of file
+#ifdef BINDLESS
+	ObjectData object = currentObject();
+	mat4 modelMatrix = object.modelMatrix;
+	mat4 normalMatrix = object.normalMatrix;
+#else
+	mat4 modelMatrix = push.modelMatrix;
+	mat4 normalMatrix = push.normalMatrix;
+#endif
+	vec4 positionWorld = modelMatrix * vec4(position, 1.0f);
+	gl_Position = ubo.projectionViewMatrix * positionWorld;
+
+	fragColor = color;
+	fragPosWorld = positionWorld.xyz;
+	fragNormalWorld = normalize(mat3(normalMatrix) * normal);
+	fragUv = uv;
+}
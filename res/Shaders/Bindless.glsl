@@ -0,0 +1,24 @@
+// Set 1 of the bindless mode, see NNBindlessTable. Draws pick their resources through the push
+// constants instead of binding descriptor sets. Includers enable GL_EXT_nonuniform_qualifier.
+
+// Keep in sync with NNInstanceTransform in TransformBatch.h
+struct ObjectData {
+	mat4 modelMatrix;
+	mat4 normalMatrix;
+};
+
+layout(set = 1, binding = 0) uniform sampler2D textures[];
+layout(set = 1, binding = 1, std430) readonly buffer ObjectBuffer {
+	ObjectData objects[];
+} objectBuffers[];
+
+// Keep in sync with BindlessPushConstants in SimpleRenderSystem.cpp
+layout(push_constant) uniform Push {
+	uint objectBuffer;
+	uint objectIndex;
+	uint textureIndex;
+} push;
+
+ObjectData currentObject() {
+	return objectBuffers[push.objectBuffer].objects[push.objectIndex];
+}
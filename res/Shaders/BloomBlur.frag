@@ -0,0 +1,22 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+layout(set = 0, binding = 0) uniform sampler2D source;
+
+layout (location = 0) out vec4 outColor;
+
+#include "PostProcess.glsl"
+
+// params.xy: blur direction in texels of the target
+void main(){
+	const float weights[5] = float[](0.227027, 0.1945946, 0.1216216, 0.054054, 0.016216);
+
+	vec2 uv = targetUv();
+	vec2 stepUv = push.params.xy * push.target.zw;
+	vec3 color = texture(source, uv).rgb * weights[0];
+	for (int i = 1; i < 5; i++) {
+		color += texture(source, uv + stepUv * float(i)).rgb * weights[i];
+		color += texture(source, uv - stepUv * float(i)).rgb * weights[i];
+	}
+	outColor = vec4(color, 1.0);
+}
@@ -0,0 +1,14 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+layout(set = 0, binding = 0) uniform sampler2D sceneColor;
+
+layout (location = 0) out vec4 outColor;
+
+#include "PostProcess.glsl"
+
+// params.x: brightness threshold
+void main(){
+	vec3 color = texture(sceneColor, targetUv()).rgb;
+	outColor = vec4(max(color - vec3(push.params.x), vec3(0.0)), 1.0);
+}
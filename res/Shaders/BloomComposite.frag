@@ -0,0 +1,16 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+layout(set = 0, binding = 0) uniform sampler2D sceneColor;
+layout(set = 0, binding = 1) uniform sampler2D bloom;
+
+layout (location = 0) out vec4 outColor;
+
+#include "PostProcess.glsl"
+
+// params.x: bloom intensity
+void main(){
+	vec2 uv = targetUv();
+	vec3 color = texture(sceneColor, uv).rgb + texture(bloom, uv).rgb * push.params.x;
+	outColor = vec4(color, 1.0);
+}
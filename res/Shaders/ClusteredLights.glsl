@@ -0,0 +1,52 @@
+// Clustered point lights, filled by NNLightClusters. Requires GlobalUbo.glsl.
+struct PointLight {
+	vec4 positionRadius;
+	vec4 color;
+};
+
+layout(std430, set = 0, binding = 1) readonly buffer PointLights {
+	PointLight lights[];
+} pointLights;
+
+// offset and count into clusterLightIndices for every cluster
+layout(std430, set = 0, binding = 2) readonly buffer ClusterGrid {
+	uvec2 clusters[];
+} clusterGrid;
+
+layout(std430, set = 0, binding = 3) readonly buffer ClusterLightIndices {
+	uint indices[];
+} clusterLightIndices;
+
+// Slice and tile come from the clustering camera, not from the fragment's screen position
+uint clusterIndex(vec3 positionWorld) {
+	vec4 positionView = ubo.clusterViewMatrix * vec4(positionWorld, 1.0);
+	vec4 positionClip = ubo.clusterProjectionMatrix * positionView;
+	uint slice = uint(max(log(positionView.z) * ubo.clusterDepth.z + ubo.clusterDepth.w, 0.0));
+	vec2 tileCoord = (positionClip.xy / positionClip.w * 0.5 + 0.5) * vec2(ubo.clusterGrid.xy);
+	uvec2 tile = uvec2(clamp(tileCoord, vec2(0.0), vec2(ubo.clusterGrid.xy - 1)));
+
+	// Behind the clustering camera the divide can give NaN, the min keeps the index in range anyway
+	slice = min(slice, ubo.clusterGrid.z - 1);
+	tile = min(tile, ubo.clusterGrid.xy - 1);
+	return tile.x + ubo.clusterGrid.x * (tile.y + ubo.clusterGrid.y * slice);
+}
+
+vec3 clusteredPointLighting(vec3 positionWorld, vec3 normalWorld) {
+	uvec2 cluster = clusterGrid.clusters[clusterIndex(positionWorld)];
+
+	vec3 diffuse = vec3(0.0);
+	for (uint i = 0; i < cluster.y; i++) {
+		PointLight light = pointLights.lights[clusterLightIndices.indices[cluster.x + i]];
+		vec3 toLight = light.positionRadius.xyz - positionWorld;
+		float distanceSquared = dot(toLight, toLight);
+
+		// Inverse square falloff windowed to reach zero at the light radius
+		float normalizedDistance = distanceSquared / (light.positionRadius.w * light.positionRadius.w);
+		float window = clamp(1.0 - normalizedDistance * normalizedDistance, 0.0, 1.0);
+		float attenuation = window * window / (distanceSquared + 1.0);
+
+		float cosAngle = max(dot(normalWorld, toLight * inversesqrt(max(distanceSquared, 1e-6))), 0.0);
+		diffuse += light.color.rgb * light.color.w * attenuation * cosAngle;
+	}
+	return diffuse;
+}
@@ -0,0 +1,34 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+// Indices match the input attachment order of the lighting subpass in NNSwapChain
+layout(input_attachment_index = 0, set = 1, binding = 0) uniform subpassInput gBufferAlbedo;
+layout(input_attachment_index = 1, set = 1, binding = 1) uniform subpassInput gBufferNormal;
+layout(input_attachment_index = 2, set = 1, binding = 2) uniform subpassInput gBufferDepth;
+
+layout (location = 0) out vec4 outColor;
+
+#include "GlobalUbo.glsl"
+#include "ClusteredLights.glsl"
+
+layout(constant_id = 0) const float AMBIENT = 0.02;
+
+void main(){
+	float depth = subpassLoad(gBufferDepth).r;
+	if (depth >= 1.0) {
+		// Nothing was drawn here, keep the clear colour
+		discard;
+	}
+
+	vec2 ndc = gl_FragCoord.xy * ubo.viewport.zw * 2.0 - 1.0;
+	vec4 positionWorld = ubo.inverseProjectionViewMatrix * vec4(ndc, depth, 1.0);
+	positionWorld /= positionWorld.w;
+
+	vec3 albedo = subpassLoad(gBufferAlbedo).rgb;
+	vec3 normalWorld = normalize(subpassLoad(gBufferNormal).xyz * 2.0 - 1.0);
+
+	vec3 lighting = vec3(AMBIENT + max(dot(normalWorld, ubo.directionToLight), 0));
+	lighting += clusteredPointLighting(positionWorld.xyz, normalWorld);
+
+	outColor = vec4(lighting * albedo, 1.0);
+}
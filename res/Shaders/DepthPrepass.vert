@@ -0,0 +1,30 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+#ifdef BINDLESS
+#extension GL_EXT_nonuniform_qualifier : require
+#endif
+
+layout(location = 0) in vec3 position;
+
+#include "GlobalUbo.glsl"
+
+#ifdef BINDLESS
+#include "Bindless.glsl"
+#else
+layout(push_constant) uniform Push {
+	mat4 modelMatrix;
+	mat4 normalMatrix;
+} push;
+#endif
+
+// Has to match BasicShader.vert bit for bit, the shading pass tests depth with EQUAL
+invariant gl_Position;
+
+void main(){
+#ifdef BINDLESS
+	mat4 modelMatrix = currentObject().modelMatrix;
+#else
+	mat4 modelMatrix = push.modelMatrix;
+#endif
+	gl_Position = ubo.projectionViewMatrix * (modelMatrix * vec4(position, 1.0f));
+}
@@ -0,0 +1,12 @@
+// Shared by every shader that binds the global set, keep in sync with GlobalUbo in Application.cpp
+layout(set = 0, binding = 0) uniform GlobalUbo{
+	mat4 projectionViewMatrix;
+	vec3 directionToLight;
+	mat4 viewMatrix;
+	uvec4 clusterGrid;       // xyz cluster counts, w light count
+	vec4 clusterDepth;       // near, far, log scale, log bias
+	mat4 clusterViewMatrix;       // camera the lights were clustered with, the draw
+	mat4 clusterProjectionMatrix; // camera can be late latched past it
+	mat4 inverseProjectionViewMatrix;
+	vec4 viewport;           // width, height, 1 / width, 1 / height
+} ubo;
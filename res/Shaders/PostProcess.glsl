@@ -0,0 +1,9 @@
+// Push constants of NNFullscreenPass
+layout(push_constant) uniform Push {
+	vec4 params;
+	vec4 target; // width, height, 1 / width, 1 / height
+} push;
+
+vec2 targetUv() {
+	return gl_FragCoord.xy * push.target.zw;
+}
@@ -1,7 +1,16 @@
 #include "Application.h"
 
+#include "BenchmarkReport.h"
 #include "Buffer.h"
 #include "Camera.h"
+#include "CameraPath.h"
+#include "CpuProfiler.h"
+#include "DeferredRenderSystem.h"
+#include "FrameGraph.h"
+#include "FullscreenPass.h"
+#include "HostMemory.h"
+#include "RenderStats.h"
+#include "ShaderReflection.h"
 #include "SimpleRenderSystem.h"
 #include "KeyboardMovementController.h"
 
@@ -10,9 +19,12 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/constants.hpp>
 
+#include <algorithm>
 #include <array>
 #include <cassert>
 #include <chrono>
+#include <iostream>
+#include <random>
 #include <stdexcept>
 
 namespace NNuts {
@@ -21,21 +33,69 @@ namespace NNuts {
 	{
 		alignas(16) glm::mat4 projectionView{ 1.0f };
 		alignas(16) glm::vec3 lightDirection = glm::normalize(glm::vec3{ 1.0f, -3.0f, -1.0f });
+		alignas(16) glm::mat4 view{ 1.0f };
+		ClusterUniforms clusters{};
+		alignas(16) glm::mat4 inverseProjectionView{ 1.0f };
+		glm::vec4 viewport{};
 	};
 
-	NNApplication::NNApplication()
+	NNApplication::NNApplication() : NNApplication(Settings{})
 	{
-		m_GlobalPool =
-			NNDescriptorPool::Builder(m_Device)
-			.setMaxSets(NNSwapChain::MAX_FRAMES_IN_FLIGHT)
-			.addPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, NNSwapChain::MAX_FRAMES_IN_FLIGHT)
-			.build();
+	}
+
+	NNApplication::NNApplication(const Settings& settings) : m_Settings{ settings }
+	{
+		m_Renderer.setFrameRateCap(m_Settings.frameRateCap);
+		m_Renderer.setLatencyLimit(m_Settings.latencyLimit);
+		NNRenderStats::setWindowSize(m_Settings.statsWindow);
+		if (!m_Settings.statsSharedMemory.empty() && !NNRenderStats::openSharedMemory(m_Settings.statsSharedMemory)) {
+			std::cerr << "Failed to open shared memory " << m_Settings.statsSharedMemory << ", statistics stay local" << std::endl;
+		}
 
-		loadGameObjects();
+		std::vector<ShaderCompileRequest> shaders{
+			{ "res/Shaders/BasicShader.vert" },
+			{ "res/Shaders/BasicShader.frag" },
+			{ "res/Shaders/DepthPrepass.vert" },
+			{ "res/Shaders/GBuffer.frag" },
+			{ "res/Shaders/Fullscreen.vert" },
+			{ "res/Shaders/DeferredLighting.frag" },
+			{ "res/Shaders/BloomBright.frag" },
+			{ "res/Shaders/BloomBlur.frag" },
+			{ "res/Shaders/BloomComposite.frag" },
+		};
+		if (m_Settings.measureShaderCache) {
+			NNShaderCompiler::measureCache(shaders, NNShaderCompiler::Options{});
+		}
+		m_ShaderCompiler.prepare(shaders);
+
+		if (m_Settings.bindless) {
+			if (m_Device.hasDescriptorIndexing()) {
+				m_BindlessTable = std::make_unique<NNBindlessTable>(m_Device, m_LayoutCache);
+				m_ShaderCompiler.prepare({
+					{ "res/Shaders/BasicShader.vert", { { "BINDLESS", "1" } } },
+					{ "res/Shaders/BasicShader.frag", { { "BINDLESS", "1" } } },
+					{ "res/Shaders/DepthPrepass.vert", { { "BINDLESS", "1" } } },
+				});
+			}
+			else {
+				std::cerr << "Descriptor indexing isn't supported, bindless mode is off" << std::endl;
+			}
+		}
+
+		if (m_Settings.scene == Scene::LightStress) {
+			loadStressScene();
+		}
+		else if (m_Settings.scene == Scene::Procedural) {
+			loadProceduralScene();
+		}
+		else {
+			loadGameObjects();
+		}
 	}
 
 	NNApplication::~NNApplication()
 	{
+		NNRenderStats::closeSharedMemory();
 	}
 
 	void NNApplication::run()
@@ -51,60 +111,566 @@ namespace NNuts {
 			uboBuffers[i]->map();
 		}
 
-		auto globalSetLayout = NNDescriptorSetLayout::Builder(m_Device)
-			.addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT)
-			.build();
-
-		std::vector<VkDescriptorSet> globalDescriptorSets(NNSwapChain::MAX_FRAMES_IN_FLIGHT);
-		for (int i = 0; i < globalDescriptorSets.size(); i++) {
-			auto bufferInfo = uboBuffers[i]->descriptorInfo();
-			NNDescriptorWriter(*globalSetLayout, *m_GlobalPool)
-				.writeBuffer(0, &bufferInfo)
-				.build(globalDescriptorSets[i]);
+		NNShaderReflection globalReflection{};
+		globalReflection
+			.addStage(VK_SHADER_STAGE_VERTEX_BIT, m_ShaderCompiler.getSpirv("res/Shaders/BasicShader.vert"))
+			.addStage(VK_SHADER_STAGE_FRAGMENT_BIT, m_ShaderCompiler.getSpirv("res/Shaders/BasicShader.frag"));
+		auto globalSetLayout = m_LayoutCache.getDescriptorSetLayout(globalReflection.getSetBindings(0));
+
+		// Forward scene into an HDR target, then bright pass, separable blur at half resolution and
+		// composite into the swap chain image. The render systems are built against the graph's passes.
+		bool deferred = m_Settings.renderPath == RenderPath::Deferred;
+		bool useFrameGraph = m_Settings.frameGraph && !deferred;
+		NNFrameGraph frameGraph{ m_Device };
+		std::unique_ptr<NNFullscreenPass> brightPass, blurPassH, blurPassV, compositePass;
+		FrameGraphResource backBuffer{}, sceneColor{}, bright{}, blurred{}, bloom{};
+		FrameInfo* graphFrameInfo = nullptr;
+		uint32_t frameGraphGeneration = m_Renderer.getSwapChainGeneration();
+		uint32_t renderPassGeneration = m_Renderer.getRenderPassGeneration();
+
+		// Only the render system matching the render pass layout is created
+		std::unique_ptr<SimpleRenderSystem> simpleRenderSystem;
+		std::unique_ptr<DeferredRenderSystem> deferredRenderSystem;
+		if (useFrameGraph) {
+			constexpr VkFormat hdrFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
+			backBuffer = frameGraph.importImage(
+				"swap chain",
+				m_Renderer.getSwapChainImageFormat(),
+				VK_IMAGE_LAYOUT_UNDEFINED,
+				m_Renderer.getSwapChainFinalLayout());
+
+			frameGraph.addPass("scene",
+				[&](NNFrameGraph::PassBuilder& builder) {
+					VkClearColorValue clearColor{ { 0.01f, 0.01f, 0.01f, 1.0f } };
+					VkClearDepthStencilValue clearDepth{ 1.0f, 0 };
+					sceneColor = builder.writeColor(builder.createImage("scene color", { hdrFormat }), &clearColor);
+					builder.writeDepth(builder.createImage("depth", { m_Renderer.getSwapChainDepthFormat() }), &clearDepth);
+				},
+				[&](const NNFrameGraph::PassContext& context) {
+					if (simpleRenderSystem->isDepthPrepassEnabled()) {
+						NNGpuProfiler::ScopedPass prepassScope{ &m_GpuProfiler, context.commandBuffer, "depth prepass" };
+						simpleRenderSystem->renderDepthPrepass(*graphFrameInfo, m_World, m_Transforms);
+					}
+					NNGpuProfiler::ScopedPass mainScope{ &m_GpuProfiler, context.commandBuffer, "main" };
+					simpleRenderSystem->renderGameObjects(*graphFrameInfo, m_World, m_Transforms);
+				});
+			frameGraph.addPass("bloom bright",
+				[&](NNFrameGraph::PassBuilder& builder) {
+					builder.readTexture(sceneColor);
+					bright = builder.writeColor(builder.createImage("bright", { hdrFormat, 0.5f }));
+				},
+				[&](const NNFrameGraph::PassContext& context) {
+					brightPass->draw(context.commandBuffer, context.extent, { 1.0f, 0.0f, 0.0f, 0.0f });
+				});
+			frameGraph.addPass("bloom blur h",
+				[&](NNFrameGraph::PassBuilder& builder) {
+					builder.readTexture(bright);
+					blurred = builder.writeColor(builder.createImage("blurred", { hdrFormat, 0.5f }));
+				},
+				[&](const NNFrameGraph::PassContext& context) {
+					blurPassH->draw(context.commandBuffer, context.extent, { 1.0f, 0.0f, 0.0f, 0.0f });
+				});
+			frameGraph.addPass("bloom blur v",
+				[&](NNFrameGraph::PassBuilder& builder) {
+					builder.readTexture(blurred);
+					bloom = builder.writeColor(builder.createImage("bloom", { hdrFormat, 0.5f }));
+				},
+				[&](const NNFrameGraph::PassContext& context) {
+					blurPassV->draw(context.commandBuffer, context.extent, { 0.0f, 1.0f, 0.0f, 0.0f });
+				});
+			frameGraph.addPass("composite",
+				[&](NNFrameGraph::PassBuilder& builder) {
+					builder.readTexture(sceneColor);
+					builder.readTexture(bloom);
+					builder.writeColor(backBuffer);
+				},
+				[&](const NNFrameGraph::PassContext& context) {
+					compositePass->draw(context.commandBuffer, context.extent, { 0.6f, 0.0f, 0.0f, 0.0f });
+				});
+			frameGraph.markOutput(backBuffer);
+			frameGraph.compile(m_Renderer.getSwapChainExtent());
+
+			simpleRenderSystem = std::make_unique<SimpleRenderSystem>(
+				m_Device,
+				m_ShaderCompiler,
+				m_LayoutCache,
+				frameGraph.getRenderPass("scene"),
+				globalSetLayout->getDescriptorSetLayout(),
+				m_BindlessTable.get());
+			brightPass = std::make_unique<NNFullscreenPass>(
+				m_Device, m_ShaderCompiler, m_LayoutCache, "res/Shaders/BloomBright.frag", frameGraph.getRenderPass("bloom bright"));
+			blurPassH = std::make_unique<NNFullscreenPass>(
+				m_Device, m_ShaderCompiler, m_LayoutCache, "res/Shaders/BloomBlur.frag", frameGraph.getRenderPass("bloom blur h"));
+			blurPassV = std::make_unique<NNFullscreenPass>(
+				m_Device, m_ShaderCompiler, m_LayoutCache, "res/Shaders/BloomBlur.frag", frameGraph.getRenderPass("bloom blur v"));
+			compositePass = std::make_unique<NNFullscreenPass>(
+				m_Device, m_ShaderCompiler, m_LayoutCache, "res/Shaders/BloomComposite.frag", frameGraph.getRenderPass("composite"));
+		}
+		else if (!deferred) {
+			simpleRenderSystem = std::make_unique<SimpleRenderSystem>(
+				m_Device,
+				m_ShaderCompiler,
+				m_LayoutCache,
+				m_Renderer.getSwapChainRenderPass(),
+				globalSetLayout->getDescriptorSetLayout(),
+				m_BindlessTable.get());
+		}
+		else {
+			deferredRenderSystem = std::make_unique<DeferredRenderSystem>(
+				m_Device,
+				m_ShaderCompiler,
+				m_LayoutCache,
+				m_Renderer.getSwapChainRenderPass(),
+				globalSetLayout->getDescriptorSetLayout());
+		}
+		if (simpleRenderSystem) {
+			// A scene without point lights (--lights 0) skips the cluster lookup in the shader
+			simpleRenderSystem->setPointLightsEnabled(!m_PointLights.empty());
 		}
 
-		SimpleRenderSystem simpleRenderSystem(m_Device, m_Renderer.getSwapChainRenderPass(), globalSetLayout->getDescriptorSetLayout());
+		// Transient views change with every compile
+		auto bindFrameGraphInputs = [&]() {
+			brightPass->setInputs({ frameGraph.getImageView(sceneColor) });
+			blurPassH->setInputs({ frameGraph.getImageView(bright) });
+			blurPassV->setInputs({ frameGraph.getImageView(blurred) });
+			compositePass->setInputs({ frameGraph.getImageView(sceneColor), frameGraph.getImageView(bloom) });
+
+			auto& stats = frameGraph.getStats();
+			std::cout << "Frame graph: " << stats.passCount << " passes (" << stats.culledPassCount << " culled), "
+				<< stats.barrierCount << " barriers, " << stats.transientImageCount << " transient images in "
+				<< stats.memoryBlockCount << " memory blocks, "
+				<< stats.transientBytes / (1024.0 * 1024.0) << " MiB without aliasing, "
+				<< stats.aliasedBytes / (1024.0 * 1024.0) << " MiB with aliasing" << std::endl;
+		};
+		if (useFrameGraph) {
+			bindFrameGraphInputs();
+		}
+		uint32_t gBufferGeneration = 0;
 		NNCamera camera{};
 		camera.setViewDirection(glm::vec3{ 0.0f }, glm::vec3{ 0.0f, 0.0f, 1.0f });
 
-		auto viewerObject = NNGameObject::createGameObject();
+		// The viewer isn't drawn, so it stays out of the world
+		TransformComponent viewerTransform{};
+		if (m_Settings.scene == Scene::LightStress) {
+			viewerTransform.translation = { 0.0f, -4.0f, -6.0f };
+			viewerTransform.rotation = { -0.35f, 0.0f, 0.0f };
+		}
 		KeyboardMovementController cameraController{};
 
+		// Benchmarks follow a path on simulated time, so every run sees the same views
+		const bool benchmark = m_Settings.benchmark.enabled;
+		const bool interactive = !benchmark && !m_Settings.headless;
+		NNCameraPath cameraPath{};
+		if (benchmark) {
+			if (!m_Settings.benchmark.cameraPathFile.empty()) {
+				cameraPath = NNCameraPath::loadFromFile(m_Settings.benchmark.cameraPathFile);
+			}
+			else {
+				cameraPath = NNCameraPath::orbit(m_SceneCenter, 0.5f * m_FarClip, -0.15f * m_FarClip, 20.0f);
+			}
+		}
+		NNCameraPath recordedPath{};
+		float simulatedTime = 0.0f;
+		float recordTimer = 0.0f;
+
 		auto currentTime = std::chrono::high_resolution_clock::now();
+		auto lastCameraSample = currentTime;
+		auto updateCamera = [&]() {
+			auto now = std::chrono::high_resolution_clock::now();
+			float cameraTime = std::chrono::duration<float, std::chrono::seconds::period>(now - lastCameraSample).count();
+			lastCameraSample = now;
+
+			if (benchmark) {
+				cameraPath.sample(simulatedTime, viewerTransform.translation, viewerTransform.rotation);
+			}
+			else if (interactive) {
+				cameraController.moveInPlaneXZ(m_Window.getGLFWwindow(), cameraTime, viewerTransform);
+			}
+			camera.setViewYXZ(viewerTransform.translation, viewerTransform.rotation);
 
-		while (!m_Window.shouldClose()) {
-			glfwPollEvents();
+			float aspect = m_Renderer.getAspectRatio();
+			//camera.setOrthographicProjection(-aspect, aspect, -1, 1, -1, 1);
+			camera.setPerespectiveProjection(glm::radians(50.0f), aspect, 0.1f, m_FarClip);
+		};
+
+		float gpuReportTimer = 0.0f;
+		double cpuWaitMilliseconds = 0.0;
+		uint32_t reportedFrames = 0;
+		double inputToSubmitMilliseconds = 0.0;
+		double inputToGpuDoneMilliseconds = 0.0;
+		uint32_t latencyFrames = 0;
+		uint64_t lastLatencyFrame = 0;
+		bool prepassKeyDown = false;
+		bool pointLightsKeyDown = false;
+		bool presentModeKeyDown = false;
+		bool lateLatchKeyDown = false;
+		bool traceKeyDown = false;
+
+		NNBenchmarkReport report{};
+		const bool fixedLength = benchmark || m_Settings.headless;
+		const uint64_t totalFrames = m_Settings.frameCount + (benchmark ? m_Settings.benchmark.warmupFrames : 0);
+		using PhaseClock = std::chrono::high_resolution_clock;
+		auto milliseconds = [](PhaseClock::time_point from, PhaseClock::time_point to) {
+			return std::chrono::duration<double, std::milli>(to - from).count();
+		};
+
+		// Measured frames that allocated on the main thread
+		size_t allocatingFrames = 0;
+
+		NNCpuProfiler::setThreadName("main");
+		bool traceRequested = m_Settings.traceFrames > 0;
+		if (traceRequested) {
+			m_GpuProfiler.calibrate();
+		}
+
+		while (!m_Window.shouldClose() && (!fixedLength || m_Renderer.getSubmittedFrameCount() < totalFrames)) {
+			// Benchmarks trace measured frames only
+			if (traceRequested && (!benchmark || m_Renderer.getSubmittedFrameCount() >= m_Settings.benchmark.warmupFrames)) {
+				traceRequested = false;
+				NNCpuProfiler::beginCapture(m_Settings.traceFrames, m_Settings.tracePath);
+			}
+			NNCpuProfiler::markFrame();
+			NN_PROFILE_SCOPE("frame");
+
+			// Frame rate cap and latency limiter sleep here, before input is sampled
+			m_Renderer.paceFrame();
+			if (!m_Settings.headless) {
+				NN_PROFILE_SCOPE("poll events");
+				glfwPollEvents();
+			}
+			if (interactive) {
+				// P toggles the depth prepass so both paths can be compared on the same scene
+				bool prepassKeyPressed = glfwGetKey(m_Window.getGLFWwindow(), GLFW_KEY_P) == GLFW_PRESS;
+				if (prepassKeyPressed && !prepassKeyDown && !deferred) {
+					simpleRenderSystem->setDepthPrepassEnabled(!simpleRenderSystem->isDepthPrepassEnabled());
+				}
+				prepassKeyDown = prepassKeyPressed;
+
+				// K switches between the pipeline variants with and without point lights
+				bool pointLightsKeyPressed = glfwGetKey(m_Window.getGLFWwindow(), GLFW_KEY_K) == GLFW_PRESS;
+				if (pointLightsKeyPressed && !pointLightsKeyDown && !deferred) {
+					simpleRenderSystem->setPointLightsEnabled(!simpleRenderSystem->isPointLightsEnabled());
+				}
+				pointLightsKeyDown = pointLightsKeyPressed;
+
+				// M cycles through the present modes
+				bool presentModeKeyPressed = glfwGetKey(m_Window.getGLFWwindow(), GLFW_KEY_M) == GLFW_PRESS;
+				if (presentModeKeyPressed && !presentModeKeyDown) {
+					static constexpr VkPresentModeKHR presentModes[] = {
+						VK_PRESENT_MODE_FIFO_KHR,
+						VK_PRESENT_MODE_FIFO_RELAXED_KHR,
+						VK_PRESENT_MODE_MAILBOX_KHR,
+						VK_PRESENT_MODE_IMMEDIATE_KHR,
+					};
+					size_t current = 0;
+					for (size_t i = 0; i < std::size(presentModes); i++) {
+						if (presentModes[i] == m_Renderer.getPresentMode()) {
+							current = i;
+						}
+					}
+					m_Renderer.setPresentMode(presentModes[(current + 1) % std::size(presentModes)]);
+				}
+				presentModeKeyDown = presentModeKeyPressed;
+
+				// L toggles the late latched camera
+				bool lateLatchKeyPressed = glfwGetKey(m_Window.getGLFWwindow(), GLFW_KEY_L) == GLFW_PRESS;
+				if (lateLatchKeyPressed && !lateLatchKeyDown) {
+					m_Settings.lateLatchCamera = !m_Settings.lateLatchCamera;
+				}
+				lateLatchKeyDown = lateLatchKeyPressed;
+
+				// C traces the next 60 frames
+				bool traceKeyPressed = glfwGetKey(m_Window.getGLFWwindow(), GLFW_KEY_C) == GLFW_PRESS;
+				if (traceKeyPressed && !traceKeyDown) {
+					m_GpuProfiler.calibrate();
+					NNCpuProfiler::beginCapture(60, m_Settings.tracePath);
+				}
+				traceKeyDown = traceKeyPressed;
+
+				// 1 - 4 pick the number of frames in flight
+				for (int key = GLFW_KEY_1; key <= GLFW_KEY_4; key++) {
+					if (glfwGetKey(m_Window.getGLFWwindow(), key) == GLFW_PRESS) {
+						m_Renderer.setFramesInFlight(static_cast<uint32_t>(key - GLFW_KEY_0));
+					}
+				}
+			}
 
 			auto newTime = std::chrono::high_resolution_clock::now();
 			float frameTime = std::chrono::duration<float, std::chrono::seconds::period>(newTime - currentTime).count();
 			currentTime = newTime;
+			// Headless runs and benchmarks animate at a fixed step, so the same frame count always ends on the same image
+			float animationTime = fixedLength ? 1.0f / 60.0f : frameTime;
+			simulatedTime += animationTime;
 
-			cameraController.moveInPlaneXZ(m_Window.getGLFWwindow(), frameTime, viewerObject);
-			camera.setViewYXZ(viewerObject.transform.translation, viewerObject.transform.rotation);
-
-			float aspect = m_Renderer.getAspectRatio();
-			//camera.setOrthographicProjection(-aspect, aspect, -1, 1, -1, 1);
-			camera.setPerespectiveProjection(glm::radians(50.0f), aspect, 0.1f, 10.f);
+			// Update through submit has to stay off the heap once the scene is warm
+			NNHostMemory::AllocationCounter frameAllocations{};
+			auto updateStart = PhaseClock::now();
+			{
+				NN_PROFILE_SCOPE("update");
+				updateCamera();
+				updateLights(animationTime);
+				NNRenderStats::add(NNRenderStats::Counter::TransformUpdates, m_Transforms.update());
+			}
+			if (!m_Settings.recordCameraPath.empty()) {
+				recordTimer += frameTime;
+				if (recordTimer >= 0.1f || recordedPath.empty()) {
+					recordTimer = 0.0f;
+					recordedPath.addKeyframe(simulatedTime, viewerTransform.translation, viewerTransform.rotation);
+				}
+			}
 
+			auto beginStart = PhaseClock::now();
 			if (auto commandBuffer = m_Renderer.beginFrame())
 			{
+				auto recordStart = PhaseClock::now();
 				int frameIndex = m_Renderer.getFrameIndex();
-				FrameInfo frameInfo{frameIndex, frameTime, commandBuffer, camera, globalDescriptorSets[frameIndex]};
+				// The global set comes from the frame's descriptor pools and is written in one templated update
+				VkDescriptorSet globalDescriptorSet;
+				{
+					auto bufferInfo = uboBuffers[frameIndex]->descriptorInfo();
+					auto lightsInfo = m_LightClusters.lightsInfo(frameIndex);
+					auto gridInfo = m_LightClusters.gridInfo(frameIndex);
+					auto indicesInfo = m_LightClusters.indicesInfo(frameIndex);
+					NNDescriptorWriter(*globalSetLayout, m_Renderer.getFrameDescriptorAllocator(), m_Renderer.getFrameAllocator())
+						.writeBuffer(0, &bufferInfo)
+						.writeBuffer(1, &lightsInfo)
+						.writeBuffer(2, &gridInfo)
+						.writeBuffer(3, &indicesInfo)
+						.build(globalDescriptorSet);
+				}
+				FrameInfo frameInfo{frameIndex, animationTime, commandBuffer, camera, globalDescriptorSet, m_Renderer.getFrameAllocator()};
 
 				GlobalUbo ubo{};
-				ubo.projectionView = camera.getProjection() * camera.getView();
+				auto writeCamera = [&]() {
+					ubo.projectionView = camera.getProjection() * camera.getView();
+					ubo.view = camera.getView();
+					ubo.inverseProjectionView = glm::inverse(ubo.projectionView);
+				};
+				writeCamera();
+				VkExtent2D extent = m_Renderer.getSwapChainExtent();
+				ubo.clusters = m_LightClusters.update(frameIndex, camera, m_PointLights);
+				ubo.viewport = {
+					static_cast<float>(extent.width),
+					static_cast<float>(extent.height),
+					1.0f / static_cast<float>(extent.width),
+					1.0f / static_cast<float>(extent.height) };
 				uboBuffers[frameIndex]->writeToBuffer(&ubo);
 				uboBuffers[frameIndex]->flush();
 
-				m_Renderer.beginSwapChainRenderPass(commandBuffer);
-				simpleRenderSystem.renderGameObjects(frameInfo, m_GameObjects);
-				m_Renderer.endSwapChainRenderPass(commandBuffer);
-				m_Renderer.endFrame();
+				m_GpuProfiler.beginFrame(commandBuffer, frameIndex, frameInfo.frameAllocator);
+				if (renderPassGeneration != m_Renderer.getRenderPassGeneration()) {
+					// The swap chain changed formats, e.g. after moving to another monitor
+					renderPassGeneration = m_Renderer.getRenderPassGeneration();
+					if (useFrameGraph) {
+						// Only the composite pass writes the swap chain image, the other passes keep their formats
+						frameGraphGeneration = m_Renderer.getSwapChainGeneration();
+						frameGraph.setImportedFormat(backBuffer, m_Renderer.getSwapChainImageFormat());
+						frameGraph.compile(extent);
+						bindFrameGraphInputs();
+						compositePass->setRenderPass(frameGraph.getRenderPass("composite"));
+					}
+					else if (deferred) {
+						deferredRenderSystem->setRenderPass(m_Renderer.getSwapChainRenderPass());
+					}
+					else {
+						simpleRenderSystem->setRenderPass(m_Renderer.getSwapChainRenderPass());
+					}
+				}
+				if (useFrameGraph) {
+					if (frameGraphGeneration != m_Renderer.getSwapChainGeneration()) {
+						frameGraphGeneration = m_Renderer.getSwapChainGeneration();
+						frameGraph.compile(extent);
+						bindFrameGraphInputs();
+					}
+					frameGraph.setImportedImage(
+						backBuffer, m_Renderer.getSwapChainImage(), m_Renderer.getSwapChainImageView(), extent);
+					graphFrameInfo = &frameInfo;
+					frameGraph.execute(commandBuffer, &m_GpuProfiler);
+				}
+				else {
+					m_Renderer.beginSwapChainRenderPass(commandBuffer);
+					if (deferred) {
+						if (gBufferGeneration != m_Renderer.getSwapChainGeneration()) {
+							gBufferGeneration = m_Renderer.getSwapChainGeneration();
+							deferredRenderSystem->setGBuffer(m_Renderer.getGBufferViews());
+						}
+						m_GpuProfiler.beginPass(commandBuffer, "gbuffer");
+						deferredRenderSystem->renderGeometry(frameInfo, m_World, m_Transforms);
+						m_GpuProfiler.endPass(commandBuffer);
+						m_Renderer.nextSubpass(commandBuffer);
+						m_GpuProfiler.beginPass(commandBuffer, "lighting");
+						deferredRenderSystem->renderLighting(frameInfo, m_Renderer.getImageIndex());
+						m_GpuProfiler.endPass(commandBuffer);
+					}
+					else {
+						if (simpleRenderSystem->isDepthPrepassEnabled()) {
+							m_GpuProfiler.beginPass(commandBuffer, "depth prepass");
+							simpleRenderSystem->renderDepthPrepass(frameInfo, m_World, m_Transforms);
+							m_GpuProfiler.endPass(commandBuffer);
+						}
+						m_GpuProfiler.beginPass(commandBuffer, "main");
+						simpleRenderSystem->renderGameObjects(frameInfo, m_World, m_Transforms);
+						m_GpuProfiler.endPass(commandBuffer);
+					}
+					m_Renderer.endSwapChainRenderPass(commandBuffer);
+				}
+				auto submitStart = PhaseClock::now();
+				if (m_Settings.lateLatchCamera) {
+					// The UBO stays mapped, so the camera can be moved once more after recording. Only the
+					// draw transforms move, the shaders still find the clusters with the camera the lights
+					// were assigned with.
+					m_Renderer.endFrame([&]() {
+						if (!m_Settings.headless) {
+							glfwPollEvents();
+						}
+						updateCamera();
+						writeCamera();
+						uboBuffers[frameIndex]->writeToBuffer(&ubo);
+						uboBuffers[frameIndex]->flush();
+					});
+				}
+				else {
+					m_Renderer.endFrame();
+				}
+				auto submitEnd = PhaseClock::now();
+				uint64_t frameAllocationCount = frameAllocations.count();
+
+				// Frame time is measured loop to loop, so it lags the phases by one frame
+				if (benchmark && m_Renderer.getSubmittedFrameCount() > m_Settings.benchmark.warmupFrames) {
+					report.addSample("cpu", "frame", 1000.0 * frameTime);
+					report.addSample("phases", "pace", m_Renderer.getLastPacingWaitMilliseconds());
+					report.addSample("phases", "update", milliseconds(updateStart, beginStart));
+					report.addSample("phases", "frame wait", m_Renderer.getLastCpuWaitMilliseconds());
+					report.addSample("phases", "begin frame", milliseconds(beginStart, recordStart));
+					report.addSample("phases", "record", milliseconds(recordStart, submitStart));
+					report.addSample("phases", "submit", milliseconds(submitStart, submitEnd));
+					report.addSample("heap", "main thread allocations", static_cast<double>(frameAllocationCount));
+					if (frameAllocationCount > 0) {
+						allocatingFrames++;
+					}
+					for (auto& timing : m_GpuProfiler.getLastTimings()) {
+						report.addSample("gpu", timing.path, timing.milliseconds);
+						if (timing.hasStatistics) {
+							report.addSample("pipeline statistics", timing.path + " vertex invocations", static_cast<double>(timing.statistics.vertexShaderInvocations));
+							report.addSample("pipeline statistics", timing.path + " clipping primitives", static_cast<double>(timing.statistics.clippingPrimitives));
+							report.addSample("pipeline statistics", timing.path + " fragment invocations", static_cast<double>(timing.statistics.fragmentShaderInvocations));
+						}
+					}
+					auto stats = NNRenderStats::getLastFrame();
+					for (uint32_t i = 0; i < NNRenderStats::COUNTER_COUNT; i++) {
+						auto counter = static_cast<NNRenderStats::Counter>(i);
+						report.addSample("render stats", NNRenderStats::counterName(counter), static_cast<double>(stats[counter]));
+					}
+					for (uint32_t i = 0; i < NNRenderStats::GAUGE_COUNT; i++) {
+						auto gauge = static_cast<NNRenderStats::Gauge>(i);
+						report.addSample("render stats", NNRenderStats::gaugeName(gauge), static_cast<double>(stats[gauge]));
+					}
+				}
+
+				cpuWaitMilliseconds += m_Renderer.getLastCpuWaitMilliseconds() + m_Renderer.getLastPacingWaitMilliseconds();
+				reportedFrames++;
+			}
+
+			auto& latency = m_Renderer.getLastLatency();
+			if (latency.frame != lastLatencyFrame) {
+				lastLatencyFrame = latency.frame;
+				inputToSubmitMilliseconds += latency.inputToSubmitMilliseconds;
+				inputToGpuDoneMilliseconds += latency.inputToGpuDoneMilliseconds;
+				latencyFrames++;
+			}
+
+			gpuReportTimer += frameTime;
+			if (gpuReportTimer >= 1.0f && m_GpuProfiler.isSupported()) {
+				gpuReportTimer = 0.0f;
+				if (deferred) {
+					std::cout << "GPU (deferred):";
+				}
+				else if (useFrameGraph) {
+					std::cout << "GPU (frame graph, prepass " << (simpleRenderSystem->isDepthPrepassEnabled() ? "on" : "off") << "):";
+				}
+				else {
+					std::cout << "GPU (prepass " << (simpleRenderSystem->isDepthPrepassEnabled() ? "on" : "off") << "):";
+				}
+				for (auto& timing : m_GpuProfiler.takeAverages()) {
+					std::cout << " " << timing.path << " " << timing.milliseconds << " ms";
+				}
+				std::cout << std::endl;
+
+				if (m_GpuProfiler.hasPipelineStatistics()) {
+					std::cout << "GPU statistics (last frame):";
+					for (auto& timing : m_GpuProfiler.getLastTimings()) {
+						if (timing.hasStatistics) {
+							std::cout << " " << timing.path << " " << timing.statistics.vertexShaderInvocations << " vs, "
+								<< timing.statistics.clippingPrimitives << " prims, "
+								<< timing.statistics.fragmentShaderInvocations << " fs;";
+						}
+					}
+					std::cout << std::endl;
+				}
+
+				std::cout << "CPU: " << m_Renderer.getFramesInFlight() << " frames in flight, wait "
+					<< (reportedFrames > 0 ? cpuWaitMilliseconds / reportedFrames : 0.0) << " ms" << std::endl;
+				cpuWaitMilliseconds = 0.0;
+				reportedFrames = 0;
+
+				if (latencyFrames > 0) {
+					std::cout << "Input to GPU latency (" << presentModeName(m_Renderer.getPresentMode())
+						<< (m_Settings.lateLatchCamera ? ", late latched" : "") << ", excludes present): input to submit "
+						<< inputToSubmitMilliseconds / latencyFrames << " ms, input to GPU done "
+						<< inputToGpuDoneMilliseconds / latencyFrames << " ms" << std::endl;
+				}
+				inputToSubmitMilliseconds = 0.0;
+				inputToGpuDoneMilliseconds = 0.0;
+				latencyFrames = 0;
+
+				auto stats = NNRenderStats::getLastFrame();
+				std::cout << "Stats (last frame): " << stats[NNRenderStats::Counter::DrawCalls] << " draws, "
+					<< stats[NNRenderStats::Counter::Triangles] << " triangles, "
+					<< stats[NNRenderStats::Counter::PipelineBinds] << " pipeline binds, "
+					<< stats[NNRenderStats::Counter::DescriptorSetBinds] << " set binds, "
+					<< stats[NNRenderStats::Counter::PushConstantBytes] << " push constant bytes, "
+					<< stats[NNRenderStats::Counter::BytesUploaded] / 1024 << " KiB uploaded";
+				if (m_Device.hasMemoryBudget()) {
+					std::cout << ", " << stats[NNRenderStats::Gauge::DeviceMemoryInUse] / (1024 * 1024) << " MiB device memory";
+				}
+				std::cout << ", " << stats[NNRenderStats::Gauge::DriverHostMemory] / 1024 << " KiB driver host memory, "
+					<< stats[NNRenderStats::Gauge::FrameArenaBytes] << " frame arena bytes";
+				if (NNHostMemory::isTrackingHeapAllocations()) {
+					std::cout << ", " << stats[NNRenderStats::Counter::HeapAllocations] << " heap allocations";
+				}
+				std::cout << std::endl;
+
+				auto& clusterStats = m_LightClusters.getLastStats();
+				std::cout << "Clusters: " << clusterStats.lightCount << " lights, "
+					<< clusterStats.lightIndexCount << " light indices"
+					<< (clusterStats.overflowed ? " (overflowed)" : "")
+					<< ", assignment " << clusterStats.milliseconds << " ms" << std::endl;
 			}
 
 		}
 
 		vkDeviceWaitIdle(m_Device.device());
+		NNCpuProfiler::endCapture();
+		if (!m_Settings.statsPath.empty()) {
+			NNRenderStats::write(m_Settings.statsPath);
+			std::cout << "Wrote render statistics of the last " << NNRenderStats::getWindow().size() << " frames to "
+				<< m_Settings.statsPath << std::endl;
+		}
+		if (benchmark) {
+			writeBenchmarkReport(report);
+		}
+		if (!m_Settings.recordCameraPath.empty() && !recordedPath.empty()) {
+			recordedPath.saveToFile(m_Settings.recordCameraPath);
+			std::cout << "Saved camera path with " << recordedPath.getKeyframes().size() << " keyframes to "
+				<< m_Settings.recordCameraPath << std::endl;
+		}
+		if (m_Settings.headless && !m_Settings.capturePath.empty()) {
+			m_Renderer.saveLastFrame(m_Settings.capturePath);
+			std::cout << "Saved frame " << m_Renderer.getSubmittedFrameCount() << " to " << m_Settings.capturePath << std::endl;
+		}
+		if (benchmark && m_Settings.benchmark.requireNoAllocations && allocatingFrames > 0) {
+			throw std::runtime_error(std::to_string(allocatingFrames) + " measured frames allocated on the main thread!");
+		}
 	}
 	
 	std::unique_ptr<NNModel> createCubeModel(NNDevice& device, glm::vec3 offset) {
@@ -161,11 +727,140 @@ namespace NNuts {
 	{
 		std::shared_ptr<NNModel> model = NNModel::createModelFromFile(m_Device, "res/Models/flat_vase.obj");
 
-		auto gameObj = NNGameObject::createGameObject();
-		gameObj.model = model;
-		gameObj.transform.translation = { 0.0f, 0.5f, 2.5f };
-		gameObj.transform.scale = { 3.0f, 1.5f, 2.0f };
-		//gameObj.transform.scale = glm::vec3{3.0f};
-		m_GameObjects.push_back(std::move(gameObj));
+		TransformComponent transform{};
+		transform.translation = { 0.0f, 0.5f, 2.5f };
+		transform.scale = { 3.0f, 1.5f, 2.0f };
+		//transform.scale = glm::vec3{3.0f};
+		m_World.create(TransformNode{ m_Transforms.add(transform) }, RenderComponent{ model });
+
+		std::vector<glm::vec3> lightColors{
+			{1.f, .1f, .1f},
+			{.1f, .1f, 1.f},
+			{.1f, 1.f, .1f},
+			{1.f, 1.f, .1f},
+			{.1f, 1.f, 1.f},
+			{1.f, 1.f, 1.f},
+		};
+		for (size_t i = 0; i < lightColors.size(); i++) {
+			float angle = i * glm::two_pi<float>() / lightColors.size();
+			PointLight light{};
+			light.positionRadius = { 1.2f * glm::cos(angle), -0.5f, 2.5f + 1.2f * glm::sin(angle), 2.0f };
+			light.color = { lightColors[i], 1.5f };
+			m_PointLights.push_back(light);
+		}
+	}
+
+	void NNApplication::loadStressScene()
+	{
+		std::shared_ptr<NNModel> cube = createCubeModel(m_Device, glm::vec3{ 0.0f });
+
+		// y points down, so the floor of cubes sits at positive y with the lights above it
+		constexpr int GRID = 32;
+		constexpr float SPACING = 1.5f;
+		for (int z = 0; z < GRID; z++) {
+			for (int x = 0; x < GRID; x++) {
+				TransformComponent transform{};
+				transform.translation = { (x - GRID / 2) * SPACING, 1.0f, z * SPACING };
+				transform.scale = glm::vec3{ 1.0f, 0.5f + 0.5f * ((x * 7 + z * 13) % 5), 1.0f };
+				m_World.create(TransformNode{ m_Transforms.add(transform) }, RenderComponent{ cube });
+			}
+		}
+
+		scatterLights(
+			{ -GRID * SPACING * 0.5f, -2.0f, 0.0f },
+			{ GRID * SPACING * 0.5f, 0.0f, GRID * SPACING });
+
+		m_SceneCenter = { 0.0f, 0.0f, GRID * SPACING * 0.5f };
+		m_LightOrbitSpeed = 0.1f;
+		m_FarClip = 60.0f;
+	}
+
+	void NNApplication::loadProceduralScene()
+	{
+		auto& params = m_Settings.procedural;
+		NNSceneGenerator::generate(m_Device, params, m_World, m_Transforms);
+
+		float halfExtent = 0.5f * params.extent;
+		scatterLights({ -halfExtent, -3.0f, -halfExtent }, { halfExtent, -0.5f, halfExtent });
+
+		m_SceneCenter = glm::vec3{ 0.0f };
+		m_LightOrbitSpeed = 0.1f;
+		m_FarClip = std::max(1.25f * params.extent, 10.0f);
+	}
+
+	void NNApplication::scatterLights(const glm::vec3& min, const glm::vec3& max)
+	{
+		// Fixed seed so runs are comparable
+		std::mt19937 random{ 1337 };
+		std::uniform_real_distribution<float> spreadX{ min.x, max.x };
+		std::uniform_real_distribution<float> spreadY{ min.y, max.y };
+		std::uniform_real_distribution<float> spreadZ{ min.z, max.z };
+		std::uniform_real_distribution<float> unit{ 0.0f, 1.0f };
+
+		m_PointLights.resize(std::min(m_Settings.stressLightCount, NNLightClusters::MAX_LIGHTS));
+		for (auto& light : m_PointLights) {
+			light.positionRadius = { spreadX(random), spreadY(random), spreadZ(random), 1.0f + 1.5f * unit(random) };
+			light.color = { unit(random), unit(random), unit(random), 2.0f };
+		}
+	}
+
+	void NNApplication::updateLights(float frameTime)
+	{
+		// Every light orbits the scene's vertical axis so cluster assignment changes each frame
+		const glm::vec3& center = m_SceneCenter;
+
+		float angle = frameTime * m_LightOrbitSpeed;
+		float c = glm::cos(angle);
+		float s = glm::sin(angle);
+		for (auto& light : m_PointLights) {
+			glm::vec3 offset = glm::vec3(light.positionRadius) - center;
+			light.positionRadius.x = center.x + c * offset.x + s * offset.z;
+			light.positionRadius.z = center.z - s * offset.x + c * offset.z;
+		}
+	}
+
+	void NNApplication::writeBenchmarkReport(NNBenchmarkReport& report) const
+	{
+		const char* sceneName = "default";
+		if (m_Settings.scene == Scene::LightStress) {
+			sceneName = "light stress";
+		}
+		else if (m_Settings.scene == Scene::Procedural) {
+			sceneName = "procedural";
+		}
+
+		report.setInfo("device", m_Device.properties.deviceName);
+		report.setInfo("scene", sceneName);
+		if (m_Settings.scene == Scene::Procedural) {
+			report.setInfo("distribution", NNSceneGenerator::distributionName(m_Settings.procedural.distribution));
+			report.setInfo("models", m_Settings.procedural.modelCount);
+			report.setInfo("seed", m_Settings.procedural.seed);
+		}
+		report.setInfo("objects", static_cast<double>(m_World.size()));
+		report.setInfo("lights", static_cast<double>(m_PointLights.size()));
+		report.setInfo("renderPath", m_Settings.renderPath == RenderPath::Deferred ? "deferred" : "forward");
+		report.setInfo("frameGraph", m_Settings.frameGraph && m_Settings.renderPath != RenderPath::Deferred ? "on" : "off");
+		report.setInfo("headless", m_Settings.headless ? "on" : "off");
+		report.setInfo("presentMode", m_Settings.headless ? "offscreen" : presentModeName(m_Renderer.getPresentMode()));
+		report.setInfo("framesInFlight", m_Renderer.getFramesInFlight());
+		report.setInfo("width", m_Renderer.getSwapChainExtent().width);
+		report.setInfo("height", m_Renderer.getSwapChainExtent().height);
+		report.setInfo("warmupFrames", m_Settings.benchmark.warmupFrames);
+		report.setInfo("cameraPath", m_Settings.benchmark.cameraPathFile.empty() ? "orbit" : m_Settings.benchmark.cameraPathFile);
+		report.setInfo("heapAllocationTracking", NNHostMemory::isTrackingHeapAllocations() ? "on" : "off");
+		report.writeJson(m_Settings.benchmark.reportPath);
+
+		auto frame = NNBenchmarkReport::summarize(report.getSamples("cpu", "frame"));
+		std::cout << "Benchmark: " << frame.count << " frames, CPU frame p50 " << frame.p50 << " ms, p95 "
+			<< frame.p95 << " ms, p99 " << frame.p99 << " ms, report written to "
+			<< m_Settings.benchmark.reportPath << std::endl;
+
+		// Steady state frames should not touch the heap, with --require-no-allocations run() fails when they do
+		if (NNHostMemory::isTrackingHeapAllocations()) {
+			auto& allocations = report.getSamples("heap", "main thread allocations");
+			size_t allocatingFrames = std::count_if(allocations.begin(), allocations.end(), [](double count) { return count > 0.0; });
+			std::cout << "Heap: " << allocatingFrames << " of " << allocations.size() << " measured frames allocated on the main thread" << std::endl;
+		}
+		NNHostMemory::printUsage();
 	}
 }
\ No newline at end of file
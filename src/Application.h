@@ -1,21 +1,91 @@
 #pragma once
 
+#include "BindlessTable.h"
 #include "Descriptor.h"
 #include "Device.h"
 #include "GameObject.h"
+#include "GpuProfiler.h"
+#include "LayoutCache.h"
+#include "LightClusters.h"
 #include "Renderer.h"
+#include "SceneGenerator.h"
+#include "ShaderCompiler.h"
+#include "TransformHierarchy.h"
 #include "Window.h"
+#include "World.h"
 
 #include <memory>
+#include <string>
 #include <vector>
 
 namespace NNuts {
+	class NNBenchmarkReport;
+
 	class NNApplication {
 	public:
 		static constexpr int WIDTH = 800;
 		static constexpr int HEIGHT = 600;
 
+		enum class Scene {
+			Default,
+			// Grid of cubes lit by thousands of moving point lights
+			LightStress,
+			// Seeded NNSceneGenerator objects, lit like the stress scene
+			Procedural,
+		};
+
+		struct BenchmarkSettings {
+			bool enabled = false;
+			// Rendered before measuring, lets pipelines, caches and clocks settle
+			uint32_t warmupFrames = 120;
+			// Camera path to replay, an orbit around the scene when empty
+			std::string cameraPathFile;
+			std::string reportPath = "benchmark.json";
+			// Fails the run when a measured frame allocates on the main thread
+			bool requireNoAllocations = false;
+		};
+
+		struct Settings {
+			Scene scene = Scene::Default;
+			RenderPath renderPath = RenderPath::Forward;
+			// Forward path followed by a bloom chain, all scheduled through NNFrameGraph
+			bool frameGraph = false;
+			uint32_t framesInFlight = 2;
+			PresentSettings present{};
+			double frameRateCap = 0.0;
+			uint32_t latencyLimit = NNSwapChain::MAX_FRAMES_IN_FLIGHT;
+			// Re-sample input and rewrite the camera right before submit
+			bool lateLatchCamera = false;
+			// Forward path draws through NNBindlessTable, ignored without descriptor indexing
+			bool bindless = false;
+			// Times shader preparation from an empty and from a warm disk cache before loading
+			bool measureShaderCache = false;
+			uint32_t stressLightCount = 4096;
+			NNSceneGenerator::Params procedural{};
+			// No window or surface: renders into offscreen images for a fixed number of frames with a
+			// fixed time step, then optionally writes the last one to capturePath as a PPM
+			bool headless = false;
+			// Frames of a headless run, measured frames (after warm-up) of a benchmark
+			uint32_t frameCount = 300;
+			std::string capturePath;
+			// Replaces keyboard input with a scripted camera and a fixed time step, and reports timings
+			BenchmarkSettings benchmark{};
+			// Interactive runs save the camera motion here on exit, for benchmarks to replay
+			std::string recordCameraPath;
+			// Writes a Chrome trace of CPU scopes and GPU passes for this many frames (measured frames of
+			// a benchmark). Interactive runs also capture 60 frames on C.
+			uint32_t traceFrames = 0;
+			std::string tracePath = "trace.json";
+			// Frames of render statistics kept in memory, written to statsPath on exit (JSON when the
+			// path ends in .json, CSV otherwise)
+			uint32_t statsWindow = 300;
+			std::string statsPath;
+			// Publishes every frame's statistics to this shared memory block while running
+			std::string statsSharedMemory;
+		};
+
 		NNApplication();
+		explicit NNApplication(const Settings& settings);
 		~NNApplication();
 
 		NNApplication(const NNApplication&) = delete;
@@ -25,12 +95,27 @@ namespace NNuts {
 
 	private:
 		void loadGameObjects();
+		void loadStressScene();
+		void loadProceduralScene();
+		void scatterLights(const glm::vec3& min, const glm::vec3& max);
+		void updateLights(float frameTime);
+		void writeBenchmarkReport(NNBenchmarkReport& report) const;
 
-		NNWindow m_Window{ WIDTH, HEIGHT, "TESTING THESE NNUTS!" };
+		Settings m_Settings;
+		NNWindow m_Window{ WIDTH, HEIGHT, "TESTING THESE NNUTS!", m_Settings.headless };
 		NNDevice m_Device{ m_Window };
-		NNRenderer	m_Renderer{ m_Window, m_Device };
+		NNRenderer	m_Renderer{ m_Window, m_Device, m_Settings.renderPath, m_Settings.framesInFlight, m_Settings.present };
+		NNShaderCompiler m_ShaderCompiler{};
+		NNLayoutCache m_LayoutCache{ m_Device };
+		NNGpuProfiler m_GpuProfiler{ m_Device };
+		NNLightClusters m_LightClusters{ m_Device };
+		std::unique_ptr<NNBindlessTable> m_BindlessTable;
 
-		std::unique_ptr<NNDescriptorPool> m_GlobalPool;
-		std::vector<NNGameObject> m_GameObjects;
+		NNTransformHierarchy m_Transforms;
+		NNWorld m_World;
+		std::vector<PointLight> m_PointLights;
+		glm::vec3 m_SceneCenter{ 0.0f, 0.0f, 2.5f };
+		float m_LightOrbitSpeed = 0.5f;
+		float m_FarClip = 10.0f;
 	};
 }
\ No newline at end of file
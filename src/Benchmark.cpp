@@ -0,0 +1,259 @@
+#include "Application.h"
+#include "GameObject.h"
+#include "TransformBatch.h"
+#include "World.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+	// Scene objects before the ECS: id, model, color and transform interleaved in one struct
+	struct InterleavedObject {
+		uint32_t id;
+		std::shared_ptr<NNuts::NNModel> model;
+		glm::vec3 color;
+		NNuts::TransformComponent transform;
+	};
+
+	template<typename Fn>
+	double bestPassMs(uint32_t passes, Fn&& pass) {
+		double best = 1e30;
+		for (uint32_t i = 0; i < passes; i++) {
+			auto start = std::chrono::steady_clock::now();
+			pass();
+			best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+		}
+		return best;
+	}
+
+	// CPU only: walks the transforms of count objects stored interleaved and stored in an NNWorld
+	void runIterationBenchmark(uint32_t count) {
+		constexpr uint32_t PASSES = 20;
+
+		std::vector<InterleavedObject> objects;
+		objects.reserve(count);
+		NNuts::NNWorld world;
+		for (uint32_t i = 0; i < count; i++) {
+			NNuts::TransformComponent transform{};
+			transform.translation = { static_cast<float>(i % 1024), 0.0f, static_cast<float>(i / 1024) };
+			transform.scale = glm::vec3{ 1.0f + (i % 7) * 0.1f };
+			objects.push_back({ i, nullptr, glm::vec3{ 1.0f }, transform });
+			world.create(transform, NNuts::RenderComponent{});
+		}
+
+		glm::vec3 interleavedSum{ 0.0f };
+		double interleavedMs = bestPassMs(PASSES, [&]() {
+			glm::vec3 sum{ 0.0f };
+			for (auto& obj : objects) {
+				sum += obj.transform.translation * obj.transform.scale;
+			}
+			interleavedSum = sum;
+		});
+
+		glm::vec3 worldSum{ 0.0f };
+		double worldMs = bestPassMs(PASSES, [&]() {
+			glm::vec3 sum{ 0.0f };
+			world.eachChunk<NNuts::TransformComponent>([&sum](size_t chunkCount, const NNuts::NNEntity*, NNuts::TransformComponent* transforms) {
+				for (size_t i = 0; i < chunkCount; i++) {
+					sum += transforms[i].translation * transforms[i].scale;
+				}
+			});
+			worldSum = sum;
+		});
+
+		auto nsPerEntity = [count](double ms) { return 1e6 * ms / count; };
+		std::cout << "Iterating " << count << " transforms, best of " << PASSES << " passes\n"
+			<< "  interleaved objects: " << interleavedMs << " ms (" << nsPerEntity(interleavedMs) << " ns/entity)\n"
+			<< "  world query:         " << worldMs << " ms (" << nsPerEntity(worldMs) << " ns/entity)\n"
+			<< "  checksum " << (interleavedSum.x + interleavedSum.z) << " / " << (worldSum.x + worldSum.z) << std::endl;
+	}
+
+	// CPU only: model and normal matrices for count random transforms through every NNTransformBatch
+	// path this CPU has, the SIMD ones checked against the scalar one. False when they disagree.
+	bool runTransformBatchBenchmark(uint32_t count) {
+		using Isa = NNuts::NNTransformBatch::Isa;
+		constexpr uint32_t PASSES = 10;
+		// Relative to the element, or absolute below 1
+		constexpr float TOLERANCE = 1e-5f;
+
+		std::mt19937 random{ 1337 };
+		std::uniform_real_distribution<float> translation{ -100.0f, 100.0f };
+		std::uniform_real_distribution<float> rotation{ -4.0f * glm::pi<float>(), 4.0f * glm::pi<float>() };
+		std::uniform_real_distribution<float> scale{ 0.25f, 4.0f };
+		NNuts::NNTransformArrays input;
+		input.resize(count);
+		for (uint32_t i = 0; i < count; i++) {
+			NNuts::TransformComponent transform{};
+			transform.translation = { translation(random), translation(random), translation(random) };
+			transform.rotation = { rotation(random), rotation(random), rotation(random) };
+			transform.scale = { scale(random), scale(random), scale(random) };
+			input.set(i, transform);
+		}
+
+		std::vector<NNuts::NNInstanceTransform> reference(count);
+		std::vector<NNuts::NNInstanceTransform> output(count);
+		bool matches = true;
+		std::cout << "Computing " << count << " model and normal matrices, best of " << PASSES << " passes\n";
+		for (Isa isa : { Isa::Scalar, Isa::SSE, Isa::AVX2 }) {
+			if (isa > NNuts::NNTransformBatch::getSupportedIsa()) {
+				std::cout << "  " << NNuts::NNTransformBatch::isaName(isa) << ": not supported\n";
+				continue;
+			}
+			auto& destination = isa == Isa::Scalar ? reference : output;
+			double ms = bestPassMs(PASSES, [&]() {
+				NNuts::NNTransformBatch::compute(input, 0, count, destination.data(), isa);
+			});
+
+			float maxError = 0.0f;
+			if (isa != Isa::Scalar) {
+				auto* computed = reinterpret_cast<const float*>(output.data());
+				auto* expected = reinterpret_cast<const float*>(reference.data());
+				for (size_t i = 0; i < size_t{ count } * 32; i++) {
+					maxError = std::max(maxError, std::abs(computed[i] - expected[i]) / std::max(1.0f, std::abs(expected[i])));
+				}
+			}
+			matches = matches && maxError <= TOLERANCE;
+			std::cout << "  " << NNuts::NNTransformBatch::isaName(isa) << ": " << ms << " ms, "
+				<< (count / ms * 1e-3) << " M transforms/s (" << (2.0 * count / ms * 1e-3) << " M matrices/s), max error " << maxError << "\n";
+		}
+		std::cout << (matches ? "SIMD paths match the scalar path" : "SIMD paths DON'T match the scalar path") << std::endl;
+		return matches;
+	}
+}
+
+// Entry point of the benchmark target: a headless, fixed length run of a scripted scene that writes
+// its timings as JSON, so results of different commits can be compared directly
+int main(int argc, char** argv) {
+	NNuts::NNApplication::Settings settings{};
+	settings.scene = NNuts::NNApplication::Scene::Procedural;
+	settings.headless = true;
+	settings.frameCount = 1000;
+	settings.benchmark.enabled = true;
+	// Nothing should throttle the measured frames
+	settings.present.presentMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+	settings.stressLightCount = 1024;
+	uint32_t iterationBenchmarkCount = 0;
+	uint32_t transformBatchCount = 0;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--windowed") {
+			settings.headless = false;
+		}
+		else if (arg == "--light-stress") {
+			settings.scene = NNuts::NNApplication::Scene::LightStress;
+		}
+		else if (arg == "--deferred") {
+			settings.renderPath = NNuts::RenderPath::Deferred;
+		}
+		else if (arg == "--frame-graph") {
+			settings.frameGraph = true;
+		}
+		else if (arg == "--bindless") {
+			settings.bindless = true;
+		}
+		else if (arg == "--frames-in-flight" && i + 1 < argc) {
+			settings.framesInFlight = static_cast<uint32_t>(std::stoul(argv[++i]));
+		}
+		else if (arg == "--objects" && i + 1 < argc) {
+			settings.procedural.objectCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+		}
+		else if (arg == "--models" && i + 1 < argc) {
+			settings.procedural.modelCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+		}
+		else if (arg == "--distribution" && i + 1 < argc) {
+			std::string distribution = argv[++i];
+			if (!NNuts::NNSceneGenerator::parseDistribution(distribution, settings.procedural.distribution)) {
+				std::cerr << "Unknown distribution " << distribution << ", keeping "
+					<< NNuts::NNSceneGenerator::distributionName(settings.procedural.distribution) << std::endl;
+			}
+		}
+		else if (arg == "--extent" && i + 1 < argc) {
+			settings.procedural.extent = std::stof(argv[++i]);
+		}
+		else if (arg == "--seed" && i + 1 < argc) {
+			settings.procedural.seed = static_cast<uint32_t>(std::stoul(argv[++i]));
+		}
+		else if (arg == "--lights" && i + 1 < argc) {
+			settings.stressLightCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+		}
+		else if (arg == "--frames" && i + 1 < argc) {
+			settings.frameCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+		}
+		else if (arg == "--warmup" && i + 1 < argc) {
+			settings.benchmark.warmupFrames = static_cast<uint32_t>(std::stoul(argv[++i]));
+		}
+		else if (arg == "--camera-path" && i + 1 < argc) {
+			settings.benchmark.cameraPathFile = argv[++i];
+		}
+		else if (arg == "--output" && i + 1 < argc) {
+			settings.benchmark.reportPath = argv[++i];
+		}
+		else if (arg == "--require-no-allocations") {
+			settings.benchmark.requireNoAllocations = true;
+		}
+		else if (arg == "--capture" && i + 1 < argc) {
+			settings.capturePath = argv[++i];
+		}
+		else if (arg == "--trace" && i + 1 < argc) {
+			settings.tracePath = argv[++i];
+		}
+		else if (arg == "--trace-frames" && i + 1 < argc) {
+			settings.traceFrames = static_cast<uint32_t>(std::stoul(argv[++i]));
+		}
+		else if (arg == "--stats" && i + 1 < argc) {
+			settings.statsPath = argv[++i];
+		}
+		else if (arg == "--stats-window" && i + 1 < argc) {
+			settings.statsWindow = static_cast<uint32_t>(std::stoul(argv[++i]));
+		}
+		else if (arg == "--stats-shm" && i + 1 < argc) {
+			settings.statsSharedMemory = argv[++i];
+		}
+		else if (arg == "--ecs-iteration") {
+			iterationBenchmarkCount = 1000000;
+			if (i + 1 < argc && std::isdigit(static_cast<unsigned char>(argv[i + 1][0]))) {
+				iterationBenchmarkCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+			}
+		}
+		else if (arg == "--transform-batch") {
+			transformBatchCount = 1000000;
+			if (i + 1 < argc && std::isdigit(static_cast<unsigned char>(argv[i + 1][0]))) {
+				transformBatchCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+			}
+		}
+		else {
+			std::cerr << "Unknown argument " << arg << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (iterationBenchmarkCount > 0) {
+		runIterationBenchmark(iterationBenchmarkCount);
+		return EXIT_SUCCESS;
+	}
+	if (transformBatchCount > 0) {
+		return runTransformBatchBenchmark(transformBatchCount) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	try
+	{
+		NNuts::NNApplication benchmark{ settings };
+		benchmark.run();
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << '\n';
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
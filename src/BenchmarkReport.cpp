@@ -0,0 +1,140 @@
+#include "BenchmarkReport.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+
+namespace NNuts {
+	namespace {
+		std::string jsonString(const std::string& value)
+		{
+			std::string escaped = "\"";
+			for (char c : value) {
+				if (c == '"' || c == '\\') {
+					escaped += '\\';
+					escaped += c;
+				}
+				else if (static_cast<unsigned char>(c) < 0x20) {
+					escaped += ' ';
+				}
+				else {
+					escaped += c;
+				}
+			}
+			return escaped + "\"";
+		}
+
+		std::string jsonNumber(double value)
+		{
+			if (!std::isfinite(value)) {
+				return "null";
+			}
+			std::ostringstream stream;
+			stream.precision(6);
+			stream << value;
+			return stream.str();
+		}
+	}
+
+	NNBenchmarkReport::Summary NNBenchmarkReport::summarize(std::vector<double> samples)
+	{
+		Summary summary{};
+		if (samples.empty()) {
+			return summary;
+		}
+
+		std::sort(samples.begin(), samples.end());
+		auto percentile = [&](double p) {
+			size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * samples.size()));
+			return samples[std::clamp<size_t>(rank, 1, samples.size()) - 1];
+		};
+		summary.count = static_cast<uint32_t>(samples.size());
+		summary.mean = std::accumulate(samples.begin(), samples.end(), 0.0) / samples.size();
+		summary.min = samples.front();
+		summary.p50 = percentile(50.0);
+		summary.p95 = percentile(95.0);
+		summary.p99 = percentile(99.0);
+		summary.max = samples.back();
+		return summary;
+	}
+
+	void NNBenchmarkReport::setInfo(const std::string& key, const std::string& value)
+	{
+		m_Info.emplace_back(key, jsonString(value));
+	}
+
+	void NNBenchmarkReport::setInfo(const std::string& key, double value)
+	{
+		m_Info.emplace_back(key, jsonNumber(value));
+	}
+
+	void NNBenchmarkReport::addSample(const std::string& group, const std::string& name, double value)
+	{
+		auto groupIt = std::find_if(m_Groups.begin(), m_Groups.end(), [&](const Group& g) { return g.name == group; });
+		if (groupIt == m_Groups.end()) {
+			groupIt = m_Groups.insert(m_Groups.end(), Group{ group, {} });
+		}
+		auto seriesIt = std::find_if(groupIt->series.begin(), groupIt->series.end(), [&](const Series& s) { return s.name == name; });
+		if (seriesIt == groupIt->series.end()) {
+			seriesIt = groupIt->series.insert(groupIt->series.end(), Series{ name, {} });
+		}
+		seriesIt->samples.push_back(value);
+	}
+
+	const std::vector<double>& NNBenchmarkReport::getSamples(const std::string& group, const std::string& name) const
+	{
+		static const std::vector<double> empty{};
+		for (auto& g : m_Groups) {
+			if (g.name != group) {
+				continue;
+			}
+			for (auto& s : g.series) {
+				if (s.name == name) {
+					return s.samples;
+				}
+			}
+		}
+		return empty;
+	}
+
+	void NNBenchmarkReport::writeJson(const std::string& filepath) const
+	{
+		std::ofstream file{ filepath };
+		if (!file) {
+			throw std::runtime_error("Failed to open " + filepath + " for writing!");
+		}
+
+		std::vector<std::string> entries;
+		for (auto& [key, value] : m_Info) {
+			entries.push_back(jsonString(key) + ": " + value);
+		}
+		for (auto& group : m_Groups) {
+			std::ostringstream entry;
+			entry << jsonString(group.name) << ": {\n";
+			for (size_t s = 0; s < group.series.size(); s++) {
+				auto& series = group.series[s];
+				Summary summary = summarize(series.samples);
+				entry << "    " << jsonString(series.name) << ": { "
+					<< "\"count\": " << summary.count
+					<< ", \"mean\": " << jsonNumber(summary.mean)
+					<< ", \"min\": " << jsonNumber(summary.min)
+					<< ", \"p50\": " << jsonNumber(summary.p50)
+					<< ", \"p95\": " << jsonNumber(summary.p95)
+					<< ", \"p99\": " << jsonNumber(summary.p99)
+					<< ", \"max\": " << jsonNumber(summary.max) << " }"
+					<< (s + 1 < group.series.size() ? ",\n" : "\n");
+			}
+			entry << "  }";
+			entries.push_back(entry.str());
+		}
+
+		file << "{\n";
+		for (size_t i = 0; i < entries.size(); i++) {
+			file << "  " << entries[i] << (i + 1 < entries.size() ? ",\n" : "\n");
+		}
+		file << "}\n";
+	}
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace NNuts {
+	// Collects per frame samples of a benchmark run and writes them out as JSON percentiles.
+	// Samples are grouped ("cpu", "phases", "gpu", ...) and keep their first-seen order in the report.
+	class NNBenchmarkReport {
+	public:
+		struct Summary {
+			uint32_t count = 0;
+			double mean = 0.0;
+			double min = 0.0;
+			double p50 = 0.0;
+			double p95 = 0.0;
+			double p99 = 0.0;
+			double max = 0.0;
+		};
+
+		// Nearest rank percentiles
+		static Summary summarize(std::vector<double> samples);
+
+		void setInfo(const std::string& key, const std::string& value);
+		void setInfo(const std::string& key, double value);
+		void addSample(const std::string& group, const std::string& name, double value);
+
+		const std::vector<double>& getSamples(const std::string& group, const std::string& name) const;
+		void writeJson(const std::string& filepath) const;
+
+	private:
+		struct Series {
+			std::string name;
+			std::vector<double> samples;
+		};
+		struct Group {
+			std::string name;
+			std::vector<Series> series;
+		};
+
+		// Values are stored already formatted as JSON
+		std::vector<std::pair<std::string, std::string>> m_Info;
+		std::vector<Group> m_Groups;
+	};
+}
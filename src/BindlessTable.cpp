@@ -0,0 +1,218 @@
+#include "BindlessTable.h"
+
+#include "HostMemory.h"
+#include "LayoutCache.h"
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+#include <string>
+
+namespace NNuts {
+	NNBindlessTable::NNBindlessTable(
+		NNDevice& device,
+		NNLayoutCache& layoutCache,
+		uint32_t maxImages,
+		uint32_t maxStorageBuffers) : m_Device{ device }
+	{
+		assert(m_Device.hasDescriptorIndexing() && "Bindless resources need descriptor indexing!");
+		auto& limits = m_Device.descriptorIndexingProperties;
+		m_Images.capacity = std::min({
+			maxImages,
+			limits.maxDescriptorSetUpdateAfterBindSampledImages,
+			limits.maxPerStageDescriptorUpdateAfterBindSampledImages });
+		m_StorageBuffers.capacity = std::min({
+			maxStorageBuffers,
+			limits.maxDescriptorSetUpdateAfterBindStorageBuffers,
+			limits.maxPerStageDescriptorUpdateAfterBindStorageBuffers });
+
+		VkDescriptorBindingFlags bindingFlags =
+			VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
+			VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+			VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+		VkShaderStageFlags stages = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+		m_SetLayout = NNDescriptorSetLayout::Builder(m_Device)
+			.setFlags(VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT)
+			.addBinding(IMAGE_BINDING, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, stages, m_Images.capacity, bindingFlags)
+			.addBinding(STORAGE_BUFFER_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, stages, m_StorageBuffers.capacity, bindingFlags)
+			.build(layoutCache);
+
+		VkDescriptorPoolSize poolSizes[] = {
+			{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, m_Images.capacity },
+			{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, m_StorageBuffers.capacity },
+		};
+		VkDescriptorPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+		poolInfo.maxSets = 1;
+		poolInfo.poolSizeCount = 2;
+		poolInfo.pPoolSizes = poolSizes;
+		if (vkCreateDescriptorPool(m_Device.device(), &poolInfo, NNHostMemory::callbacks(NNHostMemory::Tag::DescriptorPool), &m_Pool) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create bindless descriptor pool!");
+		}
+
+		VkDescriptorSetLayout setLayout = m_SetLayout->getDescriptorSetLayout();
+		VkDescriptorSetAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool = m_Pool;
+		allocInfo.descriptorSetCount = 1;
+		allocInfo.pSetLayouts = &setLayout;
+		if (vkAllocateDescriptorSets(m_Device.device(), &allocInfo, &m_Set) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to allocate bindless descriptor set!");
+		}
+
+		createWhiteTexture(layoutCache);
+	}
+
+	NNBindlessTable::~NNBindlessTable()
+	{
+		m_Device.getDeletionQueue().destroyDescriptorPool(m_Pool);
+		m_Device.getDeletionQueue().destroyImage(m_WhiteImage, m_WhiteView, m_WhiteMemory);
+	}
+
+	uint32_t NNBindlessTable::addImage(VkImageView view, VkSampler sampler, VkImageLayout layout)
+	{
+		uint32_t index = allocateSlot(m_Images, "image");
+		updateImage(index, view, sampler, layout);
+		return index;
+	}
+
+	uint32_t NNBindlessTable::addStorageBuffer(const VkDescriptorBufferInfo& bufferInfo)
+	{
+		uint32_t index = allocateSlot(m_StorageBuffers, "storage buffer");
+		updateStorageBuffer(index, bufferInfo);
+		return index;
+	}
+
+	void NNBindlessTable::updateImage(uint32_t index, VkImageView view, VkSampler sampler, VkImageLayout layout)
+	{
+		assert(index < m_Images.capacity && "Bindless image index out of range!");
+		VkDescriptorImageInfo imageInfo{ sampler, view, layout };
+		VkWriteDescriptorSet write{};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = m_Set;
+		write.dstBinding = IMAGE_BINDING;
+		write.dstArrayElement = index;
+		write.descriptorCount = 1;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		write.pImageInfo = &imageInfo;
+		vkUpdateDescriptorSets(m_Device.device(), 1, &write, 0, nullptr);
+	}
+
+	void NNBindlessTable::updateStorageBuffer(uint32_t index, const VkDescriptorBufferInfo& bufferInfo)
+	{
+		assert(index < m_StorageBuffers.capacity && "Bindless storage buffer index out of range!");
+		VkWriteDescriptorSet write{};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = m_Set;
+		write.dstBinding = STORAGE_BUFFER_BINDING;
+		write.dstArrayElement = index;
+		write.descriptorCount = 1;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		write.pBufferInfo = &bufferInfo;
+		vkUpdateDescriptorSets(m_Device.device(), 1, &write, 0, nullptr);
+	}
+
+	void NNBindlessTable::removeImage(uint32_t index)
+	{
+		assert(index != WHITE_TEXTURE && "The white texture stays in the table!");
+		releaseSlot(m_Images, index);
+	}
+
+	void NNBindlessTable::removeStorageBuffer(uint32_t index)
+	{
+		releaseSlot(m_StorageBuffers, index);
+	}
+
+	uint32_t NNBindlessTable::allocateSlot(Slots& slots, const char* kind)
+	{
+		uint32_t index;
+		if (!slots.released->empty()) {
+			index = slots.released->back();
+			slots.released->pop_back();
+		}
+		else if (slots.next < slots.capacity) {
+			index = slots.next++;
+		}
+		else {
+			throw std::runtime_error(std::string{ "Bindless table is out of " } + kind + " slots!");
+		}
+		slots.count++;
+		return index;
+	}
+
+	void NNBindlessTable::releaseSlot(Slots& slots, uint32_t index)
+	{
+		assert(index < slots.next && "Bindless index was never handed out!");
+		// The descriptor stays valid until the frames that may use it are done
+		slots.count--;
+		auto released = slots.released;
+		m_Device.getDeletionQueue().push([released, index]() {
+			released->push_back(index);
+		});
+	}
+
+	void NNBindlessTable::createWhiteTexture(NNLayoutCache& layoutCache)
+	{
+		VkImageCreateInfo imageInfo{};
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+		imageInfo.extent = { 1, 1, 1 };
+		imageInfo.mipLevels = 1;
+		imageInfo.arrayLayers = 1;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		m_Device.createImageWithInfo(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_WhiteImage, m_WhiteMemory);
+
+		VkImageViewCreateInfo viewInfo{};
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = m_WhiteImage;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = imageInfo.format;
+		viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		if (vkCreateImageView(m_Device.device(), &viewInfo, NNHostMemory::callbacks(NNHostMemory::Tag::ImageView), &m_WhiteView) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create white texture view!");
+		}
+
+		// Cleared instead of uploaded, a single texel doesn't need a staging buffer
+		VkCommandBuffer commandBuffer = m_Device.beginSingleTimeCommands();
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = m_WhiteImage;
+		barrier.subresourceRange = viewInfo.subresourceRange;
+		vkCmdPipelineBarrier(
+			commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		VkClearColorValue white{ { 1.0f, 1.0f, 1.0f, 1.0f } };
+		vkCmdClearColorImage(commandBuffer, m_WhiteImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &white, 1, &viewInfo.subresourceRange);
+
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		vkCmdPipelineBarrier(
+			commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+		m_Device.endSingleTimeCommands(commandBuffer);
+
+		VkSamplerCreateInfo samplerInfo{};
+		samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		samplerInfo.magFilter = VK_FILTER_NEAREST;
+		samplerInfo.minFilter = VK_FILTER_NEAREST;
+		samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+		samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+		samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+		// First image of the table, so it lands on WHITE_TEXTURE
+		addImage(m_WhiteView, layoutCache.getSampler(samplerInfo));
+	}
+}
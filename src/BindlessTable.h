@@ -0,0 +1,73 @@
+#pragma once
+
+#include "Descriptor.h"
+#include "Device.h"
+
+#include <memory>
+#include <vector>
+
+namespace NNuts {
+	class NNLayoutCache;
+
+	// One descriptor set holding every sampled image and storage buffer, for shaders that pick their
+	// resources by index (see Bindless.glsl). Both arrays are partially bound and update after bind, so
+	// the set stays bound for the whole frame while resources come and go. A resource keeps its index
+	// until it is removed; the index is only handed out again once the frames that could still read the
+	// old descriptor have finished. Index 0 of the image array is a 1x1 white texture.
+	class NNBindlessTable {
+	public:
+		static constexpr uint32_t IMAGE_BINDING = 0;
+		static constexpr uint32_t STORAGE_BUFFER_BINDING = 1;
+		static constexpr uint32_t WHITE_TEXTURE = 0;
+
+		// Needs NNDevice::hasDescriptorIndexing(). Capacities are clamped to the device limits.
+		NNBindlessTable(
+			NNDevice& device,
+			NNLayoutCache& layoutCache,
+			uint32_t maxImages = 4096,
+			uint32_t maxStorageBuffers = 1024);
+		~NNBindlessTable();
+
+		NNBindlessTable(const NNBindlessTable&) = delete;
+		NNBindlessTable& operator=(const NNBindlessTable&) = delete;
+
+		uint32_t addImage(VkImageView view, VkSampler sampler, VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		uint32_t addStorageBuffer(const VkDescriptorBufferInfo& bufferInfo);
+		// Points an index at a different resource, the frames that could read the old one have to be done
+		void updateImage(uint32_t index, VkImageView view, VkSampler sampler, VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		void updateStorageBuffer(uint32_t index, const VkDescriptorBufferInfo& bufferInfo);
+		void removeImage(uint32_t index);
+		void removeStorageBuffer(uint32_t index);
+
+		VkDescriptorSetLayout getDescriptorSetLayout() const { return m_SetLayout->getDescriptorSetLayout(); }
+		VkDescriptorSet getDescriptorSet() const { return m_Set; }
+
+		uint32_t getImageCount() const { return m_Images.count; }
+		uint32_t getStorageBufferCount() const { return m_StorageBuffers.count; }
+
+	private:
+		// Free indices of one array. Removed indices go through the deletion queue, which may run after
+		// the table is gone, hence the shared list.
+		struct Slots {
+			uint32_t capacity = 0;
+			uint32_t next = 0;
+			uint32_t count = 0;
+			std::shared_ptr<std::vector<uint32_t>> released = std::make_shared<std::vector<uint32_t>>();
+		};
+
+		uint32_t allocateSlot(Slots& slots, const char* kind);
+		void releaseSlot(Slots& slots, uint32_t index);
+		void createWhiteTexture(NNLayoutCache& layoutCache);
+
+		NNDevice& m_Device;
+		std::shared_ptr<NNDescriptorSetLayout> m_SetLayout;
+		VkDescriptorPool m_Pool = VK_NULL_HANDLE;
+		VkDescriptorSet m_Set = VK_NULL_HANDLE;
+		Slots m_Images;
+		Slots m_StorageBuffers;
+
+		VkImage m_WhiteImage = VK_NULL_HANDLE;
+		VkDeviceMemory m_WhiteMemory = VK_NULL_HANDLE;
+		VkImageView m_WhiteView = VK_NULL_HANDLE;
+	};
+}
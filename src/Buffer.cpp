@@ -1,5 +1,7 @@
 #include "Buffer.h"
 
+#include "RenderStats.h"
+
 #include <cassert>
 #include <cstring>
 
@@ -30,8 +32,8 @@ namespace NNuts {
 
     NNBuffer::~NNBuffer() {
         unmap();
-        vkDestroyBuffer(device.device(), buffer, nullptr);
-        vkFreeMemory(device.device(), memory, nullptr);
+        // Frames in flight may still read the buffer
+        device.getDeletionQueue().destroyBuffer(buffer, memory);
     }
 
     /**
@@ -74,11 +76,13 @@ namespace NNuts {
 
         if (size == VK_WHOLE_SIZE) {
             memcpy(mapped, data, bufferSize);
+            NNRenderStats::add(NNRenderStats::Counter::BytesUploaded, bufferSize);
         }
         else {
             char* memOffset = (char*)mapped;
             memOffset += offset;
             memcpy(memOffset, data, size);
+            NNRenderStats::add(NNRenderStats::Counter::BytesUploaded, size);
         }
     }
 
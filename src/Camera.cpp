@@ -14,6 +14,8 @@ namespace NNuts {
 		projectionMatrix[3][0] = -(right + left) / (right - left);
 		projectionMatrix[3][1] = -(bottom + top) / (bottom - top);
 		projectionMatrix[3][2] = -near / (far - near);
+		nearClip = near;
+		farClip = far;
 	}
 
 	void NNCamera::setPerespectiveProjection(float fovy, float aspect, float near, float far)
@@ -26,6 +28,8 @@ namespace NNuts {
 		projectionMatrix[2][2] = far / (far - near);
 		projectionMatrix[2][3] = 1.f;
 		projectionMatrix[3][2] = -(far * near) / (far - near);
+		nearClip = near;
+		farClip = far;
 	}
 
 	void NNCamera::setViewDirection(glm::vec3 position, glm::vec3 direction, glm::vec3 up) {
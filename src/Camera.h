@@ -19,9 +19,13 @@ namespace NNuts {
 
 		const glm::mat4& getProjection() const { return projectionMatrix; };
 		const glm::mat4& getView() const { return viewMatrix; };
+		float getNearClip() const { return nearClip; }
+		float getFarClip() const { return farClip; }
 
 	private:
 		glm::mat4 projectionMatrix{ 1.0f };
 		glm::mat4 viewMatrix{ 1.0f };
+		float nearClip{ 0.1f };
+		float farClip{ 10.0f };
 	};
 }
@@ -0,0 +1,147 @@
+#include "CameraPath.h"
+
+#include <glm/gtc/constants.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace NNuts {
+	namespace {
+		glm::vec3 catmullRom(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2, const glm::vec3& p3, float t)
+		{
+			float t2 = t * t;
+			float t3 = t2 * t;
+			return 0.5f * (2.0f * p1 + (p2 - p0) * t + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * t2 + (3.0f * p1 - p0 - 3.0f * p2 + p3) * t3);
+		}
+	}
+
+	void NNCameraPath::addKeyframe(float time, const glm::vec3& position, const glm::vec3& rotation)
+	{
+		if (!m_Keyframes.empty() && time < m_Keyframes.back().time) {
+			throw std::runtime_error("Camera path keyframes have to be added in time order!");
+		}
+
+		Keyframe keyframe{ time, position, rotation };
+		if (!m_Keyframes.empty()) {
+			float previousYaw = m_Keyframes.back().rotation.y;
+			keyframe.rotation.y -= glm::two_pi<float>() * std::round((keyframe.rotation.y - previousYaw) / glm::two_pi<float>());
+		}
+		m_Keyframes.push_back(keyframe);
+	}
+
+	NNCameraPath::Keyframe NNCameraPath::keyframe(int index) const
+	{
+		int last = static_cast<int>(m_Keyframes.size()) - 1;
+		if (index >= 0 && index <= last) {
+			return m_Keyframes[index];
+		}
+		if (!m_Looping || last == 0) {
+			return m_Keyframes[std::clamp(index, 0, last)];
+		}
+
+		// The last keyframe closes the loop, so one lap is last keyframes long
+		int laps = index < 0 ? -((-index + last - 1) / last) : index / last;
+		Keyframe result = m_Keyframes[index - laps * last];
+		result.position += static_cast<float>(laps) * (m_Keyframes[last].position - m_Keyframes[0].position);
+		result.rotation += static_cast<float>(laps) * (m_Keyframes[last].rotation - m_Keyframes[0].rotation);
+		return result;
+	}
+
+	void NNCameraPath::sample(float time, glm::vec3& position, glm::vec3& rotation) const
+	{
+		if (m_Keyframes.empty()) {
+			return;
+		}
+		if (m_Keyframes.size() == 1) {
+			position = m_Keyframes[0].position;
+			rotation = m_Keyframes[0].rotation;
+			return;
+		}
+
+		float start = m_Keyframes.front().time;
+		float duration = m_Keyframes.back().time - start;
+		time -= start;
+		if (m_Looping && duration > 0.0f) {
+			time = std::fmod(time, duration);
+			if (time < 0.0f) {
+				time += duration;
+			}
+		}
+		time = std::clamp(time, 0.0f, duration) + start;
+
+		auto next = std::upper_bound(
+			m_Keyframes.begin(), m_Keyframes.end(), time,
+			[](float t, const Keyframe& keyframe) { return t < keyframe.time; });
+		int segment = std::clamp(static_cast<int>(next - m_Keyframes.begin()) - 1, 0, static_cast<int>(m_Keyframes.size()) - 2);
+
+		Keyframe k0 = keyframe(segment - 1);
+		const Keyframe& k1 = m_Keyframes[segment];
+		const Keyframe& k2 = m_Keyframes[segment + 1];
+		Keyframe k3 = keyframe(segment + 2);
+
+		float length = k2.time - k1.time;
+		float t = length > 0.0f ? (time - k1.time) / length : 0.0f;
+		position = catmullRom(k0.position, k1.position, k2.position, k3.position, t);
+		rotation = catmullRom(k0.rotation, k1.rotation, k2.rotation, k3.rotation, t);
+	}
+
+	NNCameraPath NNCameraPath::loadFromFile(const std::string& filepath)
+	{
+		std::ifstream file{ filepath };
+		if (!file) {
+			throw std::runtime_error("Failed to open camera path " + filepath);
+		}
+
+		NNCameraPath path{};
+		std::string line;
+		while (std::getline(file, line)) {
+			if (line.empty() || line[0] == '#') {
+				continue;
+			}
+			std::istringstream stream{ line };
+			float time;
+			glm::vec3 position, rotation;
+			if (!(stream >> time >> position.x >> position.y >> position.z >> rotation.x >> rotation.y >> rotation.z)) {
+				throw std::runtime_error("Malformed camera path keyframe in " + filepath + ": " + line);
+			}
+			path.addKeyframe(time, position, rotation);
+		}
+		return path;
+	}
+
+	void NNCameraPath::saveToFile(const std::string& filepath) const
+	{
+		std::ofstream file{ filepath };
+		if (!file) {
+			throw std::runtime_error("Failed to open " + filepath + " for writing!");
+		}
+
+		file << "# time x y z pitch yaw roll\n";
+		for (auto& keyframe : m_Keyframes) {
+			file << keyframe.time << ' '
+				<< keyframe.position.x << ' ' << keyframe.position.y << ' ' << keyframe.position.z << ' '
+				<< keyframe.rotation.x << ' ' << keyframe.rotation.y << ' ' << keyframe.rotation.z << '\n';
+		}
+	}
+
+	NNCameraPath NNCameraPath::orbit(const glm::vec3& center, float radius, float height, float duration, uint32_t keyframeCount)
+	{
+		NNCameraPath path{};
+		keyframeCount = std::max(keyframeCount, 3u);
+		for (uint32_t i = 0; i <= keyframeCount; i++) {
+			float fraction = static_cast<float>(i) / keyframeCount;
+			float angle = fraction * glm::two_pi<float>();
+			glm::vec3 position = center + glm::vec3{ radius * glm::sin(angle), height, -radius * glm::cos(angle) };
+
+			// Inverse of the forward vector NNCamera::setViewYXZ builds from pitch and yaw
+			glm::vec3 forward = glm::normalize(center - position);
+			glm::vec3 rotation{ glm::asin(-forward.y), glm::atan(forward.x, forward.z), 0.0f };
+			path.addKeyframe(fraction * duration, position, rotation);
+		}
+		path.setLooping(true);
+		return path;
+	}
+}
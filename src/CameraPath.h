@@ -0,0 +1,48 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace NNuts {
+	// Scripted camera for reproducible runs. Keyframes hold a position and the yxz rotation used by
+	// NNCamera::setViewYXZ, sample() interpolates them with a Catmull-Rom spline.
+	class NNCameraPath {
+	public:
+		struct Keyframe {
+			float time = 0.0f;
+			glm::vec3 position{ 0.0f };
+			glm::vec3 rotation{ 0.0f };
+		};
+
+		// Keyframes have to be added in time order. Yaw is unwrapped against the previous keyframe, so
+		// recordings that wrap around 2 pi don't spin the long way round.
+		void addKeyframe(float time, const glm::vec3& position, const glm::vec3& rotation);
+		void sample(float time, glm::vec3& position, glm::vec3& rotation) const;
+
+		// Looping paths wrap time around the duration and close the spline back to the first keyframe
+		void setLooping(bool looping) { m_Looping = looping; }
+		bool isLooping() const { return m_Looping; }
+		bool empty() const { return m_Keyframes.empty(); }
+		float getDuration() const { return m_Keyframes.empty() ? 0.0f : m_Keyframes.back().time; }
+		const std::vector<Keyframe>& getKeyframes() const { return m_Keyframes; }
+
+		// Plain text, one "time x y z pitch yaw roll" keyframe per line, lines starting with # are skipped
+		static NNCameraPath loadFromFile(const std::string& filepath);
+		void saveToFile(const std::string& filepath) const;
+
+		// Looping circle around center at the given height (negative y is up), always facing the center
+		static NNCameraPath orbit(const glm::vec3& center, float radius, float height, float duration, uint32_t keyframeCount = 16);
+
+	private:
+		// Index outside of the path: clamped, or for looping paths wrapped with the offset of one lap
+		Keyframe keyframe(int index) const;
+
+		std::vector<Keyframe> m_Keyframes;
+		bool m_Looping = false;
+	};
+}
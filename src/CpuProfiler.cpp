@@ -0,0 +1,320 @@
+#include "CpuProfiler.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+namespace NNuts {
+	namespace {
+		// Upper bound of frames in flight, GPU results of the last captured frame arrive this much later
+		constexpr uint32_t GPU_LATENCY_FRAMES = 4;
+		// Chrome trace thread id of the GPU track, CPU threads start at 1
+		constexpr uint32_t GPU_TRACK = 0;
+
+		struct Event {
+			const char* name;
+			uint64_t begin;
+			uint64_t end;
+		};
+
+		// Single producer ring: only the owning thread writes, the main thread reads under the registry mutex.
+		// A full ring overwrites its oldest events, which the reader detects and drops.
+		struct ThreadBuffer {
+			static constexpr uint64_t CAPACITY = 1 << 14;
+
+			std::array<Event, CAPACITY> events{};
+			std::atomic<uint64_t> writeIndex{ 0 };
+			uint64_t readIndex = 0;
+			uint32_t trackId = 0;
+			bool inUse = false;
+			std::string threadName;
+		};
+
+		struct CapturedEvent {
+			std::string name;
+			uint64_t begin;
+			uint64_t end;
+			uint32_t trackId;
+		};
+
+		struct State {
+			std::mutex mutex;
+			// Buffers of finished threads go back to the pool, short lived workers don't grow it
+			std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+			std::atomic<bool> capturing{ false };
+			// Set from beginCapture until the file is written
+			std::atomic<bool> pending{ false };
+
+			std::string filepath;
+			bool started = false;
+			uint32_t framesLeft = 0;
+			uint32_t trailingFrames = 0;
+			uint64_t captureBegin = 0;
+			uint64_t captureEnd = ~0ull;
+			std::vector<uint64_t> frameMarks;
+			std::vector<CapturedEvent> events;
+			std::vector<std::pair<uint32_t, std::string>> trackNames;
+		};
+
+		State& state()
+		{
+			static State s;
+			return s;
+		}
+
+		ThreadBuffer* acquireBuffer()
+		{
+			State& s = state();
+			std::lock_guard<std::mutex> lock{ s.mutex };
+			auto it = std::find_if(s.buffers.begin(), s.buffers.end(), [](auto& buffer) { return !buffer->inUse; });
+			if (it == s.buffers.end()) {
+				it = s.buffers.insert(s.buffers.end(), std::make_unique<ThreadBuffer>());
+				(*it)->trackId = static_cast<uint32_t>(s.buffers.size());
+			}
+			(*it)->inUse = true;
+			(*it)->threadName = "thread " + std::to_string((*it)->trackId);
+			return it->get();
+		}
+
+		// Hands the buffer back when its thread exits, unread events are still drained
+		struct ThreadSlot {
+			ThreadBuffer* buffer = nullptr;
+
+			~ThreadSlot() {
+				if (buffer) {
+					std::lock_guard<std::mutex> lock{ state().mutex };
+					buffer->inUse = false;
+				}
+			}
+
+			ThreadBuffer& get() {
+				if (!buffer) {
+					buffer = acquireBuffer();
+				}
+				return *buffer;
+			}
+		};
+
+		thread_local ThreadSlot t_Slot;
+
+		// Expects the registry mutex to be held
+		void drain(State& s)
+		{
+			for (auto& buffer : s.buffers) {
+				uint64_t end = buffer->writeIndex.load(std::memory_order_acquire);
+				uint64_t begin = std::max(buffer->readIndex, end > ThreadBuffer::CAPACITY ? end - ThreadBuffer::CAPACITY : 0);
+				size_t firstNew = s.events.size();
+				for (uint64_t i = begin; i < end; i++) {
+					const Event& event = buffer->events[i % ThreadBuffer::CAPACITY];
+					s.events.push_back({ event.name, event.begin, event.end, buffer->trackId });
+				}
+
+				// Slots the owner wrapped around to while we copied (including the one it may be writing) are torn
+				uint64_t written = buffer->writeIndex.load(std::memory_order_acquire) + 1;
+				if (written > begin + ThreadBuffer::CAPACITY) {
+					uint64_t torn = std::min(written - ThreadBuffer::CAPACITY - begin, end - begin);
+					s.events.erase(s.events.begin() + firstNew, s.events.begin() + firstNew + torn);
+				}
+				buffer->readIndex = end;
+			}
+		}
+
+		std::string jsonString(const std::string& value)
+		{
+			std::string escaped = "\"";
+			for (char c : value) {
+				if (c == '"' || c == '\\') {
+					escaped += '\\';
+					escaped += c;
+				}
+				else if (static_cast<unsigned char>(c) < 0x20) {
+					escaped += ' ';
+				}
+				else {
+					escaped += c;
+				}
+			}
+			return escaped + "\"";
+		}
+
+		// Trace timestamps are microseconds relative to the start of the capture
+		std::string traceTime(uint64_t nanoseconds)
+		{
+			std::ostringstream stream;
+			stream.setf(std::ios::fixed);
+			stream.precision(3);
+			stream << nanoseconds / 1000.0;
+			return stream.str();
+		}
+
+		// Expects the registry mutex to be held
+		void writeTrace(State& s)
+		{
+			std::ofstream file{ s.filepath };
+			if (!file) {
+				std::cerr << "Failed to open " << s.filepath << " for writing, dropping CPU trace" << std::endl;
+			}
+			else {
+				std::vector<std::string> entries;
+				entries.push_back("{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " + std::to_string(GPU_TRACK)
+					+ ", \"args\": {\"name\": \"GPU\"}}");
+				for (auto& [trackId, name] : s.trackNames) {
+					entries.push_back("{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " + std::to_string(trackId)
+						+ ", \"args\": {\"name\": " + jsonString(name) + "}}");
+				}
+				for (size_t i = 0; i < s.frameMarks.size(); i++) {
+					entries.push_back("{\"name\": \"frame " + std::to_string(i) + "\", \"ph\": \"i\", \"s\": \"g\", \"pid\": 1, \"tid\": 1, \"ts\": "
+						+ traceTime(s.frameMarks[i] - s.captureBegin) + "}");
+				}
+				for (auto& event : s.events) {
+					if (event.begin < s.captureBegin || event.begin >= s.captureEnd) {
+						continue;
+					}
+					entries.push_back("{\"name\": " + jsonString(event.name) + ", \"cat\": \""
+						+ (event.trackId == GPU_TRACK ? "gpu" : "cpu") + "\", \"ph\": \"X\", \"pid\": 1, \"tid\": "
+						+ std::to_string(event.trackId) + ", \"ts\": " + traceTime(event.begin - s.captureBegin)
+						+ ", \"dur\": " + traceTime(event.end - event.begin) + "}");
+				}
+
+				file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+				for (size_t i = 0; i < entries.size(); i++) {
+					file << "  " << entries[i] << (i + 1 < entries.size() ? ",\n" : "\n");
+				}
+				file << "]}\n";
+				std::cout << "Wrote " << s.frameMarks.size() << " frame trace to " << s.filepath << std::endl;
+			}
+
+			s.pending.store(false);
+			s.capturing.store(false);
+			s.started = false;
+			s.events.clear();
+			s.frameMarks.clear();
+			s.trackNames.clear();
+		}
+	}
+
+	uint64_t NNCpuProfiler::now()
+	{
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count());
+	}
+
+	void NNCpuProfiler::setThreadName(const std::string& name)
+	{
+		ThreadBuffer& buffer = t_Slot.get();
+		std::lock_guard<std::mutex> lock{ state().mutex };
+		buffer.threadName = name;
+	}
+
+	void NNCpuProfiler::beginCapture(uint32_t frameCount, const std::string& filepath)
+	{
+		State& s = state();
+		std::lock_guard<std::mutex> lock{ s.mutex };
+		if (s.pending.load() || frameCount == 0) {
+			return;
+		}
+		s.filepath = filepath;
+		s.framesLeft = frameCount;
+		s.started = false;
+		s.pending.store(true);
+	}
+
+	void NNCpuProfiler::endCapture()
+	{
+		State& s = state();
+		std::lock_guard<std::mutex> lock{ s.mutex };
+		if (!s.pending.load()) {
+			return;
+		}
+		if (s.started) {
+			drain(s);
+			if (s.capturing.load()) {
+				s.captureEnd = now();
+				for (auto& buffer : s.buffers) {
+					s.trackNames.emplace_back(buffer->trackId, buffer->threadName);
+				}
+			}
+		}
+		writeTrace(s);
+	}
+
+	bool NNCpuProfiler::isCapturing()
+	{
+		return state().capturing.load(std::memory_order_relaxed);
+	}
+
+	void NNCpuProfiler::markFrame()
+	{
+		State& s = state();
+		if (!s.pending.load(std::memory_order_relaxed)) {
+			return;
+		}
+
+		uint64_t time = now();
+		std::lock_guard<std::mutex> lock{ s.mutex };
+		if (!s.started) {
+			// Nothing was recorded yet, only skip what threads wrote before
+			for (auto& buffer : s.buffers) {
+				buffer->readIndex = buffer->writeIndex.load(std::memory_order_acquire);
+			}
+			s.started = true;
+			s.captureBegin = time;
+			s.captureEnd = ~0ull;
+			s.frameMarks.push_back(time);
+			s.capturing.store(true);
+			return;
+		}
+
+		drain(s);
+		if (s.capturing.load()) {
+			if (--s.framesLeft > 0) {
+				s.frameMarks.push_back(time);
+				return;
+			}
+			s.capturing.store(false);
+			s.captureEnd = time;
+			s.trailingFrames = GPU_LATENCY_FRAMES;
+			for (auto& buffer : s.buffers) {
+				s.trackNames.emplace_back(buffer->trackId, buffer->threadName);
+			}
+			return;
+		}
+
+		if (--s.trailingFrames == 0) {
+			writeTrace(s);
+		}
+	}
+
+	void NNCpuProfiler::addGpuEvent(const std::string& name, uint64_t begin, uint64_t end)
+	{
+		State& s = state();
+		if (!s.pending.load(std::memory_order_relaxed)) {
+			return;
+		}
+		std::lock_guard<std::mutex> lock{ s.mutex };
+		if (s.started) {
+			s.events.push_back({ name, begin, end, GPU_TRACK });
+		}
+	}
+
+	uint64_t NNCpuProfiler::begin()
+	{
+		t_Slot.get();
+		return now();
+	}
+
+	void NNCpuProfiler::record(const char* name, uint64_t begin, uint64_t end)
+	{
+		ThreadBuffer& buffer = t_Slot.get();
+		uint64_t index = buffer.writeIndex.load(std::memory_order_relaxed);
+		buffer.events[index % ThreadBuffer::CAPACITY] = { name, begin, end };
+		buffer.writeIndex.store(index + 1, std::memory_order_release);
+	}
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Scoped CPU timers. Build with NN_ENABLE_PROFILING=0 to compile every scope out.
+#ifndef NN_ENABLE_PROFILING
+#define NN_ENABLE_PROFILING 1
+#endif
+
+#if NN_ENABLE_PROFILING
+#define NN_PROFILE_CONCAT_INNER(a, b) a##b
+#define NN_PROFILE_CONCAT(a, b) NN_PROFILE_CONCAT_INNER(a, b)
+// name has to outlive the capture, i.e. be a string literal
+#define NN_PROFILE_SCOPE(name) ::NNuts::NNCpuProfiler::Scope NN_PROFILE_CONCAT(nnProfileScope, __LINE__){ name }
+#define NN_PROFILE_FUNCTION() NN_PROFILE_SCOPE(__func__)
+#else
+#define NN_PROFILE_SCOPE(name) ((void)0)
+#define NN_PROFILE_FUNCTION() ((void)0)
+#endif
+
+namespace NNuts {
+	// Every thread writes finished scopes into its own ring buffer, the main thread drains them once
+	// per frame while a capture runs. Outside of a capture a scope costs one relaxed atomic load.
+	// Captures are written as Chrome trace JSON (chrome://tracing, ui.perfetto.dev).
+	class NNCpuProfiler {
+	public:
+		class Scope {
+		public:
+			explicit Scope(const char* name) : m_Name{ name }, m_Begin{ isCapturing() ? begin() : 0 } {}
+			~Scope() {
+				if (m_Begin != 0) {
+					record(m_Name, m_Begin, now());
+				}
+			}
+
+			Scope(const Scope&) = delete;
+			Scope& operator=(const Scope&) = delete;
+
+		private:
+			const char* m_Name;
+			uint64_t m_Begin;
+		};
+
+		// Nanoseconds on the steady clock, the time base of every event including GPU ones
+		static uint64_t now();
+		static void setThreadName(const std::string& name);
+
+		// Records the next frameCount frames and writes them to filepath once they are done. GPU events
+		// trail the CPU by the frames in flight, so the file is only written a few frames later.
+		static void beginCapture(uint32_t frameCount, const std::string& filepath);
+		// Writes what was captured so far, for runs that end in the middle of a capture
+		static void endCapture();
+		static bool isCapturing();
+
+		// Call once per frame from the main thread, before anything of the new frame is recorded
+		static void markFrame();
+		static void addGpuEvent(const std::string& name, uint64_t begin, uint64_t end);
+
+	private:
+		// Claims the thread's buffer up front, so a scope stays on the track of the thread it started on
+		static uint64_t begin();
+		static void record(const char* name, uint64_t begin, uint64_t end);
+	};
+}
@@ -0,0 +1,197 @@
+#include "DeferredRenderSystem.h"
+
+#include "CpuProfiler.h"
+#include "RenderStats.h"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <stdexcept>
+#include <cassert>
+#include <array>
+
+namespace NNuts {
+	// constant_id values declared in DeferredLighting.frag
+	enum DeferredLightingConstants : uint32_t {
+		DEFERRED_LIGHTING_AMBIENT = 0,
+	};
+
+	// Same block as BasicShader.vert, which the geometry pass reuses
+	struct DeferredPushConstantData {
+		glm::mat4 modelMatrix{ 1.0f };
+		glm::mat4 normalMatrix{ 1.0f };
+	};
+
+	DeferredRenderSystem::DeferredRenderSystem(
+		NNDevice &device,
+		NNShaderCompiler &shaderCompiler,
+		NNLayoutCache &layoutCache,
+		VkRenderPass renderPass,
+		VkDescriptorSetLayout globalSetLayout) :
+		m_Device{ device }, m_ShaderCompiler{ shaderCompiler }, m_LayoutCache{ layoutCache }
+	{
+		createGeometryLayout(globalSetLayout);
+		createGeometryPipeline(renderPass);
+		createLightingLayout(globalSetLayout);
+		createLightingPipeline(renderPass);
+	}
+
+	DeferredRenderSystem::~DeferredRenderSystem()
+	{
+	}
+
+	void DeferredRenderSystem::setRenderPass(VkRenderPass renderPass)
+	{
+		createGeometryPipeline(renderPass);
+		createLightingPipeline(renderPass);
+	}
+
+	void DeferredRenderSystem::createGeometryLayout(VkDescriptorSetLayout globalSetLayout)
+	{
+		m_GeometryReflection
+			.addStage(VK_SHADER_STAGE_VERTEX_BIT, m_ShaderCompiler.getSpirv("res/Shaders/BasicShader.vert"))
+			.addStage(VK_SHADER_STAGE_FRAGMENT_BIT, m_ShaderCompiler.getSpirv("res/Shaders/GBuffer.frag"));
+
+		m_GeometryLayout = m_LayoutCache.getPipelineLayout(m_GeometryReflection, { {0, globalSetLayout} });
+		m_PushConstantStages = m_GeometryReflection.getPushConstantStages(0, sizeof(DeferredPushConstantData));
+	}
+
+	void DeferredRenderSystem::createGeometryPipeline(VkRenderPass renderPass)
+	{
+		auto& vertCode = m_ShaderCompiler.getSpirv("res/Shaders/BasicShader.vert");
+		auto& fragCode = m_ShaderCompiler.getSpirv("res/Shaders/GBuffer.frag");
+		VkPipelineLayout pipelineLayout = m_GeometryLayout;
+		const NNShaderReflection* reflection = &m_GeometryReflection;
+		m_GeometryPipelines = std::make_unique<NNPipelineVariantCache>(
+			m_Device,
+			vertCode,
+			fragCode,
+			[renderPass, pipelineLayout, reflection](PipelineConfigInfo& pipelineConfig) {
+				pipelineConfig.renderPass = renderPass;
+				pipelineConfig.pipelineLayout = pipelineLayout;
+				pipelineConfig.subpass = NNSwapChain::GBUFFER_SUBPASS;
+				pipelineConfig.colorAttachmentCount = 2;
+				pipelineConfig.attributeDescriptions = reflection->filterVertexAttributes(pipelineConfig.attributeDescriptions);
+			}
+		);
+		m_GeometryPipeline = &m_GeometryPipelines->getVariant({});
+	}
+
+	void DeferredRenderSystem::createLightingLayout(VkDescriptorSetLayout globalSetLayout)
+	{
+		m_LightingReflection
+			.addStage(VK_SHADER_STAGE_VERTEX_BIT, m_ShaderCompiler.getSpirv("res/Shaders/Fullscreen.vert"))
+			.addStage(VK_SHADER_STAGE_FRAGMENT_BIT, m_ShaderCompiler.getSpirv("res/Shaders/DeferredLighting.frag"));
+
+		// Set 1 (the input attachments) comes straight from reflection
+		m_LightingLayout = m_LayoutCache.getPipelineLayout(m_LightingReflection, { {0, globalSetLayout} });
+		m_GBufferSetLayout = m_LayoutCache.getDescriptorSetLayout(m_LightingReflection.getSetBindings(1));
+	}
+
+	void DeferredRenderSystem::createLightingPipeline(VkRenderPass renderPass)
+	{
+		auto& vertCode = m_ShaderCompiler.getSpirv("res/Shaders/Fullscreen.vert");
+		auto& fragCode = m_ShaderCompiler.getSpirv("res/Shaders/DeferredLighting.frag");
+		VkPipelineLayout pipelineLayout = m_LightingLayout;
+		m_LightingPipelines = std::make_unique<NNPipelineVariantCache>(
+			m_Device,
+			vertCode,
+			fragCode,
+			[renderPass, pipelineLayout](PipelineConfigInfo& pipelineConfig) {
+				pipelineConfig.renderPass = renderPass;
+				pipelineConfig.pipelineLayout = pipelineLayout;
+				pipelineConfig.subpass = NNSwapChain::LIGHTING_SUBPASS;
+				pipelineConfig.bindingDescriptions.clear();
+				pipelineConfig.attributeDescriptions.clear();
+				pipelineConfig.depthStencilInfo.depthTestEnable = VK_FALSE;
+				pipelineConfig.depthStencilInfo.depthWriteEnable = VK_FALSE;
+			}
+		);
+
+		SpecializationMap constants{};
+		constants[VK_SHADER_STAGE_FRAGMENT_BIT].set(DEFERRED_LIGHTING_AMBIENT, 0.02f);
+		m_LightingPipeline = &m_LightingPipelines->getVariant(constants);
+	}
+
+	void DeferredRenderSystem::setGBuffer(const std::vector<NNSwapChain::GBufferViews>& views)
+	{
+		// The old pool's sets may still be bound by frames in flight, its destruction is deferred
+		uint32_t setCount = static_cast<uint32_t>(views.size());
+		m_GBufferPool =
+			NNDescriptorPool::Builder(m_Device)
+			.setMaxSets(setCount)
+			.addPoolSize(VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 3 * setCount)
+			.build();
+		m_GBufferSets.resize(views.size());
+		for (size_t i = 0; i < views.size(); i++) {
+			VkDescriptorImageInfo albedoInfo{ VK_NULL_HANDLE, views[i].albedo, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+			VkDescriptorImageInfo normalInfo{ VK_NULL_HANDLE, views[i].normal, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+			VkDescriptorImageInfo depthInfo{ VK_NULL_HANDLE, views[i].depth, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL };
+			NNDescriptorWriter(*m_GBufferSetLayout, *m_GBufferPool)
+				.writeImage(0, &albedoInfo)
+				.writeImage(1, &normalInfo)
+				.writeImage(2, &depthInfo)
+				.build(m_GBufferSets[i]);
+		}
+	}
+
+	void DeferredRenderSystem::renderGeometry(
+			FrameInfo& frameInfo,
+			NNWorld& world,
+			const NNTransformHierarchy& transforms)
+	{
+		NN_PROFILE_FUNCTION();
+		m_GeometryPipeline->bind(frameInfo.commandBuffer);
+
+		vkCmdBindDescriptorSets(
+			frameInfo.commandBuffer,
+			VK_PIPELINE_BIND_POINT_GRAPHICS,
+			m_GeometryLayout,
+			0, 1,
+			&frameInfo.globalDescriptorSet,
+			0, nullptr
+		);
+		NNRenderStats::add(NNRenderStats::Counter::DescriptorSetBinds);
+
+		world.each<TransformNode, RenderComponent>([&](TransformNode& node, RenderComponent& render) {
+			DeferredPushConstantData push{};
+			push.modelMatrix = transforms.getWorldMatrix(node.id);
+			push.normalMatrix = transforms.getNormalMatrix(node.id);
+
+			vkCmdPushConstants(
+				frameInfo.commandBuffer,
+				m_GeometryLayout,
+				m_PushConstantStages,
+				0,
+				sizeof(DeferredPushConstantData),
+				&push);
+			NNRenderStats::add(NNRenderStats::Counter::PushConstantBytes, sizeof(DeferredPushConstantData));
+			render.model->bind(frameInfo.commandBuffer);
+			render.model->draw(frameInfo.commandBuffer);
+		});
+	}
+
+	void DeferredRenderSystem::renderLighting(FrameInfo& frameInfo, uint32_t imageIndex)
+	{
+		assert(imageIndex < m_GBufferSets.size() && "setGBuffer has to be called before renderLighting!");
+		NN_PROFILE_FUNCTION();
+
+		m_LightingPipeline->bind(frameInfo.commandBuffer);
+
+		std::array<VkDescriptorSet, 2> sets{ frameInfo.globalDescriptorSet, m_GBufferSets[imageIndex] };
+		vkCmdBindDescriptorSets(
+			frameInfo.commandBuffer,
+			VK_PIPELINE_BIND_POINT_GRAPHICS,
+			m_LightingLayout,
+			0, static_cast<uint32_t>(sets.size()),
+			sets.data(),
+			0, nullptr
+		);
+		NNRenderStats::add(NNRenderStats::Counter::DescriptorSetBinds);
+
+		vkCmdDraw(frameInfo.commandBuffer, 3, 1, 0, 0);
+		NNRenderStats::add(NNRenderStats::Counter::DrawCalls);
+		NNRenderStats::add(NNRenderStats::Counter::Triangles);
+	}
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "Camera.h"
+#include "Descriptor.h"
+#include "LayoutCache.h"
+#include "Pipeline.h"
+#include "PipelineVariants.h"
+#include "ShaderCompiler.h"
+#include "ShaderReflection.h"
+#include "SwapChain.h"
+#include "Device.h"
+#include "GameObject.h"
+#include "TransformHierarchy.h"
+#include "World.h"
+#include "FrameInfo.h"
+
+#include <memory>
+#include <vector>
+
+namespace NNuts {
+	// Deferred path for the two-subpass render pass of RenderPath::Deferred. renderGeometry fills the
+	// G-buffer in the first subpass, renderLighting shades every covered pixel once in the second.
+	class DeferredRenderSystem {
+	public:
+		DeferredRenderSystem(
+			NNDevice &device,
+			NNShaderCompiler &shaderCompiler,
+			NNLayoutCache &layoutCache,
+			VkRenderPass renderPass,
+			VkDescriptorSetLayout globalSetLayout);
+		~DeferredRenderSystem();
+
+		DeferredRenderSystem(const DeferredRenderSystem&) = delete;
+		DeferredRenderSystem& operator=(const DeferredRenderSystem&) = delete;
+
+		// Has to be called again whenever the swap chain (and with it the G-buffer) is recreated
+		void setGBuffer(const std::vector<NNSwapChain::GBufferViews>& views);
+		// Rebuilds the pipelines for a render pass with different attachment formats
+		void setRenderPass(VkRenderPass renderPass);
+
+		// Draws every entity with a TransformNode and a RenderComponent, transforms has to be updated
+		void renderGeometry(
+			FrameInfo &frameInfo,
+			NNWorld &world,
+			const NNTransformHierarchy &transforms);
+		void renderLighting(FrameInfo &frameInfo, uint32_t imageIndex);
+
+	private:
+		void createGeometryLayout(VkDescriptorSetLayout globalSetLayout);
+		void createGeometryPipeline(VkRenderPass renderPass);
+		void createLightingLayout(VkDescriptorSetLayout globalSetLayout);
+		void createLightingPipeline(VkRenderPass renderPass);
+
+		NNDevice &m_Device;
+		NNShaderCompiler &m_ShaderCompiler;
+		NNLayoutCache &m_LayoutCache;
+
+		NNShaderReflection m_GeometryReflection;
+		std::unique_ptr<NNPipelineVariantCache> m_GeometryPipelines;
+		NNPipeline* m_GeometryPipeline = nullptr;
+		VkPipelineLayout m_GeometryLayout = VK_NULL_HANDLE;
+		VkShaderStageFlags m_PushConstantStages = 0;
+
+		NNShaderReflection m_LightingReflection;
+		std::unique_ptr<NNPipelineVariantCache> m_LightingPipelines;
+		NNPipeline* m_LightingPipeline = nullptr;
+		VkPipelineLayout m_LightingLayout = VK_NULL_HANDLE;
+
+		std::shared_ptr<NNDescriptorSetLayout> m_GBufferSetLayout;
+		std::unique_ptr<NNDescriptorPool> m_GBufferPool;
+		std::vector<VkDescriptorSet> m_GBufferSets;
+	};
+}
@@ -0,0 +1,144 @@
+#include "DeletionQueue.h"
+
+#include "HostMemory.h"
+
+namespace NNuts {
+	namespace {
+		// Non-dispatchable handles are 64 bit on every platform, pointers or not
+		template <typename T>
+		uint64_t toBits(T handle) { return (uint64_t)handle; }
+
+		template <typename T>
+		T fromBits(uint64_t bits) { return (T)bits; }
+	}
+
+	NNDeletionQueue::NNDeletionQueue(VkDevice device)
+		: m_Device{ device }, m_Handles(INITIAL_HANDLE_CAPACITY)
+	{
+	}
+
+	NNDeletionQueue::~NNDeletionQueue()
+	{
+		flush();
+	}
+
+	void NNDeletionQueue::destroyBuffer(VkBuffer buffer, VkDeviceMemory memory)
+	{
+		pushHandles(Type::Buffer, toBits(buffer), toBits(memory));
+	}
+
+	void NNDeletionQueue::destroyImage(VkImage image, VkImageView view, VkDeviceMemory memory)
+	{
+		pushHandles(Type::Image, toBits(image), toBits(view), toBits(memory));
+	}
+
+	void NNDeletionQueue::destroyDescriptorPool(VkDescriptorPool pool)
+	{
+		pushHandles(Type::DescriptorPool, toBits(pool));
+	}
+
+	void NNDeletionQueue::destroyPipeline(VkPipeline pipeline)
+	{
+		pushHandles(Type::Pipeline, toBits(pipeline));
+	}
+
+	void NNDeletionQueue::destroyFramebuffer(VkFramebuffer framebuffer)
+	{
+		pushHandles(Type::Framebuffer, toBits(framebuffer));
+	}
+
+	void NNDeletionQueue::freeMemory(VkDeviceMemory memory)
+	{
+		pushHandles(Type::Memory, toBits(memory));
+	}
+
+	void NNDeletionQueue::freeCommandBuffer(VkCommandPool pool, VkCommandBuffer commandBuffer)
+	{
+		pushHandles(Type::CommandBuffer, toBits(pool), toBits(commandBuffer));
+	}
+
+	void NNDeletionQueue::push(std::function<void()> destroy)
+	{
+		m_Callbacks.push_back({ m_PendingFrame, std::move(destroy) });
+	}
+
+	void NNDeletionQueue::pushHandles(Type type, uint64_t first, uint64_t second, uint64_t third)
+	{
+		if (m_HandleCount == m_Handles.size()) {
+			// Unroll the ring into a twice as large one
+			std::vector<HandleEntry> grown(2 * m_Handles.size());
+			for (size_t i = 0; i < m_HandleCount; i++) {
+				grown[i] = m_Handles[(m_HandleHead + i) % m_Handles.size()];
+			}
+			m_Handles = std::move(grown);
+			m_HandleHead = 0;
+		}
+		m_Handles[(m_HandleHead + m_HandleCount) % m_Handles.size()] = { m_PendingFrame, type, { first, second, third } };
+		m_HandleCount++;
+	}
+
+	void NNDeletionQueue::collect(uint64_t completedFrames)
+	{
+		while (releaseNext(completedFrames)) {
+		}
+	}
+
+	void NNDeletionQueue::flush()
+	{
+		while (releaseNext(UINT64_MAX)) {
+		}
+	}
+
+	bool NNDeletionQueue::releaseNext(uint64_t completedFrames)
+	{
+		bool handleDue = m_HandleCount > 0 && m_Handles[m_HandleHead].frame <= completedFrames;
+		bool callbackDue = !m_Callbacks.empty() && m_Callbacks.front().frame <= completedFrames;
+		if (handleDue && (!callbackDue || m_Handles[m_HandleHead].frame <= m_Callbacks.front().frame)) {
+			HandleEntry entry = m_Handles[m_HandleHead];
+			m_HandleHead = (m_HandleHead + 1) % m_Handles.size();
+			m_HandleCount--;
+			release(entry);
+			return true;
+		}
+		if (callbackDue) {
+			// Pop first, a callback is allowed to push follow-up entries
+			std::function<void()> destroy = std::move(m_Callbacks.front().destroy);
+			m_Callbacks.pop_front();
+			destroy();
+			return true;
+		}
+		return false;
+	}
+
+	void NNDeletionQueue::release(const HandleEntry& entry)
+	{
+		switch (entry.type) {
+		case Type::Buffer:
+			vkDestroyBuffer(m_Device, fromBits<VkBuffer>(entry.handles[0]), NNHostMemory::callbacks(NNHostMemory::Tag::Buffer));
+			vkFreeMemory(m_Device, fromBits<VkDeviceMemory>(entry.handles[1]), NNHostMemory::callbacks(NNHostMemory::Tag::DeviceMemory));
+			break;
+		case Type::Image:
+			vkDestroyImageView(m_Device, fromBits<VkImageView>(entry.handles[1]), NNHostMemory::callbacks(NNHostMemory::Tag::ImageView));
+			vkDestroyImage(m_Device, fromBits<VkImage>(entry.handles[0]), NNHostMemory::callbacks(NNHostMemory::Tag::Image));
+			vkFreeMemory(m_Device, fromBits<VkDeviceMemory>(entry.handles[2]), NNHostMemory::callbacks(NNHostMemory::Tag::DeviceMemory));
+			break;
+		case Type::DescriptorPool:
+			vkDestroyDescriptorPool(m_Device, fromBits<VkDescriptorPool>(entry.handles[0]), NNHostMemory::callbacks(NNHostMemory::Tag::DescriptorPool));
+			break;
+		case Type::Pipeline:
+			vkDestroyPipeline(m_Device, fromBits<VkPipeline>(entry.handles[0]), NNHostMemory::callbacks(NNHostMemory::Tag::Pipeline));
+			break;
+		case Type::Framebuffer:
+			vkDestroyFramebuffer(m_Device, fromBits<VkFramebuffer>(entry.handles[0]), NNHostMemory::callbacks(NNHostMemory::Tag::Framebuffer));
+			break;
+		case Type::Memory:
+			vkFreeMemory(m_Device, fromBits<VkDeviceMemory>(entry.handles[0]), NNHostMemory::callbacks(NNHostMemory::Tag::DeviceMemory));
+			break;
+		case Type::CommandBuffer: {
+			VkCommandBuffer commandBuffer = fromBits<VkCommandBuffer>(entry.handles[1]);
+			vkFreeCommandBuffers(m_Device, fromBits<VkCommandPool>(entry.handles[0]), 1, &commandBuffer);
+			break;
+		}
+		}
+	}
+}
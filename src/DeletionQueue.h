@@ -0,0 +1,77 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <vector>
+
+namespace NNuts {
+	// Engine wide deferred destruction. Owners hand their Vulkan handles over instead of destroying
+	// them, and they are only released once every frame that could still reference them has finished
+	// on the GPU. Entries are keyed by the frame timeline value that has to be reached and come out
+	// in frame order, handles before callbacks of the same frame. The renderer drains the queue in
+	// beginFrame.
+	class NNDeletionQueue {
+	public:
+		explicit NNDeletionQueue(VkDevice device);
+		~NNDeletionQueue();
+
+		NNDeletionQueue(const NNDeletionQueue&) = delete;
+		NNDeletionQueue& operator=(const NNDeletionQueue&) = delete;
+
+		// Anything pushed from now on is released once `frame` frames have completed. The renderer
+		// keeps this one past the last submitted frame, which also covers work submitted in between.
+		void setPendingFrame(uint64_t frame) { m_PendingFrame = frame; }
+		uint64_t getPendingFrame() const { return m_PendingFrame; }
+
+		// Handles pushed here go into a preallocated ring and don't allocate until it has to grow
+		void destroyBuffer(VkBuffer buffer, VkDeviceMemory memory);
+		void destroyImage(VkImage image, VkImageView view, VkDeviceMemory memory);
+		void destroyDescriptorPool(VkDescriptorPool pool);
+		void destroyPipeline(VkPipeline pipeline);
+		void destroyFramebuffer(VkFramebuffer framebuffer);
+		void freeMemory(VkDeviceMemory memory);
+		void freeCommandBuffer(VkCommandPool pool, VkCommandBuffer commandBuffer);
+		// Anything else, e.g. the last reference to an object that owns several handles. Kept in a
+		// separate list, which allocates, so keep it out of per frame paths.
+		void push(std::function<void()> destroy);
+
+		// Releases every entry that was waiting for at most completedFrames frames
+		void collect(uint64_t completedFrames);
+		// Releases everything, the caller guarantees the device is idle
+		void flush();
+
+		size_t size() const { return m_HandleCount + m_Callbacks.size(); }
+
+	private:
+		enum class Type { Buffer, Image, DescriptorPool, Pipeline, Framebuffer, Memory, CommandBuffer };
+
+		struct HandleEntry {
+			uint64_t frame;
+			Type type;
+			uint64_t handles[3];
+		};
+
+		struct CallbackEntry {
+			uint64_t frame;
+			std::function<void()> destroy;
+		};
+
+		void pushHandles(Type type, uint64_t first, uint64_t second = 0, uint64_t third = 0);
+		// Releases the oldest entry of either list, false when neither has one due by completedFrames
+		bool releaseNext(uint64_t completedFrames);
+		void release(const HandleEntry& entry);
+
+		static constexpr size_t INITIAL_HANDLE_CAPACITY = 256;
+
+		VkDevice m_Device;
+		uint64_t m_PendingFrame = 1;
+		// Ring buffer, both lists are sorted by frame since the pending frame only grows
+		std::vector<HandleEntry> m_Handles;
+		size_t m_HandleHead = 0;
+		size_t m_HandleCount = 0;
+		std::deque<CallbackEntry> m_Callbacks;
+	};
+}
@@ -1,56 +1,165 @@
 #include "Descriptor.h"
 
+#include "HostMemory.h"
+#include "LayoutCache.h"
+
+#include <algorithm>
 #include <cassert>
 #include <stdexcept>
 
 namespace NNuts {
+    namespace {
+        // One slot of the data an update template reads, every binding type uses the same stride
+        union DescriptorData {
+            VkDescriptorImageInfo image;
+            VkDescriptorBufferInfo buffer;
+            VkBufferView texelBufferView;
+        };
+
+        bool hasTemplateData(VkDescriptorType type) {
+            switch (type) {
+            case VK_DESCRIPTOR_TYPE_SAMPLER:
+            case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
+            case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
+            case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
+            case VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT:
+            case VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER:
+            case VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER:
+            case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+            case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+            case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC:
+            case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC:
+                return true;
+            default:
+                return false;
+            }
+        }
+    }
+
     // *************** Descriptor Set Layout Builder *********************
 
     NNDescriptorSetLayout::Builder& NNDescriptorSetLayout::Builder::addBinding(
         uint32_t binding,
         VkDescriptorType descriptorType,
         VkShaderStageFlags stageFlags,
-        uint32_t count) {
-        assert(m_Bindings.count(binding) == 0 && "Binding already in use");
+        uint32_t count,
+        VkDescriptorBindingFlags bindingFlags) {
+        auto it = std::lower_bound(m_Bindings.begin(), m_Bindings.end(), binding, [](const auto& a, uint32_t b) {
+            return a.binding < b;
+        });
+        assert((it == m_Bindings.end() || it->binding != binding) && "Binding already in use");
         VkDescriptorSetLayoutBinding layoutBinding{};
         layoutBinding.binding = binding;
         layoutBinding.descriptorType = descriptorType;
         layoutBinding.descriptorCount = count;
         layoutBinding.stageFlags = stageFlags;
-        m_Bindings[binding] = layoutBinding;
+        m_BindingFlags.insert(m_BindingFlags.begin() + (it - m_Bindings.begin()), bindingFlags);
+        m_Bindings.insert(it, layoutBinding);
+        return *this;
+    }
+
+    NNDescriptorSetLayout::Builder& NNDescriptorSetLayout::Builder::setFlags(VkDescriptorSetLayoutCreateFlags flags) {
+        m_Flags = flags;
         return *this;
     }
 
     std::unique_ptr<NNDescriptorSetLayout> NNDescriptorSetLayout::Builder::build() const {
-        return std::make_unique<NNDescriptorSetLayout>(m_Device, m_Bindings);
+        return std::make_unique<NNDescriptorSetLayout>(m_Device, m_Bindings, m_Flags, m_BindingFlags);
+    }
+
+    std::shared_ptr<NNDescriptorSetLayout> NNDescriptorSetLayout::Builder::build(NNLayoutCache& cache) const {
+        return cache.getDescriptorSetLayout(m_Bindings, m_Flags, m_BindingFlags);
     }
 
     // *************** Descriptor Set Layout *********************
 
     NNDescriptorSetLayout::NNDescriptorSetLayout(
-        NNDevice& device, std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> bindings)
-        : m_Device{ device }, m_Bindings{ bindings } {
-        std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings{};
-        for (auto& kv : bindings) {
-            setLayoutBindings.push_back(kv.second);
-        }
+        NNDevice& device,
+        std::vector<VkDescriptorSetLayoutBinding> bindings,
+        VkDescriptorSetLayoutCreateFlags flags,
+        const std::vector<VkDescriptorBindingFlags>& bindingFlags)
+        : m_Device{ device }, m_Bindings{ std::move(bindings) } {
+        assert(std::is_sorted(m_Bindings.begin(), m_Bindings.end(), [](const auto& a, const auto& b) {
+            return a.binding < b.binding;
+        }) && "Bindings have to be sorted");
+        assert((bindingFlags.empty() || bindingFlags.size() == m_Bindings.size()) && "One set of flags per binding");
 
         VkDescriptorSetLayoutCreateInfo m_DescriptorSetLayoutInfo{};
         m_DescriptorSetLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-        m_DescriptorSetLayoutInfo.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
-        m_DescriptorSetLayoutInfo.pBindings = setLayoutBindings.data();
+        m_DescriptorSetLayoutInfo.flags = flags;
+        m_DescriptorSetLayoutInfo.bindingCount = static_cast<uint32_t>(m_Bindings.size());
+        m_DescriptorSetLayoutInfo.pBindings = m_Bindings.data();
+
+        VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo{};
+        bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+        bindingFlagsInfo.bindingCount = static_cast<uint32_t>(bindingFlags.size());
+        bindingFlagsInfo.pBindingFlags = bindingFlags.data();
+        if (std::any_of(bindingFlags.begin(), bindingFlags.end(), [](auto bindingFlag) { return bindingFlag != 0; })) {
+            m_DescriptorSetLayoutInfo.pNext = &bindingFlagsInfo;
+        }
 
         if (vkCreateDescriptorSetLayout(
             m_Device.device(),
             &m_DescriptorSetLayoutInfo,
-            nullptr,
+            NNHostMemory::callbacks(NNHostMemory::Tag::DescriptorSetLayout),
             &m_DescriptorSetLayout) != VK_SUCCESS) {
             throw std::runtime_error("failed to create descriptor set layout!");
         }
+        createUpdateTemplate();
+    }
+
+    void NNDescriptorSetLayout::createUpdateTemplate() {
+        if (m_Bindings.empty() || !std::all_of(m_Bindings.begin(), m_Bindings.end(), [](const auto& binding) {
+            return hasTemplateData(binding.descriptorType);
+        })) {
+            return;
+        }
+
+        std::vector<VkDescriptorUpdateTemplateEntry> entries{};
+        for (auto& binding : m_Bindings) {
+            VkDescriptorUpdateTemplateEntry entry{};
+            entry.dstBinding = binding.binding;
+            entry.descriptorCount = binding.descriptorCount;
+            entry.descriptorType = binding.descriptorType;
+            entry.offset = m_TemplateSlotCount * sizeof(DescriptorData);
+            entry.stride = sizeof(DescriptorData);
+            entries.push_back(entry);
+
+            m_TemplateSlots.push_back(m_TemplateSlotCount);
+            m_TemplateSlotCount += binding.descriptorCount;
+        }
+
+        VkDescriptorUpdateTemplateCreateInfo templateInfo{};
+        templateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO;
+        templateInfo.descriptorUpdateEntryCount = static_cast<uint32_t>(entries.size());
+        templateInfo.pDescriptorUpdateEntries = entries.data();
+        templateInfo.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+        templateInfo.descriptorSetLayout = m_DescriptorSetLayout;
+
+        if (vkCreateDescriptorUpdateTemplate(
+            m_Device.device(),
+            &templateInfo,
+            NNHostMemory::callbacks(NNHostMemory::Tag::DescriptorUpdateTemplate),
+            &m_UpdateTemplate) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create descriptor update template!");
+        }
+    }
+
+    int32_t NNDescriptorSetLayout::findBinding(uint32_t binding) const {
+        auto it = std::lower_bound(m_Bindings.begin(), m_Bindings.end(), binding, [](const auto& a, uint32_t b) {
+            return a.binding < b;
+        });
+        if (it == m_Bindings.end() || it->binding != binding) {
+            return -1;
+        }
+        return static_cast<int32_t>(it - m_Bindings.begin());
     }
 
     NNDescriptorSetLayout::~NNDescriptorSetLayout() {
-        vkDestroyDescriptorSetLayout(m_Device.device(), m_DescriptorSetLayout, nullptr);
+        if (m_UpdateTemplate != VK_NULL_HANDLE) {
+            vkDestroyDescriptorUpdateTemplate(m_Device.device(), m_UpdateTemplate, NNHostMemory::callbacks(NNHostMemory::Tag::DescriptorUpdateTemplate));
+        }
+        vkDestroyDescriptorSetLayout(m_Device.device(), m_DescriptorSetLayout, NNHostMemory::callbacks(NNHostMemory::Tag::DescriptorSetLayout));
     }
 
     // *************** Descriptor Pool Builder *********************
@@ -90,14 +199,15 @@ namespace NNuts {
         descriptorPoolInfo.maxSets = maxSets;
         descriptorPoolInfo.flags = poolFlags;
 
-        if (vkCreateDescriptorPool(m_Device.device(), &descriptorPoolInfo, nullptr, &m_DescriptorPool) !=
+        if (vkCreateDescriptorPool(m_Device.device(), &descriptorPoolInfo, NNHostMemory::callbacks(NNHostMemory::Tag::DescriptorPool), &m_DescriptorPool) !=
             VK_SUCCESS) {
             throw std::runtime_error("failed to create descriptor pool!");
         }
     }
 
     NNDescriptorPool::~NNDescriptorPool() {
-        vkDestroyDescriptorPool(m_Device.device(), m_DescriptorPool, nullptr);
+        // Sets from this pool may still be bound by frames in flight
+        m_Device.getDeletionQueue().destroyDescriptorPool(m_DescriptorPool);
     }
 
     bool NNDescriptorPool::allocateDescriptorSet(
@@ -108,8 +218,6 @@ namespace NNuts {
         allocInfo.pSetLayouts = &m_DescriptorSetLayout;
         allocInfo.descriptorSetCount = 1;
 
-        // Might want to create a "DescriptorPoolManager" class that handles this case, and builds
-        // a new pool whenever an old pool fills up. But this is beyond our current scope
         if (vkAllocateDescriptorSets(m_Device.device(), &allocInfo, &descriptor) != VK_SUCCESS) {
             return false;
         }
@@ -128,16 +236,100 @@ namespace NNuts {
         vkResetDescriptorPool(m_Device.device(), m_DescriptorPool, 0);
     }
 
+    // *************** Descriptor Allocator *********************
+
+    NNDescriptorAllocator::NNDescriptorAllocator(
+        NNDevice& device, uint32_t setsPerPool, std::vector<PoolSizeRatio> ratios)
+        : m_Device{ device }, m_Ratios{ std::move(ratios) }, m_SetsPerPool{ setsPerPool } {}
+
+    NNDescriptorAllocator::~NNDescriptorAllocator() {
+        for (auto pool : m_UsedPools) {
+            m_Device.getDeletionQueue().destroyDescriptorPool(pool);
+        }
+        for (auto pool : m_FreePools) {
+            m_Device.getDeletionQueue().destroyDescriptorPool(pool);
+        }
+    }
+
+    bool NNDescriptorAllocator::allocate(
+        const VkDescriptorSetLayout descriptorSetLayout, VkDescriptorSet& descriptor) {
+        if (m_CurrentPool == VK_NULL_HANDLE) {
+            m_CurrentPool = grabPool();
+        }
+
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = m_CurrentPool;
+        allocInfo.pSetLayouts = &descriptorSetLayout;
+        allocInfo.descriptorSetCount = 1;
+
+        VkResult result = vkAllocateDescriptorSets(m_Device.device(), &allocInfo, &descriptor);
+        if (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL) {
+            m_CurrentPool = grabPool();
+            allocInfo.descriptorPool = m_CurrentPool;
+            result = vkAllocateDescriptorSets(m_Device.device(), &allocInfo, &descriptor);
+        }
+        return result == VK_SUCCESS;
+    }
+
+    void NNDescriptorAllocator::resetPools() {
+        for (auto pool : m_UsedPools) {
+            vkResetDescriptorPool(m_Device.device(), pool, 0);
+            m_FreePools.push_back(pool);
+        }
+        m_UsedPools.clear();
+        m_CurrentPool = VK_NULL_HANDLE;
+    }
+
+    VkDescriptorPool NNDescriptorAllocator::grabPool() {
+        VkDescriptorPool pool;
+        if (!m_FreePools.empty()) {
+            pool = m_FreePools.back();
+            m_FreePools.pop_back();
+        }
+        else {
+            std::vector<VkDescriptorPoolSize> poolSizes{};
+            for (auto& ratio : m_Ratios) {
+                poolSizes.push_back({
+                    ratio.descriptorType,
+                    std::max(1u, static_cast<uint32_t>(ratio.ratio * m_SetsPerPool)) });
+            }
+
+            VkDescriptorPoolCreateInfo descriptorPoolInfo{};
+            descriptorPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+            descriptorPoolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+            descriptorPoolInfo.pPoolSizes = poolSizes.data();
+            descriptorPoolInfo.maxSets = m_SetsPerPool;
+
+            if (vkCreateDescriptorPool(m_Device.device(), &descriptorPoolInfo, NNHostMemory::callbacks(NNHostMemory::Tag::DescriptorPool), &pool) !=
+                VK_SUCCESS) {
+                throw std::runtime_error("failed to create descriptor pool!");
+            }
+            m_SetsPerPool = std::min(m_SetsPerPool * 2, MAX_SETS_PER_POOL);
+        }
+        m_UsedPools.push_back(pool);
+        return pool;
+    }
+
     // *************** Descriptor Writer *********************
 
-    NNDescriptorWriter::NNDescriptorWriter(NNDescriptorSetLayout& setLayout, NNDescriptorPool& pool)
-        : m_SetLayout{ setLayout }, m_Pool{ pool } {}
+    NNDescriptorWriter::NNDescriptorWriter(
+        NNDescriptorSetLayout& setLayout, NNDescriptorPool& pool, std::pmr::memory_resource* allocator)
+        : m_SetLayout{ setLayout }, m_Pool{ &pool }, m_Writes{ allocator } {}
+
+    NNDescriptorWriter::NNDescriptorWriter(
+        NNDescriptorSetLayout& setLayout, NNDescriptorAllocator& descriptorAllocator, std::pmr::memory_resource* allocator)
+        : m_SetLayout{ setLayout }, m_DescriptorAllocator{ &descriptorAllocator }, m_Writes{ allocator } {}
 
     NNDescriptorWriter& NNDescriptorWriter::writeBuffer(
         uint32_t binding, VkDescriptorBufferInfo* bufferInfo) {
-        assert(m_SetLayout.m_Bindings.count(binding) == 1 && "Layout does not contain specified binding");
+        int32_t index = m_SetLayout.findBinding(binding);
+        assert(index >= 0 && "Layout does not contain specified binding");
+        assert(
+            std::none_of(m_Writes.begin(), m_Writes.end(), [binding](const auto& write) { return write.dstBinding == binding; }) &&
+            "Binding already written");
 
-        auto& bindingDescription = m_SetLayout.m_Bindings[binding];
+        auto& bindingDescription = m_SetLayout.m_Bindings[index];
 
         assert(
             bindingDescription.descriptorCount == 1 &&
@@ -156,9 +348,13 @@ namespace NNuts {
 
     NNDescriptorWriter& NNDescriptorWriter::writeImage(
         uint32_t binding, VkDescriptorImageInfo* imageInfo) {
-        assert(m_SetLayout.m_Bindings.count(binding) == 1 && "Layout does not contain specified binding");
+        int32_t index = m_SetLayout.findBinding(binding);
+        assert(index >= 0 && "Layout does not contain specified binding");
+        assert(
+            std::none_of(m_Writes.begin(), m_Writes.end(), [binding](const auto& write) { return write.dstBinding == binding; }) &&
+            "Binding already written");
 
-        auto& bindingDescription = m_SetLayout.m_Bindings[binding];
+        auto& bindingDescription = m_SetLayout.m_Bindings[index];
 
         assert(
             bindingDescription.descriptorCount == 1 &&
@@ -176,7 +372,9 @@ namespace NNuts {
     }
 
     bool NNDescriptorWriter::build(VkDescriptorSet& set) {
-        bool success = m_Pool.allocateDescriptorSet(m_SetLayout.getDescriptorSetLayout(), set);
+        bool success = m_DescriptorAllocator != nullptr
+            ? m_DescriptorAllocator->allocate(m_SetLayout.getDescriptorSetLayout(), set)
+            : m_Pool->allocateDescriptorSet(m_SetLayout.getDescriptorSetLayout(), set);
         if (!success) {
             return false;
         }
@@ -185,9 +383,25 @@ namespace NNuts {
     }
 
     void NNDescriptorWriter::overwrite(VkDescriptorSet& set) {
+        VkDevice device = m_SetLayout.m_Device.device();
+        if (m_SetLayout.m_UpdateTemplate != VK_NULL_HANDLE && m_Writes.size() == m_SetLayout.m_Bindings.size()) {
+            std::pmr::vector<DescriptorData> data(m_SetLayout.m_TemplateSlotCount, m_Writes.get_allocator().resource());
+            for (auto& write : m_Writes) {
+                DescriptorData& slot = data[m_SetLayout.m_TemplateSlots[m_SetLayout.findBinding(write.dstBinding)]];
+                if (write.pBufferInfo != nullptr) {
+                    slot.buffer = *write.pBufferInfo;
+                }
+                else {
+                    slot.image = *write.pImageInfo;
+                }
+            }
+            vkUpdateDescriptorSetWithTemplate(device, set, m_SetLayout.m_UpdateTemplate, data.data());
+            return;
+        }
+
         for (auto& write : m_Writes) {
             write.dstSet = set;
         }
-        vkUpdateDescriptorSets(m_Pool.m_Device.device(), m_Writes.size(), m_Writes.data(), 0, nullptr);
+        vkUpdateDescriptorSets(device, m_Writes.size(), m_Writes.data(), 0, nullptr);
     }
 }
\ No newline at end of file
@@ -4,11 +4,13 @@
 
 // std
 #include <memory>
-#include <unordered_map>
+#include <memory_resource>
 #include <vector>
 
 namespace NNuts {
 
+    class NNLayoutCache;
+
     class NNDescriptorSetLayout {
     public:
         class Builder {
@@ -19,26 +21,49 @@ namespace NNuts {
                 uint32_t binding,
                 VkDescriptorType descriptorType,
                 VkShaderStageFlags stageFlags,
-                uint32_t count = 1);
+                uint32_t count = 1,
+                VkDescriptorBindingFlags bindingFlags = 0);
+            Builder& setFlags(VkDescriptorSetLayoutCreateFlags flags);
             std::unique_ptr<NNDescriptorSetLayout> build() const;
+            // Returns the cache's layout for this description, creating it only the first time
+            std::shared_ptr<NNDescriptorSetLayout> build(NNLayoutCache& cache) const;
 
         private:
             NNDevice& m_Device;
-            std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> m_Bindings{};
+            // Sorted by binding, with the flags of each binding alongside
+            std::vector<VkDescriptorSetLayoutBinding> m_Bindings{};
+            std::vector<VkDescriptorBindingFlags> m_BindingFlags{};
+            VkDescriptorSetLayoutCreateFlags m_Flags = 0;
         };
 
+        // bindings have to be sorted by binding, bindingFlags is either empty or one entry per binding
         NNDescriptorSetLayout(
-            NNDevice& device, std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> bindings);
+            NNDevice& device,
+            std::vector<VkDescriptorSetLayoutBinding> bindings,
+            VkDescriptorSetLayoutCreateFlags flags = 0,
+            const std::vector<VkDescriptorBindingFlags>& bindingFlags = {});
         ~NNDescriptorSetLayout();
         NNDescriptorSetLayout(const NNDescriptorSetLayout&) = delete;
         NNDescriptorSetLayout& operator=(const NNDescriptorSetLayout&) = delete;
 
         VkDescriptorSetLayout getDescriptorSetLayout() const { return m_DescriptorSetLayout; }
+        // Updates every binding of a set in one call, VK_NULL_HANDLE for empty layouts and
+        // descriptor types without a plain info struct
+        VkDescriptorUpdateTemplate getUpdateTemplate() const { return m_UpdateTemplate; }
+        const std::vector<VkDescriptorSetLayoutBinding>& getBindings() const { return m_Bindings; }
 
     private:
+        void createUpdateTemplate();
+        // Index into m_Bindings, -1 when the layout doesn't have the binding
+        int32_t findBinding(uint32_t binding) const;
+
         NNDevice& m_Device;
         VkDescriptorSetLayout m_DescriptorSetLayout;
-        std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> m_Bindings;
+        std::vector<VkDescriptorSetLayoutBinding> m_Bindings;
+        VkDescriptorUpdateTemplate m_UpdateTemplate = VK_NULL_HANDLE;
+        // First template slot of each entry in m_Bindings
+        std::vector<uint32_t> m_TemplateSlots;
+        uint32_t m_TemplateSlotCount = 0;
 
         friend class NNDescriptorWriter;
     };
@@ -70,6 +95,7 @@ namespace NNuts {
         NNDescriptorPool(const NNDescriptorPool&) = delete;
         NNDescriptorPool& operator=(const NNDescriptorPool&) = delete;
 
+        // Fails once the pool is full, NNDescriptorAllocator chains pools instead
         bool allocateDescriptorSet(
             const VkDescriptorSetLayout descriptorSetLayout, VkDescriptorSet& descriptor) const;
 
@@ -84,20 +110,73 @@ namespace NNuts {
         friend class NNDescriptorWriter;
     };
 
+    // Hands out sets from a chain of pools, a new pool is added whenever the current one runs out.
+    // Sets can't be freed one by one, resetPools returns all of them at once, which is meant for
+    // sets that are allocated fresh every frame.
+    class NNDescriptorAllocator {
+    public:
+        struct PoolSizeRatio {
+            VkDescriptorType descriptorType;
+            // Descriptors of this type per set
+            float ratio;
+        };
+
+        NNDescriptorAllocator(
+            NNDevice& device,
+            uint32_t setsPerPool = 64,
+            std::vector<PoolSizeRatio> ratios = {
+                { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1.0f },
+                { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3.0f },
+                { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2.0f },
+                { VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 1.0f } });
+        ~NNDescriptorAllocator();
+        NNDescriptorAllocator(const NNDescriptorAllocator&) = delete;
+        NNDescriptorAllocator& operator=(const NNDescriptorAllocator&) = delete;
+
+        bool allocate(const VkDescriptorSetLayout descriptorSetLayout, VkDescriptorSet& descriptor);
+        // Every set allocated so far becomes invalid, the GPU has to be done with them
+        void resetPools();
+
+        size_t getPoolCount() const { return m_UsedPools.size() + m_FreePools.size(); }
+
+    private:
+        VkDescriptorPool grabPool();
+
+        NNDevice& m_Device;
+        std::vector<PoolSizeRatio> m_Ratios;
+        // Each new pool is twice the size of the previous one, up to MAX_SETS_PER_POOL
+        uint32_t m_SetsPerPool;
+        VkDescriptorPool m_CurrentPool = VK_NULL_HANDLE;
+        std::vector<VkDescriptorPool> m_UsedPools;
+        std::vector<VkDescriptorPool> m_FreePools;
+
+        static constexpr uint32_t MAX_SETS_PER_POOL = 4096;
+    };
+
     class NNDescriptorWriter {
     public:
-        NNDescriptorWriter(NNDescriptorSetLayout& setLayout, NNDescriptorPool& pool);
+        // Pass the frame allocator when the writer is built and thrown away during a frame
+        NNDescriptorWriter(
+            NNDescriptorSetLayout& setLayout,
+            NNDescriptorPool& pool,
+            std::pmr::memory_resource* allocator = std::pmr::get_default_resource());
+        NNDescriptorWriter(
+            NNDescriptorSetLayout& setLayout,
+            NNDescriptorAllocator& descriptorAllocator,
+            std::pmr::memory_resource* allocator = std::pmr::get_default_resource());
 
         NNDescriptorWriter& writeBuffer(uint32_t binding, VkDescriptorBufferInfo* bufferInfo);
         NNDescriptorWriter& writeImage(uint32_t binding, VkDescriptorImageInfo* imageInfo);
 
         bool build(VkDescriptorSet& set);
+        // Goes through the layout's update template when every binding was written
         void overwrite(VkDescriptorSet& set);
 
     private:
         NNDescriptorSetLayout& m_SetLayout;
-        NNDescriptorPool& m_Pool;
-        std::vector<VkWriteDescriptorSet> m_Writes;
+        NNDescriptorPool* m_Pool = nullptr;
+        NNDescriptorAllocator* m_DescriptorAllocator = nullptr;
+        std::pmr::vector<VkWriteDescriptorSet> m_Writes;
     };
 
 }
\ No newline at end of file
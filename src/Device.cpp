@@ -1,5 +1,8 @@
 #include "Device.h"
 
+#include "HostMemory.h"
+#include "RenderStats.h"
+
 // std headers
 #include <cstring>
 #include <iostream>
@@ -54,18 +57,25 @@ NNDevice::NNDevice(NNWindow &window) : window{window} {
   pickPhysicalDevice();
   createLogicalDevice();
   createCommandPool();
+  deletionQueue_ = std::make_unique<NNDeletionQueue>(device_);
 }
 
 NNDevice::~NNDevice() {
-  vkDestroyCommandPool(device_, commandPool, nullptr);
-  vkDestroyDevice(device_, nullptr);
+  // Whatever is still queued goes before the device does
+  vkDeviceWaitIdle(device_);
+  deletionQueue_.reset();
+
+  vkDestroyCommandPool(device_, commandPool, NNHostMemory::callbacks(NNHostMemory::Tag::CommandPool));
+  vkDestroyDevice(device_, NNHostMemory::callbacks(NNHostMemory::Tag::Device));
 
   if (enableValidationLayers) {
     DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
   }
 
-  vkDestroySurfaceKHR(instance, surface_, nullptr);
-  vkDestroyInstance(instance, nullptr);
+  if (surface_ != VK_NULL_HANDLE) {
+    vkDestroySurfaceKHR(instance, surface_, nullptr);
+  }
+  vkDestroyInstance(instance, NNHostMemory::callbacks(NNHostMemory::Tag::Instance));
 }
 
 void NNDevice::createInstance() {
@@ -79,7 +89,7 @@ void NNDevice::createInstance() {
   appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
   appInfo.pEngineName = "No Engine";
   appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-  appInfo.apiVersion = VK_API_VERSION_1_0;
+  appInfo.apiVersion = VK_API_VERSION_1_2;
 
   VkInstanceCreateInfo createInfo = {};
   createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -101,7 +111,7 @@ void NNDevice::createInstance() {
     createInfo.pNext = nullptr;
   }
 
-  if (vkCreateInstance(&createInfo, nullptr, &instance) != VK_SUCCESS) {
+  if (vkCreateInstance(&createInfo, NNHostMemory::callbacks(NNHostMemory::Tag::Instance), &instance) != VK_SUCCESS) {
     throw std::runtime_error("failed to create instance!");
   }
 
@@ -149,18 +159,76 @@ void NNDevice::createLogicalDevice() {
     queueCreateInfos.push_back(queueCreateInfo);
   }
 
+  VkPhysicalDeviceFeatures supportedFeatures;
+  vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+
   VkPhysicalDeviceFeatures deviceFeatures = {};
   deviceFeatures.samplerAnisotropy = VK_TRUE;
+  // Optional, only the GPU profiler uses it
+  deviceFeatures.pipelineStatisticsQuery = supportedFeatures.pipelineStatisticsQuery;
+  enabledFeatures = deviceFeatures;
+
+  // Optional, the bindless table needs partially bound, update after bind arrays
+  VkPhysicalDeviceDescriptorIndexingFeatures supportedIndexing = {};
+  supportedIndexing.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+  VkPhysicalDeviceFeatures2 supportedFeatures2 = {};
+  supportedFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+  supportedFeatures2.pNext = &supportedIndexing;
+  vkGetPhysicalDeviceFeatures2(physicalDevice, &supportedFeatures2);
+  descriptorIndexingSupported_ = supportedIndexing.runtimeDescriptorArray &&
+                                 supportedIndexing.descriptorBindingPartiallyBound &&
+                                 supportedIndexing.descriptorBindingSampledImageUpdateAfterBind &&
+                                 supportedIndexing.descriptorBindingStorageBufferUpdateAfterBind &&
+                                 supportedIndexing.descriptorBindingUpdateUnusedWhilePending;
+
+  VkPhysicalDeviceDescriptorIndexingFeatures indexingFeatures = {};
+  indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+  if (descriptorIndexingSupported_) {
+    indexingFeatures.runtimeDescriptorArray = VK_TRUE;
+    indexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+    indexingFeatures.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+    indexingFeatures.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+    indexingFeatures.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+
+    descriptorIndexingProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES;
+    VkPhysicalDeviceProperties2 properties2 = {};
+    properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties2.pNext = &descriptorIndexingProperties;
+    vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+    descriptorIndexingProperties.pNext = nullptr;
+  }
+
+  VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures = {};
+  timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+  timelineFeatures.timelineSemaphore = VK_TRUE;
+  timelineFeatures.pNext = descriptorIndexingSupported_ ? &indexingFeatures : nullptr;
 
   VkDeviceCreateInfo createInfo = {};
   createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+  createInfo.pNext = &timelineFeatures;
 
   createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
   createInfo.pQueueCreateInfos = queueCreateInfos.data();
 
   createInfo.pEnabledFeatures = &deviceFeatures;
-  createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-  createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+  auto enabledExtensions = getRequiredDeviceExtensions();
+  // Optional, only feeds the memory statistics
+  uint32_t extensionCount = 0;
+  vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+  std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+  vkEnumerateDeviceExtensionProperties(
+      physicalDevice,
+      nullptr,
+      &extensionCount,
+      availableExtensions.data());
+  for (const auto &extension : availableExtensions) {
+    if (std::strcmp(extension.extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0) {
+      enabledExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+      memoryBudgetSupported_ = true;
+    }
+  }
+  createInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size());
+  createInfo.ppEnabledExtensionNames = enabledExtensions.data();
 
   // might not really be necessary anymore because device specific validation layers
   // have been deprecated
@@ -171,7 +239,7 @@ void NNDevice::createLogicalDevice() {
     createInfo.enabledLayerCount = 0;
   }
 
-  if (vkCreateDevice(physicalDevice, &createInfo, nullptr, &device_) != VK_SUCCESS) {
+  if (vkCreateDevice(physicalDevice, &createInfo, NNHostMemory::callbacks(NNHostMemory::Tag::Device), &device_) != VK_SUCCESS) {
     throw std::runtime_error("failed to create logical device!");
   }
 
@@ -188,20 +256,24 @@ void NNDevice::createCommandPool() {
   poolInfo.flags =
       VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 
-  if (vkCreateCommandPool(device_, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
+  if (vkCreateCommandPool(device_, &poolInfo, NNHostMemory::callbacks(NNHostMemory::Tag::CommandPool), &commandPool) != VK_SUCCESS) {
     throw std::runtime_error("failed to create command pool!");
   }
 }
 
-void NNDevice::createSurface() { window.createWindowSurface(instance, &surface_); }
+void NNDevice::createSurface() {
+  if (!isHeadless()) {
+    window.createWindowSurface(instance, &surface_);
+  }
+}
 
 bool NNDevice::isDeviceSuitable(VkPhysicalDevice device) {
   QueueFamilyIndices indices = findQueueFamilies(device);
 
   bool extensionsSupported = checkDeviceExtensionSupport(device);
 
-  bool swapChainAdequate = false;
-  if (extensionsSupported) {
+  bool swapChainAdequate = isHeadless();
+  if (extensionsSupported && !isHeadless()) {
     SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
     swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
   }
@@ -209,8 +281,22 @@ bool NNDevice::isDeviceSuitable(VkPhysicalDevice device) {
   VkPhysicalDeviceFeatures supportedFeatures;
   vkGetPhysicalDeviceFeatures(device, &supportedFeatures);
 
+  // Frame pacing runs on a timeline semaphore, core since Vulkan 1.2
+  VkPhysicalDeviceProperties deviceProperties;
+  vkGetPhysicalDeviceProperties(device, &deviceProperties);
+  bool timelineSemaphoreSupported = false;
+  if (deviceProperties.apiVersion >= VK_API_VERSION_1_2) {
+    VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures{};
+    timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+    VkPhysicalDeviceFeatures2 features2{};
+    features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features2.pNext = &timelineFeatures;
+    vkGetPhysicalDeviceFeatures2(device, &features2);
+    timelineSemaphoreSupported = timelineFeatures.timelineSemaphore;
+  }
+
   return indices.isComplete() && extensionsSupported && swapChainAdequate &&
-         supportedFeatures.samplerAnisotropy;
+         supportedFeatures.samplerAnisotropy && timelineSemaphoreSupported;
 }
 
 void NNDevice::populateDebugMessengerCreateInfo(
@@ -261,11 +347,14 @@ bool NNDevice::checkValidationLayerSupport() {
 }
 
 std::vector<const char *> NNDevice::getRequiredExtensions() {
-  uint32_t glfwExtensionCount = 0;
-  const char **glfwExtensions;
-  glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-
-  std::vector<const char *> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+  // Headless runs need no surface extensions, which also keeps GLFW uninitialized
+  std::vector<const char *> extensions;
+  if (!isHeadless()) {
+    uint32_t glfwExtensionCount = 0;
+    const char **glfwExtensions;
+    glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+    extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+  }
 
   if (enableValidationLayers) {
     extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
@@ -308,6 +397,7 @@ bool NNDevice::checkDeviceExtensionSupport(VkPhysicalDevice device) {
       &extensionCount,
       availableExtensions.data());
 
+  auto deviceExtensions = getRequiredDeviceExtensions();
   std::set<std::string> requiredExtensions(deviceExtensions.begin(), deviceExtensions.end());
 
   for (const auto &extension : availableExtensions) {
@@ -317,6 +407,13 @@ bool NNDevice::checkDeviceExtensionSupport(VkPhysicalDevice device) {
   return requiredExtensions.empty();
 }
 
+std::vector<const char *> NNDevice::getRequiredDeviceExtensions() const {
+  if (isHeadless()) {
+    return {};
+  }
+  return deviceExtensions;
+}
+
 QueueFamilyIndices NNDevice::findQueueFamilies(VkPhysicalDevice device) {
   QueueFamilyIndices indices;
 
@@ -333,7 +430,11 @@ QueueFamilyIndices NNDevice::findQueueFamilies(VkPhysicalDevice device) {
       indices.graphicsFamilyHasValue = true;
     }
     VkBool32 presentSupport = false;
-    vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface_, &presentSupport);
+    if (isHeadless()) {
+      presentSupport = indices.graphicsFamilyHasValue && indices.graphicsFamily == static_cast<uint32_t>(i);
+    } else {
+      vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface_, &presentSupport);
+    }
     if (queueFamily.queueCount > 0 && presentSupport) {
       indices.presentFamily = i;
       indices.presentFamilyHasValue = true;
@@ -415,7 +516,7 @@ void NNDevice::createBuffer(
   bufferInfo.usage = usage;
   bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-  if (vkCreateBuffer(device_, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
+  if (vkCreateBuffer(device_, &bufferInfo, NNHostMemory::callbacks(NNHostMemory::Tag::Buffer), &buffer) != VK_SUCCESS) {
     throw std::runtime_error("failed to create vertex buffer!");
   }
 
@@ -427,13 +528,36 @@ void NNDevice::createBuffer(
   allocInfo.allocationSize = memRequirements.size;
   allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
 
-  if (vkAllocateMemory(device_, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
+  if (vkAllocateMemory(device_, &allocInfo, NNHostMemory::callbacks(NNHostMemory::Tag::DeviceMemory), &bufferMemory) != VK_SUCCESS) {
     throw std::runtime_error("failed to allocate vertex buffer memory!");
   }
+  NNRenderStats::add(NNRenderStats::Counter::DeviceAllocations);
+  NNRenderStats::add(NNRenderStats::Counter::DeviceBytesAllocated, allocInfo.allocationSize);
 
   vkBindBufferMemory(device_, buffer, bufferMemory, 0);
 }
 
+VkDeviceSize NNDevice::getDeviceMemoryUsage() const {
+  if (!memoryBudgetSupported_) {
+    return 0;
+  }
+
+  VkPhysicalDeviceMemoryBudgetPropertiesEXT budget{};
+  budget.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+  VkPhysicalDeviceMemoryProperties2 memProperties{};
+  memProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+  memProperties.pNext = &budget;
+  vkGetPhysicalDeviceMemoryProperties2(physicalDevice, &memProperties);
+
+  VkDeviceSize usage = 0;
+  for (uint32_t i = 0; i < memProperties.memoryProperties.memoryHeapCount; i++) {
+    if (memProperties.memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+      usage += budget.heapUsage[i];
+    }
+  }
+  return usage;
+}
+
 VkCommandBuffer NNDevice::beginSingleTimeCommands() {
   VkCommandBufferAllocateInfo allocInfo{};
   allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -453,6 +577,22 @@ VkCommandBuffer NNDevice::beginSingleTimeCommands() {
 }
 
 void NNDevice::endSingleTimeCommands(VkCommandBuffer commandBuffer) {
+  // Make the transfer visible to everything submitted after it on the queue
+  VkMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+  vkCmdPipelineBarrier(
+      commandBuffer,
+      VK_PIPELINE_STAGE_TRANSFER_BIT,
+      VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+      0,
+      1,
+      &barrier,
+      0,
+      nullptr,
+      0,
+      nullptr);
   vkEndCommandBuffer(commandBuffer);
 
   VkSubmitInfo submitInfo{};
@@ -461,9 +601,11 @@ void NNDevice::endSingleTimeCommands(VkCommandBuffer commandBuffer) {
   submitInfo.pCommandBuffers = &commandBuffer;
 
   vkQueueSubmit(graphicsQueue_, 1, &submitInfo, VK_NULL_HANDLE);
-  vkQueueWaitIdle(graphicsQueue_);
 
-  vkFreeCommandBuffers(device_, commandPool, 1, &commandBuffer);
+  // No queue idle: the upload is ordered before the next frame on the same queue, so the frame
+  // timeline covers its completion and the command buffer (like the staging buffer) goes through
+  // the deletion queue
+  deletionQueue_->freeCommandBuffer(commandPool, commandBuffer);
 }
 
 void NNDevice::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
@@ -510,25 +652,49 @@ void NNDevice::createImageWithInfo(
     VkMemoryPropertyFlags properties,
     VkImage &image,
     VkDeviceMemory &imageMemory) {
-  if (vkCreateImage(device_, &imageInfo, nullptr, &image) != VK_SUCCESS) {
+  createImageWithInfo(imageInfo, properties, properties, image, imageMemory);
+}
+
+bool NNDevice::createImageWithInfo(
+    const VkImageCreateInfo &imageInfo,
+    VkMemoryPropertyFlags preferred,
+    VkMemoryPropertyFlags fallback,
+    VkImage &image,
+    VkDeviceMemory &imageMemory) {
+  if (vkCreateImage(device_, &imageInfo, NNHostMemory::callbacks(NNHostMemory::Tag::Image), &image) != VK_SUCCESS) {
     throw std::runtime_error("failed to create image!");
   }
 
   VkMemoryRequirements memRequirements;
   vkGetImageMemoryRequirements(device_, image, &memRequirements);
 
+  VkPhysicalDeviceMemoryProperties memProperties;
+  vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+  bool usePreferred = false;
+  for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
+    if ((memRequirements.memoryTypeBits & (1 << i)) &&
+        (memProperties.memoryTypes[i].propertyFlags & preferred) == preferred) {
+      usePreferred = true;
+      break;
+    }
+  }
+
   VkMemoryAllocateInfo allocInfo{};
   allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
   allocInfo.allocationSize = memRequirements.size;
-  allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
+  allocInfo.memoryTypeIndex =
+      findMemoryType(memRequirements.memoryTypeBits, usePreferred ? preferred : fallback);
 
-  if (vkAllocateMemory(device_, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) {
+  if (vkAllocateMemory(device_, &allocInfo, NNHostMemory::callbacks(NNHostMemory::Tag::DeviceMemory), &imageMemory) != VK_SUCCESS) {
     throw std::runtime_error("failed to allocate image memory!");
   }
+  NNRenderStats::add(NNRenderStats::Counter::DeviceAllocations);
+  NNRenderStats::add(NNRenderStats::Counter::DeviceBytesAllocated, allocInfo.allocationSize);
 
   if (vkBindImageMemory(device_, image, imageMemory, 0) != VK_SUCCESS) {
     throw std::runtime_error("failed to bind image memory!");
   }
+  return usePreferred;
 }
 
 }  // namespace NNuts
\ No newline at end of file
@@ -1,8 +1,10 @@
 #pragma once
 
+#include "DeletionQueue.h"
 #include "Window.h"
 
 // std lib headers
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -40,11 +42,18 @@ class NNDevice {
   NNDevice &operator=(NNDevice &&) = delete;
 
   VkCommandPool getCommandPool() { return commandPool; }
+  VkPhysicalDevice getPhysicalDevice() { return physicalDevice; }
   VkDevice device() { return device_; }
+  // Headless devices have no surface and no swap chain extension, the present queue is the
+  // graphics queue
+  bool isHeadless() const { return window.isHeadless(); }
   VkSurfaceKHR surface() { return surface_; }
   VkQueue graphicsQueue() { return graphicsQueue_; }
   VkQueue presentQueue() { return presentQueue_; }
 
+  // Destroy GPU resources through this instead of directly, see NNDeletionQueue
+  NNDeletionQueue &getDeletionQueue() { return *deletionQueue_; }
+
   SwapChainSupportDetails getSwapChainSupport() { return querySwapChainSupport(physicalDevice); }
   uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
   QueueFamilyIndices findPhysicalQueueFamilies() { return findQueueFamilies(physicalDevice); }
@@ -69,8 +78,25 @@ class NNDevice {
       VkMemoryPropertyFlags properties,
       VkImage &image,
       VkDeviceMemory &imageMemory);
+  // Allocates `preferred` memory when the image allows it and `fallback` otherwise.
+  // Returns whether the preferred memory was used.
+  bool createImageWithInfo(
+      const VkImageCreateInfo &imageInfo,
+      VkMemoryPropertyFlags preferred,
+      VkMemoryPropertyFlags fallback,
+      VkImage &image,
+      VkDeviceMemory &imageMemory);
+
+  // Device local heap usage of this process, 0 without VK_EXT_memory_budget
+  VkDeviceSize getDeviceMemoryUsage() const;
+  bool hasMemoryBudget() const { return memoryBudgetSupported_; }
+  // Runtime sized, partially bound, update after bind descriptor arrays (see NNBindlessTable)
+  bool hasDescriptorIndexing() const { return descriptorIndexingSupported_; }
 
   VkPhysicalDeviceProperties properties;
+  VkPhysicalDeviceFeatures enabledFeatures{};
+  // Only filled in when hasDescriptorIndexing()
+  VkPhysicalDeviceDescriptorIndexingProperties descriptorIndexingProperties{};
 
  private:
   void createInstance();
@@ -88,6 +114,7 @@ class NNDevice {
   void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT &createInfo);
   void hasGflwRequiredInstanceExtensions();
   bool checkDeviceExtensionSupport(VkPhysicalDevice device);
+  std::vector<const char *> getRequiredDeviceExtensions() const;
   SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device);
 
   VkInstance instance;
@@ -97,9 +124,12 @@ class NNDevice {
   VkCommandPool commandPool;
 
   VkDevice device_;
-  VkSurfaceKHR surface_;
+  VkSurfaceKHR surface_ = VK_NULL_HANDLE;
   VkQueue graphicsQueue_;
   VkQueue presentQueue_;
+  std::unique_ptr<NNDeletionQueue> deletionQueue_;
+  bool memoryBudgetSupported_ = false;
+  bool descriptorIndexingSupported_ = false;
 
   const std::vector<const char *> validationLayers = {"VK_LAYER_KHRONOS_validation"};
   const std::vector<const char *> deviceExtensions = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
@@ -0,0 +1,66 @@
+#include "FrameArena.h"
+
+#include <algorithm>
+#include <new>
+
+namespace NNuts {
+	namespace {
+		size_t alignUp(size_t value, size_t alignment)
+		{
+			return (value + alignment - 1) & ~(alignment - 1);
+		}
+	}
+
+	NNFrameArena::NNFrameArena(size_t capacity, std::pmr::memory_resource* upstream)
+		: m_Upstream{ upstream }, m_Buffer{ std::make_unique<std::byte[]>(capacity) }, m_Capacity{ capacity }
+	{
+	}
+
+	NNFrameArena::~NNFrameArena()
+	{
+		releaseOverflow();
+	}
+
+	void NNFrameArena::reset()
+	{
+		size_t used = getUsed();
+		m_Peak = std::max(m_Peak, used);
+		m_Offset = 0;
+		if (m_Overflow == nullptr) {
+			return;
+		}
+
+		// The frame didn't fit, make room for the whole of it plus some slack
+		releaseOverflow();
+		m_Capacity = alignUp(used + used / 2, alignof(std::max_align_t));
+		m_Buffer = std::make_unique<std::byte[]>(m_Capacity);
+	}
+
+	void* NNFrameArena::do_allocate(size_t bytes, size_t alignment)
+	{
+		uintptr_t base = reinterpret_cast<uintptr_t>(m_Buffer.get());
+		size_t offset = alignUp(base + m_Offset, alignment) - base;
+		if (offset + bytes <= m_Capacity) {
+			m_Offset = offset + bytes;
+			return m_Buffer.get() + offset;
+		}
+
+		// Overflow blocks keep their bookkeeping in front of the memory handed out
+		alignment = std::max(alignment, alignof(Overflow));
+		size_t headerSize = alignUp(sizeof(Overflow), alignment);
+		void* block = m_Upstream->allocate(headerSize + bytes, alignment);
+		m_Overflow = new (block) Overflow{ m_Overflow, headerSize + bytes, alignment };
+		m_OverflowBytes += bytes;
+		return static_cast<std::byte*>(block) + headerSize;
+	}
+
+	void NNFrameArena::releaseOverflow()
+	{
+		while (m_Overflow != nullptr) {
+			Overflow* next = m_Overflow->next;
+			m_Upstream->deallocate(m_Overflow, m_Overflow->size, m_Overflow->alignment);
+			m_Overflow = next;
+		}
+		m_OverflowBytes = 0;
+	}
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+
+namespace NNuts {
+	// Linear allocator for data that only lives for a frame. Allocating bumps an offset, deallocating
+	// does nothing, and reset() drops everything at once. Requests that don't fit go to the upstream
+	// resource until the next reset, which then grows the buffer so the frame fits next time.
+	// Not thread safe, meant for the thread that records the frame.
+	class NNFrameArena : public std::pmr::memory_resource {
+	public:
+		explicit NNFrameArena(size_t capacity = 256 * 1024, std::pmr::memory_resource* upstream = std::pmr::new_delete_resource());
+		~NNFrameArena() override;
+
+		NNFrameArena(const NNFrameArena&) = delete;
+		NNFrameArena& operator=(const NNFrameArena&) = delete;
+
+		void reset();
+
+		size_t getCapacity() const { return m_Capacity; }
+		size_t getUsed() const { return m_Offset + m_OverflowBytes; }
+		// Most bytes used by a single frame since construction
+		size_t getPeak() const { return m_Peak; }
+
+	private:
+		struct Overflow {
+			Overflow* next;
+			size_t size;
+			size_t alignment;
+		};
+
+		void* do_allocate(size_t bytes, size_t alignment) override;
+		void do_deallocate(void*, size_t, size_t) override {}
+		bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+		void releaseOverflow();
+
+		std::pmr::memory_resource* m_Upstream;
+		std::unique_ptr<std::byte[]> m_Buffer;
+		size_t m_Capacity;
+		size_t m_Offset = 0;
+		Overflow* m_Overflow = nullptr;
+		size_t m_OverflowBytes = 0;
+		size_t m_Peak = 0;
+	};
+
+	// Two arenas used on alternate frames, so whatever frame N allocated is still valid while frame N + 1
+	// is recorded and is only dropped when frame N + 2 begins
+	class NNFrameAllocator {
+	public:
+		explicit NNFrameAllocator(size_t capacity = 256 * 1024) : m_Arenas{ NNFrameArena{ capacity }, NNFrameArena{ capacity } } {}
+
+		// Switches to the other arena and resets it
+		void beginFrame() {
+			m_Current ^= 1;
+			m_Arenas[m_Current].reset();
+		}
+
+		NNFrameArena& current() { return m_Arenas[m_Current]; }
+		const NNFrameArena& current() const { return m_Arenas[m_Current]; }
+
+	private:
+		NNFrameArena m_Arenas[2];
+		uint32_t m_Current = 0;
+	};
+}
@@ -0,0 +1,859 @@
+#include "FrameGraph.h"
+
+#include "CpuProfiler.h"
+#include "GpuProfiler.h"
+#include "HostMemory.h"
+#include "RenderStats.h"
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+namespace NNuts {
+	namespace {
+		constexpr VkAccessFlags WRITE_ACCESS =
+			VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+			VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+			VK_ACCESS_SHADER_WRITE_BIT |
+			VK_ACCESS_TRANSFER_WRITE_BIT;
+
+		bool isDepthFormat(VkFormat format) {
+			switch (format) {
+			case VK_FORMAT_D16_UNORM:
+			case VK_FORMAT_X8_D24_UNORM_PACK32:
+			case VK_FORMAT_D32_SFLOAT:
+			case VK_FORMAT_D16_UNORM_S8_UINT:
+			case VK_FORMAT_D24_UNORM_S8_UINT:
+			case VK_FORMAT_D32_SFLOAT_S8_UINT:
+				return true;
+			default:
+				return false;
+			}
+		}
+
+		bool hasStencil(VkFormat format) {
+			return format == VK_FORMAT_D16_UNORM_S8_UINT ||
+				format == VK_FORMAT_D24_UNORM_S8_UINT ||
+				format == VK_FORMAT_D32_SFLOAT_S8_UINT;
+		}
+
+		VkImageAspectFlags barrierAspect(VkFormat format) {
+			if (!isDepthFormat(format)) {
+				return VK_IMAGE_ASPECT_COLOR_BIT;
+			}
+			return hasStencil(format) ? VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT : VK_IMAGE_ASPECT_DEPTH_BIT;
+		}
+
+		VkPipelineStageFlags pipelineStagesFor(VkShaderStageFlags shaderStages) {
+			VkPipelineStageFlags stages = 0;
+			if (shaderStages & VK_SHADER_STAGE_VERTEX_BIT) stages |= VK_PIPELINE_STAGE_VERTEX_SHADER_BIT;
+			if (shaderStages & VK_SHADER_STAGE_FRAGMENT_BIT) stages |= VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+			if (shaderStages & VK_SHADER_STAGE_COMPUTE_BIT) stages |= VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+			return stages != 0 ? stages : static_cast<VkPipelineStageFlags>(VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+		}
+
+		bool lifetimesOverlap(int32_t firstA, int32_t lastA, int32_t firstB, int32_t lastB) {
+			return !(lastA < firstB || lastB < firstA);
+		}
+	}
+
+	FrameGraphResource NNFrameGraph::PassBuilder::createImage(const std::string& name, const FrameGraphImageDesc& desc)
+	{
+		for (auto& resource : m_Graph.m_Resources) {
+			if (resource.name == name) {
+				throw std::runtime_error("Frame graph resource declared twice: " + name);
+			}
+		}
+
+		ResourceNode resource{};
+		resource.name = name;
+		resource.desc = desc;
+		resource.format = desc.format;
+		m_Graph.m_Resources.push_back(resource);
+		return static_cast<FrameGraphResource>(m_Graph.m_Resources.size() - 1);
+	}
+
+	FrameGraphResource NNFrameGraph::PassBuilder::writeColor(FrameGraphResource resource, const VkClearColorValue* clear)
+	{
+		Access& access = m_Graph.addAccess(m_Pass, resource, AccessType::ColorWrite);
+		if (clear) {
+			access.clear = true;
+			access.clearValue.color = *clear;
+		}
+		return resource;
+	}
+
+	FrameGraphResource NNFrameGraph::PassBuilder::writeDepth(FrameGraphResource resource, const VkClearDepthStencilValue* clear)
+	{
+		Access& access = m_Graph.addAccess(m_Pass, resource, AccessType::DepthWrite);
+		if (clear) {
+			access.clear = true;
+			access.clearValue.depthStencil = *clear;
+		}
+		return resource;
+	}
+
+	FrameGraphResource NNFrameGraph::PassBuilder::readDepth(FrameGraphResource resource)
+	{
+		m_Graph.addAccess(m_Pass, resource, AccessType::DepthRead);
+		return resource;
+	}
+
+	FrameGraphResource NNFrameGraph::PassBuilder::readTexture(FrameGraphResource resource, VkShaderStageFlags stages)
+	{
+		m_Graph.addAccess(m_Pass, resource, AccessType::Sampled).shaderStages = stages;
+		return resource;
+	}
+
+	void NNFrameGraph::PassBuilder::setSideEffect()
+	{
+		m_Graph.m_Passes[m_Pass].sideEffect = true;
+	}
+
+	VkImageView NNFrameGraph::PassContext::getImageView(FrameGraphResource resource) const
+	{
+		return m_Graph.getImageView(resource);
+	}
+
+	NNFrameGraph::NNFrameGraph(NNDevice& device) : m_Device{ device }
+	{
+	}
+
+	NNFrameGraph::~NNFrameGraph()
+	{
+		releaseCompiled();
+
+		// Frames recorded with these may still be in flight
+		VkDevice vkDevice = m_Device.device();
+		for (auto& kv : m_RenderPassCache) {
+			VkRenderPass renderPass = kv.second;
+			m_Device.getDeletionQueue().push([vkDevice, renderPass]() {
+				vkDestroyRenderPass(vkDevice, renderPass, NNHostMemory::callbacks(NNHostMemory::Tag::RenderPass));
+			});
+		}
+	}
+
+	FrameGraphResource NNFrameGraph::importImage(
+		const std::string& name,
+		VkFormat format,
+		VkImageLayout initialLayout,
+		VkImageLayout finalLayout)
+	{
+		ResourceNode resource{};
+		resource.name = name;
+		resource.imported = true;
+		resource.format = format;
+		resource.initialLayout = initialLayout;
+		resource.finalLayout = finalLayout;
+		m_Resources.push_back(resource);
+		m_Compiled = false;
+		return static_cast<FrameGraphResource>(m_Resources.size() - 1);
+	}
+
+	void NNFrameGraph::setImportedImage(FrameGraphResource resource, VkImage image, VkImageView view, VkExtent2D extent)
+	{
+		assert(m_Resources[resource].imported && "Only imported images can be replaced!");
+		m_Resources[resource].image = image;
+		m_Resources[resource].view = view;
+		m_Resources[resource].extent = extent;
+	}
+
+	void NNFrameGraph::setImportedFormat(FrameGraphResource resource, VkFormat format)
+	{
+		assert(m_Resources[resource].imported && "Only imported images can be replaced!");
+		m_Resources[resource].format = format;
+		m_Compiled = false;
+	}
+
+	void NNFrameGraph::addPass(const std::string& name, const SetupFunction& setup, ExecuteFunction execute)
+	{
+		m_Passes.push_back({});
+		m_Passes.back().name = name;
+		m_Passes.back().execute = std::move(execute);
+
+		PassBuilder builder{ *this, static_cast<uint32_t>(m_Passes.size() - 1) };
+		setup(builder);
+		m_Compiled = false;
+	}
+
+	void NNFrameGraph::markOutput(FrameGraphResource resource)
+	{
+		m_Resources.at(resource).output = true;
+		m_Compiled = false;
+	}
+
+	NNFrameGraph::Access& NNFrameGraph::addAccess(uint32_t pass, FrameGraphResource resource, AccessType type)
+	{
+		if (resource >= m_Resources.size()) {
+			throw std::runtime_error("Frame graph pass " + m_Passes[pass].name + " uses an unknown resource");
+		}
+
+		auto& accesses = m_Passes[pass].accesses;
+		for (auto& access : accesses) {
+			if (access.resource == resource) {
+				throw std::runtime_error(
+					"Frame graph pass " + m_Passes[pass].name + " uses " + m_Resources[resource].name + " twice");
+			}
+		}
+
+		Access access{};
+		access.resource = resource;
+		access.type = type;
+		accesses.push_back(access);
+		return accesses.back();
+	}
+
+	NNFrameGraph::AccessState NNFrameGraph::accessState(const Access& access)
+	{
+		constexpr VkPipelineStageFlags depthStages =
+			VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+
+		switch (access.type) {
+		case AccessType::ColorWrite:
+			return {
+				VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+				VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+				VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | (access.loadContents ? static_cast<VkAccessFlags>(VK_ACCESS_COLOR_ATTACHMENT_READ_BIT) : VkAccessFlags{ 0 }),
+				true };
+		case AccessType::DepthWrite:
+			return {
+				VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+				depthStages,
+				VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+				true };
+		case AccessType::DepthRead:
+			return {
+				VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+				depthStages,
+				VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT,
+				false };
+		case AccessType::Sampled:
+		default:
+			return {
+				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+				pipelineStagesFor(access.shaderStages),
+				VK_ACCESS_SHADER_READ_BIT,
+				false };
+		}
+	}
+
+	void NNFrameGraph::compile(VkExtent2D outputExtent)
+	{
+		releaseCompiled();
+		m_OutputExtent = outputExtent;
+		m_Stats = {};
+
+		cullPasses();
+		resolveResources(outputExtent);
+		createTransientImages();
+		assignMemory();
+		planBarriers();
+		createRenderPasses();
+		m_Compiled = true;
+	}
+
+	void NNFrameGraph::cullPasses()
+	{
+		// Walk backwards from the outputs. A pass survives if it writes something a later surviving
+		// pass (or the outside) still needs; clearing a resource ends the need for earlier writers.
+		std::vector<bool> needed(m_Resources.size(), false);
+		for (size_t i = 0; i < m_Resources.size(); i++) {
+			needed[i] = m_Resources[i].output;
+		}
+
+		for (size_t p = m_Passes.size(); p-- > 0;) {
+			PassNode& pass = m_Passes[p];
+			bool produces = false;
+			for (auto& access : pass.accesses) {
+				if (accessState(access).write && needed[access.resource]) {
+					produces = true;
+				}
+			}
+
+			pass.culled = !(produces || pass.sideEffect);
+			if (pass.culled) {
+				m_Stats.culledPassCount++;
+				continue;
+			}
+			m_Stats.passCount++;
+
+			for (auto& access : pass.accesses) {
+				if (accessState(access).write && access.clear) {
+					needed[access.resource] = false;
+				}
+			}
+			for (auto& access : pass.accesses) {
+				if (!accessState(access).write || !access.clear) {
+					needed[access.resource] = true;
+				}
+			}
+		}
+	}
+
+	void NNFrameGraph::resolveResources(VkExtent2D outputExtent)
+	{
+		for (auto& resource : m_Resources) {
+			resource.firstPass = -1;
+			resource.lastPass = -1;
+			if (!resource.imported) {
+				resource.usage = 0;
+				if (resource.desc.extent.width != 0 && resource.desc.extent.height != 0) {
+					resource.extent = resource.desc.extent;
+				}
+				else {
+					resource.extent = {
+						std::max(1u, static_cast<uint32_t>(outputExtent.width * resource.desc.scale)),
+						std::max(1u, static_cast<uint32_t>(outputExtent.height * resource.desc.scale)) };
+				}
+			}
+		}
+
+		for (size_t p = 0; p < m_Passes.size(); p++) {
+			if (m_Passes[p].culled) {
+				continue;
+			}
+			for (auto& access : m_Passes[p].accesses) {
+				ResourceNode& resource = m_Resources[access.resource];
+				if (resource.firstPass < 0) {
+					resource.firstPass = static_cast<int32_t>(p);
+				}
+				resource.lastPass = static_cast<int32_t>(p);
+
+				switch (access.type) {
+				case AccessType::ColorWrite: resource.usage |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT; break;
+				case AccessType::DepthWrite:
+				case AccessType::DepthRead: resource.usage |= VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT; break;
+				case AccessType::Sampled: resource.usage |= VK_IMAGE_USAGE_SAMPLED_BIT; break;
+				}
+			}
+		}
+	}
+
+	void NNFrameGraph::createTransientImages()
+	{
+		for (auto& resource : m_Resources) {
+			if (resource.imported || resource.firstPass < 0) {
+				continue;
+			}
+
+			VkImageCreateInfo imageInfo{};
+			imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+			imageInfo.imageType = VK_IMAGE_TYPE_2D;
+			imageInfo.extent = { resource.extent.width, resource.extent.height, 1 };
+			imageInfo.mipLevels = 1;
+			imageInfo.arrayLayers = 1;
+			imageInfo.format = resource.format;
+			imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+			imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			imageInfo.usage = resource.usage;
+			imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+			imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+			if (vkCreateImage(m_Device.device(), &imageInfo, NNHostMemory::callbacks(NNHostMemory::Tag::Image), &resource.image) != VK_SUCCESS) {
+				throw std::runtime_error("Failed to create frame graph image " + resource.name);
+			}
+
+			VkMemoryRequirements requirements;
+			vkGetImageMemoryRequirements(m_Device.device(), resource.image, &requirements);
+			resource.size = requirements.size;
+			resource.memoryTypeBits = requirements.memoryTypeBits;
+
+			m_Stats.transientImageCount++;
+			m_Stats.transientBytes += resource.size;
+		}
+	}
+
+	void NNFrameGraph::assignMemory()
+	{
+		std::vector<FrameGraphResource> order;
+		for (FrameGraphResource r = 0; r < m_Resources.size(); r++) {
+			if (m_Resources[r].image != VK_NULL_HANDLE && !m_Resources[r].imported) {
+				order.push_back(r);
+			}
+		}
+		// Largest first, so smaller images fill the gaps in the lifetimes of big ones
+		std::stable_sort(order.begin(), order.end(), [this](FrameGraphResource a, FrameGraphResource b) {
+			return m_Resources[a].size > m_Resources[b].size;
+		});
+
+		for (FrameGraphResource r : order) {
+			ResourceNode& resource = m_Resources[r];
+
+			int32_t block = -1;
+			for (size_t b = 0; m_AliasingEnabled && b < m_MemoryBlocks.size() && block < 0; b++) {
+				MemoryBlock& candidate = m_MemoryBlocks[b];
+				if ((candidate.memoryTypeBits & resource.memoryTypeBits) == 0) {
+					continue;
+				}
+				bool fits = true;
+				for (FrameGraphResource other : candidate.resources) {
+					if (lifetimesOverlap(resource.firstPass, resource.lastPass, m_Resources[other].firstPass, m_Resources[other].lastPass)) {
+						fits = false;
+						break;
+					}
+				}
+				if (fits) {
+					block = static_cast<int32_t>(b);
+				}
+			}
+
+			if (block < 0) {
+				m_MemoryBlocks.push_back({});
+				block = static_cast<int32_t>(m_MemoryBlocks.size() - 1);
+			}
+
+			MemoryBlock& target = m_MemoryBlocks[block];
+			target.size = std::max(target.size, resource.size);
+			target.memoryTypeBits &= resource.memoryTypeBits;
+			target.resources.push_back(r);
+			resource.memoryBlock = block;
+
+			for (size_t p = resource.firstPass; p <= static_cast<size_t>(resource.lastPass); p++) {
+				if (m_Passes[p].culled) {
+					continue;
+				}
+				for (auto& access : m_Passes[p].accesses) {
+					if (access.resource == r) {
+						AccessState state = accessState(access);
+						target.stages |= state.stages;
+						target.writeAccess |= state.access & WRITE_ACCESS;
+					}
+				}
+			}
+		}
+
+		for (auto& block : m_MemoryBlocks) {
+			VkMemoryAllocateInfo allocInfo{};
+			allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+			allocInfo.allocationSize = block.size;
+			allocInfo.memoryTypeIndex = m_Device.findMemoryType(block.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+			if (vkAllocateMemory(m_Device.device(), &allocInfo, NNHostMemory::callbacks(NNHostMemory::Tag::DeviceMemory), &block.memory) != VK_SUCCESS) {
+				throw std::runtime_error("Failed to allocate frame graph memory!");
+			}
+			NNRenderStats::add(NNRenderStats::Counter::DeviceAllocations);
+			NNRenderStats::add(NNRenderStats::Counter::DeviceBytesAllocated, block.size);
+			m_Stats.memoryBlockCount++;
+			m_Stats.aliasedBytes += block.size;
+
+			for (FrameGraphResource r : block.resources) {
+				ResourceNode& resource = m_Resources[r];
+				if (vkBindImageMemory(m_Device.device(), resource.image, block.memory, 0) != VK_SUCCESS) {
+					throw std::runtime_error("Failed to bind frame graph image " + resource.name);
+				}
+
+				VkImageViewCreateInfo viewInfo{};
+				viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+				viewInfo.image = resource.image;
+				viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+				viewInfo.format = resource.format;
+				// Sampling a depth/stencil view needs a single aspect
+				viewInfo.subresourceRange.aspectMask =
+					isDepthFormat(resource.format) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+				viewInfo.subresourceRange.levelCount = 1;
+				viewInfo.subresourceRange.layerCount = 1;
+				if (vkCreateImageView(m_Device.device(), &viewInfo, NNHostMemory::callbacks(NNHostMemory::Tag::ImageView), &resource.view) != VK_SUCCESS) {
+					throw std::runtime_error("Failed to create frame graph image view " + resource.name);
+				}
+			}
+		}
+	}
+
+	void NNFrameGraph::planBarriers()
+	{
+		struct Tracked {
+			bool touched = false;
+			bool hasContents = false;
+			VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+			VkPipelineStageFlags writeStages = 0;
+			VkAccessFlags writeAccess = 0;
+			// Reads since the last write, and which of them already waited for it
+			VkPipelineStageFlags readStages = 0;
+			VkPipelineStageFlags syncedStages = 0;
+		};
+		std::vector<Tracked> tracked(m_Resources.size());
+
+		for (size_t p = 0; p < m_Passes.size(); p++) {
+			PassNode& pass = m_Passes[p];
+			if (pass.culled) {
+				continue;
+			}
+
+			for (auto& access : pass.accesses) {
+				ResourceNode& resource = m_Resources[access.resource];
+				Tracked& state = tracked[access.resource];
+
+				if (!state.touched) {
+					state.hasContents = resource.imported && resource.initialLayout != VK_IMAGE_LAYOUT_UNDEFINED;
+				}
+				access.loadContents = !access.clear && state.hasContents;
+				access.storeContents = resource.imported || resource.output || static_cast<int32_t>(p) < resource.lastPass;
+
+				AccessState next = accessState(access);
+				if (!next.write && !state.hasContents) {
+					throw std::runtime_error(
+						"Frame graph pass " + pass.name + " reads " + resource.name + " before anything writes it");
+				}
+
+				PlannedBarrier barrier{ access.resource, state.layout, next.layout, 0, next.access };
+				VkPipelineStageFlags srcStages = 0;
+				bool needed = true;
+
+				if (!state.touched) {
+					if (resource.imported) {
+						barrier.oldLayout = resource.initialLayout;
+						srcStages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+					}
+					else {
+						// Whatever used this memory last, in this frame (aliasing) or the previous one
+						const MemoryBlock& block = m_MemoryBlocks[resource.memoryBlock];
+						barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+						barrier.srcAccess = block.writeAccess;
+						srcStages = block.stages;
+					}
+				}
+				else if (next.write) {
+					// WAR against the reads since the last write, WAW otherwise
+					if (state.readStages != 0) {
+						srcStages = state.readStages;
+					}
+					else {
+						srcStages = state.writeStages;
+						barrier.srcAccess = state.writeAccess;
+					}
+				}
+				else if (state.layout != next.layout) {
+					srcStages = state.writeStages | state.readStages;
+					barrier.srcAccess = state.writeAccess;
+				}
+				else if ((next.stages & ~state.syncedStages) != 0) {
+					srcStages = state.writeStages;
+					barrier.srcAccess = state.writeAccess;
+				}
+				else {
+					needed = false;
+				}
+
+				if (needed) {
+					pass.barriers.srcStages |= srcStages != 0 ? srcStages : static_cast<VkPipelineStageFlags>(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+					pass.barriers.dstStages |= next.stages;
+					pass.barriers.barriers.push_back(barrier);
+					m_Stats.barrierCount++;
+				}
+
+				if (next.write) {
+					state.writeStages = next.stages;
+					state.writeAccess = next.access & WRITE_ACCESS;
+					state.readStages = 0;
+					state.syncedStages = 0;
+					state.hasContents = true;
+				}
+				else if (state.layout != next.layout) {
+					state.readStages = next.stages;
+					state.syncedStages = next.stages;
+				}
+				else {
+					state.readStages |= next.stages;
+					state.syncedStages |= next.stages;
+				}
+				state.layout = next.layout;
+				state.touched = true;
+			}
+		}
+
+		for (FrameGraphResource r = 0; r < m_Resources.size(); r++) {
+			const ResourceNode& resource = m_Resources[r];
+			const Tracked& state = tracked[r];
+			if (!resource.imported || !state.touched ||
+				resource.finalLayout == VK_IMAGE_LAYOUT_UNDEFINED || resource.finalLayout == state.layout) {
+				continue;
+			}
+
+			// Presentation and other queue operations are ordered by semaphores, no dst access needed
+			m_FinalBarriers.srcStages |= state.writeStages | state.readStages;
+			m_FinalBarriers.dstStages |= VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+			m_FinalBarriers.barriers.push_back({ r, state.layout, resource.finalLayout, state.writeAccess, 0 });
+			m_Stats.barrierCount++;
+		}
+	}
+
+	void NNFrameGraph::createRenderPasses()
+	{
+		for (auto& pass : m_Passes) {
+			if (pass.culled) {
+				continue;
+			}
+
+			std::vector<VkAttachmentDescription> descriptions;
+			const Access* depth = nullptr;
+			for (auto& access : pass.accesses) {
+				if (access.type == AccessType::ColorWrite) {
+					pass.attachments.push_back(access.resource);
+					pass.clearValues.push_back(access.clearValue);
+				}
+				else if (isAttachment(access.type)) {
+					if (depth) {
+						throw std::runtime_error("Frame graph pass " + pass.name + " has more than one depth attachment");
+					}
+					depth = &access;
+				}
+			}
+			uint32_t colorCount = static_cast<uint32_t>(pass.attachments.size());
+			if (depth) {
+				pass.attachments.push_back(depth->resource);
+				pass.clearValues.push_back(depth->clearValue);
+			}
+			if (pass.attachments.empty()) {
+				continue;
+			}
+
+			VkExtent2D extent = m_Resources[pass.attachments[0]].extent;
+			for (FrameGraphResource r : pass.attachments) {
+				const ResourceNode& resource = m_Resources[r];
+				if (!resource.imported && (resource.extent.width != extent.width || resource.extent.height != extent.height)) {
+					throw std::runtime_error("Attachments of frame graph pass " + pass.name + " differ in size");
+				}
+			}
+
+			// Same order as pass.attachments: colours first, depth last
+			for (auto& access : pass.accesses) {
+				if (access.type == AccessType::ColorWrite) {
+					descriptions.push_back(attachmentDescription(access));
+				}
+			}
+			if (depth) {
+				descriptions.push_back(attachmentDescription(*depth));
+			}
+
+			pass.renderPass = getOrCreateRenderPass(descriptions, colorCount);
+		}
+	}
+
+	VkAttachmentDescription NNFrameGraph::attachmentDescription(const Access& access) const
+	{
+		VkFormat format = m_Resources[access.resource].format;
+		VkAttachmentDescription description{};
+		description.format = format;
+		description.samples = VK_SAMPLE_COUNT_1_BIT;
+		description.loadOp = access.clear ? VK_ATTACHMENT_LOAD_OP_CLEAR
+			: access.loadContents ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		description.storeOp = access.storeContents ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		description.stencilLoadOp = hasStencil(format) ? description.loadOp : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		description.stencilStoreOp = hasStencil(format) ? description.storeOp : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		// Layout transitions happen in the planned barriers, never inside the render pass
+		description.initialLayout = accessState(access).layout;
+		description.finalLayout = description.initialLayout;
+		return description;
+	}
+
+	VkRenderPass NNFrameGraph::getOrCreateRenderPass(const std::vector<VkAttachmentDescription>& attachments, uint32_t colorCount)
+	{
+		std::vector<uint64_t> key{ colorCount };
+		for (auto& attachment : attachments) {
+			key.push_back(
+				static_cast<uint64_t>(attachment.format) |
+				static_cast<uint64_t>(attachment.loadOp) << 32 |
+				static_cast<uint64_t>(attachment.storeOp) << 36 |
+				static_cast<uint64_t>(attachment.stencilLoadOp) << 40 |
+				static_cast<uint64_t>(attachment.stencilStoreOp) << 44);
+			key.push_back(static_cast<uint64_t>(attachment.initialLayout));
+		}
+
+		auto it = m_RenderPassCache.find(key);
+		if (it != m_RenderPassCache.end()) {
+			return it->second;
+		}
+
+		std::vector<VkAttachmentReference> colorRefs;
+		for (uint32_t i = 0; i < colorCount; i++) {
+			colorRefs.push_back({ i, attachments[i].initialLayout });
+		}
+		VkAttachmentReference depthRef{};
+		bool hasDepth = attachments.size() > colorCount;
+		if (hasDepth) {
+			depthRef = { colorCount, attachments[colorCount].initialLayout };
+		}
+
+		VkSubpassDescription subpass{};
+		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpass.colorAttachmentCount = colorCount;
+		subpass.pColorAttachments = colorRefs.data();
+		subpass.pDepthStencilAttachment = hasDepth ? &depthRef : nullptr;
+
+		VkRenderPassCreateInfo renderPassInfo{};
+		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+		renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+		renderPassInfo.pAttachments = attachments.data();
+		renderPassInfo.subpassCount = 1;
+		renderPassInfo.pSubpasses = &subpass;
+
+		VkRenderPass renderPass;
+		if (vkCreateRenderPass(m_Device.device(), &renderPassInfo, NNHostMemory::callbacks(NNHostMemory::Tag::RenderPass), &renderPass) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create frame graph render pass!");
+		}
+		m_RenderPassCache.emplace(std::move(key), renderPass);
+		return renderPass;
+	}
+
+	VkFramebuffer NNFrameGraph::getFramebuffer(PassNode& pass)
+	{
+		// The lookup key goes into scratch, only a new framebuffer copies it
+		std::vector<VkImageView>& views = m_FramebufferScratch;
+		views.clear();
+		for (FrameGraphResource r : pass.attachments) {
+			views.push_back(m_Resources[r].view);
+		}
+
+		auto it = pass.framebuffers.find(views);
+		if (it != pass.framebuffers.end()) {
+			return it->second;
+		}
+
+		VkExtent2D extent = m_Resources[pass.attachments[0]].extent;
+		VkFramebufferCreateInfo framebufferInfo{};
+		framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+		framebufferInfo.renderPass = pass.renderPass;
+		framebufferInfo.attachmentCount = static_cast<uint32_t>(views.size());
+		framebufferInfo.pAttachments = views.data();
+		framebufferInfo.width = extent.width;
+		framebufferInfo.height = extent.height;
+		framebufferInfo.layers = 1;
+
+		VkFramebuffer framebuffer;
+		if (vkCreateFramebuffer(m_Device.device(), &framebufferInfo, NNHostMemory::callbacks(NNHostMemory::Tag::Framebuffer), &framebuffer) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create framebuffer for frame graph pass " + pass.name);
+		}
+		pass.framebuffers.emplace(views, framebuffer);
+		return framebuffer;
+	}
+
+	void NNFrameGraph::execute(VkCommandBuffer commandBuffer, NNGpuProfiler* profiler)
+	{
+		assert(m_Compiled && "Frame graph has to be compiled before it is executed!");
+		NN_PROFILE_SCOPE("frame graph");
+
+		PassContext context{ *this };
+		context.commandBuffer = commandBuffer;
+		for (auto& pass : m_Passes) {
+			if (pass.culled) {
+				continue;
+			}
+
+			recordBarriers(commandBuffer, pass.barriers);
+
+			context.renderPass = pass.renderPass;
+			context.extent = pass.attachments.empty() ? m_OutputExtent : m_Resources[pass.attachments[0]].extent;
+
+			if (pass.renderPass != VK_NULL_HANDLE) {
+				VkRenderPassBeginInfo renderPassInfo{};
+				renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+				renderPassInfo.renderPass = pass.renderPass;
+				renderPassInfo.framebuffer = getFramebuffer(pass);
+				renderPassInfo.renderArea = { { 0, 0 }, context.extent };
+				renderPassInfo.clearValueCount = static_cast<uint32_t>(pass.clearValues.size());
+				renderPassInfo.pClearValues = pass.clearValues.data();
+				vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+				VkViewport viewport{ 0.0f, 0.0f,
+					static_cast<float>(context.extent.width), static_cast<float>(context.extent.height), 0.0f, 1.0f };
+				VkRect2D scissor{ { 0, 0 }, context.extent };
+				vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+				vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+			}
+
+			if (profiler) {
+				profiler->beginPass(commandBuffer, pass.name);
+			}
+			pass.execute(context);
+			if (profiler) {
+				profiler->endPass(commandBuffer);
+			}
+
+			if (pass.renderPass != VK_NULL_HANDLE) {
+				vkCmdEndRenderPass(commandBuffer);
+			}
+		}
+
+		recordBarriers(commandBuffer, m_FinalBarriers);
+	}
+
+	void NNFrameGraph::recordBarriers(VkCommandBuffer commandBuffer, const BarrierBatch& batch)
+	{
+		if (batch.barriers.empty()) {
+			return;
+		}
+
+		m_BarrierScratch.clear();
+		for (auto& planned : batch.barriers) {
+			const ResourceNode& resource = m_Resources[planned.resource];
+			assert(resource.image != VK_NULL_HANDLE && "Imported frame graph image was never set!");
+
+			VkImageMemoryBarrier barrier{};
+			barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			barrier.srcAccessMask = planned.srcAccess;
+			barrier.dstAccessMask = planned.dstAccess;
+			barrier.oldLayout = planned.oldLayout;
+			barrier.newLayout = planned.newLayout;
+			barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.image = resource.image;
+			barrier.subresourceRange = { barrierAspect(resource.format), 0, 1, 0, 1 };
+			m_BarrierScratch.push_back(barrier);
+		}
+
+		vkCmdPipelineBarrier(
+			commandBuffer,
+			batch.srcStages,
+			batch.dstStages,
+			0,
+			0, nullptr,
+			0, nullptr,
+			static_cast<uint32_t>(m_BarrierScratch.size()), m_BarrierScratch.data());
+	}
+
+	void NNFrameGraph::releaseCompiled()
+	{
+		auto& deletionQueue = m_Device.getDeletionQueue();
+		for (auto& pass : m_Passes) {
+			for (auto& kv : pass.framebuffers) {
+				deletionQueue.destroyFramebuffer(kv.second);
+			}
+			pass.framebuffers.clear();
+			pass.barriers = {};
+			pass.renderPass = VK_NULL_HANDLE;
+			pass.attachments.clear();
+			pass.clearValues.clear();
+		}
+
+		for (auto& resource : m_Resources) {
+			if (!resource.imported && resource.image != VK_NULL_HANDLE) {
+				// The memory may be shared, it is freed per block below
+				deletionQueue.destroyImage(resource.image, resource.view, VK_NULL_HANDLE);
+				resource.image = VK_NULL_HANDLE;
+				resource.view = VK_NULL_HANDLE;
+			}
+			resource.memoryBlock = -1;
+		}
+
+		for (auto& block : m_MemoryBlocks) {
+			deletionQueue.freeMemory(block.memory);
+		}
+		m_MemoryBlocks.clear();
+		m_FinalBarriers = {};
+		m_Compiled = false;
+	}
+
+	VkRenderPass NNFrameGraph::getRenderPass(const std::string& passName) const
+	{
+		for (auto& pass : m_Passes) {
+			if (pass.name == passName) {
+				return pass.renderPass;
+			}
+		}
+		return VK_NULL_HANDLE;
+	}
+
+	VkImageView NNFrameGraph::getImageView(FrameGraphResource resource) const
+	{
+		return m_Resources.at(resource).view;
+	}
+}
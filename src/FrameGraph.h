@@ -0,0 +1,233 @@
+#pragma once
+
+#include "Device.h"
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace NNuts {
+	class NNGpuProfiler;
+
+	using FrameGraphResource = uint32_t;
+
+	struct FrameGraphImageDesc {
+		VkFormat format = VK_FORMAT_UNDEFINED;
+		// Size relative to the extent passed to compile(), ignored when extent is set
+		float scale = 1.0f;
+		VkExtent2D extent{ 0, 0 };
+	};
+
+	// Declarative description of a frame. Passes list the named images they read and write, and
+	// compile() turns that into render passes, framebuffers and pipeline barriers:
+	//   - passes whose results never reach an output (or a side effect) are culled
+	//   - passes run in declaration order, reads have to refer to something an earlier pass wrote
+	//   - every access gets the minimal barrier / layout transition from the previous one
+	//   - transient images whose lifetimes don't overlap share memory
+	// Setup is done once and recompiled when the output extent changes; execute() records a frame.
+	class NNFrameGraph {
+	public:
+		struct Stats {
+			uint32_t passCount = 0;
+			uint32_t culledPassCount = 0;
+			uint32_t barrierCount = 0;
+			uint32_t transientImageCount = 0;
+			uint32_t memoryBlockCount = 0;
+			// Memory the transient images would need on their own, and what was allocated for them
+			// (equal when aliasing is disabled)
+			VkDeviceSize transientBytes = 0;
+			VkDeviceSize aliasedBytes = 0;
+		};
+
+		class PassBuilder {
+		public:
+			FrameGraphResource createImage(const std::string& name, const FrameGraphImageDesc& desc);
+
+			// Colour attachments get their locations in call order. Without a clear value the previous
+			// contents are loaded if there are any.
+			FrameGraphResource writeColor(FrameGraphResource resource, const VkClearColorValue* clear = nullptr);
+			FrameGraphResource writeDepth(FrameGraphResource resource, const VkClearDepthStencilValue* clear = nullptr);
+			// Depth attachment that is tested against but not written
+			FrameGraphResource readDepth(FrameGraphResource resource);
+			FrameGraphResource readTexture(
+				FrameGraphResource resource,
+				VkShaderStageFlags stages = VK_SHADER_STAGE_FRAGMENT_BIT);
+
+			// Keeps the pass even if nothing reads what it writes
+			void setSideEffect();
+
+		private:
+			friend class NNFrameGraph;
+			PassBuilder(NNFrameGraph& graph, uint32_t pass) : m_Graph{ graph }, m_Pass{ pass } {}
+
+			NNFrameGraph& m_Graph;
+			uint32_t m_Pass;
+		};
+
+		class PassContext {
+		public:
+			VkCommandBuffer commandBuffer;
+			VkRenderPass renderPass;
+			VkExtent2D extent;
+
+			VkImageView getImageView(FrameGraphResource resource) const;
+
+		private:
+			friend class NNFrameGraph;
+			PassContext(const NNFrameGraph& graph) : m_Graph{ graph } {}
+			const NNFrameGraph& m_Graph;
+		};
+
+		using SetupFunction = std::function<void(PassBuilder&)>;
+		using ExecuteFunction = std::function<void(const PassContext&)>;
+
+		NNFrameGraph(NNDevice& device);
+		~NNFrameGraph();
+
+		NNFrameGraph(const NNFrameGraph&) = delete;
+		NNFrameGraph& operator=(const NNFrameGraph&) = delete;
+
+		// Externally owned image, e.g. the swap chain image. Its VkImage and view can change every
+		// frame through setImportedImage. Work on it before the graph is assumed to be released at
+		// COLOR_ATTACHMENT_OUTPUT, which is where the frame waits for the acquired swap chain image.
+		FrameGraphResource importImage(
+			const std::string& name,
+			VkFormat format,
+			VkImageLayout initialLayout,
+			VkImageLayout finalLayout);
+		void setImportedImage(FrameGraphResource resource, VkImage image, VkImageView view, VkExtent2D extent);
+		// The render passes writing it are rebuilt by the next compile
+		void setImportedFormat(FrameGraphResource resource, VkFormat format);
+
+		void addPass(const std::string& name, const SetupFunction& setup, ExecuteFunction execute);
+		void markOutput(FrameGraphResource resource);
+
+		// Retires the previous transient images, framebuffers and memory through the deletion queue.
+		// Render passes are cached by their attachment setup, so pipelines built against getRenderPass()
+		// stay valid across recompiles.
+		void compile(VkExtent2D outputExtent);
+		void execute(VkCommandBuffer commandBuffer, NNGpuProfiler* profiler = nullptr);
+
+		void setAliasingEnabled(bool enabled) { m_AliasingEnabled = enabled; }
+		bool isCompiled() const { return m_Compiled; }
+		// Only valid after compile(); VK_NULL_HANDLE for passes without attachments or culled passes
+		VkRenderPass getRenderPass(const std::string& passName) const;
+		VkImageView getImageView(FrameGraphResource resource) const;
+		const Stats& getStats() const { return m_Stats; }
+
+	private:
+		enum class AccessType { ColorWrite, DepthWrite, DepthRead, Sampled };
+
+		struct Access {
+			FrameGraphResource resource;
+			AccessType type;
+			bool clear = false;
+			VkClearValue clearValue{};
+			VkShaderStageFlags shaderStages = 0;
+			// Compiled: whether the attachment has contents to load / later users to store for
+			bool loadContents = false;
+			bool storeContents = false;
+		};
+
+		struct AccessState {
+			VkImageLayout layout;
+			VkPipelineStageFlags stages;
+			VkAccessFlags access;
+			bool write;
+		};
+
+		struct ResourceNode {
+			std::string name;
+			bool imported = false;
+			bool output = false;
+			FrameGraphImageDesc desc{};
+			VkFormat format = VK_FORMAT_UNDEFINED;
+			VkImageLayout initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			VkImageLayout finalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+			// Compiled / current
+			VkExtent2D extent{ 0, 0 };
+			VkImageUsageFlags usage = 0;
+			VkImage image = VK_NULL_HANDLE;
+			VkImageView view = VK_NULL_HANDLE;
+			VkDeviceSize size = 0;
+			uint32_t memoryTypeBits = 0;
+			int32_t memoryBlock = -1;
+			int32_t firstPass = -1;
+			int32_t lastPass = -1;
+		};
+
+		struct PlannedBarrier {
+			FrameGraphResource resource;
+			VkImageLayout oldLayout;
+			VkImageLayout newLayout;
+			VkAccessFlags srcAccess;
+			VkAccessFlags dstAccess;
+		};
+
+		struct BarrierBatch {
+			VkPipelineStageFlags srcStages = 0;
+			VkPipelineStageFlags dstStages = 0;
+			std::vector<PlannedBarrier> barriers;
+		};
+
+		struct PassNode {
+			std::string name;
+			std::vector<Access> accesses;
+			ExecuteFunction execute;
+			bool sideEffect = false;
+			bool culled = false;
+
+			// Compiled
+			BarrierBatch barriers;
+			VkRenderPass renderPass = VK_NULL_HANDLE;
+			std::vector<FrameGraphResource> attachments;
+			std::vector<VkClearValue> clearValues;
+			std::map<std::vector<VkImageView>, VkFramebuffer> framebuffers;
+		};
+
+		struct MemoryBlock {
+			VkDeviceMemory memory = VK_NULL_HANDLE;
+			VkDeviceSize size = 0;
+			uint32_t memoryTypeBits = ~0u;
+			VkPipelineStageFlags stages = 0;
+			VkAccessFlags writeAccess = 0;
+			std::vector<FrameGraphResource> resources;
+		};
+
+		static AccessState accessState(const Access& access);
+		static bool isAttachment(AccessType type) { return type != AccessType::Sampled; }
+
+		Access& addAccess(uint32_t pass, FrameGraphResource resource, AccessType type);
+		void cullPasses();
+		void resolveResources(VkExtent2D outputExtent);
+		void createTransientImages();
+		void assignMemory();
+		void planBarriers();
+		void createRenderPasses();
+		VkAttachmentDescription attachmentDescription(const Access& access) const;
+		VkRenderPass getOrCreateRenderPass(const std::vector<VkAttachmentDescription>& attachments, uint32_t colorCount);
+		VkFramebuffer getFramebuffer(PassNode& pass);
+		void releaseCompiled();
+		void recordBarriers(VkCommandBuffer commandBuffer, const BarrierBatch& batch);
+
+		NNDevice& m_Device;
+		std::vector<ResourceNode> m_Resources;
+		std::vector<PassNode> m_Passes;
+		std::vector<MemoryBlock> m_MemoryBlocks;
+		BarrierBatch m_FinalBarriers;
+		std::vector<VkImageMemoryBarrier> m_BarrierScratch;
+		std::vector<VkImageView> m_FramebufferScratch;
+		VkExtent2D m_OutputExtent{ 0, 0 };
+		// Attachment formats, layouts and load/store ops -> render pass
+		std::map<std::vector<uint64_t>, VkRenderPass> m_RenderPassCache;
+		bool m_AliasingEnabled = true;
+		bool m_Compiled = false;
+		Stats m_Stats{};
+	};
+}
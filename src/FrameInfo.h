@@ -4,6 +4,8 @@
 
 #include <vulkan/vulkan.h>
 
+#include <memory_resource>
+
 namespace NNuts {
 	struct FrameInfo
 	{
@@ -12,5 +14,7 @@ namespace NNuts {
 		VkCommandBuffer commandBuffer;
 		NNCamera& camera;
 		VkDescriptorSet globalDescriptorSet;
+		// Scratch memory for the frame, see NNRenderer::getFrameAllocator
+		std::pmr::memory_resource* frameAllocator;
 	};
 }
\ No newline at end of file
@@ -0,0 +1,116 @@
+#include "FullscreenPass.h"
+
+#include "RenderStats.h"
+
+#include <cassert>
+
+namespace NNuts {
+	// Matches the push constant block of the post-processing shaders
+	struct FullscreenPushConstants {
+		glm::vec4 params{ 0.0f };
+		glm::vec4 target{ 0.0f };  // width, height, 1 / width, 1 / height
+	};
+
+	NNFullscreenPass::NNFullscreenPass(
+		NNDevice& device,
+		NNShaderCompiler& shaderCompiler,
+		NNLayoutCache& layoutCache,
+		const std::string& fragmentShader,
+		VkRenderPass renderPass) : m_Device{ device }, m_ShaderCompiler{ shaderCompiler }, m_FragmentShader{ fragmentShader }
+	{
+		m_Reflection
+			.addStage(VK_SHADER_STAGE_VERTEX_BIT, shaderCompiler.getSpirv("res/Shaders/Fullscreen.vert"))
+			.addStage(VK_SHADER_STAGE_FRAGMENT_BIT, shaderCompiler.getSpirv(fragmentShader));
+
+		m_PipelineLayout = layoutCache.getPipelineLayout(m_Reflection);
+		m_SetLayout = layoutCache.getDescriptorSetLayout(m_Reflection.getSetBindings(0));
+		m_PushConstantStages = m_Reflection.getPushConstantStages(0, sizeof(FullscreenPushConstants));
+		createPipeline(renderPass);
+
+		VkSamplerCreateInfo samplerInfo{};
+		samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		samplerInfo.magFilter = VK_FILTER_LINEAR;
+		samplerInfo.minFilter = VK_FILTER_LINEAR;
+		samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.maxLod = 0.0f;
+		// Shared by every fullscreen pass, the cache owns it
+		m_Sampler = layoutCache.getSampler(samplerInfo);
+	}
+
+	void NNFullscreenPass::setRenderPass(VkRenderPass renderPass)
+	{
+		createPipeline(renderPass);
+	}
+
+	void NNFullscreenPass::createPipeline(VkRenderPass renderPass)
+	{
+		VkPipelineLayout pipelineLayout = m_PipelineLayout;
+		m_Pipelines = std::make_unique<NNPipelineVariantCache>(
+			m_Device,
+			m_ShaderCompiler.getSpirv("res/Shaders/Fullscreen.vert"),
+			m_ShaderCompiler.getSpirv(m_FragmentShader),
+			[renderPass, pipelineLayout](PipelineConfigInfo& pipelineConfig) {
+				pipelineConfig.renderPass = renderPass;
+				pipelineConfig.pipelineLayout = pipelineLayout;
+				pipelineConfig.bindingDescriptions.clear();
+				pipelineConfig.attributeDescriptions.clear();
+				pipelineConfig.depthStencilInfo.depthTestEnable = VK_FALSE;
+				pipelineConfig.depthStencilInfo.depthWriteEnable = VK_FALSE;
+			}
+		);
+		m_Pipeline = &m_Pipelines->getVariant({});
+	}
+
+	void NNFullscreenPass::setInputs(const std::vector<VkImageView>& views)
+	{
+		uint32_t inputCount = static_cast<uint32_t>(views.size());
+		m_Pool =
+			NNDescriptorPool::Builder(m_Device)
+			.setMaxSets(1)
+			.addPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, inputCount)
+			.build();
+
+		std::vector<VkDescriptorImageInfo> imageInfos(views.size());
+		NNDescriptorWriter writer{ *m_SetLayout, *m_Pool };
+		for (uint32_t i = 0; i < inputCount; i++) {
+			imageInfos[i] = { m_Sampler, views[i], VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+			writer.writeImage(i, &imageInfos[i]);
+		}
+		writer.build(m_Set);
+	}
+
+	void NNFullscreenPass::draw(VkCommandBuffer commandBuffer, VkExtent2D extent, const glm::vec4& params)
+	{
+		assert(m_Set != VK_NULL_HANDLE && "setInputs has to be called before draw!");
+
+		m_Pipeline->bind(commandBuffer);
+		vkCmdBindDescriptorSets(
+			commandBuffer,
+			VK_PIPELINE_BIND_POINT_GRAPHICS,
+			m_PipelineLayout,
+			0, 1,
+			&m_Set,
+			0, nullptr
+		);
+		NNRenderStats::add(NNRenderStats::Counter::DescriptorSetBinds);
+
+		if (m_PushConstantStages != 0) {
+			FullscreenPushConstants push{};
+			push.params = params;
+			push.target = {
+				static_cast<float>(extent.width),
+				static_cast<float>(extent.height),
+				1.0f / static_cast<float>(extent.width),
+				1.0f / static_cast<float>(extent.height) };
+			vkCmdPushConstants(commandBuffer, m_PipelineLayout, m_PushConstantStages, 0, sizeof(push), &push);
+			NNRenderStats::add(NNRenderStats::Counter::PushConstantBytes, sizeof(push));
+		}
+
+		vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+		NNRenderStats::add(NNRenderStats::Counter::DrawCalls);
+		NNRenderStats::add(NNRenderStats::Counter::Triangles);
+	}
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "Descriptor.h"
+#include "Device.h"
+#include "LayoutCache.h"
+#include "Pipeline.h"
+#include "PipelineVariants.h"
+#include "ShaderCompiler.h"
+#include "ShaderReflection.h"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace NNuts {
+	// Single triangle post-processing pass. The fragment shader samples its inputs from set 0,
+	// bindings 0..N-1, and gets the push constants of FullscreenPushConstants.
+	class NNFullscreenPass {
+	public:
+		NNFullscreenPass(
+			NNDevice& device,
+			NNShaderCompiler& shaderCompiler,
+			NNLayoutCache& layoutCache,
+			const std::string& fragmentShader,
+			VkRenderPass renderPass);
+
+		NNFullscreenPass(const NNFullscreenPass&) = delete;
+		NNFullscreenPass& operator=(const NNFullscreenPass&) = delete;
+
+		// Writes a fresh descriptor set, the old one may still be bound by frames in flight
+		void setInputs(const std::vector<VkImageView>& views);
+		// Rebuilds the pipeline for a render pass with different attachment formats
+		void setRenderPass(VkRenderPass renderPass);
+		// params is free for the shader, the target size is filled in from extent
+		void draw(VkCommandBuffer commandBuffer, VkExtent2D extent, const glm::vec4& params = glm::vec4{ 0.0f });
+
+	private:
+		void createPipeline(VkRenderPass renderPass);
+
+		NNDevice& m_Device;
+		NNShaderCompiler& m_ShaderCompiler;
+		std::string m_FragmentShader;
+		NNShaderReflection m_Reflection;
+		VkPipelineLayout m_PipelineLayout = VK_NULL_HANDLE;
+		VkShaderStageFlags m_PushConstantStages = 0;
+		std::unique_ptr<NNPipelineVariantCache> m_Pipelines;
+		NNPipeline* m_Pipeline = nullptr;
+
+		VkSampler m_Sampler = VK_NULL_HANDLE;
+		std::shared_ptr<NNDescriptorSetLayout> m_SetLayout;
+		std::unique_ptr<NNDescriptorPool> m_Pool;
+		VkDescriptorSet m_Set = VK_NULL_HANDLE;
+	};
+}
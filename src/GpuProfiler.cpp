@@ -0,0 +1,290 @@
+#include "GpuProfiler.h"
+
+#include "CpuProfiler.h"
+#include "HostMemory.h"
+#include "SwapChain.h"
+
+#include <cassert>
+#include <stdexcept>
+
+namespace NNuts {
+	namespace {
+		// Results come back in bit order, which matches PipelineStatistics
+		constexpr VkQueryPipelineStatisticFlags STATISTICS =
+			VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+			VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT |
+			VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+			VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+		constexpr uint32_t STATISTICS_COUNT = 4;
+	}
+
+	NNGpuProfiler::NNGpuProfiler(NNDevice& device, uint32_t maxPassesPerFrame)
+		: m_Device{ device }, m_MaxPasses{ maxPassesPerFrame }
+	{
+		uint32_t queueFamilyCount = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(m_Device.getPhysicalDevice(), &queueFamilyCount, nullptr);
+		std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+		vkGetPhysicalDeviceQueueFamilyProperties(m_Device.getPhysicalDevice(), &queueFamilyCount, queueFamilies.data());
+
+		uint32_t validBits = queueFamilies[m_Device.findPhysicalQueueFamilies().graphicsFamily].timestampValidBits;
+		m_Supported = validBits > 0 && m_Device.properties.limits.timestampPeriod > 0.0f;
+		if (!m_Supported) {
+			return;
+		}
+
+		m_TimestampPeriod = m_Device.properties.limits.timestampPeriod;
+		m_TimestampMask = validBits >= 64 ? ~0ull : ((1ull << validBits) - 1);
+		m_StatisticsSupported = m_Device.enabledFeatures.pipelineStatisticsQuery == VK_TRUE;
+
+		m_Frames.resize(NNSwapChain::MAX_FRAMES_IN_FLIGHT);
+		for (auto& frame : m_Frames) {
+			VkQueryPoolCreateInfo poolInfo{};
+			poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+			poolInfo.queryCount = m_MaxPasses * 2;
+
+			if (vkCreateQueryPool(m_Device.device(), &poolInfo, NNHostMemory::callbacks(NNHostMemory::Tag::QueryPool), &frame.queryPool) != VK_SUCCESS) {
+				throw std::runtime_error("Failed to create timestamp query pool!");
+			}
+
+			if (m_StatisticsSupported) {
+				poolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+				poolInfo.queryCount = m_MaxPasses;
+				poolInfo.pipelineStatistics = STATISTICS;
+				if (vkCreateQueryPool(m_Device.device(), &poolInfo, NNHostMemory::callbacks(NNHostMemory::Tag::QueryPool), &frame.statisticsPool) != VK_SUCCESS) {
+					throw std::runtime_error("Failed to create pipeline statistics query pool!");
+				}
+			}
+		}
+	}
+
+	NNGpuProfiler::~NNGpuProfiler()
+	{
+		for (auto& frame : m_Frames) {
+			vkDestroyQueryPool(m_Device.device(), frame.queryPool, NNHostMemory::callbacks(NNHostMemory::Tag::QueryPool));
+			vkDestroyQueryPool(m_Device.device(), frame.statisticsPool, NNHostMemory::callbacks(NNHostMemory::Tag::QueryPool));
+		}
+	}
+
+	void NNGpuProfiler::calibrate()
+	{
+		if (!m_Supported) {
+			return;
+		}
+
+		VkQueryPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		poolInfo.queryCount = 1;
+		VkQueryPool queryPool;
+		if (vkCreateQueryPool(m_Device.device(), &poolInfo, NNHostMemory::callbacks(NNHostMemory::Tag::QueryPool), &queryPool) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create calibration query pool!");
+		}
+
+		// Frames still in flight would delay the timestamp, so drain the queue first. The timestamp
+		// then lands somewhere between submit and idle, take the middle.
+		VkCommandBuffer commandBuffer = m_Device.beginSingleTimeCommands();
+		vkCmdResetQueryPool(commandBuffer, queryPool, 0, 1);
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 0);
+		vkQueueWaitIdle(m_Device.graphicsQueue());
+		uint64_t cpuBefore = NNCpuProfiler::now();
+		m_Device.endSingleTimeCommands(commandBuffer);
+		vkQueueWaitIdle(m_Device.graphicsQueue());
+		uint64_t cpuAfter = NNCpuProfiler::now();
+
+		uint64_t ticks = 0;
+		VkResult result = vkGetQueryPoolResults(
+			m_Device.device(), queryPool, 0, 1, sizeof(ticks), &ticks, sizeof(ticks), VK_QUERY_RESULT_64_BIT);
+		vkDestroyQueryPool(m_Device.device(), queryPool, NNHostMemory::callbacks(NNHostMemory::Tag::QueryPool));
+		if (result != VK_SUCCESS) {
+			return;
+		}
+
+		double cpuMiddle = cpuBefore + (cpuAfter - cpuBefore) * 0.5;
+		m_CpuTimeOffset = cpuMiddle - (ticks & m_TimestampMask) * m_TimestampPeriod;
+		m_Calibrated = true;
+	}
+
+	void NNGpuProfiler::beginFrame(VkCommandBuffer commandBuffer, int frameIndex, std::pmr::memory_resource* scratch)
+	{
+		if (!m_Supported) {
+			return;
+		}
+		assert(m_OpenPasses.empty() && "Previous frame ended with an open GPU pass!");
+
+		// The renderer waited for this slot's timeline value before handing out the command buffer
+		FrameQueries& frame = m_Frames[frameIndex];
+		collect(frame, scratch);
+
+		vkCmdResetQueryPool(commandBuffer, frame.queryPool, 0, m_MaxPasses * 2);
+		if (frame.statisticsPool != VK_NULL_HANDLE) {
+			vkCmdResetQueryPool(commandBuffer, frame.statisticsPool, 0, m_MaxPasses);
+		}
+		frame.scopes.clear();
+		frame.queryCount = 0;
+		frame.statisticsCount = 0;
+		m_CurrentFrame = &frame;
+	}
+
+	void NNGpuProfiler::beginPass(VkCommandBuffer commandBuffer, const std::string& name)
+	{
+		if (!m_Supported || m_CurrentFrame == nullptr) {
+			return;
+		}
+		if (m_CurrentFrame->scopes.size() >= m_MaxPasses) {
+			m_OpenPasses.push_back(-1);
+			return;
+		}
+
+		// Dropped parents are skipped, their children hang off the closest recorded ancestor
+		int32_t parent = -1;
+		for (auto it = m_OpenPasses.rbegin(); it != m_OpenPasses.rend(); ++it) {
+			if (*it >= 0) {
+				parent = *it;
+				break;
+			}
+		}
+
+		Scope scope{};
+		scope.parent = parent;
+		if (parent >= 0) {
+			auto& parentScope = m_CurrentFrame->scopes[parent];
+			scope.depth = parentScope.depth + 1;
+			scope.path = internPath(static_cast<int32_t>(parentScope.path), name);
+		}
+		else {
+			scope.path = internPath(-1, name);
+		}
+
+		scope.beginQuery = m_CurrentFrame->queryCount++;
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_CurrentFrame->queryPool, scope.beginQuery);
+		if (m_StatisticsSupported && !m_StatisticsOpen) {
+			scope.statisticsQuery = static_cast<int32_t>(m_CurrentFrame->statisticsCount++);
+			vkCmdBeginQuery(commandBuffer, m_CurrentFrame->statisticsPool, scope.statisticsQuery, 0);
+			m_StatisticsOpen = true;
+		}
+
+		m_OpenPasses.push_back(static_cast<int32_t>(m_CurrentFrame->scopes.size()));
+		m_CurrentFrame->scopes.push_back(scope);
+	}
+
+	void NNGpuProfiler::endPass(VkCommandBuffer commandBuffer)
+	{
+		if (m_OpenPasses.empty()) {
+			return;
+		}
+
+		int32_t index = m_OpenPasses.back();
+		m_OpenPasses.pop_back();
+		if (index < 0) {
+			return;
+		}
+
+		Scope& scope = m_CurrentFrame->scopes[index];
+		if (scope.statisticsQuery >= 0) {
+			vkCmdEndQuery(commandBuffer, m_CurrentFrame->statisticsPool, scope.statisticsQuery);
+			m_StatisticsOpen = false;
+		}
+		scope.endQuery = m_CurrentFrame->queryCount++;
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_CurrentFrame->queryPool, scope.endQuery);
+	}
+
+	std::vector<NNGpuProfiler::PassTiming> NNGpuProfiler::takeAverages()
+	{
+		std::vector<PassTiming> averages{};
+		for (auto& path : m_Paths) {
+			if (path.accumulatedCount == 0) {
+				continue;
+			}
+			PassTiming average{};
+			average.name = path.path;
+			average.path = path.path;
+			average.milliseconds = path.accumulatedMilliseconds / path.accumulatedCount;
+			averages.push_back(std::move(average));
+			// Zeroed in place, so the paths don't have to be rebuilt by the next frames
+			path.accumulatedMilliseconds = 0.0;
+			path.accumulatedCount = 0;
+		}
+		return averages;
+	}
+
+	uint32_t NNGpuProfiler::internPath(int32_t parent, const std::string& name)
+	{
+		for (uint32_t i = 0; i < m_Paths.size(); i++) {
+			if (m_Paths[i].parent == parent && m_Paths[i].name == name) {
+				return i;
+			}
+		}
+
+		Path path{};
+		path.name = name;
+		path.path = parent >= 0 ? m_Paths[parent].path + "/" + name : name;
+		path.parent = parent;
+		m_Paths.push_back(std::move(path));
+		return static_cast<uint32_t>(m_Paths.size() - 1);
+	}
+
+	void NNGpuProfiler::collect(FrameQueries& frame, std::pmr::memory_resource* scratch)
+	{
+		if (frame.queryCount == 0) {
+			return;
+		}
+
+		std::pmr::vector<uint64_t> timestamps(frame.queryCount, scratch);
+		VkResult result = vkGetQueryPoolResults(
+			m_Device.device(),
+			frame.queryPool,
+			0,
+			frame.queryCount,
+			timestamps.size() * sizeof(uint64_t),
+			timestamps.data(),
+			sizeof(uint64_t),
+			VK_QUERY_RESULT_64_BIT);
+		if (result != VK_SUCCESS) {
+			return;
+		}
+
+		std::pmr::vector<uint64_t> statistics(frame.statisticsCount * STATISTICS_COUNT, scratch);
+		if (frame.statisticsCount > 0) {
+			result = vkGetQueryPoolResults(
+				m_Device.device(),
+				frame.statisticsPool,
+				0,
+				frame.statisticsCount,
+				statistics.size() * sizeof(uint64_t),
+				statistics.data(),
+				STATISTICS_COUNT * sizeof(uint64_t),
+				VK_QUERY_RESULT_64_BIT);
+			if (result != VK_SUCCESS) {
+				return;
+			}
+		}
+
+		m_LastTimings.resize(frame.scopes.size());
+		for (size_t i = 0; i < frame.scopes.size(); i++) {
+			const Scope& scope = frame.scopes[i];
+			Path& path = m_Paths[scope.path];
+			PassTiming& timing = m_LastTimings[i];
+			// Assigning keeps the strings' buffers when the same scope was here last frame
+			timing.name = path.name;
+			timing.path = path.path;
+			timing.depth = scope.depth;
+			timing.parent = scope.parent;
+			uint64_t ticks = (timestamps[scope.endQuery] - timestamps[scope.beginQuery]) & m_TimestampMask;
+			timing.milliseconds = ticks * m_TimestampPeriod / 1000000.0;
+			if (m_Calibrated) {
+				double begin = m_CpuTimeOffset + (timestamps[scope.beginQuery] & m_TimestampMask) * m_TimestampPeriod;
+				NNCpuProfiler::addGpuEvent(path.path, static_cast<uint64_t>(begin), static_cast<uint64_t>(begin + ticks * m_TimestampPeriod));
+			}
+			timing.hasStatistics = scope.statisticsQuery >= 0;
+			timing.statistics = {};
+			if (timing.hasStatistics) {
+				const uint64_t* values = &statistics[scope.statisticsQuery * STATISTICS_COUNT];
+				timing.statistics = { values[0], values[1], values[2], values[3] };
+			}
+
+			path.accumulatedMilliseconds += timing.milliseconds;
+			path.accumulatedCount++;
+		}
+	}
+}
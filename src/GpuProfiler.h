@@ -0,0 +1,139 @@
+#pragma once
+
+#include "Device.h"
+
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+namespace NNuts {
+	// Measures GPU time of named, nestable scopes (render passes, render systems, ...) with timestamp
+	// queries. Every frame in flight owns its own query pools, so results are read back without
+	// stalling once that frame's timeline value has been waited on.
+	// With the pipelineStatisticsQuery feature the outermost open scope also counts vertex, clipping
+	// and fragment work. Statistics queries can't nest, nested scopes only get timings.
+	class NNGpuProfiler {
+	public:
+		struct PipelineStatistics {
+			uint64_t vertexShaderInvocations = 0;
+			uint64_t clippingInvocations = 0;
+			uint64_t clippingPrimitives = 0;
+			uint64_t fragmentShaderInvocations = 0;
+		};
+
+		// One node of the frame tree, stored in pre-order
+		struct PassTiming {
+			std::string name;
+			// Parent names joined with '/', e.g. "scene/main"
+			std::string path;
+			uint32_t depth = 0;
+			int32_t parent = -1;
+			double milliseconds = 0.0;
+			bool hasStatistics = false;
+			PipelineStatistics statistics{};
+		};
+
+		// Scope that ends when it goes out of scope, does nothing without a profiler
+		class ScopedPass {
+		public:
+			ScopedPass(NNGpuProfiler* profiler, VkCommandBuffer commandBuffer, const std::string& name)
+				: m_Profiler{ profiler }, m_CommandBuffer{ commandBuffer } {
+				if (m_Profiler) {
+					m_Profiler->beginPass(m_CommandBuffer, name);
+				}
+			}
+			~ScopedPass() {
+				if (m_Profiler) {
+					m_Profiler->endPass(m_CommandBuffer);
+				}
+			}
+
+			ScopedPass(const ScopedPass&) = delete;
+			ScopedPass& operator=(const ScopedPass&) = delete;
+
+		private:
+			NNGpuProfiler* m_Profiler;
+			VkCommandBuffer m_CommandBuffer;
+		};
+
+		NNGpuProfiler(NNDevice& device, uint32_t maxPassesPerFrame = 32);
+		~NNGpuProfiler();
+
+		NNGpuProfiler(const NNGpuProfiler&) = delete;
+		NNGpuProfiler& operator=(const NNGpuProfiler&) = delete;
+
+		bool isSupported() const { return m_Supported; }
+		bool hasPipelineStatistics() const { return m_StatisticsSupported; }
+		bool isCalibrated() const { return m_Calibrated; }
+
+		// Maps GPU timestamps onto NNCpuProfiler::now() by writing one timestamp and waiting for it, which
+		// idles the graphics queue. Afterwards finished scopes also show up in CPU profiler captures.
+		void calibrate();
+
+		// Collects the previous results of this frame slot and resets its queries.
+		// Has to be recorded outside of a render pass. scratch holds the query results while collecting.
+		void beginFrame(
+			VkCommandBuffer commandBuffer,
+			int frameIndex,
+			std::pmr::memory_resource* scratch = std::pmr::get_default_resource());
+		// A pass that has statistics has to begin and end in the same subpass, or both outside of a render pass
+		void beginPass(VkCommandBuffer commandBuffer, const std::string& name);
+		void endPass(VkCommandBuffer commandBuffer);
+
+		// Tree of the most recent frame whose results are available. Entries are overwritten in place,
+		// so a frame with the same passes as the one before doesn't allocate.
+		const std::vector<PassTiming>& getLastTimings() const { return m_LastTimings; }
+		// Per path average since the previous call, in first seen order
+		std::vector<PassTiming> takeAverages();
+
+	private:
+		// Interned scope path, built once the first time a name shows up under a parent
+		struct Path {
+			std::string name;
+			std::string path;
+			int32_t parent = -1;
+			double accumulatedMilliseconds = 0.0;
+			uint32_t accumulatedCount = 0;
+		};
+
+		struct Scope {
+			uint32_t path = 0;
+			uint32_t depth = 0;
+			int32_t parent = -1;
+			uint32_t beginQuery = 0;
+			uint32_t endQuery = 0;
+			int32_t statisticsQuery = -1;
+		};
+
+		struct FrameQueries {
+			VkQueryPool queryPool = VK_NULL_HANDLE;
+			VkQueryPool statisticsPool = VK_NULL_HANDLE;
+			std::vector<Scope> scopes{};
+			uint32_t queryCount = 0;
+			uint32_t statisticsCount = 0;
+		};
+
+		void collect(FrameQueries& frame, std::pmr::memory_resource* scratch);
+		uint32_t internPath(int32_t parent, const std::string& name);
+
+		NNDevice& m_Device;
+		uint32_t m_MaxPasses;
+		bool m_Supported = false;
+		bool m_StatisticsSupported = false;
+		double m_TimestampPeriod = 1.0;
+		uint64_t m_TimestampMask = ~0ull;
+		bool m_Calibrated = false;
+		// CPU nanoseconds at GPU tick 0
+		double m_CpuTimeOffset = 0.0;
+
+		std::vector<FrameQueries> m_Frames;
+		FrameQueries* m_CurrentFrame = nullptr;
+		// Indices into m_CurrentFrame->scopes, innermost last. Passes dropped for lack of queries are -1.
+		std::vector<int32_t> m_OpenPasses;
+		bool m_StatisticsOpen = false;
+
+		std::vector<PassTiming> m_LastTimings;
+		// Indexed by Scope::path, in first seen order
+		std::vector<Path> m_Paths;
+	};
+}
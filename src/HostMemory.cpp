@@ -0,0 +1,360 @@
+#include "HostMemory.h"
+
+#include "RenderStats.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+
+namespace NNuts {
+	namespace {
+		constexpr const char* TAG_NAMES[NNHostMemory::TAG_COUNT] = {
+			"instance",
+			"device",
+			"swap chain",
+			"command pool",
+			"device memory",
+			"buffer",
+			"image",
+			"image view",
+			"sampler",
+			"shader module",
+			"pipeline",
+			"pipeline layout",
+			"render pass",
+			"framebuffer",
+			"descriptor set layout",
+			"descriptor pool",
+			"descriptor update template",
+			"semaphore",
+			"query pool",
+		};
+		constexpr const char* SCOPE_NAMES[NNHostMemory::SCOPE_COUNT] = {
+			"command",
+			"object",
+			"cache",
+			"device",
+			"instance",
+		};
+
+		struct Counters {
+			std::atomic<uint64_t> bytes{ 0 };
+			std::atomic<uint64_t> peakBytes{ 0 };
+			std::atomic<uint64_t> liveAllocations{ 0 };
+			std::atomic<uint64_t> totalAllocations{ 0 };
+			std::atomic<uint64_t> internalBytes{ 0 };
+
+			void allocated(uint64_t size) {
+				uint64_t bytesNow = bytes.fetch_add(size, std::memory_order_relaxed) + size;
+				uint64_t peak = peakBytes.load(std::memory_order_relaxed);
+				while (bytesNow > peak && !peakBytes.compare_exchange_weak(peak, bytesNow, std::memory_order_relaxed)) {
+				}
+				liveAllocations.fetch_add(1, std::memory_order_relaxed);
+				totalAllocations.fetch_add(1, std::memory_order_relaxed);
+			}
+
+			void freed(uint64_t size) {
+				bytes.fetch_sub(size, std::memory_order_relaxed);
+				liveAllocations.fetch_sub(1, std::memory_order_relaxed);
+			}
+
+			NNHostMemory::Usage load() const {
+				NNHostMemory::Usage usage{};
+				usage.bytes = bytes.load(std::memory_order_relaxed);
+				usage.peakBytes = peakBytes.load(std::memory_order_relaxed);
+				usage.liveAllocations = liveAllocations.load(std::memory_order_relaxed);
+				usage.totalAllocations = totalAllocations.load(std::memory_order_relaxed);
+				usage.internalBytes = internalBytes.load(std::memory_order_relaxed);
+				return usage;
+			}
+		};
+
+		std::array<Counters, NNHostMemory::TAG_COUNT> g_TagCounters;
+		std::array<Counters, NNHostMemory::SCOPE_COUNT> g_ScopeCounters;
+
+		// Sits right in front of every block handed to the driver
+		struct Header {
+			void* base;
+			size_t size;
+			uint32_t tag;
+			uint32_t scope;
+		};
+
+		Header readHeader(void* memory)
+		{
+			Header header;
+			std::memcpy(&header, static_cast<char*>(memory) - sizeof(Header), sizeof(Header));
+			return header;
+		}
+
+		void* VKAPI_PTR hostAllocate(void* userData, size_t size, size_t alignment, VkSystemAllocationScope scope)
+		{
+			alignment = std::max(alignment, alignof(std::max_align_t));
+			void* base = std::malloc(size + alignment - 1 + sizeof(Header));
+			if (base == nullptr) {
+				return nullptr;
+			}
+
+			uintptr_t address = reinterpret_cast<uintptr_t>(base) + sizeof(Header);
+			address = (address + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1);
+			void* memory = reinterpret_cast<void*>(address);
+
+			Header header{ base, size, static_cast<uint32_t>(reinterpret_cast<uintptr_t>(userData)), static_cast<uint32_t>(scope) };
+			std::memcpy(static_cast<char*>(memory) - sizeof(Header), &header, sizeof(Header));
+			g_TagCounters[header.tag].allocated(size);
+			g_ScopeCounters[header.scope].allocated(size);
+			return memory;
+		}
+
+		void VKAPI_PTR hostFree(void*, void* memory)
+		{
+			if (memory == nullptr) {
+				return;
+			}
+			// Counted against the tag it was allocated with, whichever callbacks free it
+			Header header = readHeader(memory);
+			g_TagCounters[header.tag].freed(header.size);
+			g_ScopeCounters[header.scope].freed(header.size);
+			std::free(header.base);
+		}
+
+		void* VKAPI_PTR hostReallocate(void* userData, void* original, size_t size, size_t alignment, VkSystemAllocationScope scope)
+		{
+			if (original == nullptr) {
+				return hostAllocate(userData, size, alignment, scope);
+			}
+			if (size == 0) {
+				hostFree(userData, original);
+				return nullptr;
+			}
+
+			void* memory = hostAllocate(userData, size, alignment, scope);
+			if (memory == nullptr) {
+				return nullptr;
+			}
+			std::memcpy(memory, original, std::min(size, readHeader(original).size));
+			hostFree(userData, original);
+			return memory;
+		}
+
+		void VKAPI_PTR internalAllocation(void* userData, size_t size, VkInternalAllocationType, VkSystemAllocationScope scope)
+		{
+			g_TagCounters[reinterpret_cast<uintptr_t>(userData)].internalBytes.fetch_add(size, std::memory_order_relaxed);
+			g_ScopeCounters[scope].internalBytes.fetch_add(size, std::memory_order_relaxed);
+		}
+
+		void VKAPI_PTR internalFree(void* userData, size_t size, VkInternalAllocationType, VkSystemAllocationScope scope)
+		{
+			g_TagCounters[reinterpret_cast<uintptr_t>(userData)].internalBytes.fetch_sub(size, std::memory_order_relaxed);
+			g_ScopeCounters[scope].internalBytes.fetch_sub(size, std::memory_order_relaxed);
+		}
+
+		std::array<VkAllocationCallbacks, NNHostMemory::TAG_COUNT> makeCallbacks()
+		{
+			std::array<VkAllocationCallbacks, NNHostMemory::TAG_COUNT> callbacks{};
+			for (uint32_t i = 0; i < NNHostMemory::TAG_COUNT; i++) {
+				// The tag rides along as the user data
+				callbacks[i].pUserData = reinterpret_cast<void*>(static_cast<uintptr_t>(i));
+				callbacks[i].pfnAllocation = hostAllocate;
+				callbacks[i].pfnReallocation = hostReallocate;
+				callbacks[i].pfnFree = hostFree;
+				callbacks[i].pfnInternalAllocation = internalAllocation;
+				callbacks[i].pfnInternalFree = internalFree;
+			}
+			return callbacks;
+		}
+
+#if NN_TRACK_HEAP_ALLOCATIONS
+		std::atomic<uint64_t> g_HeapAllocations{ 0 };
+		thread_local uint64_t t_HeapAllocations = 0;
+
+		void* heapAllocate(std::size_t size, std::size_t alignment)
+		{
+			g_HeapAllocations.fetch_add(1, std::memory_order_relaxed);
+			t_HeapAllocations++;
+			NNRenderStats::add(NNRenderStats::Counter::HeapAllocations);
+
+			size = std::max<std::size_t>(size, 1);
+			if (alignment <= alignof(std::max_align_t)) {
+				return std::malloc(size);
+			}
+#ifdef _WIN32
+			return _aligned_malloc(size, alignment);
+#else
+			return std::aligned_alloc(alignment, (size + alignment - 1) & ~(alignment - 1));
+#endif
+		}
+
+		void heapFree(void* memory, std::size_t alignment)
+		{
+#ifdef _WIN32
+			if (alignment > alignof(std::max_align_t)) {
+				_aligned_free(memory);
+				return;
+			}
+#endif
+			std::free(memory);
+		}
+#endif
+	}
+
+	const VkAllocationCallbacks* NNHostMemory::callbacks(Tag tag)
+	{
+		static const std::array<VkAllocationCallbacks, TAG_COUNT> callbacks = makeCallbacks();
+		return &callbacks[static_cast<uint32_t>(tag)];
+	}
+
+	const char* NNHostMemory::tagName(Tag tag)
+	{
+		return TAG_NAMES[static_cast<uint32_t>(tag)];
+	}
+
+	const char* NNHostMemory::scopeName(VkSystemAllocationScope scope)
+	{
+		return SCOPE_NAMES[scope];
+	}
+
+	NNHostMemory::Usage NNHostMemory::getUsage(Tag tag)
+	{
+		return g_TagCounters[static_cast<uint32_t>(tag)].load();
+	}
+
+	NNHostMemory::Usage NNHostMemory::getUsage(VkSystemAllocationScope scope)
+	{
+		return g_ScopeCounters[scope].load();
+	}
+
+	uint64_t NNHostMemory::getTotalBytes()
+	{
+		uint64_t bytes = 0;
+		for (auto& counters : g_TagCounters) {
+			bytes += counters.bytes.load(std::memory_order_relaxed);
+		}
+		return bytes;
+	}
+
+	void NNHostMemory::printUsage()
+	{
+		std::cout << "Driver host memory: " << getTotalBytes() / 1024 << " KiB" << std::endl;
+		for (uint32_t i = 0; i < TAG_COUNT; i++) {
+			Usage usage = g_TagCounters[i].load();
+			if (usage.totalAllocations == 0 && usage.internalBytes == 0) {
+				continue;
+			}
+			std::cout << "  " << TAG_NAMES[i] << ": " << usage.bytes << " bytes in " << usage.liveAllocations
+				<< " allocations (peak " << usage.peakBytes << ", " << usage.totalAllocations << " total";
+			if (usage.internalBytes > 0) {
+				std::cout << ", " << usage.internalBytes << " internal";
+			}
+			std::cout << ")" << std::endl;
+		}
+		std::cout << "  by scope:";
+		for (uint32_t i = 0; i < SCOPE_COUNT; i++) {
+			std::cout << " " << SCOPE_NAMES[i] << " " << g_ScopeCounters[i].bytes.load(std::memory_order_relaxed);
+		}
+		std::cout << " bytes" << std::endl;
+	}
+
+	uint64_t NNHostMemory::getHeapAllocations()
+	{
+#if NN_TRACK_HEAP_ALLOCATIONS
+		return g_HeapAllocations.load(std::memory_order_relaxed);
+#else
+		return 0;
+#endif
+	}
+
+	uint64_t NNHostMemory::getThreadHeapAllocations()
+	{
+#if NN_TRACK_HEAP_ALLOCATIONS
+		return t_HeapAllocations;
+#else
+		return 0;
+#endif
+	}
+}
+
+#if NN_TRACK_HEAP_ALLOCATIONS
+void* operator new(std::size_t size)
+{
+	void* memory = NNuts::heapAllocate(size, alignof(std::max_align_t));
+	if (memory == nullptr) {
+		throw std::bad_alloc{};
+	}
+	return memory;
+}
+
+void* operator new[](std::size_t size)
+{
+	return operator new(size);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+	void* memory = NNuts::heapAllocate(size, static_cast<std::size_t>(alignment));
+	if (memory == nullptr) {
+		throw std::bad_alloc{};
+	}
+	return memory;
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment)
+{
+	return operator new(size, alignment);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+	return NNuts::heapAllocate(size, alignof(std::max_align_t));
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+	return NNuts::heapAllocate(size, alignof(std::max_align_t));
+}
+
+void operator delete(void* memory) noexcept
+{
+	NNuts::heapFree(memory, alignof(std::max_align_t));
+}
+
+void operator delete[](void* memory) noexcept
+{
+	NNuts::heapFree(memory, alignof(std::max_align_t));
+}
+
+void operator delete(void* memory, std::size_t) noexcept
+{
+	NNuts::heapFree(memory, alignof(std::max_align_t));
+}
+
+void operator delete[](void* memory, std::size_t) noexcept
+{
+	NNuts::heapFree(memory, alignof(std::max_align_t));
+}
+
+void operator delete(void* memory, std::align_val_t alignment) noexcept
+{
+	NNuts::heapFree(memory, static_cast<std::size_t>(alignment));
+}
+
+void operator delete[](void* memory, std::align_val_t alignment) noexcept
+{
+	NNuts::heapFree(memory, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void* memory, std::size_t, std::align_val_t alignment) noexcept
+{
+	NNuts::heapFree(memory, static_cast<std::size_t>(alignment));
+}
+
+void operator delete[](void* memory, std::size_t, std::align_val_t alignment) noexcept
+{
+	NNuts::heapFree(memory, static_cast<std::size_t>(alignment));
+}
+#endif
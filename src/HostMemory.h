@@ -0,0 +1,79 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+
+// Replaces the global operator new/delete to count heap allocations. Off by default, the
+// benchmark target turns it on.
+#ifndef NN_TRACK_HEAP_ALLOCATIONS
+#define NN_TRACK_HEAP_ALLOCATIONS 0
+#endif
+
+namespace NNuts {
+	// Host memory accounting. Every Vulkan object is created and destroyed with the callbacks of its
+	// tag, so driver allocations are attributed per object type and per VkSystemAllocationScope.
+	// All tags share one allocation scheme, memory may be freed through any of them.
+	class NNHostMemory {
+	public:
+		enum class Tag : uint32_t {
+			Instance,
+			Device,
+			SwapChain,
+			CommandPool,
+			DeviceMemory,
+			Buffer,
+			Image,
+			ImageView,
+			Sampler,
+			ShaderModule,
+			Pipeline,
+			PipelineLayout,
+			RenderPass,
+			Framebuffer,
+			DescriptorSetLayout,
+			DescriptorPool,
+			DescriptorUpdateTemplate,
+			Semaphore,
+			QueryPool,
+			Count
+		};
+		static constexpr uint32_t TAG_COUNT = static_cast<uint32_t>(Tag::Count);
+		static constexpr uint32_t SCOPE_COUNT = VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1;
+
+		struct Usage {
+			uint64_t bytes = 0;
+			uint64_t peakBytes = 0;
+			uint64_t liveAllocations = 0;
+			uint64_t totalAllocations = 0;
+			// Reported by the driver through the internal allocation notifications
+			uint64_t internalBytes = 0;
+		};
+
+		// Counts the heap allocations of the calling thread while alive, for checking that a block of
+		// code doesn't allocate. Always reports 0 without NN_TRACK_HEAP_ALLOCATIONS.
+		class AllocationCounter {
+		public:
+			AllocationCounter() : m_Start{ getThreadHeapAllocations() } {}
+			uint64_t count() const { return getThreadHeapAllocations() - m_Start; }
+
+		private:
+			uint64_t m_Start;
+		};
+
+		static const VkAllocationCallbacks* callbacks(Tag tag);
+
+		static const char* tagName(Tag tag);
+		static const char* scopeName(VkSystemAllocationScope scope);
+		static Usage getUsage(Tag tag);
+		static Usage getUsage(VkSystemAllocationScope scope);
+		// Driver host memory over all tags
+		static uint64_t getTotalBytes();
+		static void printUsage();
+
+		static bool isTrackingHeapAllocations() { return NN_TRACK_HEAP_ALLOCATIONS != 0; }
+		// operator new calls since start, over all threads / on the calling thread
+		static uint64_t getHeapAllocations();
+		static uint64_t getThreadHeapAllocations();
+	};
+}
@@ -20,7 +20,7 @@ namespace NNuts {
             int lookDown = GLFW_KEY_DOWN;
 		};
 
-        void moveInPlaneXZ(GLFWwindow* window, float dt, NNGameObject& gameObject);
+        void moveInPlaneXZ(GLFWwindow* window, float dt, TransformComponent& transform);
 
         KeyMappings keys{};
         float moveSpeed{ 3.f };
@@ -0,0 +1,175 @@
+#include "LayoutCache.h"
+
+#include "HostMemory.h"
+#include "ShaderReflection.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <numeric>
+#include <stdexcept>
+
+namespace NNuts {
+	NNLayoutCache::NNLayoutCache(NNDevice& device) : m_Device{ device }
+	{
+	}
+
+	NNLayoutCache::~NNLayoutCache()
+	{
+		for (auto& kv : m_PipelineLayouts) {
+			vkDestroyPipelineLayout(m_Device.device(), kv.second, NNHostMemory::callbacks(NNHostMemory::Tag::PipelineLayout));
+		}
+		for (auto& kv : m_Samplers) {
+			vkDestroySampler(m_Device.device(), kv.second, NNHostMemory::callbacks(NNHostMemory::Tag::Sampler));
+		}
+	}
+
+	std::shared_ptr<NNDescriptorSetLayout> NNLayoutCache::getDescriptorSetLayout(
+		const std::vector<VkDescriptorSetLayoutBinding>& bindings,
+		VkDescriptorSetLayoutCreateFlags flags,
+		const std::vector<VkDescriptorBindingFlags>& bindingFlags)
+	{
+		assert((bindingFlags.empty() || bindingFlags.size() == bindings.size()) && "One set of flags per binding");
+		std::vector<size_t> order(bindings.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return bindings[a].binding < bindings[b].binding; });
+
+		std::vector<VkDescriptorSetLayoutBinding> sorted{};
+		std::vector<VkDescriptorBindingFlags> sortedFlags{};
+		std::vector<uint64_t> key{ flags };
+		key.reserve(1 + bindings.size() * 5);
+		for (size_t i : order) {
+			auto& binding = bindings[i];
+			VkDescriptorBindingFlags bindingFlag = bindingFlags.empty() ? 0 : bindingFlags[i];
+			sorted.push_back(binding);
+			sortedFlags.push_back(bindingFlag);
+
+			key.push_back(binding.binding);
+			key.push_back(static_cast<uint64_t>(binding.descriptorType));
+			key.push_back(binding.descriptorCount);
+			key.push_back(binding.stageFlags);
+			key.push_back(bindingFlag);
+			// Immutable samplers come from getSampler, so equal handles mean equal sampler state
+			if (binding.pImmutableSamplers != nullptr) {
+				for (uint32_t j = 0; j < binding.descriptorCount; j++) {
+					key.push_back(reinterpret_cast<uint64_t>(binding.pImmutableSamplers[j]));
+				}
+			}
+		}
+
+		auto it = m_SetLayouts.find(key);
+		if (it != m_SetLayouts.end()) {
+			return it->second;
+		}
+
+		auto layout = std::make_shared<NNDescriptorSetLayout>(m_Device, std::move(sorted), flags, sortedFlags);
+		m_SetLayouts.emplace(std::move(key), layout);
+		return layout;
+	}
+
+	VkPipelineLayout NNLayoutCache::getPipelineLayout(
+		const std::vector<VkDescriptorSetLayout>& setLayouts,
+		const std::vector<VkPushConstantRange>& pushConstantRanges)
+	{
+		std::vector<VkPushConstantRange> sortedRanges = pushConstantRanges;
+		std::sort(sortedRanges.begin(), sortedRanges.end(), [](const auto& a, const auto& b) {
+			return a.offset != b.offset ? a.offset < b.offset : a.stageFlags < b.stageFlags;
+		});
+
+		std::vector<uint64_t> key{};
+		key.push_back(setLayouts.size());
+		for (auto setLayout : setLayouts) {
+			key.push_back(reinterpret_cast<uint64_t>(setLayout));
+		}
+		for (auto& range : sortedRanges) {
+			key.push_back(range.stageFlags);
+			key.push_back((static_cast<uint64_t>(range.offset) << 32) | range.size);
+		}
+
+		auto it = m_PipelineLayouts.find(key);
+		if (it != m_PipelineLayouts.end()) {
+			return it->second;
+		}
+
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+		pipelineLayoutInfo.pSetLayouts = setLayouts.data();
+		pipelineLayoutInfo.pushConstantRangeCount = static_cast<uint32_t>(sortedRanges.size());
+		pipelineLayoutInfo.pPushConstantRanges = sortedRanges.data();
+
+		VkPipelineLayout pipelineLayout;
+		if (vkCreatePipelineLayout(m_Device.device(), &pipelineLayoutInfo, NNHostMemory::callbacks(NNHostMemory::Tag::PipelineLayout), &pipelineLayout) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create pipeline layout!");
+		}
+
+		m_PipelineLayouts.emplace(std::move(key), pipelineLayout);
+		return pipelineLayout;
+	}
+
+	VkPipelineLayout NNLayoutCache::getPipelineLayout(
+		const NNShaderReflection& reflection,
+		const std::map<uint32_t, VkDescriptorSetLayout>& overrides)
+	{
+		uint32_t setCount = reflection.getSetCount();
+		if (!overrides.empty()) {
+			setCount = std::max(setCount, overrides.rbegin()->first + 1);
+		}
+
+		std::vector<VkDescriptorSetLayout> setLayouts{};
+		for (uint32_t set = 0; set < setCount; set++) {
+			auto it = overrides.find(set);
+			if (it != overrides.end()) {
+				setLayouts.push_back(it->second);
+			}
+			else {
+				// Unused sets in between still need a (possibly empty) layout
+				setLayouts.push_back(getDescriptorSetLayout(reflection.getSetBindings(set))->getDescriptorSetLayout());
+			}
+		}
+
+		return getPipelineLayout(setLayouts, reflection.getPushConstantRanges());
+	}
+
+	VkSampler NNLayoutCache::getSampler(const VkSamplerCreateInfo& samplerInfo)
+	{
+		assert(samplerInfo.pNext == nullptr && "Sampler extensions aren't part of the cache key");
+		auto bits = [](float value) {
+			uint32_t result;
+			std::memcpy(&result, &value, sizeof(result));
+			return result;
+		};
+
+		std::vector<uint32_t> key{
+			samplerInfo.flags,
+			static_cast<uint32_t>(samplerInfo.magFilter),
+			static_cast<uint32_t>(samplerInfo.minFilter),
+			static_cast<uint32_t>(samplerInfo.mipmapMode),
+			static_cast<uint32_t>(samplerInfo.addressModeU),
+			static_cast<uint32_t>(samplerInfo.addressModeV),
+			static_cast<uint32_t>(samplerInfo.addressModeW),
+			bits(samplerInfo.mipLodBias),
+			samplerInfo.anisotropyEnable,
+			bits(samplerInfo.maxAnisotropy),
+			samplerInfo.compareEnable,
+			static_cast<uint32_t>(samplerInfo.compareOp),
+			bits(samplerInfo.minLod),
+			bits(samplerInfo.maxLod),
+			static_cast<uint32_t>(samplerInfo.borderColor),
+			samplerInfo.unnormalizedCoordinates,
+		};
+
+		auto it = m_Samplers.find(key);
+		if (it != m_Samplers.end()) {
+			return it->second;
+		}
+
+		VkSampler sampler;
+		if (vkCreateSampler(m_Device.device(), &samplerInfo, NNHostMemory::callbacks(NNHostMemory::Tag::Sampler), &sampler) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create sampler!");
+		}
+
+		m_Samplers.emplace(std::move(key), sampler);
+		return sampler;
+	}
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "Descriptor.h"
+#include "Device.h"
+
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace NNuts {
+	class NNShaderReflection;
+
+	// Hands out shared descriptor set layouts, pipeline layouts and samplers so identical descriptions
+	// map to a single Vulkan object. Descriptions are flattened into sorted keys, so the order bindings
+	// and push constant ranges are listed in doesn't matter. Pipelines built from the same layouts stay
+	// compatible with each other's bound descriptor sets.
+	class NNLayoutCache {
+	public:
+		NNLayoutCache(NNDevice& device);
+		~NNLayoutCache();
+
+		NNLayoutCache(const NNLayoutCache&) = delete;
+		NNLayoutCache& operator=(const NNLayoutCache&) = delete;
+
+		// bindingFlags is either empty or one entry per binding, in the same order
+		std::shared_ptr<NNDescriptorSetLayout> getDescriptorSetLayout(
+			const std::vector<VkDescriptorSetLayoutBinding>& bindings,
+			VkDescriptorSetLayoutCreateFlags flags = 0,
+			const std::vector<VkDescriptorBindingFlags>& bindingFlags = {});
+
+		VkPipelineLayout getPipelineLayout(
+			const std::vector<VkDescriptorSetLayout>& setLayouts,
+			const std::vector<VkPushConstantRange>& pushConstantRanges);
+
+		// Builds one set layout per reflected set. Sets listed in `overrides` use the given layout instead,
+		// which is how a render system plugs in a layout that is shared with the rest of the frame.
+		VkPipelineLayout getPipelineLayout(
+			const NNShaderReflection& reflection,
+			const std::map<uint32_t, VkDescriptorSetLayout>& overrides = {});
+
+		// Samplers live as long as the cache, so they can also be used as immutable samplers
+		VkSampler getSampler(const VkSamplerCreateInfo& samplerInfo);
+
+		size_t descriptorSetLayoutCount() const { return m_SetLayouts.size(); }
+		size_t pipelineLayoutCount() const { return m_PipelineLayouts.size(); }
+		size_t samplerCount() const { return m_Samplers.size(); }
+
+	private:
+		struct KeyHash {
+			template<typename T>
+			size_t operator()(const std::vector<T>& key) const {
+				// FNV-1a over the key's words
+				uint64_t hash = 14695981039346656037ull;
+				for (T word : key) {
+					hash = (hash ^ static_cast<uint64_t>(word)) * 1099511628211ull;
+				}
+				return static_cast<size_t>(hash);
+			}
+		};
+
+		NNDevice& m_Device;
+
+		std::unordered_map<std::vector<uint64_t>, std::shared_ptr<NNDescriptorSetLayout>, KeyHash> m_SetLayouts;
+		std::unordered_map<std::vector<uint64_t>, VkPipelineLayout, KeyHash> m_PipelineLayouts;
+		std::unordered_map<std::vector<uint32_t>, VkSampler, KeyHash> m_Samplers;
+	};
+}
@@ -0,0 +1,276 @@
+#include "LightClusters.h"
+
+#include "CpuProfiler.h"
+#include "RenderStats.h"
+#include "SwapChain.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <string>
+
+namespace NNuts {
+	NNLightClusters::NNLightClusters(NNDevice& device) : m_Device{ device }
+	{
+		m_Frames.resize(NNSwapChain::MAX_FRAMES_IN_FLIGHT);
+		for (auto& frame : m_Frames) {
+			frame.lights = std::make_unique<NNBuffer>(
+				m_Device,
+				sizeof(PointLight),
+				MAX_LIGHTS,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+			frame.grid = std::make_unique<NNBuffer>(
+				m_Device,
+				sizeof(glm::uvec2),
+				CLUSTER_COUNT,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+			frame.indices = std::make_unique<NNBuffer>(
+				m_Device,
+				sizeof(uint32_t),
+				MAX_LIGHT_INDICES,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+
+			frame.lights->map();
+			frame.grid->map();
+			frame.indices->map();
+		}
+
+		m_Slices.resize(GRID_Z);
+
+		// The calling thread takes slices too, so it counts as one of the workers
+		uint32_t workerCount = std::min(std::thread::hardware_concurrency(), GRID_Z);
+		for (uint32_t worker = 1; worker < workerCount; worker++) {
+			m_Workers.emplace_back(&NNLightClusters::workerLoop, this, worker);
+		}
+	}
+
+	NNLightClusters::~NNLightClusters()
+	{
+		{
+			std::lock_guard<std::mutex> lock{ m_WorkMutex };
+			m_StopWorkers = true;
+		}
+		m_WorkReady.notify_all();
+		for (auto& worker : m_Workers) {
+			worker.join();
+		}
+	}
+
+	ClusterUniforms NNLightClusters::update(int frameIndex, const NNCamera& camera, const std::vector<PointLight>& lights)
+	{
+		NN_PROFILE_SCOPE("light clusters");
+		auto start = std::chrono::high_resolution_clock::now();
+
+		m_Near = camera.getNearClip();
+		m_Far = camera.getFarClip();
+		float logRange = std::log(m_Far / m_Near);
+		m_LogScale = GRID_Z / logRange;
+		m_LogBias = -static_cast<float>(GRID_Z) * std::log(m_Near) / logRange;
+
+		uint32_t lightCount = static_cast<uint32_t>(std::min<size_t>(lights.size(), MAX_LIGHTS));
+		const glm::mat4& view = camera.getView();
+
+		m_ViewLights.resize(lightCount);
+		for (uint32_t i = 0; i < lightCount; i++) {
+			ViewLight& viewLight = m_ViewLights[i];
+			viewLight.center = glm::vec3(view * glm::vec4(glm::vec3(lights[i].positionRadius), 1.0f));
+			viewLight.radius = lights[i].positionRadius.w;
+
+			float minDepth = viewLight.center.z - viewLight.radius;
+			float maxDepth = viewLight.center.z + viewLight.radius;
+			if (maxDepth < m_Near || minDepth > m_Far) {
+				// Empty slice range, the light is skipped by every slice
+				viewLight.firstSlice = 1;
+				viewLight.lastSlice = 0;
+				continue;
+			}
+			viewLight.firstSlice = sliceForDepth(std::max(minDepth, m_Near));
+			viewLight.lastSlice = sliceForDepth(std::min(maxDepth, m_Far));
+		}
+
+		const glm::mat4& projection = camera.getProjection();
+		m_NextSlice.store(0, std::memory_order_relaxed);
+		if (m_Workers.empty() || lightCount < PARALLEL_LIGHT_COUNT) {
+			assignSlices(projection);
+		}
+		else {
+			{
+				std::lock_guard<std::mutex> lock{ m_WorkMutex };
+				m_WorkProjection = &projection;
+				m_BusyWorkers = static_cast<uint32_t>(m_Workers.size());
+				m_WorkGeneration++;
+			}
+			m_WorkReady.notify_all();
+			assignSlices(projection);
+
+			std::unique_lock<std::mutex> lock{ m_WorkMutex };
+			m_WorkDone.wait(lock, [this]() { return m_BusyWorkers == 0; });
+		}
+
+		FrameBuffers& frame = m_Frames[frameIndex];
+		auto grid = static_cast<glm::uvec2*>(frame.grid->getMappedMemory());
+		auto indices = static_cast<uint32_t*>(frame.indices->getMappedMemory());
+
+		Stats stats{};
+		stats.lightCount = lightCount;
+		uint32_t base = 0;
+		for (uint32_t slice = 0; slice < GRID_Z; slice++) {
+			SliceResult& result = m_Slices[slice];
+			uint32_t sliceCount = static_cast<uint32_t>(result.indices.size());
+			if (base + sliceCount > MAX_LIGHT_INDICES) {
+				stats.overflowed = true;
+				sliceCount = MAX_LIGHT_INDICES - base;
+			}
+			std::memcpy(indices + base, result.indices.data(), sliceCount * sizeof(uint32_t));
+
+			for (uint32_t tile = 0; tile < GRID_X * GRID_Y; tile++) {
+				uint32_t offset = std::min(result.offsets[tile], sliceCount);
+				uint32_t count = std::min(result.counts[tile], sliceCount - offset);
+				grid[slice * GRID_X * GRID_Y + tile] = glm::uvec2{ base + offset, count };
+			}
+			base += sliceCount;
+		}
+		stats.lightIndexCount = base;
+
+		if (lightCount > 0) {
+			std::memcpy(frame.lights->getMappedMemory(), lights.data(), lightCount * sizeof(PointLight));
+		}
+		frame.lights->flush();
+		frame.grid->flush();
+		frame.indices->flush();
+		NNRenderStats::add(
+			NNRenderStats::Counter::BytesUploaded,
+			(lightCount * sizeof(PointLight)) + (GRID_X * GRID_Y * GRID_Z * sizeof(glm::uvec2)) + (base * sizeof(uint32_t)));
+
+		auto end = std::chrono::high_resolution_clock::now();
+		stats.milliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+		m_LastStats = stats;
+
+		ClusterUniforms uniforms{};
+		uniforms.grid = { GRID_X, GRID_Y, GRID_Z, lightCount };
+		uniforms.depthSlicing = { m_Near, m_Far, m_LogScale, m_LogBias };
+		uniforms.view = view;
+		uniforms.projection = projection;
+		return uniforms;
+	}
+
+	void NNLightClusters::assignSlices(const glm::mat4& projection)
+	{
+		NN_PROFILE_SCOPE("assign cluster slices");
+		// Slices are independent, taking them one by one evens out the busy ones
+		for (uint32_t slice = m_NextSlice.fetch_add(1, std::memory_order_relaxed); slice < GRID_Z;
+			slice = m_NextSlice.fetch_add(1, std::memory_order_relaxed)) {
+			assignSlice(slice, projection, m_Slices[slice]);
+		}
+	}
+
+	void NNLightClusters::workerLoop(uint32_t worker)
+	{
+		NNCpuProfiler::setThreadName("light clusters " + std::to_string(worker));
+		uint64_t generation = 0;
+		for (;;) {
+			const glm::mat4* projection;
+			{
+				std::unique_lock<std::mutex> lock{ m_WorkMutex };
+				m_WorkReady.wait(lock, [this, generation]() { return m_StopWorkers || m_WorkGeneration != generation; });
+				if (m_StopWorkers) {
+					return;
+				}
+				generation = m_WorkGeneration;
+				projection = m_WorkProjection;
+			}
+
+			assignSlices(*projection);
+
+			bool last;
+			{
+				std::lock_guard<std::mutex> lock{ m_WorkMutex };
+				last = --m_BusyWorkers == 0;
+			}
+			if (last) {
+				m_WorkDone.notify_one();
+			}
+		}
+	}
+
+	uint32_t NNLightClusters::sliceForDepth(float viewDepth) const
+	{
+		float slice = std::floor(std::log(viewDepth) * m_LogScale + m_LogBias);
+		return static_cast<uint32_t>(std::clamp(slice, 0.0f, static_cast<float>(GRID_Z - 1)));
+	}
+
+	void NNLightClusters::assignSlice(uint32_t slice, const glm::mat4& projection, SliceResult& result) const
+	{
+		constexpr uint32_t TILE_COUNT = GRID_X * GRID_Y;
+		float sliceNear = m_Near * std::pow(m_Far / m_Near, static_cast<float>(slice) / GRID_Z);
+		float sliceFar = m_Near * std::pow(m_Far / m_Near, static_cast<float>(slice + 1) / GRID_Z);
+		float scaleX = projection[0][0];
+		float scaleY = projection[1][1];
+
+		result.candidates.clear();
+		result.tileRects.clear();
+		result.counts.assign(TILE_COUNT, 0);
+
+		for (uint32_t i = 0; i < static_cast<uint32_t>(m_ViewLights.size()); i++) {
+			const ViewLight& light = m_ViewLights[i];
+			if (slice < light.firstSlice || slice > light.lastSlice) {
+				continue;
+			}
+
+			// Project the part of the light's bounding box inside this slice. x/z is monotonic in z,
+			// so the extremes sit on the slice's near or far plane.
+			float z0 = std::max(sliceNear, light.center.z - light.radius);
+			float z1 = std::min(sliceFar, light.center.z + light.radius);
+			float minX = light.center.x - light.radius;
+			float maxX = light.center.x + light.radius;
+			float minY = light.center.y - light.radius;
+			float maxY = light.center.y + light.radius;
+
+			float ndcMinX = std::min(minX / z0, minX / z1) * scaleX;
+			float ndcMaxX = std::max(maxX / z0, maxX / z1) * scaleX;
+			float ndcMinY = std::min(minY / z0, minY / z1) * scaleY;
+			float ndcMaxY = std::max(maxY / z0, maxY / z1) * scaleY;
+			if (ndcMaxX < -1.0f || ndcMinX > 1.0f || ndcMaxY < -1.0f || ndcMinY > 1.0f) {
+				continue;
+			}
+
+			auto toTile = [](float ndc, uint32_t tiles) {
+				float tile = std::floor((ndc * 0.5f + 0.5f) * tiles);
+				return static_cast<uint32_t>(std::clamp(tile, 0.0f, static_cast<float>(tiles - 1)));
+			};
+			glm::uvec4 rect{ toTile(ndcMinX, GRID_X), toTile(ndcMinY, GRID_Y), toTile(ndcMaxX, GRID_X), toTile(ndcMaxY, GRID_Y) };
+
+			for (uint32_t y = rect.y; y <= rect.w; y++) {
+				for (uint32_t x = rect.x; x <= rect.z; x++) {
+					result.counts[x + y * GRID_X]++;
+				}
+			}
+			result.candidates.push_back(i);
+			result.tileRects.push_back(rect);
+		}
+
+		result.offsets.resize(TILE_COUNT);
+		uint32_t total = 0;
+		for (uint32_t tile = 0; tile < TILE_COUNT; tile++) {
+			result.offsets[tile] = total;
+			total += result.counts[tile];
+		}
+
+		// Second pass fills the tiles in light order, reusing counts as write cursors
+		result.indices.resize(total);
+		std::fill(result.counts.begin(), result.counts.end(), 0);
+		for (size_t c = 0; c < result.candidates.size(); c++) {
+			const glm::uvec4& rect = result.tileRects[c];
+			for (uint32_t y = rect.y; y <= rect.w; y++) {
+				for (uint32_t x = rect.x; x <= rect.z; x++) {
+					uint32_t tile = x + y * GRID_X;
+					result.indices[result.offsets[tile] + result.counts[tile]++] = result.candidates[c];
+				}
+			}
+		}
+	}
+}
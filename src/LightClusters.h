@@ -0,0 +1,127 @@
+#pragma once
+
+#include "Buffer.h"
+#include "Camera.h"
+#include "Device.h"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace NNuts {
+	// Matches PointLight in ClusteredLights.glsl (std430)
+	struct PointLight {
+		glm::vec4 positionRadius{};  // xyz world position, w radius of influence
+		glm::vec4 color{};           // rgb colour, w intensity
+	};
+
+	// Matches the cluster block of GlobalUbo.glsl (std140)
+	struct ClusterUniforms {
+		glm::uvec4 grid{};        // xyz cluster counts, w light count
+		glm::vec4 depthSlicing{}; // near, far, log scale, log bias
+		// Camera the lights were assigned with, clusters are looked up with it even if the camera
+		// used for drawing moved since
+		glm::mat4 view{ 1.0f };
+		glm::mat4 projection{ 1.0f };
+	};
+
+	// Clustered forward light assignment. The view frustum is split into GRID_X * GRID_Y screen tiles
+	// and GRID_Z exponential depth slices; every cluster gets an offset and count into a flat light
+	// index list, so a fragment only loops over the lights that can reach its cluster.
+	// The assignment is spread over the depth slices, which a pool of workers started with the clusters
+	// and the calling thread pull one at a time. Few lights are assigned on the calling thread alone.
+	class NNLightClusters {
+	public:
+		static constexpr uint32_t GRID_X = 16;
+		static constexpr uint32_t GRID_Y = 9;
+		static constexpr uint32_t GRID_Z = 24;
+		static constexpr uint32_t CLUSTER_COUNT = GRID_X * GRID_Y * GRID_Z;
+		static constexpr uint32_t MAX_LIGHTS = 8192;
+		static constexpr uint32_t MAX_LIGHT_INDICES = 1 << 19;
+
+		struct Stats {
+			uint32_t lightCount = 0;
+			uint32_t lightIndexCount = 0;
+			bool overflowed = false;
+			double milliseconds = 0.0;
+		};
+
+		NNLightClusters(NNDevice& device);
+		~NNLightClusters();
+
+		NNLightClusters(const NNLightClusters&) = delete;
+		NNLightClusters& operator=(const NNLightClusters&) = delete;
+
+		// Assigns the lights to the camera's clusters and uploads lights, grid and indices into the
+		// buffers of frameIndex. The returned uniforms go into GlobalUbo for the same frame.
+		ClusterUniforms update(int frameIndex, const NNCamera& camera, const std::vector<PointLight>& lights);
+
+		VkDescriptorBufferInfo lightsInfo(int frameIndex) { return m_Frames[frameIndex].lights->descriptorInfo(); }
+		VkDescriptorBufferInfo gridInfo(int frameIndex) { return m_Frames[frameIndex].grid->descriptorInfo(); }
+		VkDescriptorBufferInfo indicesInfo(int frameIndex) { return m_Frames[frameIndex].indices->descriptorInfo(); }
+
+		const Stats& getLastStats() const { return m_LastStats; }
+
+	private:
+		struct FrameBuffers {
+			std::unique_ptr<NNBuffer> lights;
+			std::unique_ptr<NNBuffer> grid;
+			std::unique_ptr<NNBuffer> indices;
+		};
+
+		// Light in view space with the depth slices it overlaps
+		struct ViewLight {
+			glm::vec3 center;
+			float radius;
+			uint32_t firstSlice;
+			uint32_t lastSlice;
+		};
+
+		struct SliceResult {
+			std::vector<uint32_t> candidates;
+			std::vector<glm::uvec4> tileRects;
+			std::vector<uint32_t> counts;
+			std::vector<uint32_t> offsets;
+			std::vector<uint32_t> indices;
+		};
+
+		// Below this many lights waking the workers costs more than it saves
+		static constexpr uint32_t PARALLEL_LIGHT_COUNT = 64;
+
+		uint32_t sliceForDepth(float viewDepth) const;
+		void assignSlice(uint32_t slice, const glm::mat4& projection, SliceResult& result) const;
+		void assignSlices(const glm::mat4& projection);
+		void workerLoop(uint32_t worker);
+
+		NNDevice& m_Device;
+		std::vector<FrameBuffers> m_Frames;
+
+		// Per frame state of the current update, kept around to avoid reallocating every frame
+		float m_Near = 0.1f;
+		float m_Far = 10.0f;
+		float m_LogScale = 1.0f;
+		float m_LogBias = 0.0f;
+		std::vector<ViewLight> m_ViewLights;
+		std::vector<SliceResult> m_Slices;
+
+		std::vector<std::thread> m_Workers;
+		std::mutex m_WorkMutex;
+		std::condition_variable m_WorkReady;
+		std::condition_variable m_WorkDone;
+		// Bumped for every parallel update, workers run once per value
+		uint64_t m_WorkGeneration = 0;
+		uint32_t m_BusyWorkers = 0;
+		bool m_StopWorkers = false;
+		const glm::mat4* m_WorkProjection = nullptr;
+		std::atomic<uint32_t> m_NextSlice{ 0 };
+
+		Stats m_LastStats{};
+	};
+}
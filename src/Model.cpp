@@ -1,5 +1,6 @@
 #include "Model.h"
 
+#include "RenderStats.h"
 #include "Utils.h"
 
 #define TINYOBJLOADER_IMPLEMENTATION
@@ -27,6 +28,7 @@ namespace NNuts {
 		:m_Device(device)
 	{
 		createVertexBuffers(builder.vertices);
+		createPositionBuffer(builder.vertices);
 		createIndexBuffer(builder.indices);
 	}
 	
@@ -69,6 +71,40 @@ namespace NNuts {
 		m_Device.copyBuffer(stagingBuffer.getBuffer(), m_VertexBuffer->getBuffer(), bufferSize);
 	}
 
+	void NNModel::createPositionBuffer(const std::vector<Vertex>& vertices)
+	{
+		// A depth-only pass fetches 12 bytes per vertex instead of the whole interleaved vertex
+		std::vector<glm::vec3> positions{};
+		positions.reserve(vertices.size());
+		for (auto& vertex : vertices) {
+			positions.push_back(vertex.position);
+		}
+
+		VkDeviceSize bufferSize = sizeof(positions[0]) * m_VertexCount;
+		uint32_t positionSize = sizeof(positions[0]);
+
+		NNBuffer stagingBuffer{
+			m_Device,
+			positionSize,
+			m_VertexCount,
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+		};
+
+		stagingBuffer.map();
+		stagingBuffer.writeToBuffer((void *)positions.data());
+
+		m_PositionBuffer = std::make_unique<NNBuffer>(
+			m_Device,
+			positionSize,
+			m_VertexCount,
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+		);
+
+		m_Device.copyBuffer(stagingBuffer.getBuffer(), m_PositionBuffer->getBuffer(), bufferSize);
+	}
+
 	void NNModel::createIndexBuffer(const std::vector<uint32_t>& indices)
 	{
 		m_IndexCount = static_cast<uint32_t>(indices.size());
@@ -111,6 +147,19 @@ namespace NNuts {
 		VkBuffer buffers[] = { m_VertexBuffer->getBuffer() };
 		VkDeviceSize offsets[] = { 0 };
 		vkCmdBindVertexBuffers(commandBuffer, 0, 1, buffers, offsets);
+		NNRenderStats::add(NNRenderStats::Counter::VertexBufferBinds);
+
+		if (m_HasIndexBuffered) {
+			vkCmdBindIndexBuffer(commandBuffer, m_IndexBuffer->getBuffer(), 0, VK_INDEX_TYPE_UINT32);
+		}
+	}
+
+	void NNModel::bindPositions(VkCommandBuffer commandBuffer)
+	{
+		VkBuffer buffers[] = { m_PositionBuffer->getBuffer() };
+		VkDeviceSize offsets[] = { 0 };
+		vkCmdBindVertexBuffers(commandBuffer, 0, 1, buffers, offsets);
+		NNRenderStats::add(NNRenderStats::Counter::VertexBufferBinds);
 
 		if (m_HasIndexBuffered) {
 			vkCmdBindIndexBuffer(commandBuffer, m_IndexBuffer->getBuffer(), 0, VK_INDEX_TYPE_UINT32);
@@ -125,6 +174,8 @@ namespace NNuts {
 		else {
 			vkCmdDraw(commandBuffer, m_VertexCount, 1, 0, 0);
 		}
+		NNRenderStats::add(NNRenderStats::Counter::DrawCalls);
+		NNRenderStats::add(NNRenderStats::Counter::Triangles, getTriangleCount());
 	}
 	
 	std::vector<VkVertexInputBindingDescription> NNModel::Vertex::getBindingDescriptions()
@@ -148,6 +199,20 @@ namespace NNuts {
 		return attributeDescriptions;	
 	}
 
+	std::vector<VkVertexInputBindingDescription> NNModel::Vertex::getPositionBindingDescriptions()
+	{
+		std::vector<VkVertexInputBindingDescription> bindingDescriptions{ 1 };
+		bindingDescriptions[0].binding = 0;
+		bindingDescriptions[0].stride = sizeof(glm::vec3);
+		bindingDescriptions[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+		return bindingDescriptions;
+	}
+
+	std::vector<VkVertexInputAttributeDescription> NNModel::Vertex::getPositionAttributeDescriptions()
+	{
+		return { { 0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0 } };
+	}
+
 
 	void NNModel::Builder::loadModel(const std::string& filepath)
 	{
@@ -21,6 +21,9 @@ namespace NNuts {
 
 			static std::vector<VkVertexInputBindingDescription> getBindingDescriptions();
 			static std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions();
+			// Layout of the tightly packed position stream used by depth-only passes
+			static std::vector<VkVertexInputBindingDescription> getPositionBindingDescriptions();
+			static std::vector<VkVertexInputAttributeDescription> getPositionAttributeDescriptions();
 
 			bool operator==(const Vertex& other) const {
 				return position == other.position && color == other.color && normal == other.normal && uv == other.uv;
@@ -43,10 +46,13 @@ namespace NNuts {
 		static std::unique_ptr<NNModel> createModelFromFile(NNDevice& device, const std::string& filepath);
 
 		void bind(VkCommandBuffer commandBuffer);
+		void bindPositions(VkCommandBuffer commandBuffer);
 		void draw(VkCommandBuffer commandBuffer);
+		uint32_t getTriangleCount() const { return (m_HasIndexBuffered ? m_IndexCount : m_VertexCount) / 3; }
 
 	private:
 		void createVertexBuffers(const std::vector<Vertex>& vertices);
+		void createPositionBuffer(const std::vector<Vertex>& vertices);
 		void createIndexBuffer(const std::vector<uint32_t>& indices);
 
 		NNDevice& m_Device;
@@ -54,6 +60,8 @@ namespace NNuts {
 		std::unique_ptr<NNBuffer> m_VertexBuffer;
 		uint32_t m_VertexCount;
 
+		std::unique_ptr<NNBuffer> m_PositionBuffer;
+
 		bool m_HasIndexBuffered = false;
 		std::unique_ptr<NNBuffer> m_IndexBuffer;
 		uint32_t m_IndexCount;
@@ -1,6 +1,8 @@
 #include "Pipeline.h"
 
+#include "HostMemory.h"
 #include "Model.h"
+#include "RenderStats.h"
 
 #include <fstream>
 #include <stdexcept>
@@ -8,6 +10,36 @@
 #include <cassert>
 
 namespace NNuts {
+	namespace {
+		struct StageSpecialization {
+			std::vector<VkSpecializationMapEntry> entries;
+			std::vector<uint32_t> data;
+			VkSpecializationInfo info{};
+
+			const VkSpecializationInfo* fill(const SpecializationMap& map, VkShaderStageFlagBits stage) {
+				auto it = map.find(stage);
+				if (it == map.end() || it->second.empty()) {
+					return nullptr;
+				}
+
+				for (auto& kv : it->second.values) {
+					VkSpecializationMapEntry entry{};
+					entry.constantID = kv.first;
+					entry.offset = static_cast<uint32_t>(data.size() * sizeof(uint32_t));
+					entry.size = sizeof(uint32_t);
+					entries.push_back(entry);
+					data.push_back(kv.second);
+				}
+
+				info.mapEntryCount = static_cast<uint32_t>(entries.size());
+				info.pMapEntries = entries.data();
+				info.dataSize = data.size() * sizeof(uint32_t);
+				info.pData = data.data();
+				return &info;
+			}
+		};
+	}
+
 	NNPipeline::NNPipeline(
 		NNDevice& device, 
 		const std::string& vertFilepath, 
@@ -15,22 +47,33 @@ namespace NNuts {
 		const PipelineConfigInfo& configInfo)
 		: m_Device{ device }
 	{
-		createGraphicsPipeline(vertFilepath, fragFilepath, configInfo);
+		createGraphicsPipeline(readFile(vertFilepath), readFile(fragFilepath), configInfo);
+	}
+
+	NNPipeline::NNPipeline(
+		NNDevice& device,
+		const std::vector<uint32_t>& vertCode,
+		const std::vector<uint32_t>& fragCode,
+		const PipelineConfigInfo& configInfo)
+		: m_Device{ device }
+	{
+		createGraphicsPipeline(vertCode, fragCode, configInfo);
 	}
 
 	NNPipeline::~NNPipeline()
 	{
-		vkDestroyShaderModule(m_Device.device(), m_VertShaderModule, nullptr);
-		vkDestroyShaderModule(m_Device.device(), m_FragShaderModule, nullptr);
-		vkDestroyPipeline(m_Device.device(), m_GraphicsPipeline, nullptr);
+		vkDestroyShaderModule(m_Device.device(), m_VertShaderModule, NNHostMemory::callbacks(NNHostMemory::Tag::ShaderModule));
+		vkDestroyShaderModule(m_Device.device(), m_FragShaderModule, NNHostMemory::callbacks(NNHostMemory::Tag::ShaderModule));
+		m_Device.getDeletionQueue().destroyPipeline(m_GraphicsPipeline);
 	}
 
 	void NNPipeline::bind(VkCommandBuffer commandBuffer)
 	{
 		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_GraphicsPipeline);
+		NNRenderStats::add(NNRenderStats::Counter::PipelineBinds);
 	}
 
-	void NNPipeline::defaultPipelineConfigInfo(PipelineConfigInfo& configInfo)
+	void NNPipeline::defaultPipelineConfigInfo(PipelineConfigInfo& configInfo, DepthPassMode depthMode)
 	{
 		configInfo.inputAssemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
 		configInfo.inputAssemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
@@ -99,9 +142,26 @@ namespace NNuts {
 		configInfo.dynamicStateInfo.pDynamicStates = configInfo.dynamicStateEnables.data();
 		configInfo.dynamicStateInfo.dynamicStateCount =	static_cast<uint32_t>(configInfo.dynamicStateEnables.size());
 		configInfo.dynamicStateInfo.flags = 0;
+
+		configInfo.bindingDescriptions = NNModel::Vertex::getBindingDescriptions();
+		configInfo.attributeDescriptions = NNModel::Vertex::getAttributeDescriptions();
+
+		switch (depthMode) {
+		case DepthPassMode::Default:
+			break;
+		case DepthPassMode::Prepass:
+			configInfo.colorBlendAttachment.colorWriteMask = 0;
+			configInfo.bindingDescriptions = NNModel::Vertex::getPositionBindingDescriptions();
+			configInfo.attributeDescriptions = NNModel::Vertex::getPositionAttributeDescriptions();
+			break;
+		case DepthPassMode::EqualAfterPrepass:
+			configInfo.depthStencilInfo.depthWriteEnable = VK_FALSE;
+			configInfo.depthStencilInfo.depthCompareOp = VK_COMPARE_OP_EQUAL;
+			break;
+		}
 	}
 
-	std::vector<char> NNPipeline::readFile(const std::string& filepath)
+	std::vector<uint32_t> NNPipeline::readFile(const std::string& filepath)
 	{
 		std::ifstream file(filepath, std::ios::ate | std::ios::binary);
 
@@ -110,30 +170,35 @@ namespace NNuts {
 		}
 
 		size_t fileSize = static_cast<size_t>(file.tellg());
-		std::vector<char> buffer(fileSize);
+		if (fileSize % sizeof(uint32_t) != 0) {
+			throw std::runtime_error("SPIR-V file size is not a multiple of 4: " + filepath);
+		}
+		std::vector<uint32_t> buffer(fileSize / sizeof(uint32_t));
 
 		file.seekg(0);
-		file.read(buffer.data(), fileSize);
+		file.read(reinterpret_cast<char*>(buffer.data()), fileSize);
 
 		file.close();
 		return buffer;
 	}
 
 	void NNPipeline::createGraphicsPipeline(
-		const std::string& vertFilepath, 
-		const std::string& fragFilepath, 
+		const std::vector<uint32_t>& vertCode,
+		const std::vector<uint32_t>& fragCode,
 		const PipelineConfigInfo& configInfo){
 		assert(configInfo.pipelineLayout != VK_NULL_HANDLE &&
 			"Cannot create graphics pipeline:: no pipelineLayout provided in configInfo");
 		assert(configInfo.renderPass != VK_NULL_HANDLE &&
 			"Cannot create graphics pipeline:: no renderPass provided in configInfo");
 
-			auto vertCode = readFile(vertFilepath);
-			auto fragCode = readFile(fragFilepath);
-
 			createShaderModule(vertCode, &m_VertShaderModule);
-			createShaderModule(fragCode, &m_FragShaderModule);
+			if (!fragCode.empty()) {
+				createShaderModule(fragCode, &m_FragShaderModule);
+			}
 			
+			StageSpecialization vertSpecialization;
+			StageSpecialization fragSpecialization;
+
 			VkPipelineShaderStageCreateInfo shaderStages[2];
 			shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 			shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
@@ -141,17 +206,19 @@ namespace NNuts {
 			shaderStages[0].pName = "main";
 			shaderStages[0].flags = 0;
 			shaderStages[0].pNext = nullptr;
-			shaderStages[0].pSpecializationInfo = nullptr;
+			shaderStages[0].pSpecializationInfo =
+				vertSpecialization.fill(configInfo.specializationConstants, VK_SHADER_STAGE_VERTEX_BIT);
 			shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 			shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
 			shaderStages[1].module = m_FragShaderModule;
 			shaderStages[1].pName = "main";
 			shaderStages[1].flags = 0;
 			shaderStages[1].pNext = nullptr;
-			shaderStages[1].pSpecializationInfo = nullptr;
+			shaderStages[1].pSpecializationInfo =
+				fragSpecialization.fill(configInfo.specializationConstants, VK_SHADER_STAGE_FRAGMENT_BIT);
 
-			auto bindigDescriptions = NNModel::Vertex::getBindingDescriptions();
-			auto attributeDescriptions = NNModel::Vertex::getAttributeDescriptions();
+			auto& bindigDescriptions = configInfo.bindingDescriptions;
+			auto& attributeDescriptions = configInfo.attributeDescriptions;
 			VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
 			vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
 			vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
@@ -159,16 +226,22 @@ namespace NNuts {
 			vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
 			vertexInputInfo.pVertexBindingDescriptions = bindigDescriptions.data();
 
+			std::vector<VkPipelineColorBlendAttachmentState> colorBlendAttachments(
+				configInfo.colorAttachmentCount, configInfo.colorBlendAttachment);
+			VkPipelineColorBlendStateCreateInfo colorBlendInfo = configInfo.colorBlendInfo;
+			colorBlendInfo.attachmentCount = configInfo.colorAttachmentCount;
+			colorBlendInfo.pAttachments = colorBlendAttachments.data();
+
 			VkGraphicsPipelineCreateInfo pipelineinfo{};
 			pipelineinfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-			pipelineinfo.stageCount = 2;
+			pipelineinfo.stageCount = m_FragShaderModule != VK_NULL_HANDLE ? 2 : 1;
 			pipelineinfo.pStages = shaderStages;
 			pipelineinfo.pVertexInputState = &vertexInputInfo;
 			pipelineinfo.pInputAssemblyState = &configInfo.inputAssemblyInfo;
 			pipelineinfo.pViewportState = &configInfo.viewportInfo;
 			pipelineinfo.pRasterizationState = &configInfo.rasterizationInfo;
 			pipelineinfo.pMultisampleState = &configInfo.multisampleInfo;
-			pipelineinfo.pColorBlendState = &configInfo.colorBlendInfo;
+			pipelineinfo.pColorBlendState = &colorBlendInfo;
 			pipelineinfo.pDepthStencilState = &configInfo.depthStencilInfo;
 			pipelineinfo.pDynamicState = &configInfo.dynamicStateInfo;
 			
@@ -184,19 +257,19 @@ namespace NNuts {
 				VK_NULL_HANDLE,
 				1,
 				&pipelineinfo,
-				nullptr,
+				NNHostMemory::callbacks(NNHostMemory::Tag::Pipeline),
 				&m_GraphicsPipeline) != VK_SUCCESS) {
 				throw std::runtime_error("Failed to create graphics pipeline!");
 			}
 	}
-	void NNPipeline::createShaderModule(const std::vector<char>& code, VkShaderModule* shaderModule)
+	void NNPipeline::createShaderModule(const std::vector<uint32_t>& code, VkShaderModule* shaderModule)
 	{
 		VkShaderModuleCreateInfo createInfo{};
 		createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-		createInfo.codeSize = code.size();
-		createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+		createInfo.codeSize = code.size() * sizeof(uint32_t);
+		createInfo.pCode = code.data();
 
-		if (vkCreateShaderModule(m_Device.device(), &createInfo, nullptr, shaderModule) != VK_SUCCESS) {
+		if (vkCreateShaderModule(m_Device.device(), &createInfo, NNHostMemory::callbacks(NNHostMemory::Tag::ShaderModule), shaderModule) != VK_SUCCESS) {
 			throw std::runtime_error("Failed to create Shader Module!");
 		}
 	}
@@ -2,14 +2,55 @@
 
 #include "Device.h"
 
+#include <cstring>
+#include <map>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 namespace NNuts {
+	// Values for `layout(constant_id = N)` declarations in a single shader stage.
+	// Every supported scalar (bool, int, uint, float) is 4 bytes wide, so values are kept as raw words.
+	struct SpecializationConstants {
+		template <typename T>
+		SpecializationConstants& set(uint32_t constantId, T value) {
+			static_assert(std::is_arithmetic<T>::value, "Specialization constants must be scalars");
+			if constexpr (std::is_same<T, bool>::value) {
+				values[constantId] = value ? VK_TRUE : VK_FALSE;
+			}
+			else {
+				static_assert(sizeof(T) == sizeof(uint32_t), "Specialization constants must be 32 bit");
+				uint32_t word;
+				std::memcpy(&word, &value, sizeof(word));
+				values[constantId] = word;
+			}
+			return *this;
+		}
+
+		bool empty() const { return values.empty(); }
+		bool operator==(const SpecializationConstants& other) const { return values == other.values; }
+		bool operator<(const SpecializationConstants& other) const { return values < other.values; }
+
+		std::map<uint32_t, uint32_t> values{};
+	};
+
+	using SpecializationMap = std::map<VkShaderStageFlagBits, SpecializationConstants>;
+
+	enum class DepthPassMode {
+		// Depth test LESS with writes, the only pass that touches depth
+		Default,
+		// Position-only vertex input and no colour output; lays down depth for the shading pass
+		Prepass,
+		// Shading pass after a prepass: depth test EQUAL and no writes, so each pixel is shaded once
+		EqualAfterPrepass,
+	};
+
 	struct PipelineConfigInfo {
 		PipelineConfigInfo(const PipelineConfigInfo&) = delete;
 		PipelineConfigInfo& operator=(const PipelineConfigInfo&) = delete;
 
+		std::vector<VkVertexInputBindingDescription> bindingDescriptions{};
+		std::vector<VkVertexInputAttributeDescription> attributeDescriptions{};
 		VkPipelineViewportStateCreateInfo viewportInfo;
 		VkPipelineInputAssemblyStateCreateInfo inputAssemblyInfo;
 		VkPipelineRasterizationStateCreateInfo rasterizationInfo;
@@ -22,6 +63,9 @@ namespace NNuts {
 		VkPipelineLayout pipelineLayout = nullptr;
 		VkRenderPass renderPass = nullptr;
 		uint32_t subpass = 0;
+		// colorBlendAttachment is replicated for every colour attachment of the subpass
+		uint32_t colorAttachmentCount = 1;
+		SpecializationMap specializationConstants{};
 	};
 
 	class NNPipeline {
@@ -31,27 +75,35 @@ namespace NNuts {
 			const std::string& vertFilepath,
 			const std::string& fragFilepath,
 			const PipelineConfigInfo& configInfo);
+		// An empty fragCode builds a depth-only pipeline with just the vertex stage
+		NNPipeline(
+			NNDevice& device,
+			const std::vector<uint32_t>& vertCode,
+			const std::vector<uint32_t>& fragCode,
+			const PipelineConfigInfo& configInfo);
 		~NNPipeline();
 
 		NNPipeline(const NNPipeline&) = delete;
 		NNPipeline& operator=(const NNPipeline&) = delete;
 
 		void bind(VkCommandBuffer commandBuffer);
-		static void defaultPipelineConfigInfo(PipelineConfigInfo& configInfo);
+		static void defaultPipelineConfigInfo(
+			PipelineConfigInfo& configInfo,
+			DepthPassMode depthMode = DepthPassMode::Default);
 
 	private:
-		static std::vector<char> readFile(const std::string& filepath);
+		static std::vector<uint32_t> readFile(const std::string& filepath);
 
 		void createGraphicsPipeline(
-			const std::string& vertFilepath,
-			const std::string& fragFilepath, 
+			const std::vector<uint32_t>& vertCode,
+			const std::vector<uint32_t>& fragCode,
 			const PipelineConfigInfo& configInfo);
 
-		void createShaderModule(const std::vector<char>& code, VkShaderModule* shaderModule);
+		void createShaderModule(const std::vector<uint32_t>& code, VkShaderModule* shaderModule);
 
 		NNDevice& m_Device;
 		VkPipeline m_GraphicsPipeline;
 		VkShaderModule m_VertShaderModule;
-		VkShaderModule m_FragShaderModule;
+		VkShaderModule m_FragShaderModule = VK_NULL_HANDLE;
 	};
 }
\ No newline at end of file
@@ -0,0 +1,47 @@
+#include "PipelineVariants.h"
+
+namespace NNuts {
+	NNPipelineVariantCache::NNPipelineVariantCache(
+		NNDevice& device,
+		std::vector<uint32_t> vertCode,
+		std::vector<uint32_t> fragCode,
+		ConfigureFn configure,
+		DepthPassMode depthMode)
+		: m_Device{ device },
+		m_VertCode{ std::move(vertCode) },
+		m_FragCode{ std::move(fragCode) },
+		m_Configure{ std::move(configure) },
+		m_DepthMode{ depthMode }
+	{
+	}
+
+	NNPipeline& NNPipelineVariantCache::getVariant(const SpecializationMap& constants)
+	{
+		SpecializationMap key = normalize(constants);
+
+		auto it = m_Variants.find(key);
+		if (it != m_Variants.end()) {
+			return *it->second;
+		}
+
+		PipelineConfigInfo configInfo{};
+		NNPipeline::defaultPipelineConfigInfo(configInfo, m_DepthMode);
+		m_Configure(configInfo);
+		configInfo.specializationConstants = key;
+
+		auto pipeline = std::make_unique<NNPipeline>(m_Device, m_VertCode, m_FragCode, configInfo);
+		return *m_Variants.emplace(std::move(key), std::move(pipeline)).first->second;
+	}
+
+	SpecializationMap NNPipelineVariantCache::normalize(const SpecializationMap& constants)
+	{
+		// A stage with no overrides compiles exactly like a missing stage entry
+		SpecializationMap key{};
+		for (auto& kv : constants) {
+			if (!kv.second.empty()) {
+				key.emplace(kv.first, kv.second);
+			}
+		}
+		return key;
+	}
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "Pipeline.h"
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace NNuts {
+	// Builds one NNPipeline per distinct set of specialization constants and keeps it around,
+	// so features like light count or alpha test are compiled into the shader instead of branching.
+	class NNPipelineVariantCache {
+	public:
+		using ConfigureFn = std::function<void(PipelineConfigInfo&)>;
+
+		NNPipelineVariantCache(
+			NNDevice& device,
+			std::vector<uint32_t> vertCode,
+			std::vector<uint32_t> fragCode,
+			ConfigureFn configure,
+			DepthPassMode depthMode = DepthPassMode::Default);
+
+		NNPipelineVariantCache(const NNPipelineVariantCache&) = delete;
+		NNPipelineVariantCache& operator=(const NNPipelineVariantCache&) = delete;
+
+		NNPipeline& getVariant(const SpecializationMap& constants);
+		size_t variantCount() const { return m_Variants.size(); }
+		void clear() { m_Variants.clear(); }
+
+	private:
+		static SpecializationMap normalize(const SpecializationMap& constants);
+
+		NNDevice& m_Device;
+		std::vector<uint32_t> m_VertCode;
+		std::vector<uint32_t> m_FragCode;
+		ConfigureFn m_Configure;
+		DepthPassMode m_DepthMode;
+
+		std::map<SpecializationMap, std::unique_ptr<NNPipeline>> m_Variants;
+	};
+}
@@ -0,0 +1,305 @@
+#include "RenderStats.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace NNuts {
+	namespace {
+		constexpr const char* COUNTER_NAMES[NNRenderStats::COUNTER_COUNT] = {
+			"draw_calls",
+			"triangles",
+			"pipeline_binds",
+			"descriptor_set_binds",
+			"vertex_buffer_binds",
+			"push_constant_bytes",
+			"bytes_uploaded",
+			"device_allocations",
+			"device_bytes_allocated",
+			"heap_allocations",
+			"transform_updates",
+		};
+		constexpr const char* GAUGE_NAMES[NNRenderStats::GAUGE_COUNT] = {
+			"device_memory_in_use",
+			"driver_host_memory",
+			"frame_arena_bytes",
+		};
+
+		struct SharedMapping {
+			NNRenderStats::SharedBlock* block = nullptr;
+			NNRenderStats::SharedSlot* slots = nullptr;
+			size_t size = 0;
+			std::string name;
+#ifdef _WIN32
+			HANDLE handle = nullptr;
+#endif
+		};
+
+		struct State {
+			std::mutex mutex;
+			// Ring of the last windowSize snapshots, allocated when the size is set
+			std::vector<NNRenderStats::Snapshot> window = std::vector<NNRenderStats::Snapshot>(300);
+			size_t windowHead = 0;
+			size_t windowCount = 0;
+			std::chrono::steady_clock::time_point lastFrame{};
+			SharedMapping shared{};
+		};
+
+		State& state()
+		{
+			static State s;
+			return s;
+		}
+
+		void publish(SharedMapping& shared, const NNRenderStats::Snapshot& snapshot)
+		{
+			uint64_t written = shared.block->written.load(std::memory_order_relaxed);
+			NNRenderStats::SharedSlot& slot = shared.slots[written % shared.block->capacity];
+			uint64_t sequence = slot.sequence.load(std::memory_order_relaxed);
+			slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+			slot.snapshot = snapshot;
+			slot.sequence.store(sequence + 2, std::memory_order_release);
+			shared.block->written.store(written + 1, std::memory_order_release);
+		}
+	}
+
+	const char* NNRenderStats::counterName(Counter counter)
+	{
+		return COUNTER_NAMES[static_cast<uint32_t>(counter)];
+	}
+
+	const char* NNRenderStats::gaugeName(Gauge gauge)
+	{
+		return GAUGE_NAMES[static_cast<uint32_t>(gauge)];
+	}
+
+	void NNRenderStats::endFrame(uint64_t frame)
+	{
+		State& s = state();
+		auto now = std::chrono::steady_clock::now();
+
+		Snapshot snapshot{};
+		snapshot.frame = frame;
+		for (uint32_t i = 0; i < COUNTER_COUNT; i++) {
+			snapshot.counters[i] = s_Counters[i].exchange(0, std::memory_order_relaxed);
+		}
+		for (uint32_t i = 0; i < GAUGE_COUNT; i++) {
+			snapshot.gauges[i] = s_Gauges[i].load(std::memory_order_relaxed);
+		}
+
+		std::lock_guard<std::mutex> lock{ s.mutex };
+		if (s.lastFrame != std::chrono::steady_clock::time_point{}) {
+			snapshot.milliseconds = std::chrono::duration<double, std::milli>(now - s.lastFrame).count();
+		}
+		s.lastFrame = now;
+
+		s.window[(s.windowHead + s.windowCount) % s.window.size()] = snapshot;
+		if (s.windowCount < s.window.size()) {
+			s.windowCount++;
+		}
+		else {
+			s.windowHead = (s.windowHead + 1) % s.window.size();
+		}
+		if (s.shared.block) {
+			publish(s.shared, snapshot);
+		}
+	}
+
+	NNRenderStats::Snapshot NNRenderStats::getLastFrame()
+	{
+		State& s = state();
+		std::lock_guard<std::mutex> lock{ s.mutex };
+		return s.windowCount == 0 ? Snapshot{} : s.window[(s.windowHead + s.windowCount - 1) % s.window.size()];
+	}
+
+	std::vector<NNRenderStats::Snapshot> NNRenderStats::getWindow()
+	{
+		State& s = state();
+		std::lock_guard<std::mutex> lock{ s.mutex };
+		std::vector<Snapshot> window(s.windowCount);
+		for (size_t i = 0; i < s.windowCount; i++) {
+			window[i] = s.window[(s.windowHead + i) % s.window.size()];
+		}
+		return window;
+	}
+
+	void NNRenderStats::setWindowSize(uint32_t frames)
+	{
+		State& s = state();
+		std::lock_guard<std::mutex> lock{ s.mutex };
+		// Keeps the newest snapshots that still fit
+		std::vector<Snapshot> window(std::max<size_t>(frames, 1));
+		size_t count = std::min(s.windowCount, window.size());
+		for (size_t i = 0; i < count; i++) {
+			window[i] = s.window[(s.windowHead + s.windowCount - count + i) % s.window.size()];
+		}
+		s.window = std::move(window);
+		s.windowHead = 0;
+		s.windowCount = count;
+	}
+
+	void NNRenderStats::writeCsv(const std::string& filepath)
+	{
+		std::ofstream file{ filepath };
+		if (!file) {
+			throw std::runtime_error("Failed to open " + filepath + " for writing!");
+		}
+
+		file << "frame,milliseconds";
+		for (auto name : COUNTER_NAMES) {
+			file << ',' << name;
+		}
+		for (auto name : GAUGE_NAMES) {
+			file << ',' << name;
+		}
+		file << '\n';
+
+		for (auto& snapshot : getWindow()) {
+			file << snapshot.frame << ',' << snapshot.milliseconds;
+			for (uint64_t value : snapshot.counters) {
+				file << ',' << value;
+			}
+			for (uint64_t value : snapshot.gauges) {
+				file << ',' << value;
+			}
+			file << '\n';
+		}
+	}
+
+	void NNRenderStats::writeJson(const std::string& filepath)
+	{
+		std::ofstream file{ filepath };
+		if (!file) {
+			throw std::runtime_error("Failed to open " + filepath + " for writing!");
+		}
+
+		auto window = getWindow();
+		file << "{\n  \"frames\": [\n";
+		for (size_t f = 0; f < window.size(); f++) {
+			auto& snapshot = window[f];
+			file << "    { \"frame\": " << snapshot.frame << ", \"milliseconds\": " << snapshot.milliseconds;
+			for (uint32_t i = 0; i < COUNTER_COUNT; i++) {
+				file << ", \"" << COUNTER_NAMES[i] << "\": " << snapshot.counters[i];
+			}
+			for (uint32_t i = 0; i < GAUGE_COUNT; i++) {
+				file << ", \"" << GAUGE_NAMES[i] << "\": " << snapshot.gauges[i];
+			}
+			file << " }" << (f + 1 < window.size() ? ",\n" : "\n");
+		}
+		file << "  ]\n}\n";
+	}
+
+	void NNRenderStats::write(const std::string& filepath)
+	{
+		const std::string json = ".json";
+		if (filepath.size() >= json.size() && filepath.compare(filepath.size() - json.size(), json.size(), json) == 0) {
+			writeJson(filepath);
+		}
+		else {
+			writeCsv(filepath);
+		}
+	}
+
+	bool NNRenderStats::openSharedMemory(const std::string& name, uint32_t capacity)
+	{
+		closeSharedMemory();
+		capacity = std::max(capacity, 1u);
+
+		SharedMapping shared{};
+		shared.name = name;
+		shared.size = sizeof(SharedBlock) + sizeof(SharedSlot) * capacity;
+		void* memory = nullptr;
+#ifdef _WIN32
+		shared.handle = CreateFileMappingA(
+			INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, static_cast<DWORD>(shared.size), name.c_str());
+		if (shared.handle == nullptr) {
+			return false;
+		}
+		memory = MapViewOfFile(shared.handle, FILE_MAP_ALL_ACCESS, 0, 0, shared.size);
+		if (memory == nullptr) {
+			CloseHandle(shared.handle);
+			return false;
+		}
+#else
+		// POSIX names need a leading slash
+		if (shared.name.empty() || shared.name[0] != '/') {
+			shared.name = "/" + shared.name;
+		}
+		int fd = shm_open(shared.name.c_str(), O_CREAT | O_RDWR, 0644);
+		if (fd < 0) {
+			return false;
+		}
+		if (ftruncate(fd, static_cast<off_t>(shared.size)) != 0) {
+			close(fd);
+			shm_unlink(shared.name.c_str());
+			return false;
+		}
+		memory = mmap(nullptr, shared.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+		if (memory == MAP_FAILED) {
+			shm_unlink(shared.name.c_str());
+			return false;
+		}
+#endif
+
+		std::memset(memory, 0, shared.size);
+		shared.block = new (memory) SharedBlock{};
+		shared.slots = reinterpret_cast<SharedSlot*>(static_cast<char*>(memory) + sizeof(SharedBlock));
+		for (uint32_t i = 0; i < capacity; i++) {
+			new (&shared.slots[i]) SharedSlot{};
+		}
+		shared.block->counterCount = COUNTER_COUNT;
+		shared.block->gaugeCount = GAUGE_COUNT;
+		shared.block->capacity = capacity;
+		shared.block->snapshotSize = sizeof(Snapshot);
+		shared.block->slotSize = sizeof(SharedSlot);
+		for (uint32_t i = 0; i < COUNTER_COUNT; i++) {
+			std::strncpy(shared.block->names[i], COUNTER_NAMES[i], SharedBlock::NAME_LENGTH - 1);
+		}
+		for (uint32_t i = 0; i < GAUGE_COUNT; i++) {
+			std::strncpy(shared.block->names[COUNTER_COUNT + i], GAUGE_NAMES[i], SharedBlock::NAME_LENGTH - 1);
+		}
+		shared.block->version = SharedBlock::VERSION;
+		// The magic goes in last, readers wait for it before trusting the header
+		std::atomic_thread_fence(std::memory_order_release);
+		shared.block->magic = SharedBlock::MAGIC;
+
+		State& s = state();
+		std::lock_guard<std::mutex> lock{ s.mutex };
+		s.shared = shared;
+		return true;
+	}
+
+	void NNRenderStats::closeSharedMemory()
+	{
+		State& s = state();
+		std::lock_guard<std::mutex> lock{ s.mutex };
+		SharedMapping& shared = s.shared;
+		if (!shared.block) {
+			return;
+		}
+#ifdef _WIN32
+		UnmapViewOfFile(shared.block);
+		CloseHandle(shared.handle);
+#else
+		munmap(shared.block, shared.size);
+		shm_unlink(shared.name.c_str());
+#endif
+		shared = SharedMapping{};
+	}
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace NNuts {
+	// Per frame engine counters. Hot paths (draws, binds, uploads, allocations) bump relaxed atomics,
+	// the renderer snapshots and resets them once per frame into a rolling window. The window can be
+	// written as CSV or JSON, or published to a shared memory block that other processes can poll.
+	class NNRenderStats {
+	public:
+		enum class Counter : uint32_t {
+			DrawCalls,
+			Triangles,
+			PipelineBinds,
+			DescriptorSetBinds,
+			VertexBufferBinds,
+			PushConstantBytes,
+			BytesUploaded,
+			DeviceAllocations,
+			DeviceBytesAllocated,
+			// operator new calls, only counted with NN_TRACK_HEAP_ALLOCATIONS
+			HeapAllocations,
+			// World matrices NNTransformHierarchy had to recompute
+			TransformUpdates,
+			Count
+		};
+		// Values that are sampled instead of accumulated
+		enum class Gauge : uint32_t {
+			// Sum of the device local heap usage, 0 without VK_EXT_memory_budget
+			DeviceMemoryInUse,
+			// Host memory the driver allocated through NNHostMemory
+			DriverHostMemory,
+			// Transient memory the frame took from the renderer's frame allocator
+			FrameArenaBytes,
+			Count
+		};
+		static constexpr uint32_t COUNTER_COUNT = static_cast<uint32_t>(Counter::Count);
+		static constexpr uint32_t GAUGE_COUNT = static_cast<uint32_t>(Gauge::Count);
+
+		struct Snapshot {
+			uint64_t frame = 0;
+			// Time since the previous snapshot
+			double milliseconds = 0.0;
+			uint64_t counters[COUNTER_COUNT] = {};
+			uint64_t gauges[GAUGE_COUNT] = {};
+
+			uint64_t operator[](Counter counter) const { return counters[static_cast<uint32_t>(counter)]; }
+			uint64_t operator[](Gauge gauge) const { return gauges[static_cast<uint32_t>(gauge)]; }
+		};
+
+		// One snapshot of the shared block with its own sequence number
+		struct SharedSlot {
+			std::atomic<uint64_t> sequence;
+			Snapshot snapshot;
+		};
+
+		// Layout of the shared memory block, readers map it read only. Snapshot n goes into slot
+		// n % capacity, written counts the snapshots published so far. Every slot is a seqlock: the
+		// writer makes its sequence odd, fills the snapshot and then makes it even again, before it
+		// bumps written. A reader loads the sequence (acquire) and skips the slot while it's odd,
+		// copies the snapshot, issues an acquire fence and loads the sequence again. The copy is
+		// only good if both loads saw the same value, otherwise the writer came around and the reader
+		// retries or moves on.
+		struct SharedBlock {
+			static constexpr uint32_t MAGIC = 0x5453'4E4E; // "NNST"
+			static constexpr uint32_t VERSION = 2;
+			static constexpr uint32_t NAME_LENGTH = 32;
+
+			uint32_t magic;
+			uint32_t version;
+			uint32_t counterCount;
+			uint32_t gaugeCount;
+			uint32_t capacity;
+			uint32_t snapshotSize;
+			// Stride of the slots
+			uint32_t slotSize;
+			// Counter names followed by gauge names
+			char names[COUNTER_COUNT + GAUGE_COUNT][NAME_LENGTH];
+			std::atomic<uint64_t> written;
+			// Followed by capacity slots
+		};
+
+		static void add(Counter counter, uint64_t value = 1) {
+			s_Counters[static_cast<uint32_t>(counter)].fetch_add(value, std::memory_order_relaxed);
+		}
+		static void setGauge(Gauge gauge, uint64_t value) {
+			s_Gauges[static_cast<uint32_t>(gauge)].store(value, std::memory_order_relaxed);
+		}
+
+		static const char* counterName(Counter counter);
+		static const char* gaugeName(Gauge gauge);
+
+		// Takes the snapshot of the frame that just ended and resets the counters
+		static void endFrame(uint64_t frame);
+		static Snapshot getLastFrame();
+		// Oldest first
+		static std::vector<Snapshot> getWindow();
+		static void setWindowSize(uint32_t frames);
+
+		static void writeCsv(const std::string& filepath);
+		static void writeJson(const std::string& filepath);
+		// Picks the format from the extension, CSV unless it ends in .json
+		static void write(const std::string& filepath);
+
+		// Publishes every snapshot to the named block (a file mapping on Windows, shm_open elsewhere)
+		static bool openSharedMemory(const std::string& name, uint32_t capacity = 256);
+		static void closeSharedMemory();
+
+	private:
+		static inline std::array<std::atomic<uint64_t>, COUNTER_COUNT> s_Counters{};
+		static inline std::array<std::atomic<uint64_t>, GAUGE_COUNT> s_Gauges{};
+	};
+}
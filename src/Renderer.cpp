@@ -1,21 +1,167 @@
 #include "Renderer.h"
 
-#include <stdexcept>
+#include "Buffer.h"
+#include "CpuProfiler.h"
+#include "HostMemory.h"
+#include "RenderStats.h"
+
+#include <algorithm>
 #include <array>
+#include <chrono>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <thread>
 
 namespace NNuts {
-	NNRenderer::NNRenderer(NNWindow& window, NNDevice& device)
-		:m_Window{window}, m_Device{device}
+	NNRenderer::NNRenderer(
+		NNWindow& window,
+		NNDevice& device,
+		RenderPath renderPath,
+		uint32_t framesInFlight,
+		PresentSettings presentSettings)
+		:m_Window{window}, m_Device{device}, m_RenderPath{renderPath},
+		m_FramesInFlight{ std::clamp<uint32_t>(framesInFlight, 1, NNSwapChain::MAX_FRAMES_IN_FLIGHT) },
+		m_PresentSettings{ presentSettings }
 	{
 		recreateSwapChain();
 		createCommandBuffers();
+		createSyncObjects();
+		for (uint32_t i = 0; i < NNSwapChain::MAX_FRAMES_IN_FLIGHT; i++) {
+			m_DescriptorAllocators.push_back(std::make_unique<NNDescriptorAllocator>(m_Device));
+		}
+		m_Device.getDeletionQueue().setPendingFrame(m_SubmittedFrames + 1);
 	}
 
 	NNRenderer::~NNRenderer()
 	{
+		vkDeviceWaitIdle(m_Device.device());
+		for (auto semaphore : m_ImageAvailableSemaphores) {
+			vkDestroySemaphore(m_Device.device(), semaphore, NNHostMemory::callbacks(NNHostMemory::Tag::Semaphore));
+		}
+		vkDestroySemaphore(m_Device.device(), m_FrameTimeline, NNHostMemory::callbacks(NNHostMemory::Tag::Semaphore));
 		freeCommandBuffers();
 	}
 
+	void NNRenderer::createSyncObjects()
+	{
+		VkSemaphoreTypeCreateInfo timelineInfo{};
+		timelineInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+		timelineInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+		timelineInfo.initialValue = 0;
+
+		VkSemaphoreCreateInfo semaphoreInfo{};
+		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		semaphoreInfo.pNext = &timelineInfo;
+		if (vkCreateSemaphore(m_Device.device(), &semaphoreInfo, NNHostMemory::callbacks(NNHostMemory::Tag::Semaphore), &m_FrameTimeline) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create the frame timeline semaphore!");
+		}
+
+		// Acquire has to signal a binary semaphore, one per frame slot
+		semaphoreInfo.pNext = nullptr;
+		m_ImageAvailableSemaphores.resize(NNSwapChain::MAX_FRAMES_IN_FLIGHT);
+		for (auto& semaphore : m_ImageAvailableSemaphores) {
+			if (vkCreateSemaphore(m_Device.device(), &semaphoreInfo, NNHostMemory::callbacks(NNHostMemory::Tag::Semaphore), &semaphore) != VK_SUCCESS) {
+				throw std::runtime_error("Failed to create image available semaphore!");
+			}
+		}
+	}
+
+	uint64_t NNRenderer::getCompletedFrameCount() const
+	{
+		uint64_t value = 0;
+		vkGetSemaphoreCounterValue(m_Device.device(), m_FrameTimeline, &value);
+		return value;
+	}
+
+	void NNRenderer::waitForFrames(uint64_t completedFrames)
+	{
+		if (completedFrames == 0) {
+			return;
+		}
+
+		VkSemaphoreWaitInfo waitInfo{};
+		waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+		waitInfo.semaphoreCount = 1;
+		waitInfo.pSemaphores = &m_FrameTimeline;
+		waitInfo.pValues = &completedFrames;
+		if (vkWaitSemaphores(m_Device.device(), &waitInfo, std::numeric_limits<uint64_t>::max()) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to wait for the frame timeline!");
+		}
+	}
+
+	void NNRenderer::setFramesInFlight(uint32_t count)
+	{
+		assert(!isFrameStarted && "Can't change frames in flight while a frame is in progress!");
+		count = std::clamp<uint32_t>(count, 1, NNSwapChain::MAX_FRAMES_IN_FLIGHT);
+		if (count == m_FramesInFlight) {
+			return;
+		}
+
+		// Frame slots get remapped, so nothing may still be using one
+		waitForFrames(m_SubmittedFrames);
+		m_FramesInFlight = count;
+	}
+
+	void NNRenderer::setPresentMode(VkPresentModeKHR presentMode)
+	{
+		if (presentMode == m_PresentSettings.presentMode) {
+			return;
+		}
+		m_PresentSettings.presentMode = presentMode;
+		m_PresentSettingsChanged = true;
+	}
+
+	void NNRenderer::paceFrame()
+	{
+		assert(!isFrameStarted && "paceFrame has to be called between frames!");
+		NN_PROFILE_SCOPE("pace frame");
+		auto start = Clock::now();
+
+		if (m_FrameRateCap > 0.0) {
+			auto interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / m_FrameRateCap));
+			auto target = m_LastPaceTime + interval;
+			// The OS sleep is coarse, spin for the last millisecond
+			auto sleepUntil = target - std::chrono::milliseconds(1);
+			if (Clock::now() < sleepUntil) {
+				std::this_thread::sleep_until(sleepUntil);
+			}
+			while (Clock::now() < target) {
+				std::this_thread::yield();
+			}
+		}
+		m_LastPaceTime = Clock::now();
+
+		if (m_LatencyLimit < m_FramesInFlight && m_SubmittedFrames > m_LatencyLimit) {
+			waitForFrames(m_SubmittedFrames - m_LatencyLimit);
+		}
+
+		m_InputSampleTime = Clock::now();
+		m_InputSampled = true;
+		m_LastPacingWaitMilliseconds = std::chrono::duration<double, std::milli>(m_InputSampleTime - start).count();
+		updateLatencies();
+	}
+
+	void NNRenderer::updateLatencies()
+	{
+		if (m_PendingLatencyCount == 0) {
+			return;
+		}
+
+		uint64_t completed = getCompletedFrameCount();
+		auto now = Clock::now();
+		while (m_PendingLatencyCount > 0 && m_PendingLatencies[m_PendingLatencyHead].frameValue <= completed) {
+			auto& pending = m_PendingLatencies[m_PendingLatencyHead];
+			m_LastLatency.frame = pending.frameValue - 1;
+			m_LastLatency.inputToSubmitMilliseconds =
+				std::chrono::duration<double, std::milli>(pending.submit - pending.inputSample).count();
+			m_LastLatency.inputToGpuDoneMilliseconds =
+				std::chrono::duration<double, std::milli>(now - pending.inputSample).count();
+			m_PendingLatencyHead = (m_PendingLatencyHead + 1) % m_PendingLatencies.size();
+			m_PendingLatencyCount--;
+		}
+	}
+
 	void NNRenderer::recreateSwapChain()
 	{
 		auto extent = m_Window.getExtent();
@@ -24,18 +170,31 @@ namespace NNuts {
 			glfwWaitEvents();
 		}
 
-		vkDeviceWaitIdle(m_Device.device());
 		if (m_SwapChain == nullptr) {
-			m_SwapChain = std::make_unique<NNSwapChain>(m_Device, extent);
+			m_SwapChain = std::make_unique<NNSwapChain>(m_Device, extent, m_RenderPath, m_PresentSettings);
 		}
 		else {
+			// No device idle here: frames still in flight keep using the old swap chain's images and
+			// framebuffers, so it is only destroyed once the deletion queue reaches them
 			std::shared_ptr<NNSwapChain> oldSwapChain = std::move(m_SwapChain);
-			m_SwapChain = std::make_unique<NNSwapChain>(m_Device, extent, std::move(m_SwapChain));
+			m_SwapChain = std::make_unique<NNSwapChain>(m_Device, extent, oldSwapChain, m_RenderPath, m_PresentSettings);
 
 			if (!oldSwapChain->compareSwapFormats(*m_SwapChain.get())) {
-				throw std::runtime_error("Swap chain image(or depth) format has changed!");
+				m_RenderPassGeneration++;
 			}
+			m_Device.getDeletionQueue().push([oldSwapChain]() mutable { oldSwapChain.reset(); });
+		}
+		m_SwapChainGeneration++;
+	}
+
+	std::vector<NNSwapChain::GBufferViews> NNRenderer::getGBufferViews() const
+	{
+		assert(m_RenderPath == RenderPath::Deferred && "Only the deferred render path has a G-buffer!");
+		std::vector<NNSwapChain::GBufferViews> views(m_SwapChain->imageCount());
+		for (size_t i = 0; i < views.size(); i++) {
+			views[i] = m_SwapChain->getGBufferViews(static_cast<int>(i));
 		}
+		return views;
 	}
 
 	void NNRenderer::createCommandBuffers()
@@ -68,8 +227,39 @@ namespace NNuts {
 	VkCommandBuffer NNRenderer::beginFrame()
 	{
 		assert(!isFrameStarted && "Can't call beginFrame while already in progress!");
-		
-		auto result = m_SwapChain->acquireNextImage(&currentImageIndex);
+		NN_PROFILE_FUNCTION();
+
+		if (!m_InputSampled) {
+			m_InputSampleTime = Clock::now();
+			m_InputSampled = true;
+		}
+
+		if (m_PresentSettingsChanged) {
+			m_PresentSettingsChanged = false;
+			recreateSwapChain();
+		}
+
+		// The slot was last used m_FramesInFlight frames ago, that frame has to be done before its
+		// command buffer, semaphore and per frame buffers can be reused
+		currentFrameIndex = static_cast<int>(m_SubmittedFrames % m_FramesInFlight);
+		uint64_t slotFreeAt = m_SubmittedFrames >= m_FramesInFlight ? m_SubmittedFrames - m_FramesInFlight + 1 : 0;
+
+		auto waitStart = std::chrono::high_resolution_clock::now();
+		{
+			NN_PROFILE_SCOPE("wait for frame slot");
+			waitForFrames(slotFreeAt);
+		}
+		auto waitEnd = std::chrono::high_resolution_clock::now();
+		m_LastCpuWaitMilliseconds = std::chrono::duration<double, std::milli>(waitEnd - waitStart).count();
+
+		m_Device.getDeletionQueue().collect(getCompletedFrameCount());
+		updateLatencies();
+
+		VkResult result;
+		{
+			NN_PROFILE_SCOPE("acquire image");
+			result = m_SwapChain->acquireNextImage(m_ImageAvailableSemaphores[currentFrameIndex], &currentImageIndex);
+		}
 
 		if (result == VK_ERROR_OUT_OF_DATE_KHR) {
 			recreateSwapChain();
@@ -81,6 +271,8 @@ namespace NNuts {
 		}
 
 		isFrameStarted = true;
+		m_FrameAllocator.beginFrame();
+		m_DescriptorAllocators[currentFrameIndex]->resetPools();
 
 		auto commandBuffer = getCurrentCommandBuffer();
 
@@ -94,15 +286,75 @@ namespace NNuts {
 		return commandBuffer;
 	}
 
-	void NNRenderer::endFrame()
+	void NNRenderer::endFrame(const std::function<void()>& lateLatch)
 	{
 		assert(isFrameStarted && "Can't call endFrame while already is not in progress!");
+		NN_PROFILE_FUNCTION();
 		auto commandBuffer = getCurrentCommandBuffer();
 		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
 			throw std::runtime_error("failed to record command buffer!");
 		}
 
-		auto result = m_SwapChain->submitCommandBuffers(&commandBuffer, &currentImageIndex);
+		if (lateLatch) {
+			m_InputSampleTime = Clock::now();
+			lateLatch();
+		}
+
+		// Binary semaphores ignore their entry in the value arrays. Offscreen images are never acquired
+		// or presented, so headless frames only signal the timeline (the last entry).
+		bool headless = isHeadless();
+		VkSemaphore waitSemaphores[] = { m_ImageAvailableSemaphores[currentFrameIndex] };
+		VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+		uint64_t waitValues[] = { 0 };
+		VkSemaphore signalSemaphores[] = {
+			headless ? VK_NULL_HANDLE : m_SwapChain->getRenderFinishedSemaphore(currentImageIndex), m_FrameTimeline };
+		uint64_t signalValues[] = { 0, m_SubmittedFrames + 1 };
+		uint32_t signalOffset = headless ? 1 : 0;
+
+		VkTimelineSemaphoreSubmitInfo timelineInfo{};
+		timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+		timelineInfo.waitSemaphoreValueCount = headless ? 0 : 1;
+		timelineInfo.pWaitSemaphoreValues = waitValues;
+		timelineInfo.signalSemaphoreValueCount = 2 - signalOffset;
+		timelineInfo.pSignalSemaphoreValues = signalValues + signalOffset;
+
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.pNext = &timelineInfo;
+		submitInfo.waitSemaphoreCount = headless ? 0 : 1;
+		submitInfo.pWaitSemaphores = waitSemaphores;
+		submitInfo.pWaitDstStageMask = waitStages;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &commandBuffer;
+		submitInfo.signalSemaphoreCount = 2 - signalOffset;
+		submitInfo.pSignalSemaphores = signalSemaphores + signalOffset;
+
+		{
+			NN_PROFILE_SCOPE("queue submit");
+			if (vkQueueSubmit(m_Device.graphicsQueue(), 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+				throw std::runtime_error("failed to submit draw command buffer!");
+			}
+		}
+		m_SubmittedFrames++;
+		m_LastImageIndex = currentImageIndex;
+		NNRenderStats::setGauge(NNRenderStats::Gauge::DeviceMemoryInUse, m_Device.getDeviceMemoryUsage());
+		NNRenderStats::setGauge(NNRenderStats::Gauge::DriverHostMemory, NNHostMemory::getTotalBytes());
+		NNRenderStats::setGauge(NNRenderStats::Gauge::FrameArenaBytes, m_FrameAllocator.current().getUsed());
+		NNRenderStats::endFrame(m_SubmittedFrames);
+		m_Device.getDeletionQueue().setPendingFrame(m_SubmittedFrames + 1);
+		// Only frames still in flight stay pending, which the ring always has room for
+		updateLatencies();
+		assert(m_PendingLatencyCount < m_PendingLatencies.size() && "More frames pending than can be in flight!");
+		m_PendingLatencies[(m_PendingLatencyHead + m_PendingLatencyCount) % m_PendingLatencies.size()] =
+			{ m_SubmittedFrames, m_InputSampleTime, Clock::now() };
+		m_PendingLatencyCount++;
+		m_InputSampled = false;
+
+		VkResult result;
+		{
+			NN_PROFILE_SCOPE("present");
+			result = m_SwapChain->present(currentImageIndex);
+		}
 		if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || m_Window.wasWindowResized()) {
 			m_Window.resetWindowResizedFlag();
 			recreateSwapChain();
@@ -111,7 +363,6 @@ namespace NNuts {
 		}
 
 		isFrameStarted = false;
-		currentFrameIndex = (currentFrameIndex + 1) % NNSwapChain::MAX_FRAMES_IN_FLIGHT;
 	}
 
 	void NNRenderer::beginSwapChainRenderPass(VkCommandBuffer commandBuffer)
@@ -129,10 +380,12 @@ namespace NNuts {
 		renderPassInfo.renderArea.offset = { 0, 0 };
 		renderPassInfo.renderArea.extent = m_SwapChain->getSwapChainExtent();
 
-		std::array<VkClearValue, 2> clearValues{};
-		clearValues[0].color = { 0.01f, 0.01f, 0.01f, 1.0f };
-		clearValues[1].depthStencil = { 1.0f, 0 };
-		renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+		std::array<VkClearValue, 4> clearValues{};
+		clearValues[NNSwapChain::COLOR_ATTACHMENT].color = { 0.01f, 0.01f, 0.01f, 1.0f };
+		clearValues[NNSwapChain::DEPTH_ATTACHMENT].depthStencil = { 1.0f, 0 };
+		clearValues[NNSwapChain::GBUFFER_ALBEDO_ATTACHMENT].color = { 0.0f, 0.0f, 0.0f, 0.0f };
+		clearValues[NNSwapChain::GBUFFER_NORMAL_ATTACHMENT].color = { 0.0f, 0.0f, 0.0f, 0.0f };
+		renderPassInfo.clearValueCount = m_SwapChain->attachmentCount();
 		renderPassInfo.pClearValues = clearValues.data();
 
 		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
@@ -150,6 +403,15 @@ namespace NNuts {
 
 	}
 
+	void NNRenderer::nextSubpass(VkCommandBuffer commandBuffer)
+	{
+		assert(isFrameStarted && "Can't call nextSubpass while frame is not in progress!");
+		assert(
+			commandBuffer == getCurrentCommandBuffer() &&
+			"Can't advance subpass on command buffer from different frame!");
+		vkCmdNextSubpass(commandBuffer, VK_SUBPASS_CONTENTS_INLINE);
+	}
+
 	void NNRenderer::endSwapChainRenderPass(VkCommandBuffer commandBuffer)
 	{
 		assert(isFrameStarted && "Can't call endSwapChainRenderPass while frame already in progress!");
@@ -159,4 +421,87 @@ namespace NNuts {
 		vkCmdEndRenderPass(commandBuffer);
 	}
 
-}
\ No newline at end of file
+	void NNRenderer::saveLastFrame(const std::string& path)
+	{
+		assert(!isFrameStarted && "Can't save a frame while one is in progress!");
+		if (!isHeadless() || m_SubmittedFrames == 0) {
+			throw std::runtime_error("Only headless renderers with a finished frame can be read back!");
+		}
+		if (m_SwapChain->getSwapChainImageFormat() != VK_FORMAT_B8G8R8A8_SRGB) {
+			throw std::runtime_error("Unexpected offscreen image format for readback!");
+		}
+
+		VkExtent2D extent = m_SwapChain->getSwapChainExtent();
+		NNBuffer stagingBuffer{
+			m_Device,
+			4,
+			extent.width * extent.height,
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT };
+
+		// The frame left the image in TRANSFER_SRC_OPTIMAL, only its colour writes need to be made visible
+		VkCommandBuffer commandBuffer = m_Device.beginSingleTimeCommands();
+		VkImageMemoryBarrier imageBarrier{};
+		imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		imageBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		imageBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		imageBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		imageBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imageBarrier.image = m_SwapChain->getImage(static_cast<int>(m_LastImageIndex));
+		imageBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		vkCmdPipelineBarrier(
+			commandBuffer,
+			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0, 0, nullptr, 0, nullptr, 1, &imageBarrier);
+
+		VkBufferImageCopy region{};
+		region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+		region.imageExtent = { extent.width, extent.height, 1 };
+		vkCmdCopyImageToBuffer(
+			commandBuffer,
+			imageBarrier.image,
+			VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			stagingBuffer.getBuffer(),
+			1,
+			&region);
+
+		VkBufferMemoryBarrier bufferBarrier{};
+		bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		bufferBarrier.buffer = stagingBuffer.getBuffer();
+		bufferBarrier.size = VK_WHOLE_SIZE;
+		vkCmdPipelineBarrier(
+			commandBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_PIPELINE_STAGE_HOST_BIT,
+			0, 0, nullptr, 1, &bufferBarrier, 0, nullptr);
+
+		m_Device.endSingleTimeCommands(commandBuffer);
+		vkQueueWaitIdle(m_Device.graphicsQueue());
+
+		stagingBuffer.map();
+		auto pixels = static_cast<const uint8_t*>(stagingBuffer.getMappedMemory());
+		std::ofstream file{ path, std::ios::binary };
+		if (!file) {
+			throw std::runtime_error("Failed to open " + path + " for writing!");
+		}
+		file << "P6\n" << extent.width << " " << extent.height << "\n255\n";
+		std::vector<uint8_t> row(extent.width * 3);
+		for (uint32_t y = 0; y < extent.height; y++) {
+			const uint8_t* src = pixels + static_cast<size_t>(y) * extent.width * 4;
+			for (uint32_t x = 0; x < extent.width; x++) {
+				row[x * 3 + 0] = src[x * 4 + 2];
+				row[x * 3 + 1] = src[x * 4 + 1];
+				row[x * 3 + 2] = src[x * 4 + 0];
+			}
+			file.write(reinterpret_cast<const char*>(row.data()), row.size());
+		}
+		stagingBuffer.unmap();
+	}
+}
@@ -2,16 +2,35 @@
 
 #include "Window.h"
 #include "SwapChain.h"
+#include "Descriptor.h"
 #include "Device.h"
+#include "FrameArena.h"
 
+#include <array>
+#include <chrono>
+#include <functional>
 #include <memory>
+#include <string>
 #include <vector>
 #include <cassert>
 
 namespace NNuts {
 	class NNRenderer {
 	public:
-		NNRenderer(NNWindow &window, NNDevice &device);
+		// Input-to-GPU-done latency of one frame, the GPU end being when the CPU first saw the frame's
+		// timeline value. The time until the image is presented is not included.
+		struct InputToGpuLatency {
+			uint64_t frame = 0;
+			double inputToSubmitMilliseconds = 0.0;
+			double inputToGpuDoneMilliseconds = 0.0;
+		};
+
+		NNRenderer(
+			NNWindow &window,
+			NNDevice &device,
+			RenderPath renderPath = RenderPath::Forward,
+			uint32_t framesInFlight = 2,
+			PresentSettings presentSettings = {});
 		~NNRenderer();
 
 		NNRenderer(const NNRenderer&) = delete;
@@ -19,7 +38,49 @@ namespace NNuts {
 
 		VkRenderPass getSwapChainRenderPass() const { return m_SwapChain->getRenderPass(); }
 		float getAspectRatio() const { return m_SwapChain->extentAspectRatio(); }
+		VkExtent2D getSwapChainExtent() const { return m_SwapChain->getSwapChainExtent(); }
+		VkFormat getSwapChainImageFormat() const { return m_SwapChain->getSwapChainImageFormat(); }
+		VkFormat getSwapChainDepthFormat() const { return m_SwapChain->findDepthFormat(); }
 		bool isFrameInProgress() const { return isFrameStarted; }
+		bool isHeadless() const { return m_SwapChain->isOffscreen(); }
+		// Layout the frame's image is left in: PRESENT_SRC, or TRANSFER_SRC for offscreen images
+		VkImageLayout getSwapChainFinalLayout() const { return m_SwapChain->getFinalLayout(); }
+		RenderPath getRenderPath() const { return m_RenderPath; }
+
+		// Bumped whenever the swap chain is recreated, so image dependent state knows to rebuild
+		uint32_t getSwapChainGeneration() const { return m_SwapChainGeneration; }
+		// Bumped when a recreated swap chain changed formats and got a new render pass, pipelines built
+		// against the old one have to be rebuilt
+		uint32_t getRenderPassGeneration() const { return m_RenderPassGeneration; }
+		std::vector<NNSwapChain::GBufferViews> getGBufferViews() const;
+
+		// Frame N signals value N + 1 on the frame timeline, so both counts are timeline values
+		uint64_t getSubmittedFrameCount() const { return m_SubmittedFrames; }
+		uint64_t getCompletedFrameCount() const;
+
+		// 1 to NNSwapChain::MAX_FRAMES_IN_FLIGHT. More frames hide CPU spikes at the cost of latency.
+		// Changing it waits for the GPU once, between frames.
+		void setFramesInFlight(uint32_t count);
+		uint32_t getFramesInFlight() const { return m_FramesInFlight; }
+		// Time beginFrame spent blocked on the frame timeline before it could reuse the frame slot
+		double getLastCpuWaitMilliseconds() const { return m_LastCpuWaitMilliseconds; }
+
+		// Takes effect with a swap chain recreation at the next beginFrame
+		void setPresentMode(VkPresentModeKHR presentMode);
+		VkPresentModeKHR getPresentMode() const { return m_SwapChain->getPresentMode(); }
+		// Frames per second, 0 disables the cap
+		void setFrameRateCap(double framesPerSecond) { m_FrameRateCap = framesPerSecond; }
+		double getFrameRateCap() const { return m_FrameRateCap; }
+		// Most frames still queued on the GPU when input is sampled. 0 waits for an idle GPU,
+		// anything >= the frames in flight turns the limiter off.
+		void setLatencyLimit(uint32_t maxQueuedFrames) { m_LatencyLimit = maxQueuedFrames; }
+		uint32_t getLatencyLimit() const { return m_LatencyLimit; }
+
+		// Call right before sampling input. Applies the frame rate cap and the latency limiter and
+		// marks the input sample time of the next frame.
+		void paceFrame();
+		double getLastPacingWaitMilliseconds() const { return m_LastPacingWaitMilliseconds; }
+		const InputToGpuLatency& getLastLatency() const { return m_LastLatency; }
 
 		VkCommandBuffer getCurrentCommandBuffer() const {
 			assert(isFrameStarted && "Cannot get command buffer when frame not in progress!");
@@ -31,22 +92,92 @@ namespace NNuts {
 			return currentFrameIndex;
 		}
 
+		uint32_t getImageIndex() const {
+			assert(isFrameStarted && "Cannot get image index when frame not in progress!");
+			return currentImageIndex;
+		}
+
+		// Image acquired for the current frame, for passes that render to it without the swap chain render pass
+		VkImage getSwapChainImage() const {
+			assert(isFrameStarted && "Cannot get swap chain image when frame not in progress!");
+			return m_SwapChain->getImage(currentImageIndex);
+		}
+		VkImageView getSwapChainImageView() const {
+			assert(isFrameStarted && "Cannot get swap chain image view when frame not in progress!");
+			return m_SwapChain->getImageView(currentImageIndex);
+		}
+
+		// Transient CPU memory for the frame in progress. Everything allocated from it stays valid until
+		// the end of the next frame, then it is dropped at once; deallocations are no-ops.
+		std::pmr::memory_resource* getFrameAllocator() {
+			assert(isFrameStarted && "Cannot get frame allocator when frame not in progress!");
+			return &m_FrameAllocator.current();
+		}
+		const NNFrameArena& getFrameArena() const { return m_FrameAllocator.current(); }
+		// Descriptor sets that are only used by the frame in progress. The pools are reset once the
+		// frame slot comes around again.
+		NNDescriptorAllocator& getFrameDescriptorAllocator() {
+			assert(isFrameStarted && "Cannot get frame descriptor allocator when frame not in progress!");
+			return *m_DescriptorAllocators[currentFrameIndex];
+		}
+
 		VkCommandBuffer beginFrame();
-		void endFrame();
+		// lateLatch runs after the command buffer is closed, right before vkQueueSubmit. Host writes it
+		// makes to mapped memory are still seen by this frame, and it counts as the frame's input sample.
+		void endFrame(const std::function<void()>& lateLatch = nullptr);
 		void beginSwapChainRenderPass(VkCommandBuffer commandBuffer);
+		void nextSubpass(VkCommandBuffer commandBuffer);
 		void endSwapChainRenderPass(VkCommandBuffer commandBuffer);
 
+		// Headless only: waits for the GPU and writes the last submitted frame as a binary PPM
+		void saveLastFrame(const std::string& path);
+
 	private:
 		void createCommandBuffers();
 		void freeCommandBuffers();
+		void createSyncObjects();
+		void waitForFrames(uint64_t completedFrames);
+		void updateLatencies();
 		void recreateSwapChain();
 
 		NNWindow& m_Window;
 		NNDevice& m_Device;
+		RenderPath m_RenderPath;
 		std::unique_ptr<NNSwapChain> m_SwapChain;
+		uint32_t m_SwapChainGeneration{ 0 };
+		uint32_t m_RenderPassGeneration{ 0 };
 		std::vector<VkCommandBuffer> m_CommandBuffers;
+		uint64_t m_SubmittedFrames{ 0 };
+		uint32_t m_FramesInFlight;
+		VkSemaphore m_FrameTimeline{ VK_NULL_HANDLE };
+		std::vector<VkSemaphore> m_ImageAvailableSemaphores;
+		double m_LastCpuWaitMilliseconds{ 0.0 };
+
+		using Clock = std::chrono::high_resolution_clock;
+		struct PendingLatency {
+			uint64_t frameValue;
+			Clock::time_point inputSample;
+			Clock::time_point submit;
+		};
+
+		PresentSettings m_PresentSettings;
+		bool m_PresentSettingsChanged{ false };
+		double m_FrameRateCap{ 0.0 };
+		uint32_t m_LatencyLimit{ NNSwapChain::MAX_FRAMES_IN_FLIGHT };
+		double m_LastPacingWaitMilliseconds{ 0.0 };
+		Clock::time_point m_LastPaceTime{};
+		Clock::time_point m_InputSampleTime{};
+		bool m_InputSampled{ false };
+		// Ring of the submitted frames that haven't completed yet, at most one per frame in flight
+		std::array<PendingLatency, NNSwapChain::MAX_FRAMES_IN_FLIGHT> m_PendingLatencies{};
+		uint32_t m_PendingLatencyHead{ 0 };
+		uint32_t m_PendingLatencyCount{ 0 };
+		InputToGpuLatency m_LastLatency{};
+		NNFrameAllocator m_FrameAllocator;
+		std::vector<std::unique_ptr<NNDescriptorAllocator>> m_DescriptorAllocators;
 		
 		uint32_t currentImageIndex;
+		uint32_t m_LastImageIndex{ 0 };
 		int currentFrameIndex{ 0 };
 		bool isFrameStarted{ false };
 	};
@@ -3,9 +3,86 @@
 #include <cstdlib>
 #include <iostream>
 #include <stdexcept>
+#include <string>
 
-int main() {
-	NNuts::NNApplication sandbox{};
+int main(int argc, char** argv) {
+	NNuts::NNApplication::Settings settings{};
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--light-stress") {
+			settings.scene = NNuts::NNApplication::Scene::LightStress;
+		}
+		else if (arg == "--procedural") {
+			settings.scene = NNuts::NNApplication::Scene::Procedural;
+		}
+		else if (arg == "--deferred") {
+			settings.renderPath = NNuts::RenderPath::Deferred;
+		}
+		else if (arg == "--frame-graph") {
+			settings.frameGraph = true;
+		}
+		else if (arg == "--frames-in-flight" && i + 1 < argc) {
+			settings.framesInFlight = static_cast<uint32_t>(std::stoul(argv[++i]));
+		}
+		else if (arg == "--present-mode" && i + 1 < argc) {
+			std::string mode = argv[++i];
+			if (mode == "fifo") settings.present.presentMode = VK_PRESENT_MODE_FIFO_KHR;
+			else if (mode == "fifo-relaxed") settings.present.presentMode = VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+			else if (mode == "mailbox") settings.present.presentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+			else if (mode == "immediate") settings.present.presentMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+			else std::cerr << "Unknown present mode " << mode << ", keeping the default" << std::endl;
+		}
+		else if (arg == "--swap-images" && i + 1 < argc) {
+			settings.present.imageCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+		}
+		else if (arg == "--fps-cap" && i + 1 < argc) {
+			settings.frameRateCap = std::stod(argv[++i]);
+		}
+		else if (arg == "--latency-limit" && i + 1 < argc) {
+			settings.latencyLimit = static_cast<uint32_t>(std::stoul(argv[++i]));
+		}
+		else if (arg == "--late-latch") {
+			settings.lateLatchCamera = true;
+		}
+		else if (arg == "--bindless") {
+			settings.bindless = true;
+		}
+		else if (arg == "--measure-shader-cache") {
+			settings.measureShaderCache = true;
+		}
+		else if (arg == "--lights" && i + 1 < argc) {
+			settings.stressLightCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+		}
+		else if (arg == "--headless") {
+			settings.headless = true;
+		}
+		else if (arg == "--frames" && i + 1 < argc) {
+			settings.frameCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+		}
+		else if (arg == "--capture" && i + 1 < argc) {
+			settings.capturePath = argv[++i];
+		}
+		else if (arg == "--record-camera" && i + 1 < argc) {
+			settings.recordCameraPath = argv[++i];
+		}
+		else if (arg == "--trace" && i + 1 < argc) {
+			settings.tracePath = argv[++i];
+		}
+		else if (arg == "--trace-frames" && i + 1 < argc) {
+			settings.traceFrames = static_cast<uint32_t>(std::stoul(argv[++i]));
+		}
+		else if (arg == "--stats" && i + 1 < argc) {
+			settings.statsPath = argv[++i];
+		}
+		else if (arg == "--stats-window" && i + 1 < argc) {
+			settings.statsWindow = static_cast<uint32_t>(std::stoul(argv[++i]));
+		}
+		else if (arg == "--stats-shm" && i + 1 < argc) {
+			settings.statsSharedMemory = argv[++i];
+		}
+	}
+
+	NNuts::NNApplication sandbox{ settings };
 
 	try
 	{
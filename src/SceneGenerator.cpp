@@ -0,0 +1,139 @@
+#include "SceneGenerator.h"
+
+#include <glm/gtc/constants.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <random>
+
+namespace NNuts {
+	namespace {
+		glm::vec3 hueToRgb(float hue)
+		{
+			glm::vec3 rgb = glm::clamp(
+				glm::abs(glm::mod(hue * 6.0f + glm::vec3{ 0.0f, 4.0f, 2.0f }, 6.0f) - 3.0f) - 1.0f,
+				0.0f, 1.0f);
+			return glm::mix(glm::vec3{ 1.0f }, rgb, 0.7f);
+		}
+
+		// Lumpy sphere of unit size. The displacement is a function of the direction only, so the
+		// duplicated seam vertices stay in place and the tessellation is all that differs in cost.
+		std::shared_ptr<NNModel> createRockModel(NNDevice& device, uint32_t index, std::mt19937& random)
+		{
+			std::uniform_real_distribution<float> frequency{ 1.0f, 4.0f };
+			std::uniform_real_distribution<float> phase{ 0.0f, glm::two_pi<float>() };
+			glm::vec3 frequencies{ frequency(random), frequency(random), frequency(random) };
+			glm::vec3 phases{ phase(random), phase(random), phase(random) };
+			glm::vec3 color = hueToRgb(static_cast<float>(index) * 0.618034f);
+
+			uint32_t rings = 6 + 3 * (index % 6);
+			uint32_t segments = 2 * rings;
+
+			NNModel::Builder builder{};
+			builder.vertices.reserve((rings + 1) * (segments + 1));
+			for (uint32_t ring = 0; ring <= rings; ring++) {
+				float theta = glm::pi<float>() * ring / rings;
+				for (uint32_t segment = 0; segment <= segments; segment++) {
+					float phi = glm::two_pi<float>() * segment / segments;
+					glm::vec3 direction{ glm::sin(theta) * glm::cos(phi), glm::cos(theta), glm::sin(theta) * glm::sin(phi) };
+					glm::vec3 wave = glm::sin(frequencies * direction + phases);
+					float radius = 0.5f * (1.0f + 0.2f * wave.x * wave.y * wave.z);
+
+					NNModel::Vertex vertex{};
+					vertex.position = radius * direction;
+					vertex.color = color;
+					vertex.normal = direction;
+					vertex.uv = { static_cast<float>(segment) / segments, static_cast<float>(ring) / rings };
+					builder.vertices.push_back(vertex);
+				}
+			}
+
+			builder.indices.reserve(rings * segments * 6);
+			for (uint32_t ring = 0; ring < rings; ring++) {
+				for (uint32_t segment = 0; segment < segments; segment++) {
+					uint32_t a = ring * (segments + 1) + segment;
+					uint32_t b = a + segments + 1;
+					builder.indices.insert(builder.indices.end(), { a, a + 1, b, a + 1, b + 1, b });
+				}
+			}
+
+			return std::make_shared<NNModel>(device, builder);
+		}
+	}
+
+	const char* NNSceneGenerator::distributionName(Distribution distribution)
+	{
+		switch (distribution) {
+		case Distribution::Grid:
+			return "grid";
+		case Distribution::Uniform:
+			return "uniform";
+		case Distribution::Clustered:
+			return "clustered";
+		default:
+			return "unknown";
+		}
+	}
+
+	bool NNSceneGenerator::parseDistribution(const std::string& name, Distribution& distribution)
+	{
+		for (auto candidate : { Distribution::Grid, Distribution::Uniform, Distribution::Clustered }) {
+			if (name == distributionName(candidate)) {
+				distribution = candidate;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void NNSceneGenerator::generate(NNDevice& device, const Params& params, NNWorld& world, NNTransformHierarchy& transforms)
+	{
+		// Separate streams, so changing the object count doesn't change the models
+		std::mt19937 modelRandom{ params.seed };
+		std::mt19937 placementRandom{ params.seed ^ 0x9e3779b9u };
+
+		std::vector<std::shared_ptr<NNModel>> models(std::max(params.modelCount, 1u));
+		for (uint32_t i = 0; i < models.size(); i++) {
+			models[i] = createRockModel(device, i, modelRandom);
+		}
+
+		float halfExtent = 0.5f * params.extent;
+		std::uniform_real_distribution<float> spread{ -halfExtent, halfExtent };
+		std::uniform_real_distribution<float> unit{ 0.0f, 1.0f };
+		std::normal_distribution<float> clump{ 0.0f, 0.04f * params.extent };
+
+		std::vector<glm::vec2> clusterCenters(std::max(params.objectCount / 256u, 1u));
+		for (auto& center : clusterCenters) {
+			center = { spread(placementRandom), spread(placementRandom) };
+		}
+		uint32_t gridSize = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<float>(params.objectCount))));
+		float gridSpacing = gridSize > 1 ? params.extent / (gridSize - 1) : 0.0f;
+
+		for (uint32_t i = 0; i < params.objectCount; i++) {
+			glm::vec2 position{ 0.0f };
+			switch (params.distribution) {
+			case Distribution::Grid:
+				position = { (i % gridSize) * gridSpacing - halfExtent, (i / gridSize) * gridSpacing - halfExtent };
+				break;
+			case Distribution::Uniform:
+				position = { spread(placementRandom), spread(placementRandom) };
+				break;
+			case Distribution::Clustered: {
+				auto& center = clusterCenters[i % clusterCenters.size()];
+				position = glm::clamp(
+					center + glm::vec2{ clump(placementRandom), clump(placementRandom) },
+					glm::vec2{ -halfExtent }, glm::vec2{ halfExtent });
+				break;
+			}
+			}
+
+			float scale = 0.5f + unit(placementRandom);
+			TransformComponent transform{};
+			transform.translation = { position.x, -0.5f * scale, position.y };
+			transform.rotation = { 0.0f, glm::two_pi<float>() * unit(placementRandom), 0.0f };
+			transform.scale = glm::vec3{ scale };
+			world.create(TransformNode{ transforms.add(transform) }, RenderComponent{ models[i % models.size()] });
+		}
+	}
+}
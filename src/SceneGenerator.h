@@ -0,0 +1,43 @@
+#pragma once
+
+#include "Device.h"
+#include "GameObject.h"
+#include "TransformHierarchy.h"
+#include "World.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace NNuts {
+	// Seeded procedural scenes for benchmarking. The same parameters always give the same models
+	// and placements, so runs of different builds render identical frames.
+	class NNSceneGenerator {
+	public:
+		enum class Distribution {
+			// Square grid filling the extent
+			Grid,
+			// Uniformly random over the extent
+			Uniform,
+			// Gaussian clumps of about 256 objects, lots of overdraw close to little elsewhere
+			Clustered,
+		};
+
+		struct Params {
+			uint32_t objectCount = 1024;
+			// Unique meshes, each with its own vertex buffers and tessellation
+			uint32_t modelCount = 8;
+			Distribution distribution = Distribution::Grid;
+			// Side length of the square on the xz plane the objects are spread over, centered on the origin
+			float extent = 48.0f;
+			uint32_t seed = 1337;
+		};
+
+		static const char* distributionName(Distribution distribution);
+		static bool parseDistribution(const std::string& name, Distribution& distribution);
+
+		// Adds the objects as entities with root nodes in transforms, they rest on the y = 0 plane
+		// (negative y is up)
+		static void generate(NNDevice& device, const Params& params, NNWorld& world, NNTransformHierarchy& transforms);
+	};
+}
@@ -0,0 +1,381 @@
+#include "ShaderCompiler.h"
+
+#include <shaderc/shaderc.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <regex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+namespace NNuts {
+	namespace {
+		// Bump whenever the cache key layout changes so stale entries are never picked up
+		constexpr uint64_t CACHE_FORMAT_VERSION = 1;
+		constexpr uint32_t SPIRV_MAGIC = 0x07230203;
+
+		constexpr uint64_t FNV_OFFSET = 14695981039346656037ull;
+		constexpr uint64_t FNV_PRIME = 1099511628211ull;
+
+		void hashBytes(uint64_t& hash, const void* data, size_t size) {
+			auto bytes = static_cast<const unsigned char*>(data);
+			for (size_t i = 0; i < size; i++) {
+				hash ^= bytes[i];
+				hash *= FNV_PRIME;
+			}
+		}
+
+		void hashString(uint64_t& hash, const std::string& value) {
+			hashBytes(hash, value.data(), value.size());
+			// terminator keeps "ab"+"c" and "a"+"bc" apart
+			hashBytes(hash, "\0", 1);
+		}
+
+		template <typename T>
+		void hashValue(uint64_t& hash, const T& value) {
+			hashBytes(hash, &value, sizeof(value));
+		}
+
+		shaderc_shader_kind shaderKindFor(const std::string& filepath) {
+			std::string extension = std::filesystem::path(filepath).extension().string();
+			if (extension == ".vert") return shaderc_glsl_vertex_shader;
+			if (extension == ".frag") return shaderc_glsl_fragment_shader;
+			if (extension == ".comp") return shaderc_glsl_compute_shader;
+			if (extension == ".geom") return shaderc_glsl_geometry_shader;
+			if (extension == ".tesc") return shaderc_glsl_tess_control_shader;
+			if (extension == ".tese") return shaderc_glsl_tess_evaluation_shader;
+			throw std::runtime_error("Unknown shader stage for file: " + filepath);
+		}
+
+		std::string resolveIncludePath(
+			const std::string& requested,
+			const std::string& requestingFile,
+			const std::vector<std::string>& includeDirectories) {
+			namespace fs = std::filesystem;
+
+			fs::path relative = fs::path(requestingFile).parent_path() / requested;
+			if (fs::exists(relative)) {
+				return relative.lexically_normal().generic_string();
+			}
+
+			for (auto& directory : includeDirectories) {
+				fs::path candidate = fs::path(directory) / requested;
+				if (fs::exists(candidate)) {
+					return candidate.lexically_normal().generic_string();
+				}
+			}
+			return {};
+		}
+
+		class FileIncluder : public shaderc::CompileOptions::IncluderInterface {
+		public:
+			explicit FileIncluder(const std::vector<std::string>& includeDirectories)
+				: m_IncludeDirectories{ includeDirectories } {}
+
+			shaderc_include_result* GetInclude(
+				const char* requestedSource,
+				shaderc_include_type /*type*/,
+				const char* requestingSource,
+				size_t /*includeDepth*/) override {
+				auto include = new IncludeData{};
+				include->name = resolveIncludePath(requestedSource, requestingSource, m_IncludeDirectories);
+
+				std::ifstream file(include->name, std::ios::binary);
+				if (include->name.empty() || !file.is_open()) {
+					include->name.clear();
+					include->content = std::string("Failed to resolve include: ") + requestedSource;
+				}
+				else {
+					std::stringstream stream;
+					stream << file.rdbuf();
+					include->content = stream.str();
+				}
+
+				include->result.source_name = include->name.c_str();
+				include->result.source_name_length = include->name.size();
+				include->result.content = include->content.c_str();
+				include->result.content_length = include->content.size();
+				include->result.user_data = include;
+				return &include->result;
+			}
+
+			void ReleaseInclude(shaderc_include_result* data) override {
+				delete static_cast<IncludeData*>(data->user_data);
+			}
+
+		private:
+			struct IncludeData {
+				shaderc_include_result result{};
+				std::string name;
+				std::string content;
+			};
+
+			std::vector<std::string> m_IncludeDirectories;
+		};
+	}
+
+	NNShaderCompiler::NNShaderCompiler() : NNShaderCompiler(Options{})
+	{
+	}
+
+	NNShaderCompiler::NNShaderCompiler(Options options) : m_Options{ std::move(options) }
+	{
+		std::error_code error;
+		std::filesystem::create_directories(m_Options.cacheDirectory, error);
+		if (error) {
+			std::cerr << "Shader cache disabled, cannot create " << m_Options.cacheDirectory << ": " << error.message() << std::endl;
+			m_Options.cacheDirectory.clear();
+		}
+	}
+
+	void NNShaderCompiler::prepare(const std::vector<ShaderCompileRequest>& requests)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+
+		std::vector<std::future<Source>> jobs;
+		jobs.reserve(requests.size());
+		for (auto& request : requests) {
+			jobs.push_back(std::async(std::launch::async, [this, &request]() {
+				Source source;
+				getSpirv(request, source);
+				return source;
+			}));
+		}
+
+		Stats stats{};
+		for (auto& job : jobs) {
+			switch (job.get()) {
+			case Source::Compiled: stats.compiled++; break;
+			case Source::Disk: stats.loadedFromDisk++; break;
+			case Source::Memory: stats.loadedFromMemory++; break;
+			}
+		}
+
+		auto end = std::chrono::high_resolution_clock::now();
+		stats.milliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+		m_LastPrepareStats = stats;
+
+		std::cout << "Shader preparation: " << stats.milliseconds << " ms ("
+			<< stats.compiled << " compiled, "
+			<< stats.loadedFromDisk << " from disk cache, "
+			<< stats.loadedFromMemory << " from memory)" << std::endl;
+	}
+
+	void NNShaderCompiler::measureCache(const std::vector<ShaderCompileRequest>& requests, Options options)
+	{
+		options.cacheDirectory += "/Measure";
+		std::error_code error;
+		std::filesystem::remove_all(options.cacheDirectory, error);
+
+		double coldMilliseconds = 0.0;
+		double warmMilliseconds = 0.0;
+		{
+			NNShaderCompiler cold{ options };
+			cold.prepare(requests);
+			coldMilliseconds = cold.getLastPrepareStats().milliseconds;
+		}
+		{
+			NNShaderCompiler warm{ options };
+			warm.prepare(requests);
+			warmMilliseconds = warm.getLastPrepareStats().milliseconds;
+		}
+		std::filesystem::remove_all(options.cacheDirectory, error);
+
+		std::cout << "Shader cache: " << requests.size() << " shaders, cold " << coldMilliseconds
+			<< " ms, warm " << warmMilliseconds << " ms" << std::endl;
+	}
+
+	const std::vector<uint32_t>& NNShaderCompiler::getSpirv(const std::string& filepath, const ShaderDefines& defines)
+	{
+		Source source;
+		return getSpirv(ShaderCompileRequest{ filepath, defines }, source);
+	}
+
+	const std::vector<uint32_t>& NNShaderCompiler::getSpirv(const ShaderCompileRequest& request, Source& source)
+	{
+		std::string sourceText = readText(request.filepath);
+		uint64_t hash = hashRequest(request, sourceText);
+
+		{
+			std::lock_guard<std::mutex> lock{ m_Mutex };
+			auto it = m_Modules.find(hash);
+			if (it != m_Modules.end()) {
+				source = Source::Memory;
+				return it->second;
+			}
+		}
+
+		std::string cachePath = cachePathFor(request.filepath, hash);
+		std::vector<uint32_t> spirv;
+		if (loadCached(cachePath, spirv)) {
+			source = Source::Disk;
+		}
+		else {
+			spirv = compile(request, sourceText);
+			storeCached(cachePath, spirv);
+			source = Source::Compiled;
+		}
+
+		std::lock_guard<std::mutex> lock{ m_Mutex };
+		return m_Modules.emplace(hash, std::move(spirv)).first->second;
+	}
+
+	uint64_t NNShaderCompiler::hashRequest(const ShaderCompileRequest& request, const std::string& sourceText) const
+	{
+		uint64_t hash = FNV_OFFSET;
+		hashValue(hash, CACHE_FORMAT_VERSION);
+
+		unsigned int spvVersion = 0, spvRevision = 0;
+		shaderc_get_spv_version(&spvVersion, &spvRevision);
+		hashValue(hash, spvVersion);
+		hashValue(hash, spvRevision);
+		hashValue(hash, m_Options.optimize);
+		hashValue(hash, m_Options.generateDebugInfo);
+		hashValue(hash, static_cast<int>(shaderKindFor(request.filepath)));
+
+		for (auto& define : request.defines) {
+			hashString(hash, define.first);
+			hashString(hash, define.second);
+		}
+
+		hashString(hash, sourceText);
+		std::vector<std::string> visited{};
+		hashIncludes(sourceText, request.filepath, hash, visited);
+		return hash;
+	}
+
+	void NNShaderCompiler::hashIncludes(
+		const std::string& sourceText,
+		const std::string& requestingFile,
+		uint64_t& hash,
+		std::vector<std::string>& visited) const
+	{
+		// Every include is hashed, even the ones inside inactive #if blocks. That only costs the
+		// occasional unnecessary recompile and keeps us from having to run the preprocessor here.
+		static const std::regex includePattern{ R"(^\s*#\s*include\s*[<"]([^">]+)[">])" };
+
+		std::istringstream lines{ sourceText };
+		std::string line;
+		std::smatch match;
+		while (std::getline(lines, line)) {
+			if (!std::regex_search(line, match, includePattern)) {
+				continue;
+			}
+
+			std::string resolved = resolveIncludePath(match[1].str(), requestingFile, m_Options.includeDirectories);
+			hashString(hash, resolved.empty() ? match[1].str() : resolved);
+			if (resolved.empty() || std::find(visited.begin(), visited.end(), resolved) != visited.end()) {
+				continue;
+			}
+			visited.push_back(resolved);
+
+			std::string includeText = readText(resolved);
+			hashString(hash, includeText);
+			hashIncludes(includeText, resolved, hash, visited);
+		}
+	}
+
+	std::vector<uint32_t> NNShaderCompiler::compile(const ShaderCompileRequest& request, const std::string& sourceText) const
+	{
+		shaderc::Compiler compiler;
+		shaderc::CompileOptions options;
+		options.SetTargetEnvironment(shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_0);
+		options.SetOptimizationLevel(
+			m_Options.optimize ? shaderc_optimization_level_performance : shaderc_optimization_level_zero);
+		if (m_Options.generateDebugInfo) {
+			options.SetGenerateDebugInfo();
+		}
+		for (auto& define : request.defines) {
+			options.AddMacroDefinition(define.first, define.second);
+		}
+		options.SetIncluder(std::make_unique<FileIncluder>(m_Options.includeDirectories));
+
+		auto result = compiler.CompileGlslToSpv(
+			sourceText,
+			shaderKindFor(request.filepath),
+			request.filepath.c_str(),
+			options);
+
+		if (result.GetCompilationStatus() != shaderc_compilation_status_success) {
+			throw std::runtime_error("Failed to compile shader " + request.filepath + ":\n" + result.GetErrorMessage());
+		}
+
+		return { result.cbegin(), result.cend() };
+	}
+
+	bool NNShaderCompiler::loadCached(const std::string& cachePath, std::vector<uint32_t>& spirv) const
+	{
+		if (cachePath.empty()) {
+			return false;
+		}
+
+		std::ifstream file(cachePath, std::ios::ate | std::ios::binary);
+		if (!file.is_open()) {
+			return false;
+		}
+
+		size_t fileSize = static_cast<size_t>(file.tellg());
+		if (fileSize == 0 || fileSize % sizeof(uint32_t) != 0) {
+			return false;
+		}
+
+		spirv.resize(fileSize / sizeof(uint32_t));
+		file.seekg(0);
+		file.read(reinterpret_cast<char*>(spirv.data()), fileSize);
+
+		return file.good() && spirv[0] == SPIRV_MAGIC;
+	}
+
+	void NNShaderCompiler::storeCached(const std::string& cachePath, const std::vector<uint32_t>& spirv) const
+	{
+		if (cachePath.empty()) {
+			return;
+		}
+
+		// Write to a temporary file first so a concurrent reader never sees a partial module
+		std::ostringstream tempPath;
+		tempPath << cachePath << '.' << std::this_thread::get_id() << ".tmp";
+		{
+			std::ofstream file(tempPath.str(), std::ios::binary | std::ios::trunc);
+			if (!file.is_open()) {
+				return;
+			}
+			file.write(reinterpret_cast<const char*>(spirv.data()), spirv.size() * sizeof(uint32_t));
+		}
+
+		std::error_code error;
+		std::filesystem::rename(tempPath.str(), cachePath, error);
+		if (error) {
+			std::filesystem::remove(tempPath.str(), error);
+		}
+	}
+
+	std::string NNShaderCompiler::cachePathFor(const std::string& filepath, uint64_t hash) const
+	{
+		if (m_Options.cacheDirectory.empty()) {
+			return {};
+		}
+
+		std::ostringstream name;
+		name << std::filesystem::path(filepath).filename().string() << '.' << std::hex << hash << ".spv";
+		return (std::filesystem::path(m_Options.cacheDirectory) / name.str()).generic_string();
+	}
+
+	std::string NNShaderCompiler::readText(const std::string& filepath)
+	{
+		std::ifstream file(filepath, std::ios::binary);
+		if (!file.is_open()) {
+			throw std::runtime_error("Failed to open file: " + filepath);
+		}
+
+		std::stringstream stream;
+		stream << file.rdbuf();
+		return stream.str();
+	}
+}
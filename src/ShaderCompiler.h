@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace NNuts {
+	using ShaderDefines = std::map<std::string, std::string>;
+
+	struct ShaderCompileRequest {
+		std::string filepath;
+		ShaderDefines defines{};
+	};
+
+	// Compiles GLSL to SPIR-V at runtime through shaderc. Every result is written to an on-disk cache
+	// keyed by a hash of the source, its includes, the defines and the compiler options, so a warm
+	// start only has to read the cached SPIR-V back.
+	class NNShaderCompiler {
+	public:
+		struct Options {
+			std::string cacheDirectory = "res/ShaderCache";
+			std::vector<std::string> includeDirectories{ "res/Shaders" };
+			bool optimize = true;
+			bool generateDebugInfo = false;
+		};
+
+		struct Stats {
+			uint32_t compiled = 0;
+			uint32_t loadedFromDisk = 0;
+			uint32_t loadedFromMemory = 0;
+			double milliseconds = 0.0;
+		};
+
+		NNShaderCompiler();
+		explicit NNShaderCompiler(Options options);
+
+		NNShaderCompiler(const NNShaderCompiler&) = delete;
+		NNShaderCompiler& operator=(const NNShaderCompiler&) = delete;
+
+		// Compiles (or loads) every request in parallel and records the timings in getLastPrepareStats()
+		void prepare(const std::vector<ShaderCompileRequest>& requests);
+
+		// Times prepare() against an empty scratch cache and then again from a fresh compiler reading
+		// that cache back, so one run reports both the cold and the warm start
+		static void measureCache(const std::vector<ShaderCompileRequest>& requests, Options options);
+
+		// Thread safe. Returns the SPIR-V for the shader, compiling it on a cache miss
+		const std::vector<uint32_t>& getSpirv(const std::string& filepath, const ShaderDefines& defines = {});
+
+		const Stats& getLastPrepareStats() const { return m_LastPrepareStats; }
+
+	private:
+		enum class Source { Compiled, Disk, Memory };
+
+		const std::vector<uint32_t>& getSpirv(const ShaderCompileRequest& request, Source& source);
+
+		uint64_t hashRequest(const ShaderCompileRequest& request, const std::string& sourceText) const;
+		void hashIncludes(
+			const std::string& sourceText,
+			const std::string& requestingFile,
+			uint64_t& hash,
+			std::vector<std::string>& visited) const;
+
+		std::vector<uint32_t> compile(const ShaderCompileRequest& request, const std::string& sourceText) const;
+		bool loadCached(const std::string& cachePath, std::vector<uint32_t>& spirv) const;
+		void storeCached(const std::string& cachePath, const std::vector<uint32_t>& spirv) const;
+		std::string cachePathFor(const std::string& filepath, uint64_t hash) const;
+
+		static std::string readText(const std::string& filepath);
+
+		Options m_Options;
+		Stats m_LastPrepareStats{};
+
+		std::mutex m_Mutex;
+		std::unordered_map<uint64_t, std::vector<uint32_t>> m_Modules;
+	};
+}
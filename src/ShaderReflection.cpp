@@ -0,0 +1,218 @@
+#include "ShaderReflection.h"
+
+#include <spirv_cross/spirv_cross_c.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+namespace NNuts {
+	namespace {
+		// The C API is used because it ships as a DLL and links against both Debug and Release runtimes
+		struct SpvcContext {
+			SpvcContext() {
+				if (spvc_context_create(&context) != SPVC_SUCCESS) {
+					throw std::runtime_error("Failed to create SPIRV-Cross context!");
+				}
+			}
+			~SpvcContext() { spvc_context_destroy(context); }
+
+			SpvcContext(const SpvcContext&) = delete;
+			SpvcContext& operator=(const SpvcContext&) = delete;
+
+			void check(spvc_result result) const {
+				if (result != SPVC_SUCCESS) {
+					throw std::runtime_error(std::string("Shader reflection failed: ") + spvc_context_get_last_error_string(context));
+				}
+			}
+
+			spvc_context context = nullptr;
+		};
+
+		uint32_t descriptorCount(spvc_type type) {
+			if (spvc_type_get_num_array_dimensions(type) == 0) {
+				return 1;
+			}
+			// Runtime sized arrays report 0, the owner of the layout has to pick the real size
+			return spvc_type_array_dimension_is_literal(type, 0) ? spvc_type_get_array_dimension(type, 0) : 0;
+		}
+
+		VkDescriptorType descriptorTypeFor(spvc_resource_type resourceType, spvc_type type) {
+			bool texelBuffer = false;
+			if (resourceType == SPVC_RESOURCE_TYPE_SAMPLED_IMAGE ||
+				resourceType == SPVC_RESOURCE_TYPE_SEPARATE_IMAGE ||
+				resourceType == SPVC_RESOURCE_TYPE_STORAGE_IMAGE) {
+				texelBuffer = spvc_type_get_image_dimension(type) == SpvDimBuffer;
+			}
+
+			switch (resourceType) {
+			case SPVC_RESOURCE_TYPE_UNIFORM_BUFFER: return VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+			case SPVC_RESOURCE_TYPE_STORAGE_BUFFER: return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			case SPVC_RESOURCE_TYPE_SUBPASS_INPUT: return VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+			case SPVC_RESOURCE_TYPE_SEPARATE_SAMPLERS: return VK_DESCRIPTOR_TYPE_SAMPLER;
+			case SPVC_RESOURCE_TYPE_SAMPLED_IMAGE:
+				return texelBuffer ? VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			case SPVC_RESOURCE_TYPE_SEPARATE_IMAGE:
+				return texelBuffer ? VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+			case SPVC_RESOURCE_TYPE_STORAGE_IMAGE:
+				return texelBuffer ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+			default:
+				throw std::runtime_error("Unsupported descriptor resource in shader reflection");
+			}
+		}
+	}
+
+	NNShaderReflection& NNShaderReflection::addStage(VkShaderStageFlagBits stage, const std::vector<uint32_t>& spirv)
+	{
+		SpvcContext ctx{};
+		spvc_parsed_ir ir = nullptr;
+		spvc_compiler compiler = nullptr;
+		spvc_set activeVariables = nullptr;
+		spvc_resources resources = nullptr;
+		ctx.check(spvc_context_parse_spirv(ctx.context, spirv.data(), spirv.size(), &ir));
+		ctx.check(spvc_context_create_compiler(ctx.context, SPVC_BACKEND_NONE, ir, SPVC_CAPTURE_MODE_TAKE_OWNERSHIP, &compiler));
+		ctx.check(spvc_compiler_get_active_interface_variables(compiler, &activeVariables));
+		ctx.check(spvc_compiler_create_shader_resources_for_active_variables(compiler, &resources, activeVariables));
+
+		auto resourceList = [&](spvc_resource_type resourceType) {
+			const spvc_reflected_resource* list = nullptr;
+			size_t count = 0;
+			ctx.check(spvc_resources_get_resource_list_for_type(resources, resourceType, &list, &count));
+			return std::make_pair(list, count);
+		};
+
+		const spvc_resource_type descriptorResources[] = {
+			SPVC_RESOURCE_TYPE_UNIFORM_BUFFER,
+			SPVC_RESOURCE_TYPE_STORAGE_BUFFER,
+			SPVC_RESOURCE_TYPE_SAMPLED_IMAGE,
+			SPVC_RESOURCE_TYPE_SEPARATE_IMAGE,
+			SPVC_RESOURCE_TYPE_STORAGE_IMAGE,
+			SPVC_RESOURCE_TYPE_SEPARATE_SAMPLERS,
+			SPVC_RESOURCE_TYPE_SUBPASS_INPUT,
+		};
+
+		for (auto resourceType : descriptorResources) {
+			auto [list, count] = resourceList(resourceType);
+			for (size_t i = 0; i < count; i++) {
+				uint32_t set = spvc_compiler_get_decoration(compiler, list[i].id, SpvDecorationDescriptorSet);
+				uint32_t binding = spvc_compiler_get_decoration(compiler, list[i].id, SpvDecorationBinding);
+				spvc_type type = spvc_compiler_get_type_handle(compiler, list[i].type_id);
+				VkDescriptorType descriptorType = descriptorTypeFor(resourceType, type);
+
+				auto& bindings = m_Sets[set];
+				auto it = bindings.find(binding);
+				if (it == bindings.end()) {
+					VkDescriptorSetLayoutBinding layoutBinding{};
+					layoutBinding.binding = binding;
+					layoutBinding.descriptorType = descriptorType;
+					layoutBinding.descriptorCount = descriptorCount(type);
+					layoutBinding.stageFlags = stage;
+					bindings.emplace(binding, layoutBinding);
+				}
+				else {
+					if (it->second.descriptorType != descriptorType) {
+						throw std::runtime_error(
+							"Shader stages disagree on descriptor type of set " + std::to_string(set) +
+							" binding " + std::to_string(binding));
+					}
+					it->second.stageFlags |= stage;
+				}
+			}
+		}
+
+		auto [pushConstants, pushConstantCount] = resourceList(SPVC_RESOURCE_TYPE_PUSH_CONSTANT);
+		for (size_t i = 0; i < pushConstantCount; i++) {
+			const spvc_buffer_range* ranges = nullptr;
+			size_t rangeCount = 0;
+			ctx.check(spvc_compiler_get_active_buffer_ranges(compiler, pushConstants[i].id, &ranges, &rangeCount));
+			if (rangeCount == 0) {
+				continue;
+			}
+
+			// All stages share the one push constant block, so every stage that reads any of it declares
+			// the whole block. Trimming to the active bytes leaves disjoint per stage ranges that a single
+			// vkCmdPushConstants of the block can't update.
+			size_t blockSize = 0;
+			spvc_type blockType = spvc_compiler_get_type_handle(compiler, pushConstants[i].base_type_id);
+			ctx.check(spvc_compiler_get_declared_struct_size(compiler, blockType, &blockSize));
+
+			// Push constant ranges have to be a multiple of 4 bytes
+			uint32_t offset = 0;
+			uint32_t size = (static_cast<uint32_t>(blockSize) + 3u) & ~3u;
+			addPushConstantRange(stage, offset, size);
+		}
+
+		if (stage == VK_SHADER_STAGE_VERTEX_BIT) {
+			auto [inputs, inputCount] = resourceList(SPVC_RESOURCE_TYPE_STAGE_INPUT);
+			m_VertexInputLocations.clear();
+			for (size_t i = 0; i < inputCount; i++) {
+				m_VertexInputLocations.push_back(spvc_compiler_get_decoration(compiler, inputs[i].id, SpvDecorationLocation));
+			}
+			std::sort(m_VertexInputLocations.begin(), m_VertexInputLocations.end());
+		}
+
+		return *this;
+	}
+
+	std::vector<VkDescriptorSetLayoutBinding> NNShaderReflection::getSetBindings(uint32_t set) const
+	{
+		std::vector<VkDescriptorSetLayoutBinding> bindings{};
+		auto it = m_Sets.find(set);
+		if (it == m_Sets.end()) {
+			return bindings;
+		}
+
+		for (auto& kv : it->second) {
+			bindings.push_back(kv.second);
+		}
+		return bindings;
+	}
+
+	uint32_t NNShaderReflection::getSetCount() const
+	{
+		return m_Sets.empty() ? 0 : m_Sets.rbegin()->first + 1;
+	}
+
+	VkShaderStageFlags NNShaderReflection::getPushConstantStages(uint32_t offset, uint32_t size) const
+	{
+		VkShaderStageFlags stages = 0;
+		for (auto& range : m_PushConstantRanges) {
+			if (range.offset < offset + size && offset < range.offset + range.size) {
+				stages |= range.stageFlags;
+			}
+		}
+		return stages;
+	}
+
+	std::vector<VkVertexInputAttributeDescription> NNShaderReflection::filterVertexAttributes(
+		const std::vector<VkVertexInputAttributeDescription>& available) const
+	{
+		std::vector<VkVertexInputAttributeDescription> attributes{};
+		for (auto& attribute : available) {
+			if (std::binary_search(m_VertexInputLocations.begin(), m_VertexInputLocations.end(), attribute.location)) {
+				attributes.push_back(attribute);
+			}
+		}
+
+		if (attributes.size() != m_VertexInputLocations.size()) {
+			throw std::runtime_error("Vertex shader reads an input location the vertex format does not provide");
+		}
+		return attributes;
+	}
+
+	void NNShaderReflection::addPushConstantRange(VkShaderStageFlagBits stage, uint32_t offset, uint32_t size)
+	{
+		// Stages may declare the block with different trailing members, overlapping ranges are widened
+		// into one so the whole block is visible to every stage that reads it
+		for (auto& range : m_PushConstantRanges) {
+			if (range.offset < offset + size && offset < range.offset + range.size) {
+				uint32_t end = std::max(range.offset + range.size, offset + size);
+				range.offset = std::min(range.offset, offset);
+				range.size = end - range.offset;
+				range.stageFlags |= stage;
+				return;
+			}
+		}
+		m_PushConstantRanges.push_back({ static_cast<VkShaderStageFlags>(stage), offset, size });
+	}
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+namespace NNuts {
+	// Merged reflection of every stage of a pipeline. Only resources a stage statically uses are
+	// recorded, so stage flags end up no wider than what the shaders read.
+	class NNShaderReflection {
+	public:
+		NNShaderReflection& addStage(VkShaderStageFlagBits stage, const std::vector<uint32_t>& spirv);
+
+		// Bindings of a descriptor set sorted by binding number; empty if no stage uses the set
+		std::vector<VkDescriptorSetLayoutBinding> getSetBindings(uint32_t set) const;
+		uint32_t getSetCount() const;
+
+		const std::vector<VkPushConstantRange>& getPushConstantRanges() const { return m_PushConstantRanges; }
+		// Stages vkCmdPushConstants must name when updating [offset, offset + size)
+		VkShaderStageFlags getPushConstantStages(uint32_t offset, uint32_t size) const;
+
+		const std::vector<uint32_t>& getVertexInputLocations() const { return m_VertexInputLocations; }
+		// Keeps only the attributes the vertex stage actually consumes
+		std::vector<VkVertexInputAttributeDescription> filterVertexAttributes(
+			const std::vector<VkVertexInputAttributeDescription>& available) const;
+
+	private:
+		void addPushConstantRange(VkShaderStageFlagBits stage, uint32_t offset, uint32_t size);
+
+		// set -> binding -> description
+		std::map<uint32_t, std::map<uint32_t, VkDescriptorSetLayoutBinding>> m_Sets;
+		std::vector<VkPushConstantRange> m_PushConstantRanges;
+		std::vector<uint32_t> m_VertexInputLocations;
+	};
+}
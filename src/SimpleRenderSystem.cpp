@@ -1,5 +1,9 @@
 #include "SimpleRenderSystem.h"
 
+#include "CpuProfiler.h"
+#include "RenderStats.h"
+#include "SwapChain.h"
+
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/glm.hpp>
@@ -7,67 +11,305 @@
 
 #include <stdexcept>
 #include <cassert>
+#include <algorithm>
 #include <array>
 
 namespace NNuts {
+	// constant_id values declared in BasicShader.frag
+	enum BasicShaderConstants : uint32_t {
+		BASIC_SHADER_AMBIENT = 0,
+		BASIC_SHADER_POINT_LIGHTS = 1,
+	};
+
+	namespace {
+		SpecializationMap basicShaderConstants(bool pointLights)
+		{
+			SpecializationMap constants{};
+			constants[VK_SHADER_STAGE_FRAGMENT_BIT]
+				.set(BASIC_SHADER_AMBIENT, 0.02f)
+				.set(BASIC_SHADER_POINT_LIGHTS, pointLights);
+			return constants;
+		}
+	}
+
 	struct SimplePushConstantData {
 		glm::mat4 modelMatrix{ 1.0f };
 		glm::mat4 normalMatrix{ 1.0f };
 	};
 
-	SimpleRenderSystem::SimpleRenderSystem(NNDevice &device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout):
-		m_Device{device}
+	// Matches Bindless.glsl
+	struct BindlessPushConstants {
+		uint32_t objectBuffer;
+		uint32_t objectIndex;
+		uint32_t textureIndex;
+	};
+
+	SimpleRenderSystem::SimpleRenderSystem(
+		NNDevice &device,
+		NNShaderCompiler &shaderCompiler,
+		NNLayoutCache &layoutCache,
+		VkRenderPass renderPass,
+		VkDescriptorSetLayout globalSetLayout,
+		NNBindlessTable *bindless):
+		m_Device{device}, m_ShaderCompiler{shaderCompiler}, m_LayoutCache{layoutCache}, m_Bindless{bindless}
 	{
+		if (m_Bindless != nullptr) {
+			m_Defines["BINDLESS"] = "1";
+			m_ObjectBuffers.resize(NNSwapChain::MAX_FRAMES_IN_FLIGHT);
+			m_ObjectBufferIndices.resize(NNSwapChain::MAX_FRAMES_IN_FLIGHT);
+		}
 		createPipelineLayout(globalSetLayout);
 		createPipeline(renderPass);
+		createDepthPrepassLayout(globalSetLayout);
+		createDepthPrepassPipeline(renderPass);
 	}
 
 	SimpleRenderSystem::~SimpleRenderSystem()
 	{
-		vkDestroyPipelineLayout(m_Device.device(), m_PipelineLayout, nullptr);
+		if (m_Bindless != nullptr) {
+			for (size_t i = 0; i < m_ObjectBuffers.size(); i++) {
+				if (m_ObjectBuffers[i]) {
+					m_Bindless->removeStorageBuffer(m_ObjectBufferIndices[i]);
+				}
+			}
+		}
+	}
+
+	void SimpleRenderSystem::setRenderPass(VkRenderPass renderPass)
+	{
+		createPipeline(renderPass);
+		createDepthPrepassPipeline(renderPass);
+	}
+
+	void SimpleRenderSystem::setPointLightsEnabled(bool enabled)
+	{
+		m_PointLightsEnabled = enabled;
+		selectPipelines();
 	}
 
 	void SimpleRenderSystem::createPipelineLayout(VkDescriptorSetLayout globalSetLayout)
 	{
-		VkPushConstantRange pushConstantRange{};
-		pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
-		pushConstantRange.offset = 0;
-		pushConstantRange.size = sizeof(SimplePushConstantData);
-
-		std::vector<VkDescriptorSetLayout> descriptorSetLayouts{ globalSetLayout };
-
-		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-		pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayouts.size());
-		pipelineLayoutInfo.pSetLayouts = descriptorSetLayouts.data();
-		pipelineLayoutInfo.pushConstantRangeCount = 1;
-		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
-		if (vkCreatePipelineLayout(m_Device.device(), &pipelineLayoutInfo, nullptr, &m_PipelineLayout) !=
-			VK_SUCCESS) {
-			throw std::runtime_error("Failed to create pipeline layout!");
+		m_Reflection
+			.addStage(VK_SHADER_STAGE_VERTEX_BIT, m_ShaderCompiler.getSpirv("res/Shaders/BasicShader.vert", m_Defines))
+			.addStage(VK_SHADER_STAGE_FRAGMENT_BIT, m_ShaderCompiler.getSpirv("res/Shaders/BasicShader.frag", m_Defines));
+
+		// The layout is owned by the cache and shared with every system that reflects the same interface
+		if (m_Bindless != nullptr) {
+			m_PipelineLayout = m_LayoutCache.getPipelineLayout(
+				m_Reflection, { {0, globalSetLayout}, {1, m_Bindless->getDescriptorSetLayout()} });
+			m_PushConstantStages = m_Reflection.getPushConstantStages(0, sizeof(BindlessPushConstants));
+		}
+		else {
+			m_PipelineLayout = m_LayoutCache.getPipelineLayout(m_Reflection, { {0, globalSetLayout} });
+			m_PushConstantStages = m_Reflection.getPushConstantStages(0, sizeof(SimplePushConstantData));
 		}
 	}
 
 	void SimpleRenderSystem::createPipeline(VkRenderPass renderPass)
 	{
 		assert(m_PipelineLayout != nullptr && "Cannot create pipeline before pipeline layout!");
-		PipelineConfigInfo pipelineConfig{};
-		NNPipeline::defaultPipelineConfigInfo(pipelineConfig);
-		pipelineConfig.renderPass = renderPass;
-		pipelineConfig.pipelineLayout = m_PipelineLayout;
-		m_Pipeline = std::make_unique<NNPipeline>(
+		VkPipelineLayout pipelineLayout = m_PipelineLayout;
+		const NNShaderReflection* reflection = &m_Reflection;
+		auto configure = [renderPass, pipelineLayout, reflection](PipelineConfigInfo& pipelineConfig) {
+			pipelineConfig.renderPass = renderPass;
+			pipelineConfig.pipelineLayout = pipelineLayout;
+			pipelineConfig.attributeDescriptions = reflection->filterVertexAttributes(pipelineConfig.attributeDescriptions);
+		};
+
+		auto& vertCode = m_ShaderCompiler.getSpirv("res/Shaders/BasicShader.vert", m_Defines);
+		auto& fragCode = m_ShaderCompiler.getSpirv("res/Shaders/BasicShader.frag", m_Defines);
+		m_Pipelines = std::make_unique<NNPipelineVariantCache>(m_Device, vertCode, fragCode, configure);
+		m_DepthEqualPipelines = std::make_unique<NNPipelineVariantCache>(
+			m_Device, vertCode, fragCode, configure, DepthPassMode::EqualAfterPrepass);
+
+		// Both variants are built up front, so toggling point lights never compiles a pipeline mid-run
+		for (bool pointLights : { true, false }) {
+			m_Pipelines->getVariant(basicShaderConstants(pointLights));
+			m_DepthEqualPipelines->getVariant(basicShaderConstants(pointLights));
+		}
+		selectPipelines();
+	}
+
+	void SimpleRenderSystem::selectPipelines()
+	{
+		SpecializationMap constants = basicShaderConstants(m_PointLightsEnabled);
+		m_Pipeline = &m_Pipelines->getVariant(constants);
+		m_DepthEqualPipeline = &m_DepthEqualPipelines->getVariant(constants);
+	}
+
+	void SimpleRenderSystem::createDepthPrepassLayout(VkDescriptorSetLayout globalSetLayout)
+	{
+		m_DepthPrepassReflection.addStage(
+			VK_SHADER_STAGE_VERTEX_BIT, m_ShaderCompiler.getSpirv("res/Shaders/DepthPrepass.vert", m_Defines));
+
+		if (m_Bindless != nullptr) {
+			// Same layout as the shading pass, so the sets bound by the prepass stay bound for it
+			m_DepthPrepassLayout = m_PipelineLayout;
+			m_DepthPrepassPushStages = m_PushConstantStages;
+		}
+		else {
+			// Only modelMatrix is read, so this layout's push range is smaller than the main one
+			m_DepthPrepassLayout = m_LayoutCache.getPipelineLayout(m_DepthPrepassReflection, { {0, globalSetLayout} });
+			m_DepthPrepassPushStages = m_DepthPrepassReflection.getPushConstantStages(0, sizeof(glm::mat4));
+		}
+	}
+
+	void SimpleRenderSystem::createDepthPrepassPipeline(VkRenderPass renderPass)
+	{
+		assert(m_DepthPrepassLayout != nullptr && "Cannot create pipeline before pipeline layout!");
+		auto& vertCode = m_ShaderCompiler.getSpirv("res/Shaders/DepthPrepass.vert", m_Defines);
+		VkPipelineLayout pipelineLayout = m_DepthPrepassLayout;
+		m_DepthPrepassPipelines = std::make_unique<NNPipelineVariantCache>(
 			m_Device,
-			"res/Shaders/BasicShader.vert.spv",
-			"res/Shaders/BasicShader.frag.spv",
-			pipelineConfig
+			vertCode,
+			std::vector<uint32_t>{},
+			[renderPass, pipelineLayout](PipelineConfigInfo& pipelineConfig) {
+				pipelineConfig.renderPass = renderPass;
+				pipelineConfig.pipelineLayout = pipelineLayout;
+			},
+			DepthPassMode::Prepass
 		);
+		m_DepthPrepassPipeline = &m_DepthPrepassPipelines->getVariant({});
+	}
+
+	void SimpleRenderSystem::beginBindlessFrame(FrameInfo& frameInfo, NNWorld& world, const NNTransformHierarchy& transforms)
+	{
+		auto& objectBuffer = m_ObjectBuffers[frameInfo.frameIndex];
+		size_t drawCount = world.count<TransformNode, RenderComponent>();
+		uint32_t objectCount = static_cast<uint32_t>(std::max<size_t>(drawCount, 1));
+		if (!objectBuffer || objectBuffer->getInstanceCount() < objectCount) {
+			// The frame that last used this slot is done, so its descriptor can be repointed
+			bool replacing = static_cast<bool>(objectBuffer);
+			uint32_t capacity = replacing ? std::max(objectCount, 2 * objectBuffer->getInstanceCount()) : objectCount;
+			objectBuffer = std::make_unique<NNBuffer>(
+				m_Device,
+				sizeof(NNInstanceTransform),
+				capacity,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+			objectBuffer->map();
+			if (replacing) {
+				m_Bindless->updateStorageBuffer(m_ObjectBufferIndices[frameInfo.frameIndex], objectBuffer->descriptorInfo());
+			}
+			else {
+				m_ObjectBufferIndices[frameInfo.frameIndex] = m_Bindless->addStorageBuffer(objectBuffer->descriptorInfo());
+			}
+		}
+
+		// Every frame's buffer needs every object in draw order, while the hierarchy only recomputes what
+		// changed, so the cached instances are copied over as they are
+		auto* objects = static_cast<NNInstanceTransform*>(objectBuffer->getMappedMemory());
+		world.eachChunk<TransformNode, RenderComponent>([&](size_t count, const NNEntity*, TransformNode* nodes, RenderComponent*) {
+			for (size_t i = 0; i < count; i++) {
+				*objects++ = transforms.getInstance(nodes[i].id);
+			}
+		});
+		if (drawCount > 0) {
+			objectBuffer->flush();
+		}
+
+		VkDescriptorSet sets[] = { frameInfo.globalDescriptorSet, m_Bindless->getDescriptorSet() };
+		vkCmdBindDescriptorSets(
+			frameInfo.commandBuffer,
+			VK_PIPELINE_BIND_POINT_GRAPHICS,
+			m_PipelineLayout,
+			0, 2,
+			sets,
+			0, nullptr
+		);
+		NNRenderStats::add(NNRenderStats::Counter::DescriptorSetBinds);
+	}
+
+	void SimpleRenderSystem::renderDepthPrepass(
+			FrameInfo& frameInfo,
+			NNWorld& world,
+			const NNTransformHierarchy& transforms)
+	{
+		if (!m_DepthPrepassEnabled) {
+			return;
+		}
+		NN_PROFILE_FUNCTION();
+
+		m_DepthPrepassPipeline->bind(frameInfo.commandBuffer);
+
+		if (m_Bindless != nullptr) {
+			beginBindlessFrame(frameInfo, world, transforms);
+			BindlessPushConstants push{ m_ObjectBufferIndices[frameInfo.frameIndex], 0, NNBindlessTable::WHITE_TEXTURE };
+			world.each<TransformNode, RenderComponent>([&](TransformNode&, RenderComponent& render) {
+				vkCmdPushConstants(
+					frameInfo.commandBuffer,
+					m_PipelineLayout,
+					m_PushConstantStages,
+					0,
+					sizeof(BindlessPushConstants),
+					&push);
+				NNRenderStats::add(NNRenderStats::Counter::PushConstantBytes, sizeof(BindlessPushConstants));
+				render.model->bindPositions(frameInfo.commandBuffer);
+				render.model->draw(frameInfo.commandBuffer);
+				push.objectIndex++;
+			});
+			return;
+		}
+
+		vkCmdBindDescriptorSets(
+			frameInfo.commandBuffer,
+			VK_PIPELINE_BIND_POINT_GRAPHICS,
+			m_DepthPrepassLayout,
+			0, 1,
+			&frameInfo.globalDescriptorSet,
+			0, nullptr
+		);
+		NNRenderStats::add(NNRenderStats::Counter::DescriptorSetBinds);
+
+		world.each<TransformNode, RenderComponent>([&](TransformNode& node, RenderComponent& render) {
+			const glm::mat4& modelMatrix = transforms.getWorldMatrix(node.id);
+			vkCmdPushConstants(
+				frameInfo.commandBuffer,
+				m_DepthPrepassLayout,
+				m_DepthPrepassPushStages,
+				0,
+				sizeof(glm::mat4),
+				&modelMatrix);
+			NNRenderStats::add(NNRenderStats::Counter::PushConstantBytes, sizeof(glm::mat4));
+			render.model->bindPositions(frameInfo.commandBuffer);
+			render.model->draw(frameInfo.commandBuffer);
+		});
 	}
 
 	void SimpleRenderSystem::renderGameObjects(
 			FrameInfo& frameInfo,
-			std::vector<NNGameObject>& gameObjects)
+			NNWorld& world,
+			const NNTransformHierarchy& transforms)
 	{
-		m_Pipeline->bind(frameInfo.commandBuffer);
+		NN_PROFILE_FUNCTION();
+		if (m_DepthPrepassEnabled) {
+			m_DepthEqualPipeline->bind(frameInfo.commandBuffer);
+		}
+		else {
+			m_Pipeline->bind(frameInfo.commandBuffer);
+		}
+
+		if (m_Bindless != nullptr) {
+			// After a prepass the sets are still bound from it
+			if (!m_DepthPrepassEnabled) {
+				beginBindlessFrame(frameInfo, world, transforms);
+			}
+			BindlessPushConstants push{ m_ObjectBufferIndices[frameInfo.frameIndex], 0, NNBindlessTable::WHITE_TEXTURE };
+			world.each<TransformNode, RenderComponent>([&](TransformNode&, RenderComponent& render) {
+				vkCmdPushConstants(
+					frameInfo.commandBuffer,
+					m_PipelineLayout,
+					m_PushConstantStages,
+					0,
+					sizeof(BindlessPushConstants),
+					&push);
+				NNRenderStats::add(NNRenderStats::Counter::PushConstantBytes, sizeof(BindlessPushConstants));
+				render.model->bind(frameInfo.commandBuffer);
+				render.model->draw(frameInfo.commandBuffer);
+				push.objectIndex++;
+			});
+			return;
+		}
 
 		vkCmdBindDescriptorSets(
 			frameInfo.commandBuffer,
@@ -77,26 +319,24 @@ namespace NNuts {
 			&frameInfo.globalDescriptorSet,
 			0, nullptr
 		);
+		NNRenderStats::add(NNRenderStats::Counter::DescriptorSetBinds);
 
-		for (auto& obj : gameObjects)
-		{
-			/*obj.transform.rotation.y = glm::mod(obj.transform.rotation.y + 0.01f, glm::two_pi<float>());
-			obj.transform.rotation.x = glm::mod(obj.transform.rotation.x + 0.005f, glm::two_pi<float>());*/
-
+		world.each<TransformNode, RenderComponent>([&](TransformNode& node, RenderComponent& render) {
 			SimplePushConstantData push{};
-			push.modelMatrix = obj.transform.mat4();
-			push.normalMatrix = obj.transform.normalMatrix();
+			push.modelMatrix = transforms.getWorldMatrix(node.id);
+			push.normalMatrix = transforms.getNormalMatrix(node.id);
 
 			vkCmdPushConstants(
 				frameInfo.commandBuffer,
 				m_PipelineLayout,
-				VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+				m_PushConstantStages,
 				0,
 				sizeof(SimplePushConstantData),
 				&push);
-			obj.model->bind(frameInfo.commandBuffer);
-			obj.model->draw(frameInfo.commandBuffer);
-		}
+			NNRenderStats::add(NNRenderStats::Counter::PushConstantBytes, sizeof(SimplePushConstantData));
+			render.model->bind(frameInfo.commandBuffer);
+			render.model->draw(frameInfo.commandBuffer);
+		});
 
 
 	}
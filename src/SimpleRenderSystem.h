@@ -1,9 +1,17 @@
 #pragma once
 
+#include "BindlessTable.h"
+#include "Buffer.h"
 #include "Camera.h"
+#include "LayoutCache.h"
 #include "Pipeline.h"
+#include "PipelineVariants.h"
+#include "ShaderCompiler.h"
+#include "ShaderReflection.h"
 #include "Device.h"
 #include "GameObject.h"
+#include "TransformHierarchy.h"
+#include "World.h"
 #include "FrameInfo.h"
 
 #include <memory>
@@ -12,23 +20,74 @@
 namespace NNuts {
 	class SimpleRenderSystem {
 	public:
-		SimpleRenderSystem(NNDevice &device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout);
+		// With a bindless table the object matrices go into a per frame storage buffer that the shaders
+		// index, draws only push indices, and the global and bindless sets are bound once per frame
+		SimpleRenderSystem(
+			NNDevice &device,
+			NNShaderCompiler &shaderCompiler,
+			NNLayoutCache &layoutCache,
+			VkRenderPass renderPass,
+			VkDescriptorSetLayout globalSetLayout,
+			NNBindlessTable *bindless = nullptr);
 		~SimpleRenderSystem();
 
 		SimpleRenderSystem(const SimpleRenderSystem&) = delete;
 		SimpleRenderSystem& operator=(const SimpleRenderSystem&) = delete;
 
+		// When enabled, renderDepthPrepass has to run first in the same subpass
+		void setDepthPrepassEnabled(bool enabled) { m_DepthPrepassEnabled = enabled; }
+		bool isDepthPrepassEnabled() const { return m_DepthPrepassEnabled; }
+
+		// Rebuilds the pipelines for a render pass with different attachment formats
+		void setRenderPass(VkRenderPass renderPass);
+
+		// Switches to the shader variant specialized with or without clustered point lights
+		void setPointLightsEnabled(bool enabled);
+		bool isPointLightsEnabled() const { return m_PointLightsEnabled; }
+
+		// Both draw every entity with a TransformNode and a RenderComponent, transforms has to be updated
+		void renderDepthPrepass(
+			FrameInfo &frameInfo,
+			NNWorld &world,
+			const NNTransformHierarchy &transforms);
 		void renderGameObjects(
 			FrameInfo &frameInfo, 
-			std::vector<NNGameObject> &gameObjects);
+			NNWorld &world,
+			const NNTransformHierarchy &transforms);
 
 	private:
 		void createPipelineLayout(VkDescriptorSetLayout globalSetLayout);
 		void createPipeline(VkRenderPass renderPass);
+		void selectPipelines();
+		void createDepthPrepassLayout(VkDescriptorSetLayout globalSetLayout);
+		void createDepthPrepassPipeline(VkRenderPass renderPass);
+		// Writes this frame's object buffer and binds both sets, done by whichever pass runs first
+		void beginBindlessFrame(FrameInfo &frameInfo, NNWorld &world, const NNTransformHierarchy &transforms);
 
 		NNDevice &m_Device;
+		NNShaderCompiler &m_ShaderCompiler;
+		NNLayoutCache &m_LayoutCache;
+		NNBindlessTable *m_Bindless;
+		ShaderDefines m_Defines;
+
+		// One object buffer per frame slot, each keeps its bindless index when it grows
+		std::vector<std::unique_ptr<NNBuffer>> m_ObjectBuffers;
+		std::vector<uint32_t> m_ObjectBufferIndices;
+
+		NNShaderReflection m_Reflection;
+		std::unique_ptr<NNPipelineVariantCache> m_Pipelines;
+		std::unique_ptr<NNPipelineVariantCache> m_DepthEqualPipelines;
+		NNPipeline* m_Pipeline = nullptr;
+		NNPipeline* m_DepthEqualPipeline = nullptr;
+		VkPipelineLayout m_PipelineLayout = VK_NULL_HANDLE;
+		VkShaderStageFlags m_PushConstantStages = 0;
+		bool m_PointLightsEnabled = true;
 
-		std::unique_ptr<NNPipeline> m_Pipeline;
-		VkPipelineLayout m_PipelineLayout;
+		NNShaderReflection m_DepthPrepassReflection;
+		std::unique_ptr<NNPipelineVariantCache> m_DepthPrepassPipelines;
+		NNPipeline* m_DepthPrepassPipeline = nullptr;
+		VkPipelineLayout m_DepthPrepassLayout = VK_NULL_HANDLE;
+		VkShaderStageFlags m_DepthPrepassPushStages = 0;
+		bool m_DepthPrepassEnabled = false;
 	};
 }
\ No newline at end of file
@@ -1,6 +1,9 @@
 #include "SwapChain.h"
 
+#include "HostMemory.h"
+
 // std
+#include <algorithm>
 #include <array>
 #include <cstdlib>
 #include <cstring>
@@ -11,13 +14,44 @@
 
 namespace NNuts {
 
-NNSwapChain::NNSwapChain(NNDevice &deviceRef, VkExtent2D extent)
-    : device{deviceRef}, windowExtent{extent} {
+namespace {
+// Albedo in rgb, normals packed to [0, 1]. Both formats are mandatory colour attachment formats.
+constexpr VkFormat GBUFFER_ALBEDO_FORMAT = VK_FORMAT_R8G8B8A8_UNORM;
+constexpr VkFormat GBUFFER_NORMAL_FORMAT = VK_FORMAT_A2B10G10R10_UNORM_PACK32;
+}  // namespace
+
+const char *presentModeName(VkPresentModeKHR presentMode) {
+  switch (presentMode) {
+    case VK_PRESENT_MODE_IMMEDIATE_KHR:
+      return "Immediate";
+    case VK_PRESENT_MODE_MAILBOX_KHR:
+      return "Mailbox";
+    case VK_PRESENT_MODE_FIFO_KHR:
+      return "V-Sync";
+    case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+      return "Relaxed V-Sync";
+    default:
+      return "Unknown";
+  }
+}
+
+NNSwapChain::NNSwapChain(
+    NNDevice &deviceRef, VkExtent2D extent, RenderPath renderPath, PresentSettings presentSettings)
+    : device{deviceRef}, windowExtent{extent}, renderPath{renderPath}, presentSettings{presentSettings} {
   init();
 }
 
-NNSwapChain::NNSwapChain(NNDevice& deviceRef, VkExtent2D extent, std::shared_ptr<NNSwapChain> previous)
-    : device{ deviceRef }, windowExtent{ extent }, oldSwapChain{previous} {
+NNSwapChain::NNSwapChain(
+    NNDevice &deviceRef,
+    VkExtent2D extent,
+    std::shared_ptr<NNSwapChain> previous,
+    RenderPath renderPath,
+    PresentSettings presentSettings)
+    : device{deviceRef},
+      windowExtent{extent},
+      renderPath{renderPath},
+      presentSettings{presentSettings},
+      oldSwapChain{previous} {
     init();
 
     oldSwapChain = nullptr;
@@ -30,6 +64,7 @@ void NNSwapChain::init()
   createImageViews();
   createRenderPass();
   createDepthResources();
+  createGBufferResources();
   createFramebuffers();
   createSyncObjects();
  
@@ -37,110 +72,100 @@ void NNSwapChain::init()
 
 NNSwapChain::~NNSwapChain() {
   for (auto imageView : swapChainImageViews) {
-    vkDestroyImageView(device.device(), imageView, nullptr);
+    vkDestroyImageView(device.device(), imageView, NNHostMemory::callbacks(NNHostMemory::Tag::ImageView));
   }
   swapChainImageViews.clear();
 
   if (swapChain != nullptr) {
-    vkDestroySwapchainKHR(device.device(), swapChain, nullptr);
+    vkDestroySwapchainKHR(device.device(), swapChain, NNHostMemory::callbacks(NNHostMemory::Tag::SwapChain));
     swapChain = nullptr;
   }
 
+  for (size_t i = 0; i < offscreenImageMemorys.size(); i++) {
+    vkDestroyImage(device.device(), swapChainImages[i], NNHostMemory::callbacks(NNHostMemory::Tag::Image));
+    vkFreeMemory(device.device(), offscreenImageMemorys[i], NNHostMemory::callbacks(NNHostMemory::Tag::DeviceMemory));
+  }
+
   for (int i = 0; i < depthImages.size(); i++) {
-    vkDestroyImageView(device.device(), depthImageViews[i], nullptr);
-    vkDestroyImage(device.device(), depthImages[i], nullptr);
-    vkFreeMemory(device.device(), depthImageMemorys[i], nullptr);
+    vkDestroyImageView(device.device(), depthImageViews[i], NNHostMemory::callbacks(NNHostMemory::Tag::ImageView));
+    vkDestroyImage(device.device(), depthImages[i], NNHostMemory::callbacks(NNHostMemory::Tag::Image));
+    vkFreeMemory(device.device(), depthImageMemorys[i], NNHostMemory::callbacks(NNHostMemory::Tag::DeviceMemory));
+  }
+
+  for (size_t i = 0; i < gBufferImages.size(); i++) {
+    vkDestroyImage(device.device(), gBufferImages[i], NNHostMemory::callbacks(NNHostMemory::Tag::Image));
+    vkFreeMemory(device.device(), gBufferImageMemorys[i], NNHostMemory::callbacks(NNHostMemory::Tag::DeviceMemory));
+  }
+  for (size_t i = 0; i < gBufferAlbedoViews.size(); i++) {
+    vkDestroyImageView(device.device(), gBufferAlbedoViews[i], NNHostMemory::callbacks(NNHostMemory::Tag::ImageView));
+    vkDestroyImageView(device.device(), gBufferNormalViews[i], NNHostMemory::callbacks(NNHostMemory::Tag::ImageView));
   }
 
   for (auto framebuffer : swapChainFramebuffers) {
-    vkDestroyFramebuffer(device.device(), framebuffer, nullptr);
+    vkDestroyFramebuffer(device.device(), framebuffer, NNHostMemory::callbacks(NNHostMemory::Tag::Framebuffer));
   }
 
-  vkDestroyRenderPass(device.device(), renderPass, nullptr);
+  vkDestroyRenderPass(device.device(), renderPass, NNHostMemory::callbacks(NNHostMemory::Tag::RenderPass));
 
   // cleanup synchronization objects
-  for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-    vkDestroySemaphore(device.device(), renderFinishedSemaphores[i], nullptr);
-    vkDestroySemaphore(device.device(), imageAvailableSemaphores[i], nullptr);
-    vkDestroyFence(device.device(), inFlightFences[i], nullptr);
+  for (auto semaphore : renderFinishedSemaphores) {
+    vkDestroySemaphore(device.device(), semaphore, NNHostMemory::callbacks(NNHostMemory::Tag::Semaphore));
   }
 }
 
-VkResult NNSwapChain::acquireNextImage(uint32_t *imageIndex) {
-  vkWaitForFences(
-      device.device(),
-      1,
-      &inFlightFences[currentFrame],
-      VK_TRUE,
-      std::numeric_limits<uint64_t>::max());
+VkResult NNSwapChain::acquireNextImage(VkSemaphore imageAvailable, uint32_t *imageIndex) {
+  // Nothing signals imageAvailable here, the renderer doesn't wait on it when headless. Reuse of an
+  // image by a later frame is ordered by the render pass dependency on COLOR_ATTACHMENT_OUTPUT.
+  if (isOffscreen()) {
+    *imageIndex = nextOffscreenImage;
+    nextOffscreenImage = (nextOffscreenImage + 1) % static_cast<uint32_t>(imageCount());
+    return VK_SUCCESS;
+  }
 
-  VkResult result = vkAcquireNextImageKHR(
+  return vkAcquireNextImageKHR(
       device.device(),
       swapChain,
       std::numeric_limits<uint64_t>::max(),
-      imageAvailableSemaphores[currentFrame],  // must be a not signaled semaphore
+      imageAvailable,  // must be a not signaled semaphore
       VK_NULL_HANDLE,
       imageIndex);
-
-  return result;
 }
 
-VkResult NNSwapChain::submitCommandBuffers(
-    const VkCommandBuffer *buffers, uint32_t *imageIndex) {
-  if (imagesInFlight[*imageIndex] != VK_NULL_HANDLE) {
-    vkWaitForFences(device.device(), 1, &imagesInFlight[*imageIndex], VK_TRUE, UINT64_MAX);
-  }
-  imagesInFlight[*imageIndex] = inFlightFences[currentFrame];
-
-  VkSubmitInfo submitInfo = {};
-  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-
-  VkSemaphore waitSemaphores[] = {imageAvailableSemaphores[currentFrame]};
-  VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-  submitInfo.waitSemaphoreCount = 1;
-  submitInfo.pWaitSemaphores = waitSemaphores;
-  submitInfo.pWaitDstStageMask = waitStages;
-
-  submitInfo.commandBufferCount = 1;
-  submitInfo.pCommandBuffers = buffers;
-
-  VkSemaphore signalSemaphores[] = {renderFinishedSemaphores[currentFrame]};
-  submitInfo.signalSemaphoreCount = 1;
-  submitInfo.pSignalSemaphores = signalSemaphores;
-
-  vkResetFences(device.device(), 1, &inFlightFences[currentFrame]);
-  if (vkQueueSubmit(device.graphicsQueue(), 1, &submitInfo, inFlightFences[currentFrame]) !=
-      VK_SUCCESS) {
-    throw std::runtime_error("failed to submit draw command buffer!");
+VkResult NNSwapChain::present(uint32_t imageIndex) {
+  if (isOffscreen()) {
+    return VK_SUCCESS;
   }
 
   VkPresentInfoKHR presentInfo = {};
   presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 
   presentInfo.waitSemaphoreCount = 1;
-  presentInfo.pWaitSemaphores = signalSemaphores;
+  presentInfo.pWaitSemaphores = &renderFinishedSemaphores[imageIndex];
 
   VkSwapchainKHR swapChains[] = {swapChain};
   presentInfo.swapchainCount = 1;
   presentInfo.pSwapchains = swapChains;
 
-  presentInfo.pImageIndices = imageIndex;
+  presentInfo.pImageIndices = &imageIndex;
 
-  auto result = vkQueuePresentKHR(device.presentQueue(), &presentInfo);
-
-  currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
-
-  return result;
+  return vkQueuePresentKHR(device.presentQueue(), &presentInfo);
 }
 
 void NNSwapChain::createSwapChain() {
+  if (isOffscreen()) {
+    createOffscreenImages();
+    return;
+  }
+
   SwapChainSupportDetails swapChainSupport = device.getSwapChainSupport();
 
   VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
-  VkPresentModeKHR presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
+  presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
   VkExtent2D extent = chooseSwapExtent(swapChainSupport.capabilities);
 
-  uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
+  uint32_t imageCount = presentSettings.imageCount > 0 ?
+      std::max(presentSettings.imageCount, swapChainSupport.capabilities.minImageCount) :
+      swapChainSupport.capabilities.minImageCount + 1;
   if (swapChainSupport.capabilities.maxImageCount > 0 &&
       imageCount > swapChainSupport.capabilities.maxImageCount) {
     imageCount = swapChainSupport.capabilities.maxImageCount;
@@ -178,7 +203,7 @@ void NNSwapChain::createSwapChain() {
 
   createInfo.oldSwapchain = oldSwapChain == nullptr ? VK_NULL_HANDLE : oldSwapChain->swapChain;
 
-  if (vkCreateSwapchainKHR(device.device(), &createInfo, nullptr, &swapChain) != VK_SUCCESS) {
+  if (vkCreateSwapchainKHR(device.device(), &createInfo, NNHostMemory::callbacks(NNHostMemory::Tag::SwapChain), &swapChain) != VK_SUCCESS) {
     throw std::runtime_error("failed to create swap chain!");
   }
 
@@ -194,7 +219,31 @@ void NNSwapChain::createSwapChain() {
   swapChainExtent = extent;
 }
 
+void NNSwapChain::createOffscreenImages() {
+  // Same format the surface path prefers, so the pipelines don't care which one they render to
+  swapChainImageFormat = VK_FORMAT_B8G8R8A8_SRGB;
+  swapChainExtent = windowExtent;
+
+  uint32_t count = presentSettings.imageCount > 0 ? presentSettings.imageCount : 2;
+  swapChainImages.resize(count);
+  swapChainImageViews.resize(count);
+  offscreenImageMemorys.resize(count);
+  for (uint32_t i = 0; i < count; i++) {
+    createAttachmentImage(
+        swapChainImageFormat,
+        VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+        VK_IMAGE_ASPECT_COLOR_BIT,
+        swapChainImages[i],
+        offscreenImageMemorys[i],
+        swapChainImageViews[i]);
+  }
+}
+
 void NNSwapChain::createImageViews() {
+  if (isOffscreen()) {
+    return;
+  }
+
   swapChainImageViews.resize(swapChainImages.size());
   for (size_t i = 0; i < swapChainImages.size(); i++) {
     VkImageViewCreateInfo viewInfo{};
@@ -208,7 +257,7 @@ void NNSwapChain::createImageViews() {
     viewInfo.subresourceRange.baseArrayLayer = 0;
     viewInfo.subresourceRange.layerCount = 1;
 
-    if (vkCreateImageView(device.device(), &viewInfo, nullptr, &swapChainImageViews[i]) !=
+    if (vkCreateImageView(device.device(), &viewInfo, NNHostMemory::callbacks(NNHostMemory::Tag::ImageView), &swapChainImageViews[i]) !=
         VK_SUCCESS) {
       throw std::runtime_error("failed to create texture image view!");
     }
@@ -216,6 +265,23 @@ void NNSwapChain::createImageViews() {
 }
 
 void NNSwapChain::createRenderPass() {
+  // Resizes keep the format, so the render pass (and every pipeline built against it) survives
+  if (oldSwapChain != nullptr && oldSwapChain->renderPath == renderPath &&
+      oldSwapChain->swapChainImageFormat == swapChainImageFormat &&
+      oldSwapChain->swapChainDepthFormat == findDepthFormat()) {
+    renderPass = oldSwapChain->renderPass;
+    oldSwapChain->renderPass = VK_NULL_HANDLE;
+    return;
+  }
+
+  if (renderPath == RenderPath::Deferred) {
+    createDeferredRenderPass();
+  } else {
+    createForwardRenderPass();
+  }
+}
+
+void NNSwapChain::createForwardRenderPass() {
   VkAttachmentDescription depthAttachment{};
   depthAttachment.format = findDepthFormat();
   depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
@@ -238,7 +304,7 @@ void NNSwapChain::createRenderPass() {
   colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
   colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
   colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-  colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+  colorAttachment.finalLayout = getFinalLayout();
 
   VkAttachmentReference colorAttachmentRef = {};
   colorAttachmentRef.attachment = 0;
@@ -271,15 +337,122 @@ void NNSwapChain::createRenderPass() {
   renderPassInfo.dependencyCount = 1;
   renderPassInfo.pDependencies = &dependency;
 
-  if (vkCreateRenderPass(device.device(), &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
+  if (vkCreateRenderPass(device.device(), &renderPassInfo, NNHostMemory::callbacks(NNHostMemory::Tag::RenderPass), &renderPass) != VK_SUCCESS) {
     throw std::runtime_error("failed to create render pass!");
   }
 }
 
+void NNSwapChain::createDeferredRenderPass() {
+  VkAttachmentDescription colorAttachment = {};
+  colorAttachment.format = getSwapChainImageFormat();
+  colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+  colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+  colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  colorAttachment.finalLayout = getFinalLayout();
+
+  // Nothing in the G-buffer is stored, it only lives for the duration of the render pass
+  VkAttachmentDescription depthAttachment{};
+  depthAttachment.format = findDepthFormat();
+  depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+  depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+  VkAttachmentDescription albedoAttachment = depthAttachment;
+  albedoAttachment.format = GBUFFER_ALBEDO_FORMAT;
+  albedoAttachment.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+  VkAttachmentDescription normalAttachment = albedoAttachment;
+  normalAttachment.format = GBUFFER_NORMAL_FORMAT;
+
+  std::array<VkAttachmentReference, 2> gBufferColorRefs = {{
+      {GBUFFER_ALBEDO_ATTACHMENT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL},
+      {GBUFFER_NORMAL_ATTACHMENT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL},
+  }};
+  VkAttachmentReference gBufferDepthRef = {
+      DEPTH_ATTACHMENT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+
+  VkAttachmentReference lightingColorRef = {
+      COLOR_ATTACHMENT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+  // Order matches input_attachment_index in DeferredLighting.frag
+  std::array<VkAttachmentReference, 3> lightingInputRefs = {{
+      {GBUFFER_ALBEDO_ATTACHMENT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL},
+      {GBUFFER_NORMAL_ATTACHMENT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL},
+      {DEPTH_ATTACHMENT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL},
+  }};
+
+  std::array<VkSubpassDescription, 2> subpasses = {};
+  subpasses[GBUFFER_SUBPASS].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+  subpasses[GBUFFER_SUBPASS].colorAttachmentCount = static_cast<uint32_t>(gBufferColorRefs.size());
+  subpasses[GBUFFER_SUBPASS].pColorAttachments = gBufferColorRefs.data();
+  subpasses[GBUFFER_SUBPASS].pDepthStencilAttachment = &gBufferDepthRef;
+
+  subpasses[LIGHTING_SUBPASS].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+  subpasses[LIGHTING_SUBPASS].colorAttachmentCount = 1;
+  subpasses[LIGHTING_SUBPASS].pColorAttachments = &lightingColorRef;
+  subpasses[LIGHTING_SUBPASS].inputAttachmentCount = static_cast<uint32_t>(lightingInputRefs.size());
+  subpasses[LIGHTING_SUBPASS].pInputAttachments = lightingInputRefs.data();
+
+  std::array<VkSubpassDependency, 3> dependencies = {};
+  dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+  dependencies[0].srcStageMask =
+      VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+  dependencies[0].srcAccessMask = 0;
+  dependencies[0].dstSubpass = GBUFFER_SUBPASS;
+  dependencies[0].dstStageMask =
+      VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+  dependencies[0].dstAccessMask =
+      VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+  // The swap chain image is first written by the lighting subpass
+  dependencies[1].srcSubpass = VK_SUBPASS_EXTERNAL;
+  dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  dependencies[1].srcAccessMask = 0;
+  dependencies[1].dstSubpass = LIGHTING_SUBPASS;
+  dependencies[1].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  dependencies[1].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+  // Per pixel dependency, which is what lets tilers resolve the G-buffer without leaving the tile
+  dependencies[2].srcSubpass = GBUFFER_SUBPASS;
+  dependencies[2].srcStageMask =
+      VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+  dependencies[2].srcAccessMask =
+      VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  dependencies[2].dstSubpass = LIGHTING_SUBPASS;
+  dependencies[2].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+  dependencies[2].dstAccessMask = VK_ACCESS_INPUT_ATTACHMENT_READ_BIT;
+  dependencies[2].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+  std::array<VkAttachmentDescription, 4> attachments = {
+      colorAttachment, depthAttachment, albedoAttachment, normalAttachment};
+  VkRenderPassCreateInfo renderPassInfo = {};
+  renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+  renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+  renderPassInfo.pAttachments = attachments.data();
+  renderPassInfo.subpassCount = static_cast<uint32_t>(subpasses.size());
+  renderPassInfo.pSubpasses = subpasses.data();
+  renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+  renderPassInfo.pDependencies = dependencies.data();
+
+  if (vkCreateRenderPass(device.device(), &renderPassInfo, NNHostMemory::callbacks(NNHostMemory::Tag::RenderPass), &renderPass) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create deferred render pass!");
+  }
+}
+
 void NNSwapChain::createFramebuffers() {
   swapChainFramebuffers.resize(imageCount());
   for (size_t i = 0; i < imageCount(); i++) {
-    std::array<VkImageView, 2> attachments = {swapChainImageViews[i], depthImageViews[i]};
+    std::vector<VkImageView> attachments = {swapChainImageViews[i], depthImageViews[i]};
+    if (renderPath == RenderPath::Deferred) {
+      attachments.push_back(gBufferAlbedoViews[i]);
+      attachments.push_back(gBufferNormalViews[i]);
+    }
 
     VkExtent2D swapChainExtent = getSwapChainExtent();
     VkFramebufferCreateInfo framebufferInfo = {};
@@ -294,7 +467,7 @@ void NNSwapChain::createFramebuffers() {
     if (vkCreateFramebuffer(
             device.device(),
             &framebufferInfo,
-            nullptr,
+            NNHostMemory::callbacks(NNHostMemory::Tag::Framebuffer),
             &swapChainFramebuffers[i]) != VK_SUCCESS) {
       throw std::runtime_error("failed to create framebuffer!");
     }
@@ -304,72 +477,126 @@ void NNSwapChain::createFramebuffers() {
 void NNSwapChain::createDepthResources() {
   VkFormat depthFormat = findDepthFormat();
   swapChainDepthFormat = depthFormat;
-  VkExtent2D swapChainExtent = getSwapChainExtent();
 
   depthImages.resize(imageCount());
   depthImageMemorys.resize(imageCount());
   depthImageViews.resize(imageCount());
 
+  // The deferred path reads depth back as an input attachment to reconstruct positions
+  VkImageUsageFlags usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+  if (renderPath == RenderPath::Deferred) {
+    usage |= VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+  }
+
   for (int i = 0; i < depthImages.size(); i++) {
-    VkImageCreateInfo imageInfo{};
-    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-    imageInfo.imageType = VK_IMAGE_TYPE_2D;
-    imageInfo.extent.width = swapChainExtent.width;
-    imageInfo.extent.height = swapChainExtent.height;
-    imageInfo.extent.depth = 1;
-    imageInfo.mipLevels = 1;
-    imageInfo.arrayLayers = 1;
-    imageInfo.format = depthFormat;
-    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
-    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
-    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    imageInfo.flags = 0;
-
-    device.createImageWithInfo(
-        imageInfo,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+    createAttachmentImage(
+        depthFormat,
+        usage,
+        VK_IMAGE_ASPECT_DEPTH_BIT,
         depthImages[i],
-        depthImageMemorys[i]);
+        depthImageMemorys[i],
+        depthImageViews[i]);
+  }
+}
 
-    VkImageViewCreateInfo viewInfo{};
-    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-    viewInfo.image = depthImages[i];
-    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-    viewInfo.format = depthFormat;
-    viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-    viewInfo.subresourceRange.baseMipLevel = 0;
-    viewInfo.subresourceRange.levelCount = 1;
-    viewInfo.subresourceRange.baseArrayLayer = 0;
-    viewInfo.subresourceRange.layerCount = 1;
+void NNSwapChain::createGBufferResources() {
+  if (renderPath != RenderPath::Deferred) {
+    return;
+  }
 
-    if (vkCreateImageView(device.device(), &viewInfo, nullptr, &depthImageViews[i]) != VK_SUCCESS) {
-      throw std::runtime_error("failed to create texture image view!");
-    }
+  gBufferImages.resize(imageCount() * 2);
+  gBufferImageMemorys.resize(imageCount() * 2);
+  gBufferAlbedoViews.resize(imageCount());
+  gBufferNormalViews.resize(imageCount());
+
+  VkImageUsageFlags usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                            VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT |
+                            VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+  for (size_t i = 0; i < imageCount(); i++) {
+    createAttachmentImage(
+        GBUFFER_ALBEDO_FORMAT,
+        usage,
+        VK_IMAGE_ASPECT_COLOR_BIT,
+        gBufferImages[2 * i],
+        gBufferImageMemorys[2 * i],
+        gBufferAlbedoViews[i]);
+    createAttachmentImage(
+        GBUFFER_NORMAL_FORMAT,
+        usage,
+        VK_IMAGE_ASPECT_COLOR_BIT,
+        gBufferImages[2 * i + 1],
+        gBufferImageMemorys[2 * i + 1],
+        gBufferNormalViews[i]);
+  }
+}
+
+void NNSwapChain::createAttachmentImage(
+    VkFormat format,
+    VkImageUsageFlags usage,
+    VkImageAspectFlags aspect,
+    VkImage &image,
+    VkDeviceMemory &memory,
+    VkImageView &view) {
+  VkExtent2D swapChainExtent = getSwapChainExtent();
+
+  VkImageCreateInfo imageInfo{};
+  imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  imageInfo.imageType = VK_IMAGE_TYPE_2D;
+  imageInfo.extent.width = swapChainExtent.width;
+  imageInfo.extent.height = swapChainExtent.height;
+  imageInfo.extent.depth = 1;
+  imageInfo.mipLevels = 1;
+  imageInfo.arrayLayers = 1;
+  imageInfo.format = format;
+  imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+  imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  imageInfo.usage = usage;
+  imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+  imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  imageInfo.flags = 0;
+
+  // Transient attachments never need backing memory on tilers that support lazy allocation
+  VkMemoryPropertyFlags preferred = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+  if (usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT) {
+    preferred |= VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+  }
+  device.createImageWithInfo(
+      imageInfo,
+      preferred,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+      image,
+      memory);
+
+  VkImageViewCreateInfo viewInfo{};
+  viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+  viewInfo.image = image;
+  viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+  viewInfo.format = format;
+  viewInfo.subresourceRange.aspectMask = aspect;
+  viewInfo.subresourceRange.baseMipLevel = 0;
+  viewInfo.subresourceRange.levelCount = 1;
+  viewInfo.subresourceRange.baseArrayLayer = 0;
+  viewInfo.subresourceRange.layerCount = 1;
+
+  if (vkCreateImageView(device.device(), &viewInfo, NNHostMemory::callbacks(NNHostMemory::Tag::ImageView), &view) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create texture image view!");
   }
 }
 
 void NNSwapChain::createSyncObjects() {
-  imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-  renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-  inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
-  imagesInFlight.resize(imageCount(), VK_NULL_HANDLE);
+  if (isOffscreen()) {
+    return;
+  }
+
+  renderFinishedSemaphores.resize(imageCount());
 
   VkSemaphoreCreateInfo semaphoreInfo = {};
   semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-  VkFenceCreateInfo fenceInfo = {};
-  fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-  fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-
-  for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-    if (vkCreateSemaphore(device.device(), &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) !=
-            VK_SUCCESS ||
-        vkCreateSemaphore(device.device(), &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) !=
-            VK_SUCCESS ||
-        vkCreateFence(device.device(), &fenceInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS) {
-      throw std::runtime_error("failed to create synchronization objects for a frame!");
+  for (size_t i = 0; i < imageCount(); i++) {
+    if (vkCreateSemaphore(device.device(), &semaphoreInfo, NNHostMemory::callbacks(NNHostMemory::Tag::Semaphore), &renderFinishedSemaphores[i]) !=
+        VK_SUCCESS) {
+      throw std::runtime_error("failed to create synchronization objects for a swap chain image!");
     }
   }
 }
@@ -388,22 +615,23 @@ VkSurfaceFormatKHR NNSwapChain::chooseSwapSurfaceFormat(
 
 VkPresentModeKHR NNSwapChain::chooseSwapPresentMode(
     const std::vector<VkPresentModeKHR> &availablePresentModes) {
+  VkPresentModeKHR chosen = VK_PRESENT_MODE_FIFO_KHR;
   for (const auto &availablePresentMode : availablePresentModes) {
-    if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
-      std::cout << "Present mode: Mailbox" << std::endl;
-      return availablePresentMode;
+    if (availablePresentMode == presentSettings.presentMode) {
+      chosen = availablePresentMode;
+      break;
     }
   }
 
-  // for (const auto &availablePresentMode : availablePresentModes) {
-  //   if (availablePresentMode == VK_PRESENT_MODE_IMMEDIATE_KHR) {
-  //     std::cout << "Present mode: Immediate" << std::endl;
-  //     return availablePresentMode;
-  //   }
-  // }
-
-  std::cout << "Present mode: V-Sync" << std::endl;
-  return VK_PRESENT_MODE_FIFO_KHR;
+  // Only worth a line when it changes, resizes recreate the swap chain all the time
+  if (oldSwapChain == nullptr || oldSwapChain->presentMode != chosen) {
+    std::cout << "Present mode: " << presentModeName(chosen);
+    if (chosen != presentSettings.presentMode) {
+      std::cout << " (" << presentModeName(presentSettings.presentMode) << " unsupported)";
+    }
+    std::cout << std::endl;
+  }
+  return chosen;
 }
 
 VkExtent2D NNSwapChain::chooseSwapExtent(const VkSurfaceCapabilitiesKHR &capabilities) {
@@ -12,12 +12,55 @@
 
 namespace NNuts {
 
+enum class RenderPath {
+  // Single subpass with colour and depth
+  Forward,
+  // Subpass 0 fills the G-buffer, subpass 1 reads it back as input attachments and lights the
+  // swap chain image. The G-buffer never leaves the render pass, so tilers can keep it on chip.
+  Deferred,
+};
+
+struct PresentSettings {
+  // FIFO is the fallback, it is the only mode every device has to support
+  VkPresentModeKHR presentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+  // 0 picks minImageCount + 1, anything else is clamped to what the surface allows
+  uint32_t imageCount = 0;
+};
+
+const char *presentModeName(VkPresentModeKHR presentMode);
+
 class NNSwapChain {
  public:
-  static constexpr int MAX_FRAMES_IN_FLIGHT = 2;
-
-  NNSwapChain(NNDevice &deviceRef, VkExtent2D windowExtent);
-  NNSwapChain(NNDevice &deviceRef, VkExtent2D windowExtent, std::shared_ptr<NNSwapChain> previous);
+  // Upper bound for per frame resources, the renderer picks how many are actually in flight
+  static constexpr int MAX_FRAMES_IN_FLIGHT = 4;
+
+  // Framebuffer attachment order of the deferred render pass
+  static constexpr uint32_t COLOR_ATTACHMENT = 0;
+  static constexpr uint32_t DEPTH_ATTACHMENT = 1;
+  static constexpr uint32_t GBUFFER_ALBEDO_ATTACHMENT = 2;
+  static constexpr uint32_t GBUFFER_NORMAL_ATTACHMENT = 3;
+  static constexpr uint32_t GBUFFER_SUBPASS = 0;
+  static constexpr uint32_t LIGHTING_SUBPASS = 1;
+
+  struct GBufferViews {
+    VkImageView albedo;
+    VkImageView normal;
+    VkImageView depth;
+  };
+
+  NNSwapChain(
+      NNDevice &deviceRef,
+      VkExtent2D windowExtent,
+      RenderPath renderPath = RenderPath::Forward,
+      PresentSettings presentSettings = {});
+  // Recreates on top of previous without waiting for the device: the render pass is reused when
+  // the formats match. previous itself has to stay alive until the frames that used it have finished.
+  NNSwapChain(
+      NNDevice &deviceRef,
+      VkExtent2D windowExtent,
+      std::shared_ptr<NNSwapChain> previous,
+      RenderPath renderPath = RenderPath::Forward,
+      PresentSettings presentSettings = {});
   ~NNSwapChain();
 
   NNSwapChain(const NNSwapChain &) = delete;
@@ -25,20 +68,36 @@ class NNSwapChain {
 
   VkFramebuffer getFrameBuffer(int index) { return swapChainFramebuffers[index]; }
   VkRenderPass getRenderPass() { return renderPass; }
+  VkImage getImage(int index) { return swapChainImages[index]; }
   VkImageView getImageView(int index) { return swapChainImageViews[index]; }
   size_t imageCount() { return swapChainImages.size(); }
   VkFormat getSwapChainImageFormat() { return swapChainImageFormat; }
   VkExtent2D getSwapChainExtent() { return swapChainExtent; }
   uint32_t width() { return swapChainExtent.width; }
   uint32_t height() { return swapChainExtent.height; }
+  RenderPath getRenderPath() const { return renderPath; }
+  // What the surface actually gave us, may differ from the requested PresentSettings
+  VkPresentModeKHR getPresentMode() const { return presentMode; }
+  uint32_t attachmentCount() const { return renderPath == RenderPath::Deferred ? 4 : 2; }
+  // Headless devices get plain images instead of a VkSwapchainKHR. They end the frame in
+  // TRANSFER_SRC_OPTIMAL so they can be read back, acquire cycles through them and present is a no-op.
+  bool isOffscreen() const { return device.isHeadless(); }
+  VkImageLayout getFinalLayout() const {
+    return isOffscreen() ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+  }
+  GBufferViews getGBufferViews(int index) {
+    return {gBufferAlbedoViews[index], gBufferNormalViews[index], depthImageViews[index]};
+  }
 
   float extentAspectRatio() {
     return static_cast<float>(swapChainExtent.width) / static_cast<float>(swapChainExtent.height);
   }
   VkFormat findDepthFormat();
 
-  VkResult acquireNextImage(uint32_t *imageIndex);
-  VkResult submitCommandBuffers(const VkCommandBuffer *buffers, uint32_t *imageIndex);
+  // Frame pacing lives in NNRenderer, the swap chain only owns the per image present semaphores
+  VkResult acquireNextImage(VkSemaphore imageAvailable, uint32_t *imageIndex);
+  VkSemaphore getRenderFinishedSemaphore(uint32_t imageIndex) { return renderFinishedSemaphores[imageIndex]; }
+  VkResult present(uint32_t imageIndex);
 
   bool compareSwapFormats(const NNSwapChain& swapChain) const {
       return swapChain.swapChainDepthFormat == swapChainDepthFormat &&
@@ -48,9 +107,20 @@ class NNSwapChain {
 private:
   void init();
   void createSwapChain();
+  void createOffscreenImages();
   void createImageViews();
   void createDepthResources();
+  void createGBufferResources();
   void createRenderPass();
+  void createForwardRenderPass();
+  void createDeferredRenderPass();
+  void createAttachmentImage(
+      VkFormat format,
+      VkImageUsageFlags usage,
+      VkImageAspectFlags aspect,
+      VkImage &image,
+      VkDeviceMemory &memory,
+      VkImageView &view);
   void createFramebuffers();
   void createSyncObjects();
 
@@ -71,20 +141,26 @@ private:
   std::vector<VkImage> depthImages;
   std::vector<VkDeviceMemory> depthImageMemorys;
   std::vector<VkImageView> depthImageViews;
+  std::vector<VkImage> gBufferImages;
+  std::vector<VkDeviceMemory> gBufferImageMemorys;
+  std::vector<VkImageView> gBufferAlbedoViews;
+  std::vector<VkImageView> gBufferNormalViews;
   std::vector<VkImage> swapChainImages;
   std::vector<VkImageView> swapChainImageViews;
+  std::vector<VkDeviceMemory> offscreenImageMemorys;
+  uint32_t nextOffscreenImage = 0;
 
   NNDevice &device;
   VkExtent2D windowExtent;
+  RenderPath renderPath;
+  PresentSettings presentSettings;
+  VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
 
-  VkSwapchainKHR swapChain;
+  VkSwapchainKHR swapChain = VK_NULL_HANDLE;
   std::shared_ptr<NNSwapChain> oldSwapChain;
 
-  std::vector<VkSemaphore> imageAvailableSemaphores;
+  // One per image: an image is only acquired again once its previous present consumed the semaphore
   std::vector<VkSemaphore> renderFinishedSemaphores;
-  std::vector<VkFence> inFlightFences;
-  std::vector<VkFence> imagesInFlight;
-  size_t currentFrame = 0;
 };
 
 }  // namespace NNuts
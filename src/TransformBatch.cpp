@@ -0,0 +1,364 @@
+#include "TransformBatch.h"
+
+#include <algorithm>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define NN_TRANSFORM_BATCH_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+#else
+#define NN_TRANSFORM_BATCH_X86 0
+#endif
+
+// MSVC emits AVX2 intrinsics anywhere, GCC and Clang only in functions that enable them
+#if defined(_MSC_VER) && !defined(__clang__)
+#define NN_TARGET_AVX2
+#else
+#define NN_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#endif
+
+namespace NNuts {
+	namespace {
+		void computeScalar(const NNTransformArrays& input, size_t first, size_t count, NNInstanceTransform* output)
+		{
+			for (size_t i = 0; i < count; i++) {
+				TransformComponent transform = input.get(first + i);
+				output[i].modelMatrix = transform.mat4();
+				output[i].normalMatrix = glm::mat4{ transform.normalMatrix() };
+			}
+		}
+
+#if NN_TRANSFORM_BATCH_X86
+		// Cephes sinf/cosf: reduce to [-pi/4, pi/4] around the nearest even octant, then one polynomial
+		// for sin and one for cos, swapped and negated depending on the octant. Good to about 1e-7 for
+		// angles below 8192.
+		constexpr float FOUR_OVER_PI = 1.27323954473516f;
+		constexpr float PI_OVER_FOUR_1 = 0.78515625f;
+		constexpr float PI_OVER_FOUR_2 = 2.4187564849853515625e-4f;
+		constexpr float PI_OVER_FOUR_3 = 3.77489497744594108e-8f;
+		constexpr float SIN_0 = -1.9515295891e-4f;
+		constexpr float SIN_1 = 8.3321608736e-3f;
+		constexpr float SIN_2 = -1.6666654611e-1f;
+		constexpr float COS_0 = 2.443315711809948e-5f;
+		constexpr float COS_1 = -1.388731625493765e-3f;
+		constexpr float COS_2 = 4.166664568298827e-2f;
+
+		float* objectFloats(NNInstanceTransform* output, size_t object)
+		{
+			return reinterpret_cast<float*>(output + object);
+		}
+
+		__m128 select4(__m128 mask, __m128 a, __m128 b)
+		{
+			return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+		}
+
+		void sincos4(__m128 x, __m128& sin, __m128& cos)
+		{
+			const __m128 signMask = _mm_set1_ps(-0.0f);
+			__m128 sinSign = _mm_and_ps(x, signMask);
+			x = _mm_andnot_ps(signMask, x);
+
+			__m128i octant = _mm_cvttps_epi32(_mm_mul_ps(x, _mm_set1_ps(FOUR_OVER_PI)));
+			octant = _mm_and_si128(_mm_add_epi32(octant, _mm_set1_epi32(1)), _mm_set1_epi32(~1));
+			__m128 y = _mm_cvtepi32_ps(octant);
+
+			sinSign = _mm_xor_ps(sinSign, _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(octant, _mm_set1_epi32(4)), 29)));
+			__m128 cosSign = _mm_castsi128_ps(_mm_slli_epi32(
+				_mm_andnot_si128(_mm_sub_epi32(octant, _mm_set1_epi32(2)), _mm_set1_epi32(4)), 29));
+			__m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(octant, _mm_set1_epi32(2)), _mm_set1_epi32(2)));
+
+			x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(PI_OVER_FOUR_1)));
+			x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(PI_OVER_FOUR_2)));
+			x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(PI_OVER_FOUR_3)));
+			__m128 z = _mm_mul_ps(x, x);
+
+			__m128 cosPoly = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(COS_0), z), _mm_set1_ps(COS_1));
+			cosPoly = _mm_add_ps(_mm_mul_ps(cosPoly, z), _mm_set1_ps(COS_2));
+			cosPoly = _mm_mul_ps(_mm_mul_ps(cosPoly, z), z);
+			cosPoly = _mm_add_ps(_mm_sub_ps(cosPoly, _mm_mul_ps(_mm_set1_ps(0.5f), z)), _mm_set1_ps(1.0f));
+
+			__m128 sinPoly = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(SIN_0), z), _mm_set1_ps(SIN_1));
+			sinPoly = _mm_add_ps(_mm_mul_ps(sinPoly, z), _mm_set1_ps(SIN_2));
+			sinPoly = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(sinPoly, z), x), x);
+
+			sin = _mm_xor_ps(select4(swap, cosPoly, sinPoly), sinSign);
+			cos = _mm_xor_ps(select4(swap, sinPoly, cosPoly), cosSign);
+		}
+
+		// x, y, z and w each hold one element for 4 objects, every object gets its 4 elements at offset
+		void storeTransposed4(__m128 x, __m128 y, __m128 z, __m128 w, NNInstanceTransform* output, size_t offset)
+		{
+			_MM_TRANSPOSE4_PS(x, y, z, w);
+			_mm_storeu_ps(objectFloats(output, 0) + offset, x);
+			_mm_storeu_ps(objectFloats(output, 1) + offset, y);
+			_mm_storeu_ps(objectFloats(output, 2) + offset, z);
+			_mm_storeu_ps(objectFloats(output, 3) + offset, w);
+		}
+
+		// Returns how many objects it wrote, a multiple of 4
+		size_t computeSSE(const NNTransformArrays& input, size_t first, size_t count, NNInstanceTransform* output)
+		{
+			const __m128 zero = _mm_setzero_ps();
+			const __m128 one = _mm_set1_ps(1.0f);
+
+			size_t i = 0;
+			for (; i + 4 <= count; i += 4) {
+				size_t k = first + i;
+				__m128 s1, c1, s2, c2, s3, c3;
+				sincos4(_mm_loadu_ps(&input.rotationY[k]), s1, c1);
+				sincos4(_mm_loadu_ps(&input.rotationX[k]), s2, c2);
+				sincos4(_mm_loadu_ps(&input.rotationZ[k]), s3, c3);
+
+				// Same terms as TransformComponent::mat4
+				__m128 s2s3 = _mm_mul_ps(s2, s3);
+				__m128 c3s2 = _mm_mul_ps(c3, s2);
+				__m128 r00 = _mm_add_ps(_mm_mul_ps(c1, c3), _mm_mul_ps(s1, s2s3));
+				__m128 r01 = _mm_mul_ps(c2, s3);
+				__m128 r02 = _mm_sub_ps(_mm_mul_ps(c1, s2s3), _mm_mul_ps(c3, s1));
+				__m128 r10 = _mm_sub_ps(_mm_mul_ps(s1, c3s2), _mm_mul_ps(c1, s3));
+				__m128 r11 = _mm_mul_ps(c2, c3);
+				__m128 r12 = _mm_add_ps(_mm_mul_ps(c1, c3s2), _mm_mul_ps(s1, s3));
+				__m128 r20 = _mm_mul_ps(c2, s1);
+				__m128 r21 = _mm_sub_ps(zero, s2);
+				__m128 r22 = _mm_mul_ps(c1, c2);
+
+				__m128 sx = _mm_loadu_ps(&input.scaleX[k]);
+				__m128 sy = _mm_loadu_ps(&input.scaleY[k]);
+				__m128 sz = _mm_loadu_ps(&input.scaleZ[k]);
+				__m128 ix = _mm_div_ps(one, sx);
+				__m128 iy = _mm_div_ps(one, sy);
+				__m128 iz = _mm_div_ps(one, sz);
+
+				NNInstanceTransform* out = output + i;
+				storeTransposed4(_mm_mul_ps(sx, r00), _mm_mul_ps(sx, r01), _mm_mul_ps(sx, r02), zero, out, 0);
+				storeTransposed4(_mm_mul_ps(sy, r10), _mm_mul_ps(sy, r11), _mm_mul_ps(sy, r12), zero, out, 4);
+				storeTransposed4(_mm_mul_ps(sz, r20), _mm_mul_ps(sz, r21), _mm_mul_ps(sz, r22), zero, out, 8);
+				storeTransposed4(
+					_mm_loadu_ps(&input.translationX[k]),
+					_mm_loadu_ps(&input.translationY[k]),
+					_mm_loadu_ps(&input.translationZ[k]),
+					one, out, 12);
+				storeTransposed4(_mm_mul_ps(ix, r00), _mm_mul_ps(ix, r01), _mm_mul_ps(ix, r02), zero, out, 16);
+				storeTransposed4(_mm_mul_ps(iy, r10), _mm_mul_ps(iy, r11), _mm_mul_ps(iy, r12), zero, out, 20);
+				storeTransposed4(_mm_mul_ps(iz, r20), _mm_mul_ps(iz, r21), _mm_mul_ps(iz, r22), zero, out, 24);
+				storeTransposed4(zero, zero, zero, one, out, 28);
+			}
+			return i;
+		}
+
+		NN_TARGET_AVX2 void sincos8(__m256 x, __m256& sin, __m256& cos)
+		{
+			const __m256 signMask = _mm256_set1_ps(-0.0f);
+			__m256 sinSign = _mm256_and_ps(x, signMask);
+			x = _mm256_andnot_ps(signMask, x);
+
+			__m256i octant = _mm256_cvttps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(FOUR_OVER_PI)));
+			octant = _mm256_and_si256(_mm256_add_epi32(octant, _mm256_set1_epi32(1)), _mm256_set1_epi32(~1));
+			__m256 y = _mm256_cvtepi32_ps(octant);
+
+			sinSign = _mm256_xor_ps(sinSign, _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(octant, _mm256_set1_epi32(4)), 29)));
+			__m256 cosSign = _mm256_castsi256_ps(_mm256_slli_epi32(
+				_mm256_andnot_si256(_mm256_sub_epi32(octant, _mm256_set1_epi32(2)), _mm256_set1_epi32(4)), 29));
+			__m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(octant, _mm256_set1_epi32(2)), _mm256_set1_epi32(2)));
+
+			x = _mm256_fnmadd_ps(y, _mm256_set1_ps(PI_OVER_FOUR_1), x);
+			x = _mm256_fnmadd_ps(y, _mm256_set1_ps(PI_OVER_FOUR_2), x);
+			x = _mm256_fnmadd_ps(y, _mm256_set1_ps(PI_OVER_FOUR_3), x);
+			__m256 z = _mm256_mul_ps(x, x);
+
+			__m256 cosPoly = _mm256_fmadd_ps(_mm256_set1_ps(COS_0), z, _mm256_set1_ps(COS_1));
+			cosPoly = _mm256_fmadd_ps(cosPoly, z, _mm256_set1_ps(COS_2));
+			cosPoly = _mm256_mul_ps(_mm256_mul_ps(cosPoly, z), z);
+			cosPoly = _mm256_add_ps(_mm256_fnmadd_ps(_mm256_set1_ps(0.5f), z, cosPoly), _mm256_set1_ps(1.0f));
+
+			__m256 sinPoly = _mm256_fmadd_ps(_mm256_set1_ps(SIN_0), z, _mm256_set1_ps(SIN_1));
+			sinPoly = _mm256_fmadd_ps(sinPoly, z, _mm256_set1_ps(SIN_2));
+			sinPoly = _mm256_fmadd_ps(_mm256_mul_ps(sinPoly, z), x, x);
+
+			sin = _mm256_xor_ps(_mm256_blendv_ps(sinPoly, cosPoly, swap), sinSign);
+			cos = _mm256_xor_ps(_mm256_blendv_ps(cosPoly, sinPoly, swap), cosSign);
+		}
+
+		// r[e] holds element e of 8 objects, every object gets its 8 elements at offset
+		NN_TARGET_AVX2 void storeTransposed8(const __m256 (&r)[8], NNInstanceTransform* output, size_t offset)
+		{
+			__m256 t0 = _mm256_unpacklo_ps(r[0], r[1]);
+			__m256 t1 = _mm256_unpackhi_ps(r[0], r[1]);
+			__m256 t2 = _mm256_unpacklo_ps(r[2], r[3]);
+			__m256 t3 = _mm256_unpackhi_ps(r[2], r[3]);
+			__m256 t4 = _mm256_unpacklo_ps(r[4], r[5]);
+			__m256 t5 = _mm256_unpackhi_ps(r[4], r[5]);
+			__m256 t6 = _mm256_unpacklo_ps(r[6], r[7]);
+			__m256 t7 = _mm256_unpackhi_ps(r[6], r[7]);
+
+			__m256 u0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+			__m256 u1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+			__m256 u2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+			__m256 u3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+			__m256 u4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+			__m256 u5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+			__m256 u6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+			__m256 u7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+
+			_mm256_storeu_ps(objectFloats(output, 0) + offset, _mm256_permute2f128_ps(u0, u4, 0x20));
+			_mm256_storeu_ps(objectFloats(output, 1) + offset, _mm256_permute2f128_ps(u1, u5, 0x20));
+			_mm256_storeu_ps(objectFloats(output, 2) + offset, _mm256_permute2f128_ps(u2, u6, 0x20));
+			_mm256_storeu_ps(objectFloats(output, 3) + offset, _mm256_permute2f128_ps(u3, u7, 0x20));
+			_mm256_storeu_ps(objectFloats(output, 4) + offset, _mm256_permute2f128_ps(u0, u4, 0x31));
+			_mm256_storeu_ps(objectFloats(output, 5) + offset, _mm256_permute2f128_ps(u1, u5, 0x31));
+			_mm256_storeu_ps(objectFloats(output, 6) + offset, _mm256_permute2f128_ps(u2, u6, 0x31));
+			_mm256_storeu_ps(objectFloats(output, 7) + offset, _mm256_permute2f128_ps(u3, u7, 0x31));
+		}
+
+		// Returns how many objects it wrote, a multiple of 8
+		NN_TARGET_AVX2 size_t computeAVX2(const NNTransformArrays& input, size_t first, size_t count, NNInstanceTransform* output)
+		{
+			const __m256 zero = _mm256_setzero_ps();
+			const __m256 one = _mm256_set1_ps(1.0f);
+
+			size_t i = 0;
+			for (; i + 8 <= count; i += 8) {
+				size_t k = first + i;
+				__m256 s1, c1, s2, c2, s3, c3;
+				sincos8(_mm256_loadu_ps(&input.rotationY[k]), s1, c1);
+				sincos8(_mm256_loadu_ps(&input.rotationX[k]), s2, c2);
+				sincos8(_mm256_loadu_ps(&input.rotationZ[k]), s3, c3);
+
+				__m256 s2s3 = _mm256_mul_ps(s2, s3);
+				__m256 c3s2 = _mm256_mul_ps(c3, s2);
+				__m256 r00 = _mm256_fmadd_ps(s1, s2s3, _mm256_mul_ps(c1, c3));
+				__m256 r01 = _mm256_mul_ps(c2, s3);
+				__m256 r02 = _mm256_fmsub_ps(c1, s2s3, _mm256_mul_ps(c3, s1));
+				__m256 r10 = _mm256_fmsub_ps(s1, c3s2, _mm256_mul_ps(c1, s3));
+				__m256 r11 = _mm256_mul_ps(c2, c3);
+				__m256 r12 = _mm256_fmadd_ps(c1, c3s2, _mm256_mul_ps(s1, s3));
+				__m256 r20 = _mm256_mul_ps(c2, s1);
+				__m256 r21 = _mm256_sub_ps(zero, s2);
+				__m256 r22 = _mm256_mul_ps(c1, c2);
+
+				__m256 sx = _mm256_loadu_ps(&input.scaleX[k]);
+				__m256 sy = _mm256_loadu_ps(&input.scaleY[k]);
+				__m256 sz = _mm256_loadu_ps(&input.scaleZ[k]);
+				__m256 ix = _mm256_div_ps(one, sx);
+				__m256 iy = _mm256_div_ps(one, sy);
+				__m256 iz = _mm256_div_ps(one, sz);
+
+				// Elements 0-7 and 8-15 of each matrix, i.e. two columns at a time
+				NNInstanceTransform* out = output + i;
+				const __m256 model01[8] = {
+					_mm256_mul_ps(sx, r00), _mm256_mul_ps(sx, r01), _mm256_mul_ps(sx, r02), zero,
+					_mm256_mul_ps(sy, r10), _mm256_mul_ps(sy, r11), _mm256_mul_ps(sy, r12), zero };
+				storeTransposed8(model01, out, 0);
+				const __m256 model23[8] = {
+					_mm256_mul_ps(sz, r20), _mm256_mul_ps(sz, r21), _mm256_mul_ps(sz, r22), zero,
+					_mm256_loadu_ps(&input.translationX[k]), _mm256_loadu_ps(&input.translationY[k]), _mm256_loadu_ps(&input.translationZ[k]), one };
+				storeTransposed8(model23, out, 8);
+				const __m256 normal01[8] = {
+					_mm256_mul_ps(ix, r00), _mm256_mul_ps(ix, r01), _mm256_mul_ps(ix, r02), zero,
+					_mm256_mul_ps(iy, r10), _mm256_mul_ps(iy, r11), _mm256_mul_ps(iy, r12), zero };
+				storeTransposed8(normal01, out, 16);
+				const __m256 normal23[8] = {
+					_mm256_mul_ps(iz, r20), _mm256_mul_ps(iz, r21), _mm256_mul_ps(iz, r22), zero,
+					zero, zero, zero, one };
+				storeTransposed8(normal23, out, 24);
+			}
+			return i;
+		}
+#endif
+
+		NNTransformBatch::Isa detectIsa()
+		{
+#if NN_TRANSFORM_BATCH_X86
+#if defined(_MSC_VER) && !defined(__clang__)
+			int info[4];
+			__cpuid(info, 0);
+			int maxLeaf = info[0];
+			__cpuid(info, 1);
+			bool fma = (info[2] & (1 << 12)) != 0;
+			bool osxsave = (info[2] & (1 << 27)) != 0;
+			bool avx = (info[2] & (1 << 28)) != 0;
+			bool avx2 = false;
+			if (maxLeaf >= 7) {
+				__cpuidex(info, 7, 0);
+				avx2 = (info[1] & (1 << 5)) != 0;
+			}
+			// The OS also has to save the upper halves of the ymm registers
+			bool ymmState = osxsave && (_xgetbv(0) & 6) == 6;
+			return fma && avx && avx2 && ymmState ? NNTransformBatch::Isa::AVX2 : NNTransformBatch::Isa::SSE;
+#else
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") ? NNTransformBatch::Isa::AVX2 : NNTransformBatch::Isa::SSE;
+#endif
+#else
+			return NNTransformBatch::Isa::Scalar;
+#endif
+		}
+	}
+
+	void NNTransformArrays::resize(size_t count)
+	{
+		for (auto* values : { &translationX, &translationY, &translationZ, &rotationX, &rotationY, &rotationZ, &scaleX, &scaleY, &scaleZ }) {
+			values->resize(count);
+		}
+	}
+
+	void NNTransformArrays::set(size_t index, const TransformComponent& transform)
+	{
+		translationX[index] = transform.translation.x;
+		translationY[index] = transform.translation.y;
+		translationZ[index] = transform.translation.z;
+		rotationX[index] = transform.rotation.x;
+		rotationY[index] = transform.rotation.y;
+		rotationZ[index] = transform.rotation.z;
+		scaleX[index] = transform.scale.x;
+		scaleY[index] = transform.scale.y;
+		scaleZ[index] = transform.scale.z;
+	}
+
+	TransformComponent NNTransformArrays::get(size_t index) const
+	{
+		TransformComponent transform{};
+		transform.translation = { translationX[index], translationY[index], translationZ[index] };
+		transform.rotation = { rotationX[index], rotationY[index], rotationZ[index] };
+		transform.scale = { scaleX[index], scaleY[index], scaleZ[index] };
+		return transform;
+	}
+
+	NNTransformBatch::Isa NNTransformBatch::getSupportedIsa()
+	{
+		static const Isa isa = detectIsa();
+		return isa;
+	}
+
+	const char* NNTransformBatch::isaName(Isa isa)
+	{
+		switch (isa) {
+		case Isa::SSE: return "sse";
+		case Isa::AVX2: return "avx2";
+		default: return "scalar";
+		}
+	}
+
+	void NNTransformBatch::compute(
+		const NNTransformArrays& input,
+		size_t first,
+		size_t count,
+		NNInstanceTransform* output,
+		Isa isa)
+	{
+		isa = std::min(isa, getSupportedIsa());
+		size_t done = 0;
+#if NN_TRANSFORM_BATCH_X86
+		if (isa == Isa::AVX2) {
+			done += computeAVX2(input, first, count, output);
+		}
+		if (isa >= Isa::SSE) {
+			done += computeSSE(input, first + done, count - done, output + done);
+		}
+#endif
+		computeScalar(input, first + done, count - done, output + done);
+	}
+}
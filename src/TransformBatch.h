@@ -0,0 +1,54 @@
+#pragma once
+
+#include "GameObject.h"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <vector>
+
+namespace NNuts {
+	// One object of an instance or object buffer, laid out like ObjectData in Bindless.glsl
+	struct NNInstanceTransform {
+		glm::mat4 modelMatrix;
+		glm::mat4 normalMatrix;
+	};
+
+	// Transforms as separate arrays per component, which is what the batch kernels load from
+	struct NNTransformArrays {
+		std::vector<float> translationX, translationY, translationZ;
+		std::vector<float> rotationX, rotationY, rotationZ;
+		std::vector<float> scaleX, scaleY, scaleZ;
+
+		size_t size() const { return translationX.size(); }
+		void resize(size_t count);
+		void set(size_t index, const TransformComponent& transform);
+		TransformComponent get(size_t index) const;
+	};
+
+	// Model and normal matrices for many transforms at once, the same as TransformComponent::mat4
+	// and normalMatrix. The AVX2 path does 8 objects per iteration and the SSE path 4, both with a
+	// vectorized sincos, leftovers go through the scalar path. The output can be a mapped buffer, every
+	// object is written with whole 16 or 32 byte stores and nothing is read back.
+	class NNTransformBatch {
+	public:
+		enum class Isa {
+			Scalar,
+			SSE,
+			AVX2,
+		};
+
+		// Best path the CPU and OS support, detected once
+		static Isa getSupportedIsa();
+		static const char* isaName(Isa isa);
+
+		// Writes output[0, count) from input[first, first + count). Asking for more than the CPU
+		// supports falls back to the best supported path.
+		static void compute(
+			const NNTransformArrays& input,
+			size_t first,
+			size_t count,
+			NNInstanceTransform* output,
+			Isa isa = getSupportedIsa());
+	};
+}
@@ -0,0 +1,214 @@
+#include "TransformHierarchy.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace NNuts {
+	namespace {
+		// Inverse transpose of the upper 3x3 from its cofactors, which also holds up under the shear a
+		// non-uniformly scaled parent introduces
+		glm::mat3 normalMatrixOf(const glm::mat4& world)
+		{
+			glm::vec3 x{ world[0] };
+			glm::vec3 y{ world[1] };
+			glm::vec3 z{ world[2] };
+			glm::vec3 yz = glm::cross(y, z);
+			return glm::mat3{ yz, glm::cross(z, x), glm::cross(x, y) } / glm::dot(x, yz);
+		}
+	}
+
+	uint32_t NNTransformHierarchy::add(const TransformComponent& local, uint32_t parent)
+	{
+		uint32_t id;
+		if (!m_FreeIds.empty()) {
+			id = m_FreeIds.back();
+			m_FreeIds.pop_back();
+		}
+		else {
+			id = static_cast<uint32_t>(m_Positions.size());
+			m_Positions.push_back(NO_POSITION);
+		}
+
+		// Appending keeps the order, the parent is already somewhere in front
+		uint32_t position = static_cast<uint32_t>(m_Nodes.size());
+		m_Positions[id] = position;
+		m_Nodes.push_back(id);
+		m_Parents.push_back(parent == NO_PARENT ? NO_POSITION : m_Positions[parent]);
+		m_Locals.push_back(local);
+		m_Instances.push_back({ glm::mat4{ 1.0f }, glm::mat4{ 1.0f } });
+		m_Dirty.push_back(0);
+		markDirty(position);
+		return id;
+	}
+
+	void NNTransformHierarchy::remove(uint32_t node)
+	{
+		uint32_t position = m_Positions[node];
+		assert(position != NO_POSITION && "Node was already removed!");
+
+		// Descendants come after the node, so one pass finds the whole subtree
+		std::vector<uint8_t> removed(m_Nodes.size(), 0);
+		removed[position] = 1;
+		std::vector<uint32_t> order;
+		order.reserve(m_Nodes.size());
+		for (uint32_t i = 0; i < m_Nodes.size(); i++) {
+			uint32_t parent = m_Parents[i];
+			if (i > position && parent != NO_POSITION && removed[parent]) {
+				removed[i] = 1;
+			}
+			if (removed[i]) {
+				m_Positions[m_Nodes[i]] = NO_POSITION;
+				m_FreeIds.push_back(m_Nodes[i]);
+			}
+			else {
+				order.push_back(i);
+			}
+		}
+		reorder(order);
+	}
+
+	void NNTransformHierarchy::setParent(uint32_t node, uint32_t parent)
+	{
+		assert(parent != node && (parent == NO_PARENT || !isDescendant(parent, node)) && "Parenting would make a cycle!");
+		uint32_t position = m_Positions[node];
+		uint32_t parentPosition = parent == NO_PARENT ? NO_POSITION : m_Positions[parent];
+		m_Parents[position] = parentPosition;
+		markDirty(position);
+		if (parentPosition == NO_POSITION || parentPosition < position) {
+			return;
+		}
+
+		// The new parent comes later, move the node's subtree behind everything else
+		std::vector<uint8_t> inSubtree(m_Nodes.size(), 0);
+		inSubtree[position] = 1;
+		std::vector<uint32_t> order;
+		std::vector<uint32_t> subtree{ position };
+		order.reserve(m_Nodes.size());
+		for (uint32_t i = 0; i < m_Nodes.size(); i++) {
+			if (i > position && m_Parents[i] != NO_POSITION && inSubtree[m_Parents[i]]) {
+				inSubtree[i] = 1;
+				subtree.push_back(i);
+			}
+			else if (!inSubtree[i]) {
+				order.push_back(i);
+			}
+		}
+		order.insert(order.end(), subtree.begin(), subtree.end());
+		reorder(order);
+	}
+
+	uint32_t NNTransformHierarchy::getParent(uint32_t node) const
+	{
+		uint32_t parent = m_Parents[m_Positions[node]];
+		return parent == NO_POSITION ? NO_PARENT : m_Nodes[parent];
+	}
+
+	void NNTransformHierarchy::setLocal(uint32_t node, const TransformComponent& local)
+	{
+		uint32_t position = m_Positions[node];
+		m_Locals[position] = local;
+		markDirty(position);
+	}
+
+	uint32_t NNTransformHierarchy::update()
+	{
+		uint32_t count = static_cast<uint32_t>(m_Nodes.size());
+		if (m_FirstDirty >= count) {
+			return 0;
+		}
+
+		m_UpdateList.clear();
+		for (uint32_t i = m_FirstDirty; i < count; i++) {
+			uint32_t parent = m_Parents[i];
+			if (!m_Dirty[i]) {
+				if (parent == NO_POSITION || !m_Dirty[parent]) {
+					continue;
+				}
+				// Passes the change on to this node's children
+				m_Dirty[i] = 1;
+			}
+			m_UpdateList.push_back(i);
+		}
+		std::fill(m_Dirty.begin() + m_FirstDirty, m_Dirty.end(), uint8_t{ 0 });
+		m_FirstDirty = count;
+
+		size_t updated = m_UpdateList.size();
+		m_BatchInput.resize(updated);
+		for (size_t k = 0; k < updated; k++) {
+			m_BatchInput.set(k, m_Locals[m_UpdateList[k]]);
+		}
+
+		// One batch per run of consecutive positions, written in place
+		for (size_t first = 0; first < updated;) {
+			size_t last = first + 1;
+			while (last < updated && m_UpdateList[last] == m_UpdateList[last - 1] + 1) {
+				last++;
+			}
+			NNTransformBatch::compute(m_BatchInput, first, last - first, &m_Instances[m_UpdateList[first]]);
+			first = last;
+		}
+
+		// The list is in order, so parents are done before their children
+		for (size_t k = 0; k < updated; k++) {
+			uint32_t i = m_UpdateList[k];
+			uint32_t parent = m_Parents[i];
+			if (parent != NO_POSITION) {
+				NNInstanceTransform& instance = m_Instances[i];
+				instance.modelMatrix = m_Instances[parent].modelMatrix * instance.modelMatrix;
+				instance.normalMatrix = glm::mat4{ normalMatrixOf(instance.modelMatrix) };
+			}
+		}
+		return static_cast<uint32_t>(updated);
+	}
+
+	void NNTransformHierarchy::markDirty(uint32_t position)
+	{
+		m_Dirty[position] = 1;
+		m_FirstDirty = std::min(m_FirstDirty, position);
+	}
+
+	void NNTransformHierarchy::reorder(const std::vector<uint32_t>& order)
+	{
+		std::vector<uint32_t> newPositions(m_Nodes.size(), NO_POSITION);
+		for (uint32_t i = 0; i < order.size(); i++) {
+			newPositions[order[i]] = i;
+		}
+
+		std::vector<uint32_t> nodes(order.size());
+		std::vector<uint32_t> parents(order.size());
+		std::vector<TransformComponent> locals(order.size());
+		std::vector<NNInstanceTransform> instances(order.size());
+		std::vector<uint8_t> dirty(order.size());
+		m_FirstDirty = static_cast<uint32_t>(order.size());
+		for (uint32_t i = 0; i < order.size(); i++) {
+			uint32_t from = order[i];
+			nodes[i] = m_Nodes[from];
+			parents[i] = m_Parents[from] == NO_POSITION ? NO_POSITION : newPositions[m_Parents[from]];
+			assert(parents[i] == NO_POSITION || parents[i] < i);
+			locals[i] = m_Locals[from];
+			instances[i] = m_Instances[from];
+			dirty[i] = m_Dirty[from];
+			if (dirty[i]) {
+				m_FirstDirty = std::min(m_FirstDirty, i);
+			}
+			m_Positions[nodes[i]] = i;
+		}
+
+		m_Nodes = std::move(nodes);
+		m_Parents = std::move(parents);
+		m_Locals = std::move(locals);
+		m_Instances = std::move(instances);
+		m_Dirty = std::move(dirty);
+	}
+
+	bool NNTransformHierarchy::isDescendant(uint32_t node, uint32_t ancestor) const
+	{
+		uint32_t target = m_Positions[ancestor];
+		for (uint32_t position = m_Parents[m_Positions[node]]; position != NO_POSITION; position = m_Parents[position]) {
+			if (position == target) {
+				return true;
+			}
+		}
+		return false;
+	}
+}
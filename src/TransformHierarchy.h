@@ -0,0 +1,74 @@
+#pragma once
+
+#include "GameObject.h"
+#include "TransformBatch.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace NNuts {
+	// Parent-child transforms with cached world and normal matrices. Nodes live in flat arrays sorted
+	// so every parent comes before its children, update() walks them once and only recomputes nodes
+	// whose local transform changed or whose parent was recomputed. NNTransformBatch writes their
+	// local matrices straight into the cached NNInstanceTransforms, children are then multiplied by
+	// their parent in place. Without changes it returns right away, so static objects cost nothing
+	// per frame.
+	class NNTransformHierarchy {
+	public:
+		static constexpr uint32_t NO_PARENT = UINT32_MAX;
+
+		// Node ids stay valid until the node is removed, then they are reused
+		uint32_t add(const TransformComponent& local, uint32_t parent = NO_PARENT);
+		// Removes the node together with all of its descendants
+		void remove(uint32_t node);
+		void setParent(uint32_t node, uint32_t parent);
+		uint32_t getParent(uint32_t node) const;
+
+		const TransformComponent& getLocal(uint32_t node) const { return m_Locals[m_Positions[node]]; }
+		void setLocal(uint32_t node, const TransformComponent& local);
+
+		// Returns the number of nodes recomputed
+		uint32_t update();
+
+		// Valid after update(). The normal matrix is padded to a mat4, the way shaders read it.
+		const glm::mat4& getWorldMatrix(uint32_t node) const { return m_Instances[m_Positions[node]].modelMatrix; }
+		const glm::mat4& getNormalMatrix(uint32_t node) const { return m_Instances[m_Positions[node]].normalMatrix; }
+		// Both matrices laid out as one entry of an object buffer
+		const NNInstanceTransform& getInstance(uint32_t node) const { return m_Instances[m_Positions[node]]; }
+
+		size_t size() const { return m_Nodes.size(); }
+
+	private:
+		static constexpr uint32_t NO_POSITION = UINT32_MAX;
+
+		void markDirty(uint32_t position);
+		// Moves the nodes into the given order, which has to keep parents before children
+		void reorder(const std::vector<uint32_t>& order);
+		bool isDescendant(uint32_t node, uint32_t ancestor) const;
+
+		// Indexed by node id
+		std::vector<uint32_t> m_Positions;
+		std::vector<uint32_t> m_FreeIds;
+
+		// Indexed by position, parents before children. Parents are stored as positions.
+		std::vector<uint32_t> m_Nodes;
+		std::vector<uint32_t> m_Parents;
+		std::vector<TransformComponent> m_Locals;
+		std::vector<NNInstanceTransform> m_Instances;
+		std::vector<uint8_t> m_Dirty;
+		// Nothing before this position is dirty
+		uint32_t m_FirstDirty = 0;
+
+		// Scratch of update(), kept so a steady frame doesn't allocate
+		std::vector<uint32_t> m_UpdateList;
+		NNTransformArrays m_BatchInput;
+	};
+
+	// Ties an entity to its node in the scene's NNTransformHierarchy
+	struct TransformNode
+	{
+		uint32_t id;
+	};
+}
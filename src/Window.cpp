@@ -1,21 +1,32 @@
 #include "Window.h"
 
+#include <stdexcept>
+
 namespace NNuts {
-	NNWindow::NNWindow(int w, int h, std::string name):
-		m_Width(w), m_Height(h), m_WindowName(name)
+	NNWindow::NNWindow(int w, int h, std::string name, bool headless):
+		m_Width(w), m_Height(h), m_Headless(headless), m_WindowName(name)
 	{
-		initWindow();
+		if (!m_Headless) {
+			initWindow();
+		}
 	}
 
 	NNWindow::~NNWindow()
 	{
-		glfwDestroyWindow(m_Window);
-		glfwTerminate();
+		if (!m_Headless) {
+			glfwDestroyWindow(m_Window);
+			glfwTerminate();
+		}
 	}
 	
 	void NNWindow::createWindowSurface(VkInstance instance, VkSurfaceKHR* surface)
 	{
-		if (glfwCreateWindowSurface(instance, m_Window, nullptr, surface));
+		if (m_Headless) {
+			throw std::runtime_error("A headless window has no surface!");
+		}
+		if (glfwCreateWindowSurface(instance, m_Window, nullptr, surface) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create window surface!");
+		}
 	}
 
 	void NNWindow::framebufferResizeCallback(GLFWwindow* window, int width, int height)
@@ -8,13 +8,15 @@
 namespace NNuts {
 	class NNWindow {
 	public:
-		NNWindow(int w, int h, std::string name);
+		// A headless window never initializes GLFW, it only carries the extent to render at
+		NNWindow(int w, int h, std::string name, bool headless = false);
 		~NNWindow();
 
 		NNWindow(const NNWindow&) = delete;
 		NNWindow& operator = (const NNWindow&) = delete;
 
-		bool shouldClose() { return glfwWindowShouldClose(m_Window); }
+		bool shouldClose() { return !m_Headless && glfwWindowShouldClose(m_Window); }
+		bool isHeadless() const { return m_Headless; }
 		VkExtent2D getExtent() { 
 			return { static_cast<uint32_t>(m_Width), static_cast<uint32_t>(m_Height) }; 
 		}
@@ -29,9 +31,10 @@ namespace NNuts {
 
 		int m_Width;
 		int m_Height;
-		bool m_FramebufferResized;
+		bool m_FramebufferResized = false;
+		bool m_Headless;
 
 		std::string m_WindowName;
-		GLFWwindow* m_Window;
+		GLFWwindow* m_Window = nullptr;
 	};
 }
\ No newline at end of file
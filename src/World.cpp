@@ -0,0 +1,194 @@
+#include "World.h"
+
+#include <stdexcept>
+
+namespace NNuts {
+	namespace {
+		constexpr size_t CHUNK_ALIGNMENT = 64;
+
+		size_t alignUp(size_t value, size_t alignment)
+		{
+			return (value + alignment - 1) & ~(alignment - 1);
+		}
+	}
+
+	NNWorld::~NNWorld()
+	{
+		clear();
+		for (auto& archetype : m_Archetypes) {
+			for (auto& chunk : archetype->chunks) {
+				::operator delete(chunk.data, std::align_val_t{ CHUNK_ALIGNMENT });
+			}
+		}
+	}
+
+	uint32_t NNWorld::registerComponent(const ComponentInfo& info)
+	{
+		auto& infos = componentInfos();
+		if (infos.size() >= MAX_COMPONENTS) {
+			throw std::runtime_error("Too many component types!");
+		}
+		infos.push_back(info);
+		return static_cast<uint32_t>(infos.size() - 1);
+	}
+
+	std::vector<NNWorld::ComponentInfo>& NNWorld::componentInfos()
+	{
+		static std::vector<ComponentInfo> infos;
+		return infos;
+	}
+
+	void NNWorld::destroy(NNEntity entity)
+	{
+		if (!isAlive(entity)) {
+			return;
+		}
+
+		Record& record = m_Records[entity.index];
+		Archetype& archetype = *record.archetype;
+		for (uint32_t id : archetype.components) {
+			componentInfos()[id].destroy(component(archetype, record.chunk, record.row, id));
+		}
+		removeRow(archetype, record.chunk, record.row);
+
+		record.archetype = nullptr;
+		record.generation++;
+		m_FreeIndices.push_back(entity.index);
+		m_AliveCount--;
+	}
+
+	void NNWorld::clear()
+	{
+		for (auto& archetype : m_Archetypes) {
+			for (uint32_t chunk = 0; chunk < archetype->usedChunks; chunk++) {
+				NNEntity* chunkEntities = entities(*archetype, chunk);
+				for (uint32_t row = 0; row < archetype->chunks[chunk].count; row++) {
+					for (uint32_t id : archetype->components) {
+						componentInfos()[id].destroy(component(*archetype, chunk, row, id));
+					}
+					Record& record = m_Records[chunkEntities[row].index];
+					record.archetype = nullptr;
+					record.generation++;
+					m_FreeIndices.push_back(chunkEntities[row].index);
+				}
+				archetype->chunks[chunk].count = 0;
+			}
+			archetype->usedChunks = 0;
+		}
+		m_AliveCount = 0;
+	}
+
+	NNWorld::Archetype& NNWorld::getArchetype(Mask mask)
+	{
+		for (auto& archetype : m_Archetypes) {
+			if (archetype->mask == mask) {
+				return *archetype;
+			}
+		}
+
+		auto archetype = std::make_unique<Archetype>();
+		archetype->mask = mask;
+		archetype->offsets.fill(0);
+		size_t rowSize = sizeof(NNEntity);
+		size_t padding = 0;
+		for (uint32_t id = 0; id < MAX_COMPONENTS; id++) {
+			if (mask & (Mask{ 1 } << id)) {
+				archetype->components.push_back(id);
+				rowSize += componentInfos()[id].size;
+				padding += componentInfos()[id].alignment;
+			}
+		}
+
+		// Worst case alignment padding between the arrays comes off the top, then the arrays are laid
+		// out back to back
+		size_t capacity = (CHUNK_SIZE - padding) / rowSize;
+		if (capacity == 0) {
+			throw std::runtime_error("Components don't fit into a chunk!");
+		}
+		size_t offset = capacity * sizeof(NNEntity);
+		for (uint32_t id : archetype->components) {
+			offset = alignUp(offset, componentInfos()[id].alignment);
+			archetype->offsets[id] = static_cast<uint32_t>(offset);
+			offset += capacity * componentInfos()[id].size;
+		}
+		archetype->chunkCapacity = static_cast<uint32_t>(capacity);
+
+		m_Archetypes.push_back(std::move(archetype));
+		return *m_Archetypes.back();
+	}
+
+	NNEntity NNWorld::allocateEntity()
+	{
+		NNEntity entity{};
+		if (!m_FreeIndices.empty()) {
+			entity.index = m_FreeIndices.back();
+			m_FreeIndices.pop_back();
+		}
+		else {
+			entity.index = static_cast<uint32_t>(m_Records.size());
+			m_Records.emplace_back();
+		}
+		entity.generation = m_Records[entity.index].generation;
+		m_AliveCount++;
+		return entity;
+	}
+
+	void NNWorld::pushRow(Archetype& archetype, NNEntity entity)
+	{
+		if (archetype.usedChunks == 0 || archetype.chunks[archetype.usedChunks - 1].count == archetype.chunkCapacity) {
+			if (archetype.usedChunks == archetype.chunks.size()) {
+				auto data = static_cast<std::byte*>(::operator new(CHUNK_SIZE, std::align_val_t{ CHUNK_ALIGNMENT }));
+				archetype.chunks.push_back({ data, 0 });
+			}
+			archetype.usedChunks++;
+		}
+
+		uint32_t chunk = archetype.usedChunks - 1;
+		uint32_t row = archetype.chunks[chunk].count++;
+		entities(archetype, chunk)[row] = entity;
+
+		Record& record = m_Records[entity.index];
+		record.archetype = &archetype;
+		record.chunk = chunk;
+		record.row = row;
+	}
+
+	void NNWorld::removeRow(Archetype& archetype, uint32_t chunk, uint32_t row)
+	{
+		uint32_t lastChunk = archetype.usedChunks - 1;
+		uint32_t lastRow = archetype.chunks[lastChunk].count - 1;
+		if (chunk != lastChunk || row != lastRow) {
+			for (uint32_t id : archetype.components) {
+				void* last = component(archetype, lastChunk, lastRow, id);
+				componentInfos()[id].move(component(archetype, chunk, row, id), last);
+				componentInfos()[id].destroy(last);
+			}
+			NNEntity moved = entities(archetype, lastChunk)[lastRow];
+			entities(archetype, chunk)[row] = moved;
+			m_Records[moved.index].chunk = chunk;
+			m_Records[moved.index].row = row;
+		}
+
+		if (--archetype.chunks[lastChunk].count == 0) {
+			archetype.usedChunks--;
+		}
+	}
+
+	void NNWorld::migrate(NNEntity entity, Archetype& target)
+	{
+		Record& record = m_Records[entity.index];
+		Archetype& source = *record.archetype;
+		uint32_t sourceChunk = record.chunk;
+		uint32_t sourceRow = record.row;
+
+		pushRow(target, entity);
+		for (uint32_t id : source.components) {
+			void* from = component(source, sourceChunk, sourceRow, id);
+			if (target.mask & (Mask{ 1 } << id)) {
+				componentInfos()[id].move(component(target, record.chunk, record.row, id), from);
+			}
+			componentInfos()[id].destroy(from);
+		}
+		removeRow(source, sourceChunk, sourceRow);
+	}
+}
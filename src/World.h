@@ -0,0 +1,245 @@
+#pragma once
+
+#include <array>
+#include <bitset>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace NNuts {
+	// Handle to an entity of an NNWorld. The index is reused once the entity is destroyed, the
+	// generation tells a stale handle apart from the entity that got the index next.
+	struct NNEntity {
+		static constexpr uint32_t INVALID_INDEX = UINT32_MAX;
+
+		uint32_t index = INVALID_INDEX;
+		uint32_t generation = 0;
+
+		bool operator==(const NNEntity& other) const { return index == other.index && generation == other.generation; }
+		bool operator!=(const NNEntity& other) const { return !(*this == other); }
+	};
+
+	// Archetype based entity component storage. Entities with the same set of component types share
+	// an archetype, which keeps them in fixed size chunks with one array per component type, so a
+	// query walks contiguous arrays of just the components it asks for. Destroying an entity moves
+	// the last one of its archetype into the hole, adding or removing a component moves the entity to
+	// another archetype. Neither may happen while a query is running.
+	class NNWorld {
+	public:
+		static constexpr size_t CHUNK_SIZE = 16 * 1024;
+		static constexpr uint32_t MAX_COMPONENTS = 64;
+		using Mask = uint64_t;
+
+		NNWorld() = default;
+		~NNWorld();
+
+		NNWorld(const NNWorld&) = delete;
+		NNWorld& operator=(const NNWorld&) = delete;
+
+		template<typename... Ts>
+		NNEntity create(Ts&&... components);
+		void destroy(NNEntity entity);
+		// Destroys every entity, archetypes and their chunks are kept for reuse
+		void clear();
+
+		bool isAlive(NNEntity entity) const {
+			return entity.index < m_Records.size() && m_Records[entity.index].generation == entity.generation
+				&& m_Records[entity.index].archetype != nullptr;
+		}
+		size_t size() const { return m_AliveCount; }
+
+		template<typename T>
+		bool has(NNEntity entity) const;
+		// nullptr when the entity is gone or doesn't have the component. Only valid until the next
+		// structural change.
+		template<typename T>
+		T* get(NNEntity entity);
+		// Replaces the component when the entity already has one
+		template<typename T>
+		T& add(NNEntity entity, T component);
+		template<typename T>
+		void remove(NNEntity entity);
+
+		// Calls fn(count, entities, Ts* arrays...) for every chunk holding all of Ts
+		template<typename... Ts, typename Fn>
+		void eachChunk(Fn&& fn);
+		// Calls fn(Ts&...) for every entity holding all of Ts, in chunk order
+		template<typename... Ts, typename Fn>
+		void each(Fn&& fn);
+		// Entities holding all of Ts, a query visits them in the same order as long as nothing changes
+		template<typename... Ts>
+		size_t count() const;
+
+		template<typename T>
+		static uint32_t componentId() {
+			static const uint32_t id = registerComponent(ComponentInfo{
+				sizeof(T),
+				alignof(T),
+				[](void* destination, void* source) { new (destination) T(std::move(*static_cast<T*>(source))); },
+				[](void* component) { static_cast<T*>(component)->~T(); } });
+			return id;
+		}
+
+		template<typename... Ts>
+		static Mask maskOf() { return (Mask{ 0 } | ... | (Mask{ 1 } << componentId<std::decay_t<Ts>>())); }
+
+	private:
+		struct ComponentInfo {
+			size_t size;
+			size_t alignment;
+			// Move constructs into raw memory
+			void (*move)(void* destination, void* source);
+			void (*destroy)(void* component);
+		};
+
+		struct Chunk {
+			std::byte* data;
+			uint32_t count;
+		};
+
+		struct Archetype {
+			Mask mask;
+			std::vector<uint32_t> components;
+			// Byte offset of each component's array within a chunk, indexed by component id. The
+			// entity array sits at the start.
+			std::array<uint32_t, MAX_COMPONENTS> offsets;
+			uint32_t chunkCapacity;
+			// Only the last chunk is partly filled, empty ones stay around for reuse
+			std::vector<Chunk> chunks;
+			uint32_t usedChunks = 0;
+		};
+
+		struct Record {
+			Archetype* archetype = nullptr;
+			uint32_t chunk = 0;
+			uint32_t row = 0;
+			uint32_t generation = 0;
+		};
+
+		static uint32_t registerComponent(const ComponentInfo& info);
+		// Indexed by component id
+		static std::vector<ComponentInfo>& componentInfos();
+
+		Archetype& getArchetype(Mask mask);
+		NNEntity allocateEntity();
+		// Appends a row for the entity and points its record at it
+		void pushRow(Archetype& archetype, NNEntity entity);
+		// Fills the hole at (chunk, row) with the archetype's last row, the components at the hole
+		// have to be destroyed or moved out already
+		void removeRow(Archetype& archetype, uint32_t chunk, uint32_t row);
+		// Moves the entity's components into the target archetype, those the target lacks are destroyed
+		void migrate(NNEntity entity, Archetype& target);
+
+		static std::byte* component(Archetype& archetype, uint32_t chunk, uint32_t row, uint32_t id) {
+			return archetype.chunks[chunk].data + archetype.offsets[id] + size_t{ row } * componentInfos()[id].size;
+		}
+		static NNEntity* entities(Archetype& archetype, uint32_t chunk) {
+			return reinterpret_cast<NNEntity*>(archetype.chunks[chunk].data);
+		}
+		// Qualified types share the column of the plain type
+		template<typename T>
+		static T* column(Archetype& archetype, uint32_t chunk) {
+			return reinterpret_cast<T*>(archetype.chunks[chunk].data + archetype.offsets[componentId<std::decay_t<T>>()]);
+		}
+
+		std::vector<std::unique_ptr<Archetype>> m_Archetypes;
+		std::vector<Record> m_Records;
+		std::vector<uint32_t> m_FreeIndices;
+		size_t m_AliveCount = 0;
+	};
+
+	template<typename... Ts>
+	NNEntity NNWorld::create(Ts&&... components)
+	{
+		Mask mask = maskOf<Ts...>();
+		assert(std::bitset<MAX_COMPONENTS>(mask).count() == sizeof...(Ts) && "Component types have to be unique!");
+		Archetype& archetype = getArchetype(mask);
+		NNEntity entity = allocateEntity();
+		pushRow(archetype, entity);
+		const Record& record = m_Records[entity.index];
+		(new (component(archetype, record.chunk, record.row, componentId<std::decay_t<Ts>>()))
+			std::decay_t<Ts>(std::forward<Ts>(components)), ...);
+		return entity;
+	}
+
+	template<typename T>
+	bool NNWorld::has(NNEntity entity) const
+	{
+		return isAlive(entity) && (m_Records[entity.index].archetype->mask & maskOf<T>()) != 0;
+	}
+
+	template<typename T>
+	T* NNWorld::get(NNEntity entity)
+	{
+		if (!has<T>(entity)) {
+			return nullptr;
+		}
+		const Record& record = m_Records[entity.index];
+		return reinterpret_cast<T*>(component(*record.archetype, record.chunk, record.row, componentId<std::decay_t<T>>()));
+	}
+
+	template<typename T>
+	T& NNWorld::add(NNEntity entity, T value)
+	{
+		assert(isAlive(entity) && "Can't add a component to a destroyed entity!");
+		if (T* existing = get<T>(entity)) {
+			*existing = std::move(value);
+			return *existing;
+		}
+		migrate(entity, getArchetype(m_Records[entity.index].archetype->mask | maskOf<T>()));
+		const Record& record = m_Records[entity.index];
+		return *new (component(*record.archetype, record.chunk, record.row, componentId<std::decay_t<T>>())) std::decay_t<T>(std::move(value));
+	}
+
+	template<typename T>
+	void NNWorld::remove(NNEntity entity)
+	{
+		if (has<T>(entity)) {
+			migrate(entity, getArchetype(m_Records[entity.index].archetype->mask & ~maskOf<T>()));
+		}
+	}
+
+	template<typename... Ts, typename Fn>
+	void NNWorld::eachChunk(Fn&& fn)
+	{
+		Mask mask = maskOf<Ts...>();
+		for (auto& archetype : m_Archetypes) {
+			if ((archetype->mask & mask) != mask) {
+				continue;
+			}
+			for (uint32_t chunk = 0; chunk < archetype->usedChunks; chunk++) {
+				fn(static_cast<size_t>(archetype->chunks[chunk].count), entities(*archetype, chunk), column<Ts>(*archetype, chunk)...);
+			}
+		}
+	}
+
+	template<typename... Ts, typename Fn>
+	void NNWorld::each(Fn&& fn)
+	{
+		eachChunk<Ts...>([&fn](size_t count, const NNEntity*, Ts*... columns) {
+			for (size_t i = 0; i < count; i++) {
+				fn(columns[i]...);
+			}
+		});
+	}
+
+	template<typename... Ts>
+	size_t NNWorld::count() const
+	{
+		Mask mask = maskOf<Ts...>();
+		size_t total = 0;
+		for (auto& archetype : m_Archetypes) {
+			if ((archetype->mask & mask) == mask) {
+				for (uint32_t chunk = 0; chunk < archetype->usedChunks; chunk++) {
+					total += archetype->chunks[chunk].count;
+				}
+			}
+		}
+		return total;
+	}
+}